@@ -0,0 +1,220 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cpuid.h>
+#include <x86intrin.h>
+
+#include "autotuner.h"
+#include "helper_utilities.h"
+
+static std::mutex autotuner_mutex;
+static std::map<std::string, std::string> autotuner_decisions; // key -> name of the implementation
+static bool autotuner_loaded = false; // tuning cache read into autotuner_decisions
+static std::string autotuner_cache_path; // empty := BW_TUNING_CACHE or AUTOTUNER_CACHE
+static size_t autotuner_tunings = 0;
+
+/**
+ * The registered function with the given name, NULL if there is none
+ */
+static const struct RegisteredFunction* registered(const std::string& name){
+    for(size_t i = 0; FuncRegister::funcs && i < FuncRegister::size(); i++){
+        if(FuncRegister::funcs->at(i).name == name) return &FuncRegister::funcs->at(i);
+    }
+    return NULL;
+}
+
+/**
+ * Key of the tuning cache, the first columns of a line: CPU;ISA;K;N;M;T;Total length;Memory;Lengths
+ */
+static std::string tuning_key(const BWdata& bw){
+    std::ostringstream key;
+    key << Autotuner::cpu_model() << ";" << FuncRegister::isa_name(FuncRegister::cpu_isa()) << ";"
+        << bw.K << ";" << bw.N << ";" << bw.M << ";" << bw.T << ";" << bw.total_length() << ";"
+        << (bw.checkpoint ? "checkpoint" : (bw.stream_sigma ? "stream-sigma" : "sigma")) << ";"
+        << (bw.ragged ? "ragged" : "uniform");
+    return key.str();
+}
+
+/**
+ * Reads the tuning cache into autotuner_decisions (later lines win), skips lines of
+ * implementations that are not registered (anymore)
+ */
+static void load_cache(){
+    autotuner_loaded = true;
+    std::ifstream file(Autotuner::cache_path());
+    std::string line;
+    while(std::getline(file, line)){
+        std::vector<std::string> columns;
+        std::istringstream stream(line);
+        std::string column;
+        while(std::getline(stream, column, ';')) columns.push_back(column);
+        if(columns.size() != 11 || columns.at(0) == "CPU" || !registered(columns.at(9))) continue;
+        std::string key = columns.at(0);
+        for(size_t c = 1; c < 9; c++) key += ";" + columns.at(c);
+        autotuner_decisions[key] = columns.at(9);
+    }
+}
+
+static void append_cache(const std::string& key, const AutotunerCandidate& winner){
+    const std::string path = Autotuner::cache_path();
+    const bool exists = std::ifstream(path).good();
+    std::ofstream file(path, std::ios::app);
+    if(!file){
+        printf("Warning: cannot write the tuning cache '%s'\n", path.c_str());
+        return;
+    }
+    if(!exists) file << "CPU;ISA;K;N;M;T;Total length;Memory;Lengths;Implementation;Cycles" << std::endl;
+    file << std::fixed << key << ";" << winner.name << ";" << winner.cycles << std::endl;
+}
+
+/**
+ * A BWdata of the same shape and memory mode with the observations of bw and AUTOTUNER_ITERATIONS iterations
+ */
+static const BWdata& tuning_copy(const BWdata& bw){
+    BWdata* copy;
+    if(bw.ragged){
+        std::vector<size_t> lengths(bw.K);
+        for(size_t k = 0; k < bw.K; k++) lengths.at(k) = bw.length(k);
+        copy = new BWdata(bw.K, bw.N, bw.M, lengths, AUTOTUNER_ITERATIONS, bw.stream_sigma, bw.checkpoint);
+    } else {
+        copy = new BWdata(bw.K, bw.N, bw.M, bw.T, AUTOTUNER_ITERATIONS, bw.stream_sigma, bw.checkpoint);
+    }
+    memcpy(copy->observations, bw.observations, bw.total_length() * sizeof(size_t));
+    return *copy;
+}
+
+/**
+ * Minimal cycles of AUTOTUNER_REPETITIONS runs of f on copy, each starting from the model of bw
+ */
+static double time_function(const struct RegisteredFunction& f, const BWdata& bw, const BWdata& copy){
+    double cycles = std::numeric_limits<double>::max();
+    for(size_t r = 0; r <= AUTOTUNER_REPETITIONS; r++){
+        memcpy(copy.init_prob, bw.init_prob, bw.N * sizeof(double));
+        memcpy(copy.trans_prob, bw.trans_prob, bw.N*bw.N * sizeof(double));
+        if(f.transpose_emit_prob){
+            transpose_matrix(copy.emit_prob, bw.emit_prob, bw.N, bw.M);
+        } else {
+            memcpy(copy.emit_prob, bw.emit_prob, bw.N*bw.M * sizeof(double));
+        }
+        const unsigned long long start = __rdtsc();
+        f.func(copy);
+        const double run_cycles = (double)(__rdtsc() - start);
+        // the first run is the warm-up
+        if(r > 0) cycles = std::min(cycles, run_cycles);
+    }
+    return cycles;
+}
+
+/**
+ * Times the eligible implementations (autotuner_mutex held)
+ */
+static const struct RegisteredFunction* tune_locked(const BWdata& bw, std::vector<AutotunerCandidate>* candidates){
+    std::vector<AutotunerCandidate> timings;
+    const BWdata& copy = tuning_copy(bw);
+    for(size_t i = 0; i < FuncRegister::size(); i++){
+        const struct RegisteredFunction& f = FuncRegister::funcs->at(i);
+        if(!Autotuner::eligible(f, bw)) continue;
+        timings.push_back({f.name, time_function(f, bw, copy)});
+    }
+    delete &copy;
+    autotuner_tunings++;
+
+    std::stable_sort(timings.begin(), timings.end(), [](const AutotunerCandidate& a, const AutotunerCandidate& b){ return a.cycles < b.cycles; });
+    if(candidates) *candidates = timings;
+    if(timings.empty()) return NULL;
+
+    const std::string key = tuning_key(bw);
+    autotuner_decisions[key] = timings.front().name;
+    append_cache(key, timings.front());
+    return registered(timings.front().name);
+}
+
+size_t Autotuner::run(const BWdata& bw){
+    const struct RegisteredFunction* f = select(bw);
+    if(!f) return FuncRegister::baseline_func(bw);
+
+    double* transposed = NULL;
+    if(f->transpose_emit_prob){
+        transposed = (double *)malloc(bw.N*bw.M * sizeof(double));
+        transpose_matrix(transposed, bw.emit_prob, bw.N, bw.M);
+        memcpy(bw.emit_prob, transposed, bw.N*bw.M * sizeof(double));
+    }
+
+    const size_t convergence = f->func(bw);
+
+    if(f->transpose_emit_prob){
+        transpose_matrix(transposed, bw.emit_prob, bw.M, bw.N);
+        memcpy(bw.emit_prob, transposed, bw.N*bw.M * sizeof(double));
+        free(transposed);
+    }
+    return convergence;
+}
+
+const struct RegisteredFunction* Autotuner::select(const BWdata& bw){
+    std::lock_guard<std::mutex> lock(autotuner_mutex);
+    if(!autotuner_loaded) load_cache();
+    const auto decision = autotuner_decisions.find(tuning_key(bw));
+    if(decision != autotuner_decisions.end()) return registered(decision->second);
+    return tune_locked(bw, NULL);
+}
+
+const struct RegisteredFunction* Autotuner::tune(const BWdata& bw, std::vector<AutotunerCandidate>* candidates){
+    std::lock_guard<std::mutex> lock(autotuner_mutex);
+    if(!autotuner_loaded) load_cache();
+    return tune_locked(bw, candidates);
+}
+
+bool Autotuner::eligible(const struct RegisteredFunction& f, const BWdata& bw){
+    if(f.features & BW_FEATURE_FLOAT32) return false;
+    if(bw.stream_sigma && !(f.features & BW_FEATURE_STREAM_SIGMA)) return false;
+    if(bw.checkpoint && !(f.features & BW_FEATURE_CHECKPOINT)) return false;
+    if(bw.ragged && !(f.features & BW_FEATURE_RAGGED)) return false;
+    // the assumptions of the implementations without BW_FEATURE_ANY_NM (see README), any K and T if ragged
+    const bool aligned = bw.N % 16 == 0 && bw.M % 16 == 0 && (bw.ragged || (bw.K % 16 == 0 && bw.T % 16 == 0 && bw.T >= 32));
+    return aligned || (f.features & BW_FEATURE_ANY_NM);
+}
+
+void Autotuner::clear(){
+    std::lock_guard<std::mutex> lock(autotuner_mutex);
+    autotuner_decisions.clear();
+    autotuner_loaded = false;
+}
+
+void Autotuner::set_cache_path(const std::string& path){
+    std::lock_guard<std::mutex> lock(autotuner_mutex);
+    autotuner_cache_path = path;
+    autotuner_decisions.clear();
+    autotuner_loaded = false;
+}
+
+std::string Autotuner::cache_path(){
+    if(!autotuner_cache_path.empty()) return autotuner_cache_path;
+    const char* path = getenv("BW_TUNING_CACHE");
+    return path ? path : AUTOTUNER_CACHE;
+}
+
+std::string Autotuner::cpu_model(){
+    unsigned int brand[12] = {0};
+    if(__get_cpuid_max(0x80000000, NULL) < 0x80000004) return "unknown";
+    for(unsigned int i = 0; i < 3; i++){
+        __get_cpuid(0x80000002 + i, &brand[4*i], &brand[4*i + 1], &brand[4*i + 2], &brand[4*i + 3]);
+    }
+    std::string model(reinterpret_cast<const char*>(brand), sizeof(brand));
+    model = model.substr(0, model.find('\0'));
+    // no separators of the tuning cache in the key, no padding
+    std::replace(model.begin(), model.end(), ';', ',');
+    model.erase(0, model.find_first_not_of(' '));
+    model.erase(model.find_last_not_of(' ') + 1);
+    return model.empty() ? "unknown" : model;
+}
+
+size_t Autotuner::tunings(){
+    std::lock_guard<std::mutex> lock(autotuner_mutex);
+    return autotuner_tunings;
+}
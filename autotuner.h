@@ -0,0 +1,102 @@
+/*
+    Autotuner
+    Which registered implementation is fastest depends on the shape (K, N, M, T) and the CPU.
+    The autotuner times the eligible implementations briefly on the first call with a new shape,
+    keeps the winner in memory, and appends it to an on-disk tuning cache keyed by CPU model, ISA
+    level, shape and memory mode. Later calls (and later processes) dispatch to the winner directly.
+    `benchmarks --tune` fills the cache ahead of time.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_AUTOTUNER_H)
+#define __BW_AUTOTUNER_H
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+// iterations of a timed run (briefly, the implementations are timed on a copy of the BWdata)
+#define AUTOTUNER_ITERATIONS 4
+// timed runs per implementation after one warm-up run, the minimum counts
+#define AUTOTUNER_REPETITIONS 2
+// default tuning cache, overridden by the environment variable BW_TUNING_CACHE or set_cache_path
+#define AUTOTUNER_CACHE "bw_tuning.csv"
+
+/**
+ * Cycles of one implementation for a shape (see Autotuner::tune)
+ */
+struct AutotunerCandidate {
+    std::string name;
+    double cycles;
+};
+
+/**
+ * Picks the fastest registered implementation per shape and memory mode of a BWdata.
+ * Thread-safe; concurrent calls with a new shape are tuned one after the other.
+ *
+ *     Autotuner::run(bw); // same as FuncRegister::find(Autotuner::select(bw)->name)(bw), emit_prob transposed if needed
+ */
+class Autotuner
+{
+public:
+
+    /**
+     * Runs the selected implementation on bw (emit_prob as [N][M], as for the baseline).
+     * Falls back to the baseline if no registered implementation is eligible.
+     *
+     * Returns: the result of the implementation (iterations until convergence)
+     */
+    static size_t run(const BWdata& bw);
+
+    /**
+     * The implementation for the shape of bw: from memory, from the tuning cache or tuned now.
+     * NULL if no registered implementation is eligible
+     */
+    static const struct RegisteredFunction* select(const BWdata& bw);
+
+    /**
+     * Times all eligible implementations on (copies of) bw, remembers the winner and appends it to
+     * the tuning cache, even if the shape was tuned before. candidates (if given) gets the cycles of
+     * every eligible implementation, fastest first.
+     */
+    static const struct RegisteredFunction* tune(const BWdata& bw, std::vector<AutotunerCandidate>* candidates = NULL);
+
+    /**
+     * Whether an implementation can run on bw: its features cover the memory mode and the
+     * (ragged) shape of bw; single precision implementations are never selected
+     */
+    static bool eligible(const struct RegisteredFunction& f, const BWdata& bw);
+
+    /**
+     * Forgets the decisions in memory (the tuning cache is read again on the next select)
+     */
+    static void clear();
+
+    static void set_cache_path(const std::string& path);
+
+    static std::string cache_path();
+
+    /**
+     * CPU model (cpuid brand string), part of the key of the tuning cache
+     */
+    static std::string cpu_model();
+
+    /**
+     * Number of shapes tuned (timed) by this process so far
+     */
+    static size_t tunings();
+};
+
+#endif /* __BW_AUTOTUNER_H */
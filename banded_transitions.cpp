@@ -0,0 +1,54 @@
+#include <cassert>
+#include <cstring>
+
+#include "banded_transitions.h"
+#include "workspace.h"
+
+BWbandedTransitions::BWbandedTransitions(const BWdata& bw): bw(bw){
+    bandwidths(bw.trans_prob, bw.N, lower, upper);
+    width = lower + upper + 1;
+    margin = (((lower > upper) ? lower : upper) + 3) / 4 * 4;
+    stride = margin + bw.N + margin;
+    diagonals = (double *)bw_scratch_alloc(bw, "banded_transitions/diagonals", width*stride * sizeof(double));
+    assert(diagonals != NULL && "Failed to allocate the banded transitions");
+}
+
+BWbandedTransitions::~BWbandedTransitions(){
+    bw_scratch_free(bw, diagonals);
+}
+
+void BWbandedTransitions::compress(){
+    const ptrdiff_t N = bw.N;
+    memset(diagonals, 0, width*stride * sizeof(double));
+    for (ptrdiff_t o = -(ptrdiff_t)lower; o <= (ptrdiff_t)upper; o++) {
+        double* d = diagonal(o);
+        for (ptrdiff_t n1 = 0; n1 < N; n1++) {
+            const ptrdiff_t n0 = n1 - o;
+            if (n0 >= 0 && n0 < N) d[n1] = bw.trans_prob[n0*N + n1];
+        }
+    }
+}
+
+void BWbandedTransitions::expand(const double* band, double* dense) const{
+    const ptrdiff_t N = bw.N;
+    memset(dense, 0, N*N * sizeof(double));
+    for (ptrdiff_t o = -(ptrdiff_t)lower; o <= (ptrdiff_t)upper; o++) {
+        const double* d = band + (o + (ptrdiff_t)lower)*stride + margin;
+        for (ptrdiff_t n1 = 0; n1 < N; n1++) {
+            const ptrdiff_t n0 = n1 - o;
+            if (n0 >= 0 && n0 < N) dense[n0*N + n1] = d[n1];
+        }
+    }
+}
+
+void BWbandedTransitions::bandwidths(const double* trans_prob, const size_t N, size_t& lower, size_t& upper){
+    lower = 0;
+    upper = 0;
+    for (size_t n0 = 0; n0 < N; n0++) {
+        for (size_t n1 = 0; n1 < N; n1++) {
+            if (trans_prob[n0*N + n1] == 0.0) continue;
+            if (n0 > n1 && n0 - n1 > lower) lower = n0 - n1;
+            if (n1 > n0 && n1 - n0 > upper) upper = n1 - n0;
+        }
+    }
+}
@@ -0,0 +1,80 @@
+/*
+    Banded transitions
+    trans_prob of a BWdata stored by diagonals, for structured (e.g. duration-like) topologies
+    where state n0 only transitions to n0-lower <= n1 <= n0+upper. Baum-Welch never turns a zero
+    transition probability into a nonzero one, so the band of a model never grows.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_BANDED_TRANSITIONS_H)
+#define __BW_BANDED_TRANSITIONS_H
+
+#include <cstdlib>
+#include <cstddef>
+
+#include "common.h"
+
+/**
+ * Diagonal o (-lower <= o <= upper) is indexed by the column: diagonal(o)[n1] = trans_prob[n1-o][n1].
+ * Every diagonal is padded by margin zeros on both sides, such that diagonal(o)[n] can be read
+ * for -margin <= n < N+margin; entries outside the matrix are zero.
+ * The buffer is a scratch buffer of the BWdata (see workspace.h).
+ *
+ *     BWbandedTransitions trans(bw);
+ *     trans.compress();
+ *     for (ptrdiff_t o = -(ptrdiff_t)trans.lower; o <= (ptrdiff_t)trans.upper; o++) {
+ *         const double* diagonal = trans.diagonal(o);
+ *         ... alpha[t][n1] += alpha[t-1][n1-o] * diagonal[n1]
+ *     }
+ */
+struct BWbandedTransitions {
+    size_t lower;      // number of diagonals below the main diagonal (n1 < n0)
+    size_t upper;      // number of diagonals above the main diagonal (n1 > n0)
+    size_t width;      // lower + upper + 1
+    size_t margin;     // zeros before and after each diagonal, max(lower, upper) rounded up to 4
+    size_t stride;     // doubles per diagonal (margin + N + margin)
+    double* diagonals; // [width][stride]
+
+    /**
+     * Allocates the diagonals for the band of bw.trans_prob (not filled yet)
+     */
+    BWbandedTransitions(const BWdata& bw);
+
+    ~BWbandedTransitions();
+
+    inline double* diagonal(const ptrdiff_t o) const{
+        return diagonals + (o + (ptrdiff_t)lower)*stride + margin;
+    }
+
+    /**
+     * (Re)builds the diagonals from bw.trans_prob
+     */
+    void compress();
+
+    /**
+     * Writes a [width][stride] buffer with the layout of diagonals (e.g. sums of sigma by diagonal)
+     * into a dense N x N matrix, with zeros outside of the band
+     */
+    void expand(const double* band, double* dense) const;
+
+    /**
+     * Number of diagonals below (lower) and above (upper) the main diagonal with nonzeros
+     */
+    static void bandwidths(const double* trans_prob, const size_t N, size_t& lower, size_t& upper);
+
+private:
+    const BWdata& bw;
+};
+
+#endif /* __BW_BANDED_TRANSITIONS_H */
@@ -19,6 +19,7 @@
 #include <cstdio>
 #include <ctime>
 #include <climits>
+#include <cstdint>
 #include <vector>
 #include <set>
 #include <getopt.h>
@@ -30,6 +31,15 @@
 #include "tsc_x86.h"
 #include "helper_utilities.h"
 #include "common.h"
+#include "thread_pool.h"
+#include "instrumentation.h"
+#include "workspace.h"
+#include "scoring.h"
+#include "decoding.h"
+#include "packed_observations.h"
+#include "sparse_transitions.h"
+#include "likelihood.h"
+#include "autotuner.h"
 #include <random>
 
 #define NUM_RUNS 100
@@ -61,13 +71,71 @@ size_t flops;
 // adjust max_iterations if it's too slow
 size_t max_iterations = 500;
 
+// memory mode: don't allocate sigma and only run implementations that support it
+bool stream_sigma = false;
+
+// memory mode: no alpha, beta and ggamma buffers either (implies stream_sigma)
+bool checkpoint = false;
+
+// thread counts of the ThreadPool to benchmark every shape with (empty := number of hardware threads)
+std::vector<size_t> thread_counts;
+
+// nonzeros per row of trans_prob to benchmark every shape with (empty := dense, training only)
+std::vector<size_t> trans_nonzeros;
+size_t nonzeros_per_row = 0; // of the current run, 0 := dense
+
+// half bandwidths of trans_prob to benchmark every shape with (empty := dense, training only)
+std::vector<size_t> trans_bands;
+size_t band_per_row = 0; // of the current run, 0 := dense
+
+// seed of the random data of every shape
+unsigned int seed;
+
+// stopping policy of all runs (default: fixed max_iterations, see --converge)
+BWstopping stopping;
+
+// what is benchmarked: the training (default), the scoring (scoring.h), the decoding (decoding.h),
+// the likelihood accumulation alone (likelihood.h) or the implementations for the tuning cache (autotuner.h)
+enum bench_mode {
+    BENCH_TRAINING = 0,
+    BENCH_SCORING,
+    BENCH_VITERBI,
+    BENCH_POSTERIOR,
+    BENCH_LIKELIHOOD,
+    BENCH_TUNE
+};
+bench_mode mode = BENCH_TRAINING;
+
+/**
+ * Returns true if the registered function should be run with the selected implementations and memory mode
+ */
+bool is_selected(const std::set<std::string> &sel_impl, const struct RegisteredFunction& f){
+    if(!sel_impl.empty() && sel_impl.find(f.name) == sel_impl.end()){
+        return false;
+    }
+    if(stream_sigma && !(f.features & BW_FEATURE_STREAM_SIGMA)){
+        printf("Skipping: %s: does not support --stream-sigma\n\n", f.name.c_str());
+        return false;
+    }
+    if(checkpoint && !(f.features & BW_FEATURE_CHECKPOINT)){
+        printf("Skipping: %s: does not support --checkpoint\n\n", f.name.c_str());
+        return false;
+    }
+    return true;
+}
+
 struct perf_result{
     double cycles;
-    size_t iterations;
+    size_t iterations; // iteration of convergence
+    size_t executed; // iterations actually executed (max_iterations unless --converge)
     double performance;
 };
 
-void perf_test(compute_bw_func func, const BWdata& bw, struct perf_result *result = NULL) {
+/**
+ * Measures func on copies of bw. With a workspace, all runs share it (amortized path, the
+ * scratch buffers are allocated in the warm-up), otherwise every run allocates its own (one-shot path).
+ */
+void perf_test(compute_bw_func func, const BWdata& bw, struct perf_result *result = NULL, BWworkspace *workspace = NULL) {
     double cycles = 0.;
     size_t num_runs = 1;
     double perf;
@@ -84,6 +152,7 @@ void perf_test(compute_bw_func func, const BWdata& bw, struct perf_result *resul
         num_runs = num_runs * multiplier;
         for(size_t i = 0; i < num_runs; i++) {
             bw_data.push_back(new BWdata(bw));
+            if(workspace) workspace->prepare(*bw_data.back());
         }
 
         start = start_tsc();
@@ -108,11 +177,13 @@ void perf_test(compute_bw_func func, const BWdata& bw, struct perf_result *resul
     double total_cycles = 0;
     size_t iter;
     size_t total_iter = 0;
+    size_t executed = 0;
     for (size_t j = 0; j < REP; j++) {
         iter = 0;
         // Create all copies for all runs of the function
         for(size_t i = 0; i < num_runs; i++) {
             bw_data.push_back(new BWdata(bw));
+            if(workspace) workspace->prepare(*bw_data.back());
         }
         
         // Measure function
@@ -124,6 +195,7 @@ void perf_test(compute_bw_func func, const BWdata& bw, struct perf_result *resul
         
         // Clean up all copies
         for(size_t i = 0; i < num_runs; i++) {
+            executed += bw_data.at(i)->iterations;
             delete bw_data.at(i);
         }
         bw_data.clear();
@@ -135,43 +207,131 @@ void perf_test(compute_bw_func func, const BWdata& bw, struct perf_result *resul
     }
     total_cycles /= REP;
     total_iter /= REP;
+    executed /= REP*num_runs;
 
     cycles = total_cycles;
     iter = total_iter;
-    perf = (max_iterations*flops) / cycles;
+    perf = (executed*flops) / cycles;
 
-    printf("Total iterations: %ld\n", max_iterations);
+    printf("Total iterations: %ld\n", executed);
     if (iter == 0){
         printf("\x1b[1;36mWarning:\x1b[0m has not converged within the maximum iterations\n");
     } else {
         printf("Iterations to converge: %ld\n", iter);
     }
-    printf("Flops: %zu\n", max_iterations*flops);
+    printf("Flops: %zu\n", executed*flops);
     printf("Cycles: %f\n", round(cycles));
     printf("Performance: %f\n", perf);
     if(result){
         result->cycles = cycles;
         result->iterations = iter;
+        result->executed = executed;
         result->performance = perf;
     }
 }
 
-void perform_measure_and_write_to_file(const std::set<std::string> &sel_impl, const size_t K, const size_t N, const size_t M, const size_t T, const size_t max_iterations, std::ofstream &logfile){
-    printf("Benchmarking with K = %zu, N = %zu, M = %zu, T = %zu and max_iterations = %zu\n", K, N, M, T, max_iterations);
+/**
+ * Runs func once with the instrumentation enabled (separately from the timed runs, such
+ * that the counter reads do not disturb the cycle count) and prints the phase breakdown
+ */
+void phase_test(compute_bw_func func, const BWdata& bw) {
+    const BWdata* bw_copy = new BWdata(bw);
+    Instrumentation::start();
+    func(*bw_copy);
+    Instrumentation::stop();
+    delete bw_copy;
+
+    printf("%-13s %15s", "Phase", "cycles");
+    for(size_t c = 0; c < BW_COUNTER_COUNT; c++){
+        printf(" %15s", Instrumentation::counter_name((bw_counter)c));
+    }
+    printf("\n");
+    for(size_t p = 0; p < BW_PHASE_COUNT; p++){
+        const PhaseCounters& counters = Instrumentation::get((bw_phase)p);
+        if(counters.cycles == 0) continue; // not marked by the implementation
+        printf("%-13s %15.0f", Instrumentation::phase_name((bw_phase)p), counters.cycles);
+        for(size_t c = 0; c < BW_COUNTER_COUNT; c++){
+            printf(" %15lld", counters.counters[c]);
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * Writes the CSV header columns of the phase breakdown (one column per phase and counter)
+ */
+void write_phase_header(std::ofstream &logfile){
+    for(size_t p = 0; p < BW_PHASE_COUNT; p++){
+        const char* phase = Instrumentation::phase_name((bw_phase)p);
+        logfile << ";" << phase << " cycles";
+        for(size_t c = 0; c < BW_COUNTER_COUNT; c++){
+            logfile << ";" << phase << " " << Instrumentation::counter_name((bw_counter)c);
+        }
+    }
+}
+
+/**
+ * Writes the phase breakdown of the last phase_test (0 for phases the implementation does not mark, -1 for unavailable counters)
+ */
+void write_phases(std::ofstream &logfile){
+    for(size_t p = 0; p < BW_PHASE_COUNT; p++){
+        const PhaseCounters& counters = Instrumentation::get((bw_phase)p);
+        logfile << ";" << counters.cycles;
+        for(size_t c = 0; c < BW_COUNTER_COUNT; c++){
+            logfile << ";" << counters.counters[c];
+        }
+    }
+}
+
+/**
+ * Benchmarks the baseline and the selected implementations for one shape.
+ * The results are appended to logfile (if not NULL) in the format of write_header.
+ */
+void perform_measure_and_write_to_file(const std::set<std::string> &sel_impl, const size_t K, const size_t N, const size_t M, const size_t T, const size_t max_iterations, std::ofstream *logfile){
+    printf("Benchmarking with K = %zu, N = %zu, M = %zu, T = %zu and max_iterations = %zu on %zu threads\n", K, N, M, T, max_iterations, ThreadPool::get_num_threads());
     flops = 9*T*K*N*N - 5*K*N*N + N*N + 8*T*K*N + 3*K*N + K + 2*K*N*M + 2*T*K + N + N*M;
-    size_t mem = (N + N*N + N*M + 2*K*T + max_iterations + 3*K*T*N + K*T*N*N + K*N + K*N*N)*8;
-    const BWdata& bw = *new BWdata(K, N, M, T, max_iterations);
+    // the baseline always has alpha, beta and ggamma (see --checkpoint)
+    const size_t base_mem = (N + N*N + N*M + 2*K*T + max_iterations + 3*K*T*N + (stream_sigma ? 0 : K*T*N*N) + K*N + K*N*N)*8;
+    const size_t mem = checkpoint ? base_mem - 3*K*T*N*8 : base_mem;
+    // observations as stored in BWdata (size_t) and the packed copy that "combined" and
+    // "vector_optimized" read in addition (packed_observations.h)
+    const size_t observations_bytes = K*T*sizeof(size_t);
+    const size_t observations_packed_bytes = K*T*BWpackedObservations::width_for(M);
+    printf("Observations: %zu bytes, packed copy: %zu bytes extra (%zu bit per observation)\n", observations_bytes, observations_packed_bytes, 8*BWpackedObservations::width_for(M));
+    const BWdata& bw = *new BWdata(K, N, M, T, max_iterations, stream_sigma, checkpoint);
+    bw.stopping = stopping;
+    // same data for a shape, independent of the other shapes of the sweep
+    srand(seed);
     initialize_random(bw);
+    if(nonzeros_per_row > 0){
+        // left-to-right topology, the sparse implementations switch to their sparse kernels
+        sparsify_trans_prob(bw, nonzeros_per_row);
+        printf("trans_prob: %zu nonzeros per row (density %f)\n", nonzeros_per_row, BWsparseTransitions::density(bw.trans_prob, N));
+    }
+    if(band_per_row > 0){
+        // duration-like topology, 'banded' works on band_per_row diagonals on each side
+        bandify_trans_prob(bw, band_per_row, band_per_row);
+        printf("trans_prob: band of %zu diagonals (density %f)\n", 2*band_per_row + 1, BWsparseTransitions::density(bw.trans_prob, N));
+    }
+    // the baseline needs alpha, beta and ggamma, with --checkpoint it runs on a copy that has them
+    const BWdata& bw_base = checkpoint ? bw.deep_copy(stream_sigma, false) : bw;
     printf("Running: %s\n", FuncRegister::baseline_name.c_str());
     struct perf_result base_res;
     std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-    perf_test(FuncRegister::baseline_func, bw, &base_res);
+    perf_test(FuncRegister::baseline_func, bw_base, &base_res);
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     auto time = std::chrono::duration_cast<std::chrono::microseconds> (end - begin).count()/1000000.0;
-    logfile << std::fixed << "Baseline" << ";" << K << ";" << N << ";" << M << ";" << T << ";" << max_iterations << ";" << flops << ";" << base_res.cycles << ";" << base_res.iterations << ";" << base_res.performance << ";" << mem <<";" << time << std::endl;
+    phase_test(FuncRegister::baseline_func, bw_base);
+    if(checkpoint) delete &bw_base;
+    if(logfile){
+        // the baseline has no scratch buffers, one-shot = amortized
+        *logfile << std::fixed << "Baseline" << ";" << K << ";" << N << ";" << M << ";" << T << ";" << max_iterations << ";" << flops << ";" << base_res.cycles << ";" << base_res.iterations << ";" << base_res.performance << ";" << base_mem <<";" << time << ";" << FuncRegister::isa_name(BW_ISA_GENERIC) << ";" << base_res.cycles << ";" << base_res.performance << ";" << base_res.executed << ";" << observations_bytes << ";" << observations_packed_bytes << ";" << ThreadPool::get_num_threads() << ";" << nonzeros_per_row << ";" << band_per_row;
+        write_phases(*logfile);
+        *logfile << std::endl;
+    }
     printf("\n");
     for(size_t i = 0; i < FuncRegister::size(); i++){
-        if(sel_impl.empty() || sel_impl.find(FuncRegister::funcs->at(i).name) != sel_impl.end()){
+        if(is_selected(sel_impl, FuncRegister::funcs->at(i))){
             // Hacky but it works: Transpose emit_prob
             if(FuncRegister::funcs->at(i).transpose_emit_prob){
                 double *new_emit_prob = (double *)malloc(bw.N*bw.M * sizeof(double));
@@ -180,68 +340,337 @@ void perform_measure_and_write_to_file(const std::set<std::string> &sel_impl, co
                 free(new_emit_prob);
             }
 //
-            printf("Running: %s: %s\n", FuncRegister::funcs->at(i).name.c_str(), FuncRegister::funcs->at(i).description.c_str());
+            printf("Running: %s [%s]: %s\n", FuncRegister::funcs->at(i).name.c_str(), FuncRegister::isa_name(FuncRegister::funcs->at(i).isa), FuncRegister::funcs->at(i).description.c_str());
             struct perf_result result;
             std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
             perf_test(FuncRegister::funcs->at(i).func, bw, &result);
             std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-            printf("\n");
             auto time = std::chrono::duration_cast<std::chrono::microseconds> (end - begin).count()/1000000.0;
 
-            logfile << std::fixed << FuncRegister::funcs->at(i).name << ";" << K << ";" << N << ";" << M << ";" << T << ";" << max_iterations << ";" << flops << ";" << result.cycles << ";" << result.iterations << ";" << result.performance << ";" << mem <<";" << time << std::endl;
+            printf("With workspace (amortized):\n");
+            struct perf_result workspace_result;
+            BWworkspace workspace;
+            perf_test(FuncRegister::funcs->at(i).func, bw, &workspace_result, &workspace);
+            printf("Workspace: %zu bytes\n", workspace.size());
+            workspace.release();
+
+            phase_test(FuncRegister::funcs->at(i).func, bw);
+            printf("\n");
+
+            // Transpose back, such that the next implementation runs on the same data
+            // (matters with --converge, where the data determines the work)
+            if(FuncRegister::funcs->at(i).transpose_emit_prob){
+                double *new_emit_prob = (double *)malloc(bw.N*bw.M * sizeof(double));
+                transpose_matrix(new_emit_prob, bw.emit_prob, bw.M, bw.N);
+                memcpy(bw.emit_prob, new_emit_prob, bw.N*bw.M * sizeof(double));
+                free(new_emit_prob);
+            }
+
+            if(logfile){
+                *logfile << std::fixed << FuncRegister::funcs->at(i).name << ";" << K << ";" << N << ";" << M << ";" << T << ";" << max_iterations << ";" << flops << ";" << result.cycles << ";" << result.iterations << ";" << result.performance << ";" << mem <<";" << time << ";" << FuncRegister::isa_name(FuncRegister::funcs->at(i).isa) << ";" << workspace_result.cycles << ";" << workspace_result.performance << ";" << result.executed << ";" << observations_bytes << ";" << observations_packed_bytes << ";" << ThreadPool::get_num_threads() << ";" << nonzeros_per_row << ";" << band_per_row;
+                write_phases(*logfile);
+                *logfile << std::endl;
+            }
         }
     }
     delete &bw;
 }
 
-void make_performance_plot(const std::set<std::string> &sel_impl, const size_t max_iterations){
-    // create log file
-    std::ofstream logfile;
-    struct stat buffer;
-    if(stat("log.csv", &buffer) == 0){
-        printf("File 'log.csv' does already exist! Please rename the existing file and try again\n");
-        exit(-3);
+struct throughput_result{
+    double cycles; // per call (all K sequences)
+    double sequences_per_second;
+};
+
+/**
+ * Measures run() that processes K sequences (same calibration as perf_test)
+ */
+template<typename Run>
+void throughput_test(Run run, const size_t K, struct throughput_result *result) {
+    size_t num_runs = 1;
+    double cycles;
+    myInt64 start, end;
+
+#if CALIBRATE
+    double multiplier = 1;
+    do {
+        num_runs = num_runs * multiplier;
+        start = start_tsc();
+        for (size_t i = 0; i < num_runs; i++) {
+            run();
+        }
+        end = stop_tsc(start);
+        cycles = (double)end;
+        multiplier = (CYCLES_REQUIRED) / (cycles);
+    } while (multiplier > 2);
+#endif
+
+    double total_cycles = 0;
+    double total_seconds = 0;
+    for (size_t j = 0; j < REP; j++) {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        start = start_tsc();
+        for (size_t i = 0; i < num_runs; i++) {
+            run();
+        }
+        end = stop_tsc(start);
+        std::chrono::steady_clock::time_point finish = std::chrono::steady_clock::now();
+        total_cycles += ((double)end) / num_runs;
+        total_seconds += std::chrono::duration_cast<std::chrono::nanoseconds> (finish - begin).count()/1e9/num_runs;
+    }
+
+    result->cycles = total_cycles / REP;
+    result->sequences_per_second = K / (total_seconds / REP);
+}
+
+/**
+ * Measures the selected functions of a ModelRegister, call(f) runs f on all K sequences.
+ * suffix is appended to the names in the output (to tell several calls of the same function apart)
+ */
+template<typename F, typename Call>
+void measure_model_functions(const std::set<std::string> &sel_impl, const size_t K, const size_t N, const size_t M, const size_t T, const size_t flops, Call call, std::ofstream *logfile, const std::string &suffix = ""){
+    for(size_t i = 0; i < ModelRegister<F>::size(); i++){
+        const RegisteredModelFunction<F>& f = ModelRegister<F>::funcs->at(i);
+        if(!sel_impl.empty() && sel_impl.find(f.name) == sel_impl.end()) continue;
+
+        printf("Running: %s%s [%s]: %s\n", f.name.c_str(), suffix.c_str(), FuncRegister::isa_name(f.isa), f.description.c_str());
+        struct throughput_result result;
+        throughput_test([&call, &f]{ call(f.func); }, K, &result);
+        const double perf = flops / result.cycles;
+        printf("Cycles per sequence: %f\n", result.cycles / K);
+        printf("Sequences per second: %f\n", result.sequences_per_second);
+        printf("Performance: %f\n\n", perf);
+
+        if(logfile){
+            *logfile << std::fixed << f.name << suffix << ";" << K << ";" << N << ";" << M << ";" << T << ";" << flops << ";" << result.cycles << ";" << perf << ";" << result.sequences_per_second << ";" << FuncRegister::isa_name(f.isa) << ";" << ThreadPool::get_num_threads() << std::endl;
+        }
+    }
+}
+
+/**
+ * Benchmarks the selected likelihood accumulations (--likelihood) on K*T random c_norm
+ * (the reciprocals of normalization sums of N states, as left behind by a forward pass).
+ * The results are appended to logfile (if not NULL) in the format of write_model_header.
+ */
+void perform_likelihood_measure_and_write_to_file(const std::set<std::string> &sel_impl, const size_t K, const size_t N, const size_t M, const size_t T, std::ofstream *logfile){
+    printf("Likelihood with K = %zu, N = %zu, M = %zu and T = %zu\n", K, N, M, T);
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> sum(0.05, 1.0);
+    double* c_norm = (double *)aligned_alloc(32, K*T * sizeof(double));
+    size_t* offsets = (size_t *)malloc((K+1) * sizeof(size_t));
+    for (size_t k = 0; k <= K; k++) {
+        offsets[k] = k*T;
     }
-    logfile.open("log.csv", std::ios::out);
-    logfile << "Implementation;K;N;M;T;max_iterations;Flops;Cylces;Iterations;Performance;Memory (aprox.)(bytes);Benchmark time(s)" << std::endl;
-
-    size_t K = 16;
-    size_t N = 16;
-    size_t M = 16;
-    size_t T = 32;
-
-    //perform_measure_and_write_to_file(sel_impl, K,N,M,T,max_iterations,logfile);
-
-    #define M_TEST_COUNT 0
-    size_t M_tests[] = {256, 512};
-    #define N_TEST_COUNT 1
-    size_t N_tests[] = {112};
-    #define T_TEST_COUNT 0
-    size_t T_tests[] = {96, 192, 256, 320};
-    #define K_TEST_COUNT 0
-    size_t K_tests[] = {192, 256};
-
-    for(size_t i = 0; i < M_TEST_COUNT; i++){
-        perform_measure_and_write_to_file(sel_impl, K,N,M_tests[i],T,max_iterations,logfile);
+    for (size_t i = 0; i < K*T; i++) {
+        c_norm[i] = 1.0/(N*sum(generator));
     }
+    double* neg_log_likelihoods = (double *)malloc(K * sizeof(double));
+
+    // one multiplication or log per time step
+    measure_model_functions<likelihood_func>(sel_impl, K, N, M, T, K*T, [&](likelihood_func f){
+        f(c_norm, K, offsets, neg_log_likelihoods);
+    }, logfile);
+
+    free(neg_log_likelihoods);
+    free(offsets);
+    free(c_norm);
+}
 
-    for(size_t i = 0; i < K_TEST_COUNT; i++){
-        perform_measure_and_write_to_file(sel_impl, K_tests[i],N,M,T,max_iterations,logfile);
+/**
+ * Benchmarks the selected scoring (--score), Viterbi (--viterbi) or posterior decoding (--posterior)
+ * implementations for one shape.
+ * The results are appended to logfile (if not NULL) in the format of write_model_header.
+ */
+void perform_model_measure_and_write_to_file(const std::set<std::string> &sel_impl, const size_t K, const size_t N, const size_t M, const size_t T, std::ofstream *logfile){
+    printf("%s with K = %zu, N = %zu, M = %zu and T = %zu\n", mode == BENCH_SCORING ? "Scoring" : "Decoding", K, N, M, T);
+    // no sigma buffer needed, only the observations and the model are read
+    const BWdata& bw = *new BWdata(K, N, M, T, 1, true);
+    srand(seed);
+    initialize_random(bw);
+    const BWmodel model(bw);
+    const BWsequences sequences(bw);
+    double* log_likelihoods = (double *)malloc(K * sizeof(double));
+
+    if(mode == BENCH_SCORING){
+        // forward step only (see the cost analysis above)
+        const size_t flops = 2*K*N*N*T + 3*K*N*T + 3*K*N + K*T + K;
+        measure_model_functions<score_func>(sel_impl, K, N, M, T, flops, [&](score_func f){
+            f(model, sequences, log_likelihoods);
+        }, logfile);
+    } else if (mode == BENCH_POSTERIOR) {
+        // forward step + backward step without sigma: (1 add + 1 mul)*K*N*N*T twice, the rest per K*N*T
+        const size_t flops = 4*K*N*N*T + 6*K*N*T;
+        double* gamma = (double *)malloc(K*T*N * sizeof(double));
+        size_t* states = (size_t *)malloc(K*T * sizeof(size_t));
+        measure_model_functions<posterior_func>(sel_impl, K, N, M, T, flops, [&](posterior_func f){
+            f(model, sequences, gamma, NULL);
+        }, logfile);
+        measure_model_functions<posterior_func>(sel_impl, K, N, M, T, flops, [&](posterior_func f){
+            f(model, sequences, NULL, states);
+        }, logfile, "/argmax");
+        free(gamma);
+        free(states);
+    } else {
+        // (1 add + 1 compare)*K*N*N*(T-1) + (1 add)*K*N*T, without the logs of the model
+        const size_t flops = 2*K*N*N*(T-1) + K*N*T;
+        size_t* paths = (size_t *)malloc(K*T * sizeof(size_t));
+        measure_model_functions<viterbi_func>(sel_impl, K, N, M, T, flops, [&](viterbi_func f){
+            f(model, sequences, paths, log_likelihoods);
+        }, logfile);
+        free(paths);
     }
 
-    for(size_t i = 0; i < T_TEST_COUNT; i++){
-        perform_measure_and_write_to_file(sel_impl, K,N,M,T_tests[i],max_iterations,logfile);
+    free(log_likelihoods);
+    delete &bw;
+}
+
+/**
+ * Times the eligible implementations for one shape (--tune) and appends the fastest to the tuning
+ * cache (see autotuner.h), replacing an earlier decision for the shape.
+ */
+void perform_tuning(const size_t K, const size_t N, const size_t M, const size_t T){
+    const BWdata& bw = *new BWdata(K, N, M, T, max_iterations, stream_sigma, checkpoint);
+    srand(seed);
+    initialize_random(bw);
+    printf("Tuning K = %zu, N = %zu, M = %zu, T = %zu (%s) for '%s' [%s]\n", K, N, M, T, checkpoint ? "checkpoint" : (stream_sigma ? "stream-sigma" : "sigma"), Autotuner::cpu_model().c_str(), FuncRegister::isa_name(FuncRegister::cpu_isa()));
+
+    std::vector<AutotunerCandidate> candidates;
+    const struct RegisteredFunction* winner = Autotuner::tune(bw, &candidates);
+    for(const AutotunerCandidate& candidate : candidates){
+        printf("%20s: %.0f cycles (%d iterations)\n", candidate.name.c_str(), candidate.cycles, AUTOTUNER_ITERATIONS);
     }
+    if(winner){
+        printf("Selected '%s', written to '%s'\n\n", winner->name.c_str(), Autotuner::cache_path().c_str());
+    } else {
+        printf("No eligible implementation, the baseline is used\n\n");
+    }
+    delete &bw;
+}
+
+/**
+ * Writes the CSV header of --score, --viterbi, --posterior and --likelihood
+ */
+void write_model_header(std::ofstream &logfile){
+    logfile << "Implementation;K;N;M;T;Flops;Cycles;Performance;Sequences per second;ISA;Threads" << std::endl;
+}
 
-    for(size_t i = 0; i < N_TEST_COUNT; i++){
-        perform_measure_and_write_to_file(sel_impl, K,N_tests[i],M,T,max_iterations,logfile);
+/**
+ * Writes the CSV header (';' separated, the columns are looked up by name in plotting/rooflineplot.py)
+ */
+void write_header(std::ofstream &logfile){
+    logfile << "Implementation;K;N;M;T;max_iterations;Flops;Cylces;Iterations;Performance;Memory (aprox.)(bytes);Benchmark time(s);ISA;Cycles (workspace);Performance (workspace);Executed iterations;Observations (bytes);Observations packed copy (bytes);Threads;Trans nonzeros per row;Trans half bandwidth";
+    write_phase_header(logfile);
+    logfile << std::endl;
+}
+
+/**
+ * Runs the sweep over all combinations of the given K, N, M and T values (and thread counts).
+ * The results are written to output (if not empty).
+ */
+void make_performance_plot(const std::set<std::string> &sel_impl, const size_t max_iterations, const std::vector<size_t> shapes[4], const std::string &output){
+    std::ofstream logfile;
+    if(!output.empty()){
+        logfile.open(output, std::ios::out);
+        if(!logfile.is_open()){
+            printf("Error: cannot open '%s' for writing\n", output.c_str());
+            exit(-3);
+        }
+        if(mode != BENCH_TRAINING){
+            write_model_header(logfile);
+        } else {
+            write_header(logfile);
+        }
+    }
+
+    for(const size_t K : shapes[0]){
+        for(const size_t N : shapes[1]){
+            for(const size_t M : shapes[2]){
+                for(const size_t T : shapes[3]){
+                    for(const size_t threads : thread_counts.empty() ? std::vector<size_t>{0} : thread_counts){
+                        ThreadPool::set_num_threads(threads);
+                        if(mode == BENCH_TUNE){
+                            perform_tuning(K, N, M, T);
+                            continue;
+                        }
+                        if(mode == BENCH_LIKELIHOOD){
+                            perform_likelihood_measure_and_write_to_file(sel_impl, K, N, M, T, output.empty() ? NULL : &logfile);
+                            continue;
+                        }
+                        if(mode != BENCH_TRAINING){
+                            perform_model_measure_and_write_to_file(sel_impl, K, N, M, T, output.empty() ? NULL : &logfile);
+                            continue;
+                        }
+                        for(const size_t nonzeros : trans_nonzeros.empty() ? std::vector<size_t>{0} : trans_nonzeros){
+                            nonzeros_per_row = (nonzeros < N) ? nonzeros : 0;
+                            for(const size_t band : trans_bands.empty() ? std::vector<size_t>{0} : trans_bands){
+                                band_per_row = (band < N) ? band : 0;
+                                perform_measure_and_write_to_file(sel_impl, K, N, M, T, max_iterations, output.empty() ? NULL : &logfile);
+                            }
+                        }
+                    }
+                }
+            }
+        }
     }
-    // Everything
-    for(size_t i=2; i<3; i++){
-        perform_measure_and_write_to_file(sel_impl, K + i*16,N+i*16,M+i*16,T+(i/2)*32,max_iterations,logfile);
+
+    if(!output.empty()){
+        logfile.close();
+        printf("Results written to '%s'\n", output.c_str());
+    }
+}
+
+/**
+ * Parses a shape specification into values:
+ * a value ("64"), a list ("16,48,64") or a range "start:stop[:step]" with an additive ("16", "+16", default +16)
+ * or multiplicative ("x2") step. All values have to be nonzero multiples of multiple_of and at least minimum.
+ */
+bool parse_shape(const char* name, const char* spec, const size_t multiple_of, const size_t minimum, std::vector<size_t> &values){
+    values.clear();
+    std::string str(spec);
+    size_t start, stop, step = 16;
+    bool multiply = false;
+    char step_str[32] = "";
+
+    if(str.find(':') != std::string::npos){
+        const int nb = sscanf(spec, "%zu:%zu:%31s", &start, &stop, step_str);
+        if(nb < 2){
+            printf("Error: cannot parse --%s '%s'\n", name, spec);
+            return false;
+        }
+        if(nb == 3){
+            multiply = (step_str[0] == 'x' || step_str[0] == '*');
+            step = strtoul(step_str + ((multiply || step_str[0] == '+') ? 1 : 0), NULL, 10);
+        }
+        if(step == 0 || (multiply && step == 1) || start > stop){
+            printf("Error: invalid range --%s '%s'\n", name, spec);
+            return false;
+        }
+        // a range starting at 0 would never grow with x<step>
+        if(start == 0 || start < minimum){
+            printf("Error: --%s: %zu is not a nonzero multiple of %zu (>= %zu)\n", name, start, multiple_of, minimum);
+            return false;
+        }
+        for(size_t v = start; v <= stop; v = multiply ? v*step : v + step){
+            values.push_back(v);
+            // the next value would overflow
+            if(multiply ? v > SIZE_MAX / step : v > SIZE_MAX - step) break;
+        }
+    } else {
+        size_t pos = 0;
+        while(pos < str.size()){
+            size_t next = str.find(',', pos);
+            if(next == std::string::npos) next = str.size();
+            values.push_back(strtoul(str.substr(pos, next - pos).c_str(), NULL, 10));
+            pos = next + 1;
+        }
     }
 
-    logfile.close();
+    for(const size_t v : values){
+        if(v == 0 || v % multiple_of != 0 || v < minimum){
+            printf("Error: --%s: %zu is not a nonzero multiple of %zu (>= %zu)\n", name, v, multiple_of, minimum);
+            return false;
+        }
+    }
+    return !values.empty();
 }
 
 static struct option arg_options[] = {
@@ -249,23 +678,43 @@ static struct option arg_options[] = {
         {"only", required_argument, NULL, 'o'},
         {"list", no_argument, NULL, 'l'},
         {"max-iterations", required_argument, NULL, 1},
+        {"threads", required_argument, NULL, 2},
+        {"stream-sigma", no_argument, NULL, 3},
+        {"K", required_argument, NULL, 4},
+        {"N", required_argument, NULL, 5},
+        {"M", required_argument, NULL, 6},
+        {"T", required_argument, NULL, 7},
+        {"seed", required_argument, NULL, 8},
+        {"output", required_argument, NULL, 9},
+        {"converge", no_argument, NULL, 10},
+        {"tol", required_argument, NULL, 11},
+        {"rel-tol", required_argument, NULL, 12},
+        {"patience", required_argument, NULL, 13},
+        {"min-iterations", required_argument, NULL, 14},
+        {"score", no_argument, NULL, 15},
+        {"viterbi", no_argument, NULL, 16},
+        {"posterior", no_argument, NULL, 17},
+        {"checkpoint", no_argument, NULL, 18},
+        {"trans-nonzeros", required_argument, NULL, 19},
+        {"trans-band", required_argument, NULL, 20},
+        {"likelihood", no_argument, NULL, 21},
+        {"tune", no_argument, NULL, 22},
+        {"tuning-cache", required_argument, NULL, 23},
         {"help", no_argument, NULL, 'h'},
         {0, 0, 0, 0}
     };
 
 int main(int argc, char **argv) {
-    // randomize seed
-    srand(time(NULL));
+    // randomize seed (reproducible with --seed)
+    seed = time(NULL);
 
     std::set<std::string> sel_impl;
     std::string arg;
+    std::string output;
 
     // no need for variable size randomness in benchmarks
-    // NOTE: Please choose a nonzero multiple of 16 (and 32 for T)
-    const size_t K = 16;
-    const size_t N = 16;
-    const size_t M = 16;
-    const size_t T = 32;
+    // NOTE: nonzero multiples of 16 (T >= 32), see parse_shape
+    std::vector<size_t> shapes[4] = {{16}, {16}, {16}, {32}}; // K, N, M, T
 
     bool test_mode = false;
 
@@ -290,6 +739,22 @@ int main(int argc, char **argv) {
             case 'l':
                 printf("Registered functions:\n");
                 FuncRegister::printRegisteredFuncs();
+                printf("Scoring functions:\n");
+                for(size_t i = 0; i < ScoreRegister::size(); i++){
+                    printf("%20s: [%s] %s\n", ScoreRegister::funcs->at(i).name.c_str(), FuncRegister::isa_name(ScoreRegister::funcs->at(i).isa), ScoreRegister::funcs->at(i).description.c_str());
+                }
+                printf("Viterbi functions:\n");
+                for(size_t i = 0; i < ViterbiRegister::size(); i++){
+                    printf("%20s: [%s] %s\n", ViterbiRegister::funcs->at(i).name.c_str(), FuncRegister::isa_name(ViterbiRegister::funcs->at(i).isa), ViterbiRegister::funcs->at(i).description.c_str());
+                }
+                printf("Posterior decoding functions:\n");
+                for(size_t i = 0; i < PosteriorRegister::size(); i++){
+                    printf("%20s: [%s] %s\n", PosteriorRegister::funcs->at(i).name.c_str(), FuncRegister::isa_name(PosteriorRegister::funcs->at(i).isa), PosteriorRegister::funcs->at(i).description.c_str());
+                }
+                printf("Likelihood accumulations:\n");
+                for(size_t i = 0; i < LikelihoodRegister::size(); i++){
+                    printf("%20s: [%s] %s\n", LikelihoodRegister::funcs->at(i).name.c_str(), FuncRegister::isa_name(LikelihoodRegister::funcs->at(i).isa), LikelihoodRegister::funcs->at(i).description.c_str());
+                }
                 return 0;
             case 1:
                 max_iterations = atoi(optarg);
@@ -298,17 +763,122 @@ int main(int argc, char **argv) {
                     return -1;
                 }
                 break;
+            case 2:
+                if(!parse_shape("threads", optarg, 1, 1, thread_counts)) return -1;
+                break;
+            case 3:
+                stream_sigma = true;
+                break;
+            case 4:
+                if(!parse_shape("K", optarg, 16, 16, shapes[0])) return -1;
+                break;
+            case 5:
+                if(!parse_shape("N", optarg, 16, 16, shapes[1])) return -1;
+                break;
+            case 6:
+                if(!parse_shape("M", optarg, 16, 16, shapes[2])) return -1;
+                break;
+            case 7:
+                if(!parse_shape("T", optarg, 16, 32, shapes[3])) return -1;
+                break;
+            case 8:
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 9:
+                output = optarg;
+                break;
+            case 10:
+                stopping.early_stop = true;
+                break;
+            case 11:
+                stopping.abs_tol = atof(optarg);
+                break;
+            case 12:
+                stopping.rel_tol = atof(optarg);
+                break;
+            case 13:
+                stopping.patience = atoi(optarg);
+                break;
+            case 14:
+                stopping.min_iterations = atoi(optarg);
+                break;
+            case 15:
+                mode = BENCH_SCORING;
+                break;
+            case 16:
+                mode = BENCH_VITERBI;
+                break;
+            case 17:
+                mode = BENCH_POSTERIOR;
+                break;
+            case 18:
+                checkpoint = true;
+                stream_sigma = true;
+                break;
+            case 19:
+                if(!parse_shape("trans-nonzeros", optarg, 1, 1, trans_nonzeros)) return -1;
+                break;
+            case 20:
+                if(!parse_shape("trans-band", optarg, 1, 1, trans_bands)) return -1;
+                break;
+            case 21:
+                mode = BENCH_LIKELIHOOD;
+                break;
+            case 22:
+                mode = BENCH_TUNE;
+                break;
+            case 23:
+                Autotuner::set_cache_path(optarg);
+                break;
             case 'h':
                 printf("Usage: %s [OPTIONS]\n", argv[0]);
                 printf("Benchmarks the registered implementations against the registered baseline.\n\n");
                 printf("Options:\n");
                 printf("  -h, --help\t\t\tPrints this message and exits\n");
-                printf("  -t, --test\t\t\tPerform test that can be used for the report (Not yet implemented)\n");
+                printf("  -t, --test\t\t\tPerform test that can be used for the report (writes log.csv unless --output is given)\n");
                 printf("  -o, --only <name>\t\tOnly execute the implementation with the given name (case-sensitive). "
                                  "\n  \t\t\t\t Can occur multiple times and is compatible with --test. The baseline is"
                                  "\n  \t\t\t\t always run.\n");
                 printf("      --list\t\t\tLists all available implementations and exits\n");
                 printf("      --max-iterations <value>\tSets the max-iteration to a value\n");
+                printf("      --threads <spec>\t\tNumber of threads of the parallel implementations (default: number of"
+                                 "\n  \t\t\t\t hardware threads). A list or range (see --K) runs every shape with each"
+                                 "\n  \t\t\t\t thread count\n");
+                printf("      --stream-sigma\t\tDo not allocate the K*T*N*N sigma buffer (accumulate sigma_sum directly)."
+                                 "\n  \t\t\t\t Only implementations supporting it are run\n");
+                printf("      --checkpoint\t\tDo not allocate alpha, beta and ggamma either (keep alpha at every"
+                                 "\n  \t\t\t\t ~sqrt(T)-th time step, implies --stream-sigma). Only implementations"
+                                 "\n  \t\t\t\t supporting it are run, the baseline runs on a copy with the buffers\n");
+                printf("      --trans-nonzeros <spec>\tPrune trans_prob to a left-to-right topology with this many nonzeros"
+                                 "\n  \t\t\t\t per row (list or range, see --K; >= N := dense). Compare 'sparse' and"
+                                 "\n  \t\t\t\t 'sparse-dense' across densities. Training only\n");
+                printf("      --trans-band <spec>\tPrune trans_prob to a band with this many diagonals on each side of the"
+                                 "\n  \t\t\t\t main diagonal (list or range, see --K; >= N := dense). Compare 'banded'"
+                                 "\n  \t\t\t\t across bandwidths. Training only\n");
+                printf("      --K, --N, --M, --T <spec>\tShapes to benchmark (all combinations are run). <spec> is a value (64),"
+                                 "\n  \t\t\t\t a list (16,48,64) or a range start:stop[:step] with step +16 (default)"
+                                 "\n  \t\t\t\t or x2. Nonzero multiples of 16 (T >= 32). Default: K=N=M=16, T=32\n");
+                printf("      --seed <value>\t\tSeed of the random data (default: current time)\n");
+                printf("      --output <path>\t\tWrites the results as CSV to path (overwritten if it exists)\n");
+                printf("      --converge\t\tStop a run once it converged instead of running max_iterations."
+                                 "\n  \t\t\t\t Performance is then computed from the executed iterations\n");
+                printf("      --tol <value>\t\tConverged if the change of the negative log likelihood is below"
+                                 "\n  \t\t\t\t tol + rel-tol*|previous| (default: %g)\n", EPSILON);
+                printf("      --rel-tol <value>\t\tSee --tol (default: 0)\n");
+                printf("      --patience <value>\tNumber of consecutive converged iterations before stopping (default: 1)\n");
+                printf("      --min-iterations <value>\tNever stop before this number of iterations (default: 0)\n");
+                printf("      --score\t\t\tBenchmark the scoring implementations (log P(sequence | model), forward only)"
+                                 "\n  \t\t\t\t instead of the training. Reports sequences per second\n");
+                printf("      --viterbi\t\t\tBenchmark the Viterbi implementations (most likely state paths) instead\n"
+                                 "  \t\t\t\t of the training. Reports sequences per second\n");
+                printf("      --posterior\t\tBenchmark the posterior decoding implementations (state marginals and,\n"
+                                 "  \t\t\t\t suffixed /argmax, only the most likely state per time step) instead of\n"
+                                 "  \t\t\t\t the training. Reports sequences per second\n");
+                printf("      --likelihood\t\tMicrobenchmark of the likelihood accumulations alone (negative log\n"
+                                 "  \t\t\t\t likelihood from K*T random c_norm, see likelihood.h)\n");
+                printf("      --tune\t\t\tTimes the eligible implementations for every shape (and memory mode) and\n"
+                                 "  \t\t\t\t stores the fastest in the tuning cache used by the autotuner\n");
+                printf("      --tuning-cache <path>\tTuning cache of --tune (default: $BW_TUNING_CACHE or %s)\n", AUTOTUNER_CACHE);
                 return 0;
             case '?':
                 return -1;
@@ -319,34 +889,18 @@ int main(int argc, char **argv) {
 
     }
 
-    if(test_mode){
-        make_performance_plot(sel_impl, max_iterations);
-    } else {
-        printf("Benchmarking with K = %zu, N = %zu, M = %zu, T = %zu and max_iterations = %zu\n", K, N, M, T, max_iterations);
-
-        flops = 9*T*K*N*N - 5*K*N*N + N*N + 8*T*K*N + 3*K*N + K + 2*K*N*M + 2*T*K + N + N*M;
+    printf("Seed: %u\n", seed);
 
-        const BWdata& bw = *new BWdata(K, N, M, T, max_iterations);
-        initialize_random(bw);
-        printf("Running: %s\n", FuncRegister::baseline_name.c_str());
-        perf_test(FuncRegister::baseline_func, bw);
-        printf("\n");
-        for(size_t i = 0; i < FuncRegister::size(); i++){
-            if(sel_impl.empty() || sel_impl.find(FuncRegister::funcs->at(i).name) != sel_impl.end()){
-
-                // Hacky but it works: Transpose emit_prob
-                if(FuncRegister::funcs->at(i).transpose_emit_prob){
-                    double *new_emit_prob = (double *)malloc(bw.N*bw.M * sizeof(double));
-                    transpose_matrix(new_emit_prob, bw.emit_prob, bw.N, bw.M);
-                    memcpy(bw.emit_prob, new_emit_prob, bw.N*bw.M * sizeof(double));
-                    free(new_emit_prob);
-                }
-
-                printf("Running: %s: %s\n", FuncRegister::funcs->at(i).name.c_str(), FuncRegister::funcs->at(i).description.c_str());
-                perf_test(FuncRegister::funcs->at(i).func, bw);
-                printf("\n");
+    if(test_mode){
+        // the CSV used for the report
+        if(output.empty()){
+            output = "log.csv";
+            struct stat buffer;
+            if(stat(output.c_str(), &buffer) == 0){
+                printf("File 'log.csv' does already exist! Please rename the existing file or use --output and try again\n");
+                return -3;
             }
         }
-        delete &bw;
     }
+    make_performance_plot(sel_impl, max_iterations, shapes, output);
 }
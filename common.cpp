@@ -5,11 +5,24 @@ std::vector<struct RegisteredFunction> *FuncRegister::funcs = NULL;
 std::string FuncRegister::baseline_name = "";
 compute_bw_func FuncRegister::baseline_func = NULL;
 
-void FuncRegister::add_function(compute_bw_func f, const std::string& name, const std::string& description,bool transpose_emit_prob){
+void FuncRegister::add_function(compute_bw_func f, const std::string& name, const std::string& description, bool transpose_emit_prob, unsigned int features, int isa){
     if(!funcs)
         funcs = new std::vector<struct RegisteredFunction>();
 
-    funcs->push_back({f, name, description, transpose_emit_prob});
+    // Variant for an instruction set this CPU cannot execute
+    if(isa > cpu_isa())
+        return;
+
+    // Keep the best variant per name (registration order across translation units is unspecified)
+    for(size_t i = 0; i < funcs->size(); i++){
+        if(funcs->at(i).name == name){
+            if(isa > funcs->at(i).isa)
+                funcs->at(i) = {f, name, description, transpose_emit_prob, features, isa};
+            return;
+        }
+    }
+
+    funcs->push_back({f, name, description, transpose_emit_prob, features, isa});
 }
 
 void FuncRegister::set_baseline(compute_bw_func f, const std::string& name){
@@ -17,10 +30,49 @@ void FuncRegister::set_baseline(compute_bw_func f, const std::string& name){
     baseline_name = name;
 }
 
+int FuncRegister::cpu_isa(){
+    static int isa = -1;
+    if(isa >= 0) return isa;
+
+    // Registration happens in static constructors, possibly before libgcc initialized its cpuid data
+    __builtin_cpu_init();
+    isa = BW_ISA_GENERIC;
+    if(__builtin_cpu_supports("sse4.2")) isa = BW_ISA_SSE42;
+    if(isa == BW_ISA_SSE42 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) isa = BW_ISA_AVX2;
+    if(isa == BW_ISA_AVX2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")
+        && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512bw")) isa = BW_ISA_AVX512;
+
+    const char* max_isa = getenv("BW_MAX_ISA");
+    if(max_isa){
+        for(int i = BW_ISA_GENERIC; i <= BW_ISA_AVX512; i++){
+            if(strcmp(max_isa, isa_name(i)) == 0 && i < isa) isa = i;
+        }
+    }
+    return isa;
+}
+
+const char* FuncRegister::isa_name(const int isa){
+    switch(isa){
+        case BW_ISA_GENERIC: return "generic";
+        case BW_ISA_SSE42: return "sse4.2";
+        case BW_ISA_AVX2: return "avx2";
+        case BW_ISA_AVX512: return "avx512";
+        default: return "unknown";
+    }
+}
+
 void FuncRegister::printRegisteredFuncs(){
+    printf("Detected instruction set is '%s'\n", isa_name(cpu_isa()));
     printf("Registered baseline is '%s'\n", baseline_name.c_str());
     printf("User functions:\n");
     for(size_t i = 0; i < size(); i++){
-        printf("%20s: %s\n", funcs->at(i).name.c_str(), funcs->at(i).description.c_str());
+        printf("%20s: [%s] %s\n", funcs->at(i).name.c_str(), isa_name(funcs->at(i).isa), funcs->at(i).description.c_str());
     }
-}
\ No newline at end of file
+}
+
+compute_bw_func FuncRegister::find(const std::string& name){
+    for(size_t i = 0; funcs && i < size(); i++){
+        if(funcs->at(i).name == name) return funcs->at(i).func;
+    }
+    return NULL;
+}
@@ -19,6 +19,7 @@
 #define __BW_COMMON_H
 
 #include <string>
+#include <cmath>
 #include <cstring>
 #include <vector>
 #include <cstdlib>
@@ -27,11 +28,45 @@
 
 #define EPSILON 1e-4
 
+class BWworkspace; // workspace.h
+
+/**
+ * Stopping policy of a run (see BWconvergence). By default all max_iterations are
+ * executed, such that the benchmarks measure a fixed amount of work.
+ * With early_stop set, a run stops after the iteration in which the change of the negative
+ * log likelihood has been below abs_tol + rel_tol*|previous| for patience consecutive
+ * iterations, but not before min_iterations have been executed.
+ */
+struct BWstopping {
+    bool early_stop = false;
+    double abs_tol = EPSILON;
+    double rel_tol = 0.0;
+    size_t patience = 1;
+    size_t min_iterations = 0;
+};
+
+// Instruction set levels the kernels are compiled for (see CMakeLists.txt).
+// The hot kernels are built once per level into the same binary and each
+// translation unit registers its functions with the level it was compiled for.
+#define BW_ISA_GENERIC 0 // x86-64 baseline, no flags
+#define BW_ISA_SSE42   1 // -msse4.2
+#define BW_ISA_AVX2    2 // -mavx2 -mfma
+#define BW_ISA_AVX512  3 // -mavx512f -mavx512dq -mavx512vl -mavx512bw
+
+#if !defined(BW_ISA)
+#define BW_ISA BW_ISA_GENERIC
+#endif
+
 /**
  * Struct containing all data for the Baum-Welch algorithm
+ *
+ * The sequences are stored packed one after the other (CSR-style): sequence k occupies
+ * the rows offsets[k] <= i < offsets[k+1] of observations, c_norm, alpha, beta, ggamma and sigma.
+ * If all sequences have the same length T, offsets[k] = k*T and [K][T] indexing is equivalent.
  */
 struct BWdata {
     // (for each observation/training sequence 0 <= k < K)
+    size_t* offsets; //             [K+1]           [k]               :=  index of time step t = 0 of sequence k (offsets[K] = total length)
     size_t* observations; //        [K][T]          [k][t]            :=  observation sequence k at time_step t
     double* init_prob; //           [N]             [n]               :=  P(X_1 = n)
     double* trans_prob; //          [N][N]          [n0][n1]          :=  P(X_t = n1 | X_(t-1) = n0)
@@ -48,6 +83,8 @@ struct BWdata {
     double* beta; //                [K][T][N]       [k][t][n]         :=  P(Y_(t+1) = y_(t+1), ..., Y_N = y_N | X_t = n, theta)
     double* ggamma; //              [K][T][N]       [k][t][n]         :=  P(X_t = n | Y, theta)
     double* sigma; //               [K][T][N][N]    [k][t][n0][n1]    :=  P(X_t = n0, X_(t+1) = n1 | Y, theta)
+                   // NULL if stream_sigma is set (only sigma_sum is materialized)
+    // alpha, beta and ggamma are NULL if checkpoint is set
     // where theta = {init_prob, trans_prob, emit_prob} represent the model parameters we want to learn/refine/estimate iteratively.
     double* gamma_sum; //           [K][N]
     double* sigma_sum; //           [K][N][N]
@@ -55,10 +92,31 @@ struct BWdata {
     const size_t K;  // number of observation sequences / training datasets
     const size_t N;  // number of hidden state variables
     const size_t M;  // number of distinct observations
-    const size_t T;  // number of time steps
+    const size_t T;  // number of time steps (maximum length of a sequence if ragged)
     const size_t max_iterations; // Number of maximum iterations that should be performed
     
     const bool full_copy;
+
+    // Memory mode: if set, the K*T*N*N sigma buffer is not allocated and implementations
+    // accumulate the sigma contributions directly into sigma_sum
+    const bool stream_sigma;
+
+    // Memory mode for very long sequences: if set, the K*T*N alpha, beta and ggamma buffers are
+    // not allocated either (requires stream_sigma). Only implementations registered with
+    // BW_FEATURE_CHECKPOINT run on it, they keep alpha at every ~sqrt(T)-th time step only
+    const bool checkpoint;
+
+    // Set if the sequences have different lengths. Only implementations registered with
+    // BW_FEATURE_RAGGED (and the baseline) respect offsets, all others assume offsets[k] = k*T
+    const bool ragged;
+
+    // Scratch memory kept between runs (see workspace.h), NULL := implementations allocate per run.
+    // Shared by shallow copies, not by deep copies.
+    mutable BWworkspace* workspace;
+
+    // When to stop iterating (copied by all copies) and the number of iterations the last run executed
+    mutable BWstopping stopping;
+    mutable size_t iterations;
     
     /**
      * Creates a BWdata from given data (Constructor)
@@ -67,43 +125,50 @@ struct BWdata {
            const size_t N,
            const size_t M,
            const size_t T,
-           const size_t max_iterations):
-            K(K), N(N), M(M), T(T), max_iterations(max_iterations), full_copy(true){
-        init_prob = (double *)aligned_alloc(32, N * sizeof(double));
-        trans_prob = (double *)aligned_alloc(32, N*N * sizeof(double));
-        emit_prob = (double *)aligned_alloc(32, N*M * sizeof(double));
-        observations = (size_t *)aligned_alloc(32, K*T * sizeof(size_t));
-        neg_log_likelihoods = (double *)aligned_alloc(32, max_iterations * sizeof(double));
-        c_norm = (double *)aligned_alloc(32, K*T * sizeof(double));
-        alpha = (double *)aligned_alloc(32, K*T*N * sizeof(double));
-        beta = (double *)aligned_alloc(32, K*T*N * sizeof(double));
-        ggamma = (double *)aligned_alloc(32, K*T*N * sizeof(double));
-        sigma = (double *)aligned_alloc(32,K*T*N*N * sizeof(double));
-        gamma_sum = (double *)aligned_alloc(32, K*N * sizeof(double));
-        sigma_sum = (double *)aligned_alloc(32, K*N*N * sizeof(double));
+           const size_t max_iterations,
+           const bool stream_sigma = false,
+           const bool checkpoint = false):
+            K(K), N(N), M(M), T(T), max_iterations(max_iterations), full_copy(true), stream_sigma(stream_sigma), checkpoint(checkpoint), ragged(false), workspace(NULL), iterations(0){
+        offsets = (size_t *)aligned_alloc(32, (K+1) * sizeof(size_t));
+        assert(offsets != NULL && "Failed to allocate offsets");
+        for (size_t k = 0; k <= K; k++) {
+            offsets[k] = k*T;
+        }
+        allocate();
+    }
 
-        assert(observations != NULL && "Failed to allocate observations");
-        assert(init_prob != NULL && "Failed to allocate init_prob");
-        assert(trans_prob != NULL && "Failed to allocate trans_prob");
-        assert(emit_prob != NULL && "Failed to allocate emit_prob");
-        assert(neg_log_likelihoods != NULL && "Failed to allocate neg_log_likelihoods");
-        assert(c_norm != NULL && "Failed to allocate c_norm");
-        assert(alpha != NULL && "Failed to allocate alpha");
-        assert(beta != NULL && "Failed to allocate beta");
-        assert(ggamma != NULL && "Failed to allocate ggamma");
-        assert(sigma != NULL && "Failed to allocate sigma");
-        assert(gamma_sum != NULL && "Failed to allocate gamma_sum");
-        assert(sigma_sum != NULL && "Failed to allocate sigma_sum");
+    /**
+     * Creates a BWdata with sequences of different lengths (Constructor)
+     * lengths[k] is the length of sequence k and has to be at least 2
+     */
+    BWdata(const size_t K,
+           const size_t N,
+           const size_t M,
+           const std::vector<size_t>& lengths,
+           const size_t max_iterations,
+           const bool stream_sigma = false,
+           const bool checkpoint = false):
+            K(K), N(N), M(M), T(max_length(lengths)), max_iterations(max_iterations), full_copy(true), stream_sigma(stream_sigma), checkpoint(checkpoint), ragged(true), workspace(NULL), iterations(0){
+        assert(lengths.size() == K && "Need one length per sequence");
+        offsets = (size_t *)aligned_alloc(32, (K+1) * sizeof(size_t));
+        assert(offsets != NULL && "Failed to allocate offsets");
+        offsets[0] = 0;
+        for (size_t k = 0; k < K; k++) {
+            assert(lengths.at(k) >= 2 && "Sequences need at least two time steps");
+            offsets[k+1] = offsets[k] + lengths.at(k);
+        }
+        allocate();
     }
     
     /**
      * Creates a BWdata from a given BWdata (constructor).
      * This is no deep copy. As no parallelization is used, the reuse of constant memory data is permitted
      */
-    BWdata(const BWdata& other): K(other.K), N(other.N), M(other.M), T(other.T), max_iterations(other.max_iterations), full_copy(false){
+    BWdata(const BWdata& other): K(other.K), N(other.N), M(other.M), T(other.T), max_iterations(other.max_iterations), full_copy(false), stream_sigma(other.stream_sigma), checkpoint(other.checkpoint), ragged(other.ragged), workspace(other.workspace), stopping(other.stopping), iterations(other.iterations){
         init_prob = (double *)aligned_alloc(32, N *sizeof(double));
         trans_prob = (double *)aligned_alloc(32, N*N * sizeof(double));
         emit_prob = (double *)aligned_alloc(32, N*M * sizeof(double));
+        offsets = other.offsets;
         observations = other.observations;
         neg_log_likelihoods = other.neg_log_likelihoods;
         c_norm = other.c_norm;
@@ -123,23 +188,63 @@ struct BWdata {
         memcpy(emit_prob, other.emit_prob, N * M * sizeof(double));
     }
 
+    /**
+     * Length of sequence k
+     */
+    inline size_t length(const size_t k) const{
+        return offsets[k+1] - offsets[k];
+    }
+
+    /**
+     * Sum of the lengths of all sequences (K*T if not ragged)
+     */
+    inline size_t total_length() const{
+        return offsets[K];
+    }
+
     /**
      * Copies the current BWdata into a new one (deep copy).
      */
     const BWdata& deep_copy() const{
-        BWdata* other = new BWdata(K, N, M, T, max_iterations);
+        return deep_copy(stream_sigma, checkpoint);
+    }
+
+    /**
+     * Copies the current BWdata into a new one (deep copy) with the given memory mode.
+     * sigma is only copied if both BWdata have a sigma buffer.
+     */
+    const BWdata& deep_copy(const bool copy_stream_sigma) const{
+        return deep_copy(copy_stream_sigma, checkpoint && copy_stream_sigma);
+    }
+
+    /**
+     * Copies the current BWdata into a new one (deep copy) with the given memory modes.
+     * sigma, alpha, beta and ggamma are only copied if both BWdata have the buffer.
+     */
+    const BWdata& deep_copy(const bool copy_stream_sigma, const bool copy_checkpoint) const{
+        BWdata* other;
+        if (ragged) {
+            std::vector<size_t> lengths(K);
+            for (size_t k = 0; k < K; k++) lengths.at(k) = length(k);
+            other = new BWdata(K, N, M, lengths, max_iterations, copy_stream_sigma, copy_checkpoint);
+        } else {
+            other = new BWdata(K, N, M, T, max_iterations, copy_stream_sigma, copy_checkpoint);
+        }
+        const size_t L = total_length();
         memcpy(other->init_prob, init_prob, N * sizeof(double));
         memcpy(other->trans_prob, trans_prob, N * N * sizeof(double));
         memcpy(other->emit_prob, emit_prob, N * M * sizeof(double));
-        memcpy(other->observations, observations, K*T*sizeof(double));
+        memcpy(other->observations, observations, L*sizeof(size_t));
         memcpy(other->neg_log_likelihoods, neg_log_likelihoods, max_iterations*sizeof(double));
-        memcpy(other->c_norm, c_norm, K*T*sizeof(double));
-        memcpy(other->alpha, alpha,  K*T*N*sizeof(double));
-        memcpy(other->beta, beta,  K*T*N*sizeof(double));
-        memcpy(other->ggamma, ggamma,  K*T*N*sizeof(double));
-        memcpy(other->sigma, sigma,  K*T*N*N*sizeof(double));
+        memcpy(other->c_norm, c_norm, L*sizeof(double));
+        if(alpha && other->alpha) memcpy(other->alpha, alpha,  L*N*sizeof(double));
+        if(beta && other->beta) memcpy(other->beta, beta,  L*N*sizeof(double));
+        if(ggamma && other->ggamma) memcpy(other->ggamma, ggamma,  L*N*sizeof(double));
+        if(sigma && other->sigma) memcpy(other->sigma, sigma,  L*N*N*sizeof(double));
         memcpy(other->gamma_sum, gamma_sum,  K*N*sizeof(double));
         memcpy(other->sigma_sum, sigma_sum,  K*N*N*sizeof(double));
+        other->stopping = stopping;
+        other->iterations = iterations;
         
         return *other;
     }
@@ -160,12 +265,112 @@ struct BWdata {
             free(gamma_sum);
             free(sigma_sum);
             free(observations);
+            free(offsets);
             free(neg_log_likelihoods);
         }
         free(init_prob);
         free(trans_prob);
         free(emit_prob);
     }
+
+private:
+
+    static size_t max_length(const std::vector<size_t>& lengths){
+        size_t T = 0;
+        for (size_t k = 0; k < lengths.size(); k++) {
+            if (lengths.at(k) > T) T = lengths.at(k);
+        }
+        return T;
+    }
+
+    /**
+     * Allocates all arrays, offsets have to be set up already
+     */
+    void allocate(){
+        assert((!checkpoint || stream_sigma) && "checkpoint requires stream_sigma");
+        const size_t L = total_length();
+        init_prob = (double *)aligned_alloc(32, N * sizeof(double));
+        trans_prob = (double *)aligned_alloc(32, N*N * sizeof(double));
+        emit_prob = (double *)aligned_alloc(32, N*M * sizeof(double));
+        observations = (size_t *)aligned_alloc(32, L * sizeof(size_t));
+        neg_log_likelihoods = (double *)aligned_alloc(32, max_iterations * sizeof(double));
+        c_norm = (double *)aligned_alloc(32, L * sizeof(double));
+        alpha = checkpoint ? NULL : (double *)aligned_alloc(32, L*N * sizeof(double));
+        beta = checkpoint ? NULL : (double *)aligned_alloc(32, L*N * sizeof(double));
+        ggamma = checkpoint ? NULL : (double *)aligned_alloc(32, L*N * sizeof(double));
+        sigma = stream_sigma ? NULL : (double *)aligned_alloc(32,L*N*N * sizeof(double));
+        gamma_sum = (double *)aligned_alloc(32, K*N * sizeof(double));
+        sigma_sum = (double *)aligned_alloc(32, K*N*N * sizeof(double));
+
+        assert(observations != NULL && "Failed to allocate observations");
+        assert(init_prob != NULL && "Failed to allocate init_prob");
+        assert(trans_prob != NULL && "Failed to allocate trans_prob");
+        assert(emit_prob != NULL && "Failed to allocate emit_prob");
+        assert(neg_log_likelihoods != NULL && "Failed to allocate neg_log_likelihoods");
+        assert(c_norm != NULL && "Failed to allocate c_norm");
+        assert((checkpoint || alpha != NULL) && "Failed to allocate alpha");
+        assert((checkpoint || beta != NULL) && "Failed to allocate beta");
+        assert((checkpoint || ggamma != NULL) && "Failed to allocate ggamma");
+        assert((stream_sigma || sigma != NULL) && "Failed to allocate sigma");
+        assert(gamma_sum != NULL && "Failed to allocate gamma_sum");
+        assert(sigma_sum != NULL && "Failed to allocate sigma_sum");
+    }
+};
+
+/**
+ * Convergence check of the negative log likelihood, shared by all implementations:
+ *
+ *     BWconvergence convergence(bw);
+ *     for (size_t i = 0; i < bw.max_iterations; i++) {
+ *         ... (E-step, likelihood)
+ *         convergence.update(i, neg_log_likelihood_sum);
+ *         ... (M-step)
+ *         if (convergence.stop()) break;
+ *     }
+ *     return convergence.converged_at();
+ */
+class BWconvergence
+{
+public:
+
+    BWconvergence(const BWdata& bw): bw(bw), converged(0), streak(0), old(0){
+        bw.iterations = 0;
+    }
+
+    /**
+     * Records the negative log likelihood of iteration i
+     */
+    inline void update(const size_t i, const double neg_log_likelihood_sum){
+        bw.iterations = i + 1;
+        if (i > 0 && fabs(neg_log_likelihood_sum - old) < bw.stopping.abs_tol + bw.stopping.rel_tol*fabs(old)) {
+            if (converged == 0) converged = i + 1;
+            streak++;
+        } else {
+            streak = 0;
+        }
+        old = neg_log_likelihood_sum;
+    }
+
+    /**
+     * True if the stopping policy of bw ends the run after the current iteration
+     */
+    inline bool stop() const{
+        return bw.stopping.early_stop && streak >= bw.stopping.patience && bw.iterations >= bw.stopping.min_iterations;
+    }
+
+    /**
+     * First iteration (1-based) that met the tolerance, 0 if none did
+     */
+    inline size_t converged_at() const{
+        return converged;
+    }
+
+private:
+
+    const BWdata& bw;
+    size_t converged;
+    size_t streak;
+    double old;
 };
 
 
@@ -174,11 +379,27 @@ struct BWdata {
  */
 typedef size_t(*compute_bw_func)(const BWdata& bw);
 
+// Optional features an implementation can declare when registering (bitmask)
+#define BW_FEATURE_STREAM_SIGMA 0x1 // Runs on a BWdata with stream_sigma set (no sigma buffer)
+#define BW_FEATURE_RAGGED       0x2 // Respects offsets, i.e. runs on sequences of different lengths
+#define BW_FEATURE_ANY_NM       0x4 // N and M do not have to be multiples of 16 (any K and T >= 2 as well)
+#define BW_FEATURE_FLOAT32      0x8 // Computes in single precision, thus only approximately equal to the baseline
+#define BW_FEATURE_CHECKPOINT   0x10 // Runs on a BWdata with checkpoint set (no alpha, beta and ggamma buffers)
+#define BW_FEATURE_PARALLEL_T   0x20 // Splits a sequence over the threads of the ThreadPool (long sequences, K = 1)
+#define BW_FEATURE_SPARSE       0x40 // Exploits zeros in trans_prob (left-to-right and pruned topologies)
+#define BW_FEATURE_BANDED       0x80 // Exploits a banded trans_prob (duration-like topologies)
+#define BW_FEATURE_LOG_SPACE    0x100 // Computes alpha and beta in log space (peaked emissions that underflow when scaled)
+#define BW_FEATURE_SPECIALIZED  0x200 // Has kernels compiled for fixed N (other N take a generic path)
+#define BW_FEATURE_BATCHED      0x400 // Advances blocks of sequences together (N a multiple of 4, many sequences)
+#define BW_FEATURE_INTERLEAVED  0x800 // Keeps groups of four sequences in the SIMD lanes (N a multiple of 4, many ragged sequences)
+
 struct RegisteredFunction{
     compute_bw_func func;
     std::string name;
     std::string description;
     bool transpose_emit_prob;
+    unsigned int features;
+    int isa; // BW_ISA_* level of the selected variant
 };
 
 /**
@@ -194,10 +415,27 @@ public:
      */
     static void set_baseline(compute_bw_func f, const std::string& name);
 
-    static void add_function(compute_bw_func f, const std::string& name, const std::string& description, const bool transpose_emit_prob = false);
+    /**
+     * Registers a function. If a function with the same name is registered for several
+     * ISA levels, only the highest level supported by the CPU (and not above BW_MAX_ISA) is kept
+     */
+    static void add_function(compute_bw_func f, const std::string& name, const std::string& description, const bool transpose_emit_prob = false, const unsigned int features = 0, const int isa = BW_ISA_GENERIC);
     
     static void printRegisteredFuncs();
 
+    /**
+     * The registered function with the given name (the selected ISA variant), NULL if there is none
+     */
+    static compute_bw_func find(const std::string& name);
+
+    /**
+     * Highest ISA level supported by the CPU (cpuid) and the OS, capped by the
+     * environment variable BW_MAX_ISA (generic, sse4.2, avx2 or avx512) if set
+     */
+    static int cpu_isa();
+
+    static const char* isa_name(const int isa);
+
     static size_t size()
     {
         return (*funcs).size();
@@ -208,34 +446,59 @@ public:
     static std::string baseline_name;
 };
 
+// The registration structs live in an anonymous namespace, such that the variants of
+// the same file compiled for different ISA levels do not share (weak) constructor symbols
+
 // Macro to register a function and a name that should be executed
 #define REGISTER_FUNCTION(f, name, description)                   \
-    static struct f##_                                            \
+    namespace {                                                   \
+    struct f##_                                                   \
     {                                                             \
         f##_()                                                    \
         {                                                         \
-            FuncRegister::add_function(f, name, description);     \
+            FuncRegister::add_function(f, name, description, false, 0, BW_ISA); \
         }                                                         \
-    } f##__BW_
+    };                                                            \
+    }                                                             \
+    static f##_ f##__BW_
 
 //Macro to register a function that requires emit_prob to be column major
 #define REGISTER_FUNCTION_TRANSPOSE_EMIT_PROB(f, name, description)                   \
-    static struct f##_                                            \
+    namespace {                                                   \
+    struct f##_                                                   \
+    {                                                             \
+        f##_()                                                    \
+        {                                                         \
+            FuncRegister::add_function(f, name, description, true, 0, BW_ISA); \
+        }                                                         \
+    };                                                            \
+    }                                                             \
+    static f##_ f##__BW_
+
+//Macro to register a function that supports optional features (BW_FEATURE_*)
+#define REGISTER_FUNCTION_FEATURES(f, name, description, transpose_emit_prob, features) \
+    namespace {                                                   \
+    struct f##_                                                   \
     {                                                             \
         f##_()                                                    \
         {                                                         \
-            FuncRegister::add_function(f, name, description, true);     \
+            FuncRegister::add_function(f, name, description, transpose_emit_prob, features, BW_ISA); \
         }                                                         \
-    } f##__BW_
+    };                                                            \
+    }                                                             \
+    static f##_ f##__BW_
 
 // Macro to register a function and a name that should be executed
 #define SET_BASELINE(f, name)                                     \
-    static struct f##_                                            \
+    namespace {                                                   \
+    struct f##_                                                   \
     {                                                             \
         f##_()                                                    \
         {                                                         \
             FuncRegister::set_baseline(f, name);                  \
         }                                                         \
-    } f##__BW_
+    };                                                            \
+    }                                                             \
+    static f##_ f##__BW_
 
 #endif /* __BW_COMMON_H */
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+#include "decoding.h"
+
+REGISTER_VITERBI_FUNCTION(viterbi_scalar, "viterbi-scalar", "Scalar max-product recursion in log space (reference)");
+REGISTER_POSTERIOR_FUNCTION(posterior_scalar, "posterior-scalar", "Scalar forward-backward pass (reference)");
+
+void bw_viterbi(const BWmodel& model, const BWsequences& sequences, size_t* paths, double* log_probabilities){
+    ViterbiRegister::best().func(model, sequences, paths, log_probabilities);
+}
+
+void viterbi_scalar(const BWmodel& model, const BWsequences& sequences, size_t* paths, double* log_probabilities){
+    const size_t N = model.N;
+    const size_t M = model.M;
+
+    size_t T_max = 0;
+    for (size_t k = 0; k < sequences.K; k++) {
+        assert(sequences.length(k) >= 1 && "Viterbi needs sequences of at least one time step");
+        T_max = std::max(T_max, sequences.length(k));
+    }
+
+    double* log_trans_prob = (double *)malloc(N*N * sizeof(double));
+    double* log_emit_prob = (double *)malloc(N*M * sizeof(double));
+    double* delta = (double *)malloc(2*N * sizeof(double));
+    size_t* psi = (size_t *)malloc(T_max*N * sizeof(size_t));
+    assert(log_trans_prob != NULL && log_emit_prob != NULL && delta != NULL && psi != NULL && "Failed to allocate memory");
+
+    for (size_t n = 0; n < N*N; n++) {
+        log_trans_prob[n] = bw_log(model.trans_prob[n]);
+    }
+    for (size_t n = 0; n < N*M; n++) {
+        log_emit_prob[n] = bw_log(model.emit_prob[n]);
+    }
+
+    for (size_t k = 0; k < sequences.K; k++) {
+        const size_t* observations = sequences.observations + sequences.offsets[k];
+        const size_t T = sequences.length(k);
+        double* delta_old = delta;
+        double* delta_new = delta + N;
+
+        // t = 0, base case
+        for (size_t n = 0; n < N; n++) {
+            delta_old[n] = bw_log(model.init_prob[n]) + log_emit_prob[n*M + observations[0]];
+        }
+
+        // recursion step
+        for (size_t t = 1; t < T; t++) {
+            for (size_t n0 = 0; n0 < N; n0++) {
+                double best = delta_old[0] + log_trans_prob[n0];
+                size_t arg = 0;
+                for (size_t n1 = 1; n1 < N; n1++) {
+                    const double candidate = delta_old[n1] + log_trans_prob[n1*N + n0];
+                    if (candidate > best) {
+                        best = candidate;
+                        arg = n1;
+                    }
+                }
+                delta_new[n0] = best + log_emit_prob[n0*M + observations[t]];
+                psi[t*N + n0] = arg;
+            }
+            double* swap = delta_old;
+            delta_old = delta_new;
+            delta_new = swap;
+        }
+
+        // backtracking
+        size_t state = 0;
+        for (size_t n = 1; n < N; n++) {
+            if (delta_old[n] > delta_old[state]) state = n;
+        }
+        log_probabilities[k] = delta_old[state];
+        size_t* path = paths + sequences.offsets[k];
+        path[T-1] = state;
+        for (size_t t = T-1; t > 0; t--) {
+            state = psi[t*N + state];
+            path[t-1] = state;
+        }
+    }
+
+    free(log_trans_prob);
+    free(log_emit_prob);
+    free(delta);
+    free(psi);
+}
+
+void bw_posterior(const BWmodel& model, const BWsequences& sequences, double* gamma, size_t* states){
+    PosteriorRegister::best().func(model, sequences, gamma, states);
+}
+
+void posterior_scalar(const BWmodel& model, const BWsequences& sequences, double* gamma, size_t* states){
+    const size_t N = model.N;
+    const size_t M = model.M;
+
+    size_t T_max = 0;
+    for (size_t k = 0; k < sequences.K; k++) {
+        T_max = std::max(T_max, sequences.length(k));
+    }
+
+    double* alpha = (double *)malloc(T_max*N * sizeof(double));
+    double* c_norm = (double *)malloc(T_max * sizeof(double));
+    double* beta = (double *)malloc(2*N * sizeof(double));
+    double* ggamma = (double *)malloc(N * sizeof(double));
+    assert(alpha != NULL && c_norm != NULL && beta != NULL && ggamma != NULL && "Failed to allocate memory");
+
+    for (size_t k = 0; k < sequences.K; k++) {
+        const size_t* observations = sequences.observations + sequences.offsets[k];
+        const size_t T = sequences.length(k);
+
+        // forward step (scaled as in the baseline)
+        for (size_t t = 0; t < T; t++) {
+            double c_sum = 0.0;
+            for (size_t n0 = 0; n0 < N; n0++) {
+                double alpha_temp;
+                if (t == 0) {
+                    alpha_temp = model.init_prob[n0];
+                } else {
+                    alpha_temp = 0.0;
+                    for (size_t n1 = 0; n1 < N; n1++) {
+                        alpha_temp += alpha[(t-1)*N + n1]*model.trans_prob[n1*N + n0];
+                    }
+                }
+                alpha[t*N + n0] = model.emit_prob[n0*M + observations[t]] * alpha_temp;
+                c_sum += alpha[t*N + n0];
+            }
+            c_norm[t] = 1.0/c_sum;
+            for (size_t n0 = 0; n0 < N; n0++) {
+                alpha[t*N + n0] *= c_norm[t];
+            }
+        }
+
+        // backward step, gamma per time step (normalized, from the last to the first)
+        double* beta_new = beta;
+        double* beta_old = beta + N;
+        for (size_t n = 0; n < N; n++) {
+            beta_new[n] = c_norm[T-1];
+        }
+        for (size_t t = T; t-- > 0; ) {
+            if (t < T-1) {
+                double* swap = beta_old;
+                beta_old = beta_new;
+                beta_new = swap;
+                for (size_t n0 = 0; n0 < N; n0++) {
+                    double beta_temp = 0.0;
+                    for (size_t n1 = 0; n1 < N; n1++) {
+                        beta_temp += beta_old[n1]*model.trans_prob[n0*N + n1]*model.emit_prob[n1*M + observations[t+1]];
+                    }
+                    beta_new[n0] = beta_temp*c_norm[t];
+                }
+            }
+
+            double g_sum = 0.0;
+            for (size_t n = 0; n < N; n++) {
+                ggamma[n] = alpha[t*N + n]*beta_new[n];
+                g_sum += ggamma[n];
+            }
+            size_t state = 0;
+            for (size_t n = 0; n < N; n++) {
+                ggamma[n] /= g_sum;
+                if (ggamma[n] > ggamma[state]) state = n;
+            }
+            if (gamma) {
+                for (size_t n = 0; n < N; n++) {
+                    gamma[(sequences.offsets[k] + t)*N + n] = ggamma[n];
+                }
+            }
+            if (states) {
+                states[sequences.offsets[k] + t] = state;
+            }
+        }
+    }
+
+    free(alpha);
+    free(c_norm);
+    free(beta);
+    free(ggamma);
+}
+
+double path_log_probability(const BWmodel& model, const BWsequences& sequences, const size_t k, const size_t* path){
+    const size_t N = model.N;
+    const size_t M = model.M;
+    const size_t* observations = sequences.observations + sequences.offsets[k];
+
+    double log_probability = bw_log(model.init_prob[path[0]]) + bw_log(model.emit_prob[path[0]*M + observations[0]]);
+    for (size_t t = 1; t < sequences.length(k); t++) {
+        log_probability += bw_log(model.trans_prob[path[t-1]*N + path[t]]) + bw_log(model.emit_prob[path[t]*M + observations[t]]);
+    }
+    return log_probability;
+}
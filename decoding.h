@@ -0,0 +1,93 @@
+/*
+    Decoding
+    Most likely state path (Viterbi) and posterior state marginals of many sequences under a
+    trained model. The model and the sequences are the ones of scoring.h.
+    Viterbi: max-product recursion in log space, no scaling is needed.
+    Posterior: one scaled forward-backward pass, without sigma, the M-step or iterations.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_DECODING_H)
+#define __BW_DECODING_H
+
+#include <cmath>
+
+#include "scoring.h"
+
+// log(0): finite, such that sums (and comparisons under -ffast-math) stay well defined
+#define BW_LOG_ZERO (-1e300)
+
+/**
+ * Natural logarithm of a probability, log(0) = BW_LOG_ZERO
+ */
+inline double bw_log(const double p){
+    return p > 0.0 ? log(p) : BW_LOG_ZERO;
+}
+
+/**
+ * Function interface of a Viterbi implementation:
+ * paths[offsets[k] + t] = state at time step t of the most likely path of sequence k
+ * (same layout as the observations) and log_probabilities[k] = log P(path, sequence k | model).
+ * Ties are broken towards the smallest state. Has to support any N and M and sequences of at
+ * least one time step (the path of an empty sequence is not defined).
+ */
+typedef void(*viterbi_func)(const BWmodel& model, const BWsequences& sequences, size_t* paths, double* log_probabilities);
+
+typedef RegisteredModelFunction<viterbi_func> RegisteredViterbiFunction;
+typedef ModelRegister<viterbi_func> ViterbiRegister;
+
+/**
+ * Function interface of a posterior decoding implementation, a single forward-backward pass:
+ * gamma[(offsets[k] + t)*N + n] = P(X_t = n | sequence k, model) (same layout as BWdata.ggamma)
+ * and states[offsets[k] + t] = argmax_n of it (ties towards the smallest state).
+ * Either output may be NULL, e.g. gamma to only get the states without writing K*T*N values.
+ * Has to support any N and M and sequences of at least two time steps (as the training).
+ */
+typedef void(*posterior_func)(const BWmodel& model, const BWsequences& sequences, double* gamma, size_t* states);
+
+typedef RegisteredModelFunction<posterior_func> RegisteredPosteriorFunction;
+typedef ModelRegister<posterior_func> PosteriorRegister;
+
+/**
+ * Decodes the sequences with the best registered implementation
+ */
+void bw_viterbi(const BWmodel& model, const BWsequences& sequences, size_t* paths, double* log_probabilities);
+
+/**
+ * Reference implementation (scalar), also registered as "viterbi-scalar"
+ */
+void viterbi_scalar(const BWmodel& model, const BWsequences& sequences, size_t* paths, double* log_probabilities);
+
+/**
+ * Posterior decoding with the best registered implementation
+ */
+void bw_posterior(const BWmodel& model, const BWsequences& sequences, double* gamma, size_t* states);
+
+/**
+ * Reference implementation (scalar), also registered as "posterior-scalar"
+ */
+void posterior_scalar(const BWmodel& model, const BWsequences& sequences, double* gamma, size_t* states);
+
+/**
+ * log P(path, sequence k | model) of a given path of sequence k
+ */
+double path_log_probability(const BWmodel& model, const BWsequences& sequences, const size_t k, const size_t* path);
+
+// Macro to register a Viterbi function
+#define REGISTER_VITERBI_FUNCTION(f, name, description) REGISTER_MODEL_FUNCTION(ViterbiRegister, f, name, description)
+
+// Macro to register a posterior decoding function
+#define REGISTER_POSTERIOR_FUNCTION(f, name, description) REGISTER_MODEL_FUNCTION(PosteriorRegister, f, name, description)
+
+#endif /* __BW_DECODING_H */
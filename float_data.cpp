@@ -0,0 +1,68 @@
+#include <cassert>
+
+#include "float_data.h"
+#include "workspace.h"
+
+BWdataFloat::BWdataFloat(const BWdata& bw): offsets(bw.offsets), observations(bw.observations), K(bw.K), N(bw.N), M(bw.M), bw(bw){
+    const size_t L = bw.total_length();
+    init_prob = (float *)bw_scratch_alloc(bw, "float/init_prob", N * sizeof(float));
+    trans_prob = (float *)bw_scratch_alloc(bw, "float/trans_prob", N*N * sizeof(float));
+    emit_prob = (float *)bw_scratch_alloc(bw, "float/emit_prob", M*N * sizeof(float));
+    c_norm = (float *)bw_scratch_alloc(bw, "float/c_norm", L * sizeof(float));
+    alpha = (float *)bw_scratch_alloc(bw, "float/alpha", L*N * sizeof(float));
+    beta = (float *)bw_scratch_alloc(bw, "float/beta", L*N * sizeof(float));
+    ggamma = (float *)bw_scratch_alloc(bw, "float/ggamma", L*N * sizeof(float));
+    gamma_sum = (float *)bw_scratch_alloc(bw, "float/gamma_sum", K*N * sizeof(float));
+    sigma_sum = (float *)bw_scratch_alloc(bw, "float/sigma_sum", K*N*N * sizeof(float));
+
+    for (size_t n0 = 0; n0 < N; n0++) {
+        init_prob[n0] = (float)bw.init_prob[n0];
+        for (size_t n1 = 0; n1 < N; n1++) {
+            trans_prob[n0*N + n1] = (float)bw.trans_prob[n0*N + n1];
+        }
+        for (size_t m = 0; m < M; m++) {
+            emit_prob[m*N + n0] = (float)bw.emit_prob[n0*M + m];
+        }
+    }
+}
+
+void BWdataFloat::store(const BWdata& bw) const{
+    assert(&bw == &this->bw && "Has to be stored to the BWdata it was created from");
+    const size_t L = bw.total_length();
+
+    for (size_t n0 = 0; n0 < N; n0++) {
+        bw.init_prob[n0] = init_prob[n0];
+        for (size_t n1 = 0; n1 < N; n1++) {
+            bw.trans_prob[n0*N + n1] = trans_prob[n0*N + n1];
+        }
+        for (size_t m = 0; m < M; m++) {
+            bw.emit_prob[n0*M + m] = emit_prob[m*N + n0];
+        }
+    }
+    for (size_t i = 0; i < L; i++) {
+        bw.c_norm[i] = c_norm[i];
+    }
+    for (size_t i = 0; i < L*N; i++) {
+        bw.alpha[i] = alpha[i];
+        bw.beta[i] = beta[i];
+        bw.ggamma[i] = ggamma[i];
+    }
+    for (size_t i = 0; i < K*N; i++) {
+        bw.gamma_sum[i] = gamma_sum[i];
+    }
+    for (size_t i = 0; i < K*N*N; i++) {
+        bw.sigma_sum[i] = sigma_sum[i];
+    }
+}
+
+BWdataFloat::~BWdataFloat(){
+    bw_scratch_free(bw, init_prob);
+    bw_scratch_free(bw, trans_prob);
+    bw_scratch_free(bw, emit_prob);
+    bw_scratch_free(bw, c_norm);
+    bw_scratch_free(bw, alpha);
+    bw_scratch_free(bw, beta);
+    bw_scratch_free(bw, ggamma);
+    bw_scratch_free(bw, gamma_sum);
+    bw_scratch_free(bw, sigma_sum);
+}
@@ -0,0 +1,84 @@
+/*
+    Single precision data
+    float32 variant of BWdata for the single precision implementations: the model and the
+    E-step buffers (alpha, beta, ggamma, ...) in float, i.e. half the memory and twice the
+    states per vector. The scaling by c_norm keeps all values in (0, 1] (c_norm itself
+    in float range), thus float is accurate enough for the training.
+    The observations and offsets are shared with the BWdata it is created from.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_FLOAT_DATA_H)
+#define __BW_FLOAT_DATA_H
+
+#include <cstdlib>
+
+#include "common.h"
+
+/**
+ * Same fields and layout as BWdata, except:
+ * - emit_prob is always [M][N] (transposed)
+ * - there is no sigma buffer (the implementations accumulate sigma_sum directly)
+ * - the negative log likelihoods are written to the BWdata (in double)
+ *
+ * The buffers are scratch buffers of the BWdata (see workspace.h), i.e. kept in its workspace if
+ * there is one. Usage:
+ *
+ *     BWdataFloat bwf(bw); // model converted to float
+ *     ... (training on bwf)
+ *     bwf.store(bw);       // model and E-step results written back in double
+ */
+struct BWdataFloat {
+    const size_t* offsets; //       [K+1]         (shared with the BWdata)
+    const size_t* observations; //  [K][T]        (shared with the BWdata)
+    float* init_prob; //            [N]
+    float* trans_prob; //           [N][N]
+    float* emit_prob; //            [M][N]
+    float* c_norm; //               [K][T]
+    float* alpha; //                [K][T][N]
+    float* beta; //                 [K][T][N]
+    float* ggamma; //               [K][T][N]
+    float* gamma_sum; //            [K][N]
+    float* sigma_sum; //            [K][N][N]
+
+    const size_t K;
+    const size_t N;
+    const size_t M;
+
+    /**
+     * Allocates the buffers and converts the model of bw to float
+     */
+    BWdataFloat(const BWdata& bw);
+
+    /**
+     * Writes the model (emit_prob as [N][M]) and the E-step buffers back to bw,
+     * the BWdata it was created from
+     */
+    void store(const BWdata& bw) const;
+
+    ~BWdataFloat();
+
+    inline size_t length(const size_t k) const{
+        return offsets[k+1] - offsets[k];
+    }
+
+    inline size_t total_length() const{
+        return offsets[K];
+    }
+
+private:
+    const BWdata& bw;
+};
+
+#endif /* __BW_FLOAT_DATA_H */
@@ -23,7 +23,6 @@ void initialize_uar(const BWdata& bw) {
     const size_t K = bw.K;
     const size_t N = bw.N;
     const size_t M = bw.M;
-    const size_t T = bw.T;
 
     // uniform at random set init_prob and trans_prob
     for (size_t n0 = 0; n0 < N; n0++) {
@@ -43,12 +42,12 @@ void initialize_uar(const BWdata& bw) {
     // uniform at random set observations
     // (well, not really u.a.r. but let's pretend)
     for (size_t k = 0; k < K; k++) {
-        for (size_t t = 0; t < T; t++) {
+        for (size_t t = 0; t < bw.length(k); t++) {
             // % T would be wrong, because the observation sequence over time 0 <= t < T
             // represents observations that access the emission states
             // emit_prob[n][observations[k][t]] in 0 <= m < M,
             // which is a categorical random variable
-            bw.observations[k*T + t] = t % M;
+            bw.observations[bw.offsets[k] + t] = t % M;
         }
     }
 }
@@ -57,7 +56,6 @@ void initialize_random(const BWdata& bw) {
     const size_t K = bw.K;
     const size_t N = bw.N;
     const size_t M = bw.M;
-    const size_t T = bw.T;
 
     double init_sum;
     double trans_sum;
@@ -111,12 +109,79 @@ void initialize_random(const BWdata& bw) {
 
     // fixed observation (can be changed to e.g. all 1 for verification)
     for (size_t k = 0; k < K; k++) {
-        for (size_t t = 0; t < T; t++) {
+        for (size_t t = 0; t < bw.length(k); t++) {
             // % T would be wrong, because the observation sequence over time 0 <= t < T
             // represents observations that access the emission states
             // emit_prob[n][observations[k][t]] in 0 <= m < M,
             // which is a categorical random variable
-            bw.observations[k*T + t] = rand() % M;
+            bw.observations[bw.offsets[k] + t] = rand() % M;
+        }
+    }
+}
+
+std::vector<size_t> random_sequence_lengths(const size_t K, const size_t T_min, const size_t T_max) {
+    std::vector<size_t> lengths(K);
+    for (size_t k = 0; k < K; k++) {
+        lengths.at(k) = T_min + rand() % (T_max - T_min + 1);
+    }
+    return lengths;
+}
+
+void sparsify_trans_prob(const BWdata& bw, const size_t nonzeros) {
+    const size_t N = bw.N;
+
+    for (size_t n0 = 0; n0 < N; n0++) {
+        double trans_sum = 0.0;
+        for (size_t n1 = 0; n1 < N; n1++) {
+            // distance from n0 to n1 in the left-to-right order
+            if ((n1 + N - n0) % N < nonzeros) {
+                trans_sum += bw.trans_prob[n0*N + n1];
+            } else {
+                bw.trans_prob[n0*N + n1] = 0.0;
+            }
+        }
+
+        // the row trans_prob[n0*N] must sum to 1.0
+        for (size_t n1 = 0; n1 < N; n1++) {
+            bw.trans_prob[n0*N + n1] /= trans_sum;
+        }
+    }
+}
+
+void bandify_trans_prob(const BWdata& bw, const size_t lower, const size_t upper) {
+    const size_t N = bw.N;
+
+    for (size_t n0 = 0; n0 < N; n0++) {
+        double trans_sum = 0.0;
+        for (size_t n1 = 0; n1 < N; n1++) {
+            if (n1 + lower >= n0 && n1 <= n0 + upper) {
+                trans_sum += bw.trans_prob[n0*N + n1];
+            } else {
+                bw.trans_prob[n0*N + n1] = 0.0;
+            }
+        }
+
+        // the row trans_prob[n0*N] must sum to 1.0
+        for (size_t n1 = 0; n1 < N; n1++) {
+            bw.trans_prob[n0*N + n1] /= trans_sum;
+        }
+    }
+}
+
+void peak_emit_prob(const BWdata& bw, const double floor) {
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+
+    for (size_t n = 0; n < N; n++) {
+        double emit_sum = 0.0;
+        for (size_t m = 0; m < M; m++) {
+            if (m != n % M) bw.emit_prob[n*M + m] *= floor;
+            emit_sum += bw.emit_prob[n*M + m];
+        }
+
+        // the row emit_prob[n*M] must sum to 1.0
+        for (size_t m = 0; m < M; m++) {
+            bw.emit_prob[n*M + m] /= emit_sum;
         }
     }
 }
@@ -232,8 +297,8 @@ void print_BWdata(const BWdata& bw) {
 
     printf("\nObservation Data (tip: shouldn't change after initialization):\n");
     for (size_t k = 0; k < bw.K; k++) {
-        for (size_t t = 0; t < bw.T; t++) {
-            printf("obs[k = %zu][t = %zu] = %zu\n", k, t, bw.observations[k*bw.T + t]);
+        for (size_t t = 0; t < bw.length(k); t++) {
+            printf("obs[k = %zu][t = %zu] = %zu\n", k, t, bw.observations[bw.offsets[k] + t]);
         }
     }
 
@@ -246,16 +311,16 @@ void print_BWdata(const BWdata& bw) {
 
     printf("\n(tip: Should only change during the forward_step):\n");
     for (size_t k = 0; k < bw.K; k++) {
-        for (size_t t = 0; t < bw.T; t++) {
-            printf("c_norm[k = %zu][t = %zu] = %f\n", k, t, bw.c_norm[k*bw.T + t]);
+        for (size_t t = 0; t < bw.length(k); t++) {
+            printf("c_norm[k = %zu][t = %zu] = %f\n", k, t, bw.c_norm[bw.offsets[k] + t]);
         }
     }
 
     printf("\n(tip: Should only change during the forward_step)\n");
     for (size_t k = 0; k < bw.K; k++) {
-        for (size_t t = 0; t < bw.T; t++) {
+        for (size_t t = 0; t < bw.length(k); t++) {
             for (size_t n = 0; n < bw.N; n++) {
-                printf("alpha[k = %zu][t = %zu][n = %zu] = %f\n", k, t, n, bw.alpha[(k*bw.T + t)*bw.N + n]);
+                printf("alpha[k = %zu][t = %zu][n = %zu] = %f\n", k, t, n, bw.alpha[(bw.offsets[k] + t)*bw.N + n]);
             }
         }
     }
@@ -263,41 +328,41 @@ void print_BWdata(const BWdata& bw) {
     printf("\ntip: Can be NaNs, overflow, underflow or vanish to zero (that's why we use scaling)\n");
     for (size_t k = 0; k < bw.K; k++) {
         double C_t = 1.0;
-        for (size_t t = 0; t < bw.T; t++) {
-            C_t *= bw.c_norm[k*bw.T + t];
+        for (size_t t = 0; t < bw.length(k); t++) {
+            C_t *= bw.c_norm[bw.offsets[k] + t];
             for (size_t n = 0; n < bw.N; n++) {
-                printf("DE-SCALEDalpha[k = %zu][t = %zu][n = %zu] = %f\n", k, t, n, bw.alpha[(k*bw.T + t)*bw.N + n]/C_t);
+                printf("DE-SCALEDalpha[k = %zu][t = %zu][n = %zu] = %f\n", k, t, n, bw.alpha[(bw.offsets[k] + t)*bw.N + n]/C_t);
             }
         }
     }
 
     printf("\n(tip: Should only change during the backward_step)\n");
     for (size_t k = 0; k < bw.K; k++) {
-        for (size_t t = 0; t < bw.T; t++) {
+        for (size_t t = 0; t < bw.length(k); t++) {
             for (size_t n = 0; n < bw.N; n++) {
-                printf("beta[k = %zu][t = %zu][n = %zu] = %f\n", k, t, n, bw.beta[(k*bw.T + t)*bw.N + n]);
+                printf("beta[k = %zu][t = %zu][n = %zu] = %f\n", k, t, n, bw.beta[(bw.offsets[k] + t)*bw.N + n]);
             }
         }
     }
 
     printf("\ntip: Can be NaNs, overflow, underflow or vanish to zero (that's why we use scaling)\n");
     for (size_t k = 0; k < bw.K; k++) {
-        for (size_t t = 0; t < bw.T; t++) {
+        for (size_t t = 0; t < bw.length(k); t++) {
             double D_t = 1.0;
-            for (size_t tt = t; tt < bw.T; tt++) {
-                D_t *= bw.c_norm[k*bw.T + tt];
+            for (size_t tt = t; tt < bw.length(k); tt++) {
+                D_t *= bw.c_norm[bw.offsets[k] + tt];
             }
             for (size_t n = 0; n < bw.N; n++) {
-                printf("DE-SCALEDbeta[k = %zu][t = %zu][n = %zu] = %f\n", k, t, n, bw.beta[(k*bw.T + t)*bw.N + n]/D_t);
+                printf("DE-SCALEDbeta[k = %zu][t = %zu][n = %zu] = %f\n", k, t, n, bw.beta[(bw.offsets[k] + t)*bw.N + n]/D_t);
             }
         }
     }
 
     //printf("\nggamma:\n");
     for (size_t k = 0; k < bw.K; k++) {
-        for (size_t t = 0; t < bw.T; t++) {
+        for (size_t t = 0; t < bw.length(k); t++) {
             for (size_t n = 0; n < bw.N; n++) {
-                printf("ggamma[k = %zu][t = %zu][n = %zu] = %f\n", k, t, n, bw.ggamma[(k*bw.T + t)*bw.N + n]);
+                printf("ggamma[k = %zu][t = %zu][n = %zu] = %f\n", k, t, n, bw.ggamma[(bw.offsets[k] + t)*bw.N + n]);
             }
         }
     }
@@ -310,11 +375,11 @@ void print_BWdata(const BWdata& bw) {
     }
 
     //printf("\nsigma:\n");
-    for(size_t k = 0; k < bw.K; k++) {
-        for (size_t t = 0; t < bw.T; t++) {
+    for(size_t k = 0; bw.sigma && k < bw.K; k++) {
+        for (size_t t = 0; t < bw.length(k); t++) {
             for (size_t n0 = 0; n0 < bw.N; n0++) {
                 for(size_t n1 = 0; n1 < bw.N; n1++) {
-                    printf("sigma[k = %zu][t = %zu][n0 = %zu][n1 = %zu] = %f\n", k, t, n0, n1, bw.sigma[((k*bw.T + t)*bw.N + n0)*bw.N + n1]);
+                    printf("sigma[k = %zu][t = %zu][n0 = %zu][n1 = %zu] = %f\n", k, t, n0, n1, bw.sigma[((bw.offsets[k] + t)*bw.N + n0)*bw.N + n1]);
                 }
             }
         }
@@ -465,6 +530,13 @@ bool is_BWdata_equal(const BWdata& bw1, const BWdata& bw2) {
         return false;
     }
 
+    for (size_t k = 0; k <= bw1.K; k++) {
+        if (bw1.offsets[k] != bw2.offsets[k]) {
+            PRINT_BWDATA_MISSMATCH("offsets1[%zu] = %zu is not %zu = offsets2[%zu]\n", k, bw1.offsets[k], bw2.offsets[k], k);
+            return false;
+        }
+    }
+
     if (bw1.max_iterations != bw2.max_iterations) {
         PRINT_BWDATA_MISSMATCH("maxIterations1 = %zu is not %zu = maxIterations2\n",
             bw1.max_iterations, bw2.max_iterations
@@ -476,7 +548,6 @@ bool is_BWdata_equal(const BWdata& bw1, const BWdata& bw2) {
 
     const size_t K = bw1.K;
     const size_t N = bw1.N;
-    const size_t T = bw1.T;
     const size_t max_iterations = bw1.max_iterations;
 
     for (size_t it = 0; it < max_iterations; it++) {
@@ -493,8 +564,8 @@ bool is_BWdata_equal(const BWdata& bw1, const BWdata& bw2) {
     errors_local = 0;
 
     for (size_t k = 0; k < K; k++) {
-        for (size_t t = 0; t < T; t++) {
-            const size_t index = k*T + t;
+        for (size_t t = 0; t < bw1.length(k); t++) {
+            const size_t index = bw1.offsets[k] + t;
             const double err_abs_diff = fabs(bw1.c_norm[index] - bw2.c_norm[index]);
             if (!(err_abs_diff < EPSILON)) {
                 errors_local++;
@@ -507,10 +578,11 @@ bool is_BWdata_equal(const BWdata& bw1, const BWdata& bw2) {
     errors_total += errors_local;
     errors_local = 0;
 
-    for (size_t k = 0; k < K; k++) {
-        for (size_t t = 0; t < T; t++) {
+    // alpha, beta and ggamma can only be compared if neither BWdata checkpoints
+    for (size_t k = 0; bw1.alpha && bw2.alpha && k < K; k++) {
+        for (size_t t = 0; t < bw1.length(k); t++) {
             for (size_t n = 0; n < N; n++) {
-                const size_t index = (k*T + t)*N + n;
+                const size_t index = (bw1.offsets[k] + t)*N + n;
                 const double err_abs_diff = fabs(bw1.alpha[index] - bw2.alpha[index]);
                 if (!(err_abs_diff < EPSILON)) {
                     errors_local++;
@@ -524,10 +596,10 @@ bool is_BWdata_equal(const BWdata& bw1, const BWdata& bw2) {
     errors_total += errors_local;
     errors_local = 0;
 
-    for (size_t k = 0; k < K; k++) {
-        for (size_t t = 0; t < T; t++) {
+    for (size_t k = 0; bw1.beta && bw2.beta && k < K; k++) {
+        for (size_t t = 0; t < bw1.length(k); t++) {
             for (size_t n = 0; n < N; n++) {
-                const size_t index = (k*T + t)*N + n;
+                const size_t index = (bw1.offsets[k] + t)*N + n;
                 const double err_abs_diff = fabs(bw1.beta[index] - bw2.beta[index]);
                 if (!(err_abs_diff < EPSILON)) {
                     errors_local++;
@@ -541,10 +613,10 @@ bool is_BWdata_equal(const BWdata& bw1, const BWdata& bw2) {
     errors_total += errors_local;
     errors_local = 0;
 
-    for (size_t k = 0; k < K; k++) {
-        for (size_t t = 0; t < T; t++) {
+    for (size_t k = 0; bw1.ggamma && bw2.ggamma && k < K; k++) {
+        for (size_t t = 0; t < bw1.length(k); t++) {
             for (size_t n = 0; n < N; n++) {
-                const size_t index = (k*T + t)*N + n;
+                const size_t index = (bw1.offsets[k] + t)*N + n;
                 const double err_abs_diff = fabs(bw1.ggamma[index] - bw2.ggamma[index]);
                 if (!(err_abs_diff < EPSILON)) {
                     errors_local++;
@@ -573,11 +645,13 @@ bool is_BWdata_equal(const BWdata& bw1, const BWdata& bw2) {
     errors_total += errors_local;
     errors_local = 0;
 
-    for(size_t k = 0; k < K; k++) {
-        for (size_t t = 0; t < T; t++) {
+    // sigma can only be compared if neither BWdata streams sigma;
+    // there is no transition from the last time step, its sigma is never written
+    for(size_t k = 0; bw1.sigma && bw2.sigma && k < K; k++) {
+        for (size_t t = 0; t + 1 < bw1.length(k); t++) {
             for (size_t n0 = 0; n0 < N; n0++) {
                 for(size_t n1 = 0; n1 < N; n1++) {
-                    const size_t index =((k*T + t)*N + n0)*N + n1;
+                    const size_t index =((bw1.offsets[k] + t)*N + n0)*N + n1;
                     const double err_abs_diff = fabs(bw1.sigma[index] - bw2.sigma[index]);
                     if (!(err_abs_diff < EPSILON)) {
                         errors_local++;
@@ -40,6 +40,31 @@ void initialize_uar(const BWdata& bw);
  */
 void initialize_random(const BWdata& bw);
 
+/**
+ * Draws K sequence lengths uniform at random from [T_min, T_max].
+ * Used to create a ragged BWdata (see BWdata constructor), which is then initialized as usual.
+ */
+std::vector<size_t> random_sequence_lengths(const size_t K, const size_t T_min, const size_t T_max);
+
+/**
+ * Prunes the (initialized) trans_prob of the given BWdata to a cyclic left-to-right topology:
+ * row n0 keeps the transitions to n0, n0+1, ..., n0+nonzeros-1 (mod N) and is renormalized.
+ * Every state stays reachable, so the baseline does not degenerate.
+ */
+void sparsify_trans_prob(const BWdata& bw, const size_t nonzeros);
+
+/**
+ * Prunes the (initialized) trans_prob of the given BWdata to a band: row n0 keeps the transitions
+ * to n0-lower, ..., n0+upper (within 0 and N-1) and is renormalized.
+ */
+void bandify_trans_prob(const BWdata& bw, const size_t lower, const size_t upper);
+
+/**
+ * Makes the (initialized) emit_prob of the given BWdata peaked: row n keeps one observation
+ * (n mod M), all others are scaled down to at most floor and the row is renormalized.
+ */
+void peak_emit_prob(const BWdata& bw, const double floor);
+
 /**
  * Checks and verifies that BWdata has the following properties:
  * - Initial distribution sums to 1.0
@@ -91,6 +116,8 @@ bool is_BWdata_equal_only_probabilities(const BWdata& bw1, const BWdata& bw2);
 
 /**
  * Compares all fields of the two given BWdata structs (considering EPSILON)
+ * sigma is skipped if one of the structs streams sigma (stream_sigma), alpha, beta and ggamma
+ * if one of them checkpoints (checkpoint)
  *
  * Returns: true if both structs contain the same data up to EPSILON
  * */
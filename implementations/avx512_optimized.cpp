@@ -0,0 +1,355 @@
+/*
+    AVX-512 implementation
+    8-wide doubles with mask registers: N and M do not have to be multiples of 16
+    (or of anything). The model parameters are copied into zero-padded scratch matrices
+    with a row stride of Np = N rounded up to 8, such that all kernels run on full vectors
+    and only the accesses to the BWdata arrays (row stride N) need masked loads/stores.
+    Sums over n use _mm512_reduce_add_pd instead of hand-written hadd/permute reductions.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+
+#include "../common.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+#include "../likelihood.h"
+
+#if BW_ISA < BW_ISA_AVX512
+#error "avx512_optimized.cpp has to be compiled for BW_ISA_AVX512 (see KERNELS_AVX512 in CMakeLists.txt)"
+#endif
+
+// gcc 12 warns about the intentionally undefined vectors inside _mm512_reduce_*_pd
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+/**
+ * Zero-padded scratch data, row stride Np
+ */
+struct Avx512Scratch {
+    size_t Np;
+    double* trans; //       [N][Np]     trans_prob
+    double* trans_t; //     [N][Np]     trans_prob transposed
+    double* emit; //        [M][Np]     emit_prob (already [M][N] in the BWdata)
+    double* beta_emit; //   [Np]        beta[t+1] .* emit[obs[t+1]]
+    double* vec; //         [Np]        result of a vector-matrix product
+    double* outer; //       [N][Np]     sum_t alpha[t][n0]*beta_emit[n1] of the current sequence
+    double* numerator; //   [M][Np]     sum_k sum_{t : obs[k][t] == m} ggamma[k][t][n]
+    double* init; //        [Np]        sum_k ggamma[k][0][n]
+    double* trans_denom; // [Np]        sum_k sum_{t < T-1} ggamma[k][t][n]
+    double* emit_denom; //  [Np]        sum_k sum_{t} ggamma[k][t][n]
+};
+
+static void forward_step_avx512(const BWdata& bw, const Avx512Scratch& s, const size_t k);
+static void backward_step_avx512(const BWdata& bw, const Avx512Scratch& s, const size_t k);
+static void accumulate_avx512(const BWdata& bw, const Avx512Scratch& s, const size_t k);
+static void update_avx512(const BWdata& bw, const Avx512Scratch& s);
+static size_t comp_bw_avx512(const BWdata& bw);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_avx512, "avx512", "AVX-512: masked 8-wide kernels, any N and M", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_ANY_NM);
+
+
+/**
+ * Mask of the valid lanes of the vector starting at n (all lanes except in the tail)
+ */
+static inline __mmask8 lane_mask(const size_t n, const size_t N) {
+    return (n + 8 <= N) ? (__mmask8)0xFF : (__mmask8)((1u << (N - n)) - 1);
+}
+
+/**
+ * out[0..Np) = sum_{r < rows} x[r] * A[r][0..Np), the padding lanes of A have to be zero
+ */
+static inline void vector_matrix(const double* x, const double* A, double* out, const size_t rows, const size_t Np) {
+    size_t j = 0;
+    for (; j + 32 <= Np; j += 32) {
+        __m512d acc0 = _mm512_setzero_pd();
+        __m512d acc1 = _mm512_setzero_pd();
+        __m512d acc2 = _mm512_setzero_pd();
+        __m512d acc3 = _mm512_setzero_pd();
+        for (size_t r = 0; r < rows; r++) {
+            const __m512d xr = _mm512_set1_pd(x[r]);
+            const double* row = A + r*Np + j;
+            acc0 = _mm512_fmadd_pd(xr, _mm512_load_pd(row), acc0);
+            acc1 = _mm512_fmadd_pd(xr, _mm512_load_pd(row + 8), acc1);
+            acc2 = _mm512_fmadd_pd(xr, _mm512_load_pd(row + 16), acc2);
+            acc3 = _mm512_fmadd_pd(xr, _mm512_load_pd(row + 24), acc3);
+        }
+        _mm512_store_pd(out + j, acc0);
+        _mm512_store_pd(out + j + 8, acc1);
+        _mm512_store_pd(out + j + 16, acc2);
+        _mm512_store_pd(out + j + 24, acc3);
+    }
+    for (; j < Np; j += 8) {
+        __m512d acc = _mm512_setzero_pd();
+        for (size_t r = 0; r < rows; r++) {
+            acc = _mm512_fmadd_pd(_mm512_set1_pd(x[r]), _mm512_load_pd(A + r*Np + j), acc);
+        }
+        _mm512_store_pd(out + j, acc);
+    }
+}
+
+
+static size_t comp_bw_avx512(const BWdata& bw){
+    BWconvergence convergence(bw);
+    double neg_log_likelihood_sum;
+
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+
+    Avx512Scratch s;
+    s.Np = (N + 7) & ~(size_t)7;
+    const size_t Np = s.Np;
+    const size_t total = 3*N*Np + 2*M*Np + 5*Np;
+    double* storage = (double *)bw_scratch_alloc(bw, "avx512/storage", total*sizeof(double));
+    assert(storage != nullptr && "Failed to allocate memory");
+    memset(storage, 0, total*sizeof(double));
+    s.trans = storage;
+    s.trans_t = s.trans + N*Np;
+    s.outer = s.trans_t + N*Np;
+    s.emit = s.outer + N*Np;
+    s.numerator = s.emit + M*Np;
+    s.beta_emit = s.numerator + M*Np;
+    s.vec = s.beta_emit + Np;
+    s.init = s.vec + Np;
+    s.trans_denom = s.init + Np;
+    s.emit_denom = s.trans_denom + Np;
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+
+        // padded copies of the current parameters (the padding stays zero)
+        Instrumentation::phase(BW_PHASE_FORWARD);
+        for (size_t n0 = 0; n0 < N; n0++) {
+            for (size_t n1 = 0; n1 < N; n1++) {
+                s.trans[n0*Np + n1] = bw.trans_prob[n0*N + n1];
+                s.trans_t[n1*Np + n0] = bw.trans_prob[n0*N + n1];
+            }
+        }
+        for (size_t m = 0; m < M; m++) {
+            memcpy(s.emit + m*Np, bw.emit_prob + m*N, N*sizeof(double));
+        }
+        memset(s.numerator, 0, M*Np*sizeof(double));
+        memset(s.init, 0, 3*Np*sizeof(double));
+
+        neg_log_likelihood_sum = 0.0;
+        for (size_t k = 0; k < bw.K; k++) {
+            Instrumentation::phase(BW_PHASE_FORWARD);
+            forward_step_avx512(bw, s, k);
+            // sigma and gamma are fused into the backward step
+            Instrumentation::phase(BW_PHASE_BACKWARD);
+            backward_step_avx512(bw, s, k);
+            Instrumentation::phase(BW_PHASE_GAMMA);
+            accumulate_avx512(bw, s, k);
+
+            Instrumentation::phase(BW_PHASE_LIKELIHOOD);
+            // one log per sequence, the exponents of the products are tracked (likelihood.h)
+            neg_log_likelihood_sum += likelihood_log(bw.c_norm + bw.offsets[k], bw.length(k));
+        }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        // all three updates are fused
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        update_avx512(bw, s);
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bw_scratch_free(bw, storage);
+
+    return convergence.converged_at();
+}
+
+
+static inline void forward_step_avx512(const BWdata& bw, const Avx512Scratch& s, const size_t k) {
+    const size_t N = bw.N;
+    const size_t Np = s.Np;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    double* alpha = bw.alpha + kT*N;
+    double* c_norm = bw.c_norm + kT;
+
+    // t = 0, base case
+    const double* emit = s.emit + observations[0]*Np;
+    __m512d c_sum = _mm512_setzero_pd();
+    for (size_t n = 0; n < N; n += 8) {
+        const __mmask8 mask = lane_mask(n, N);
+        const __m512d a = _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, bw.init_prob + n), _mm512_load_pd(emit + n));
+        _mm512_mask_storeu_pd(alpha + n, mask, a);
+        c_sum = _mm512_add_pd(c_sum, a);
+    }
+    double c = 1.0/_mm512_reduce_add_pd(c_sum);
+    c_norm[0] = c;
+    __m512d c_vec = _mm512_set1_pd(c);
+    for (size_t n = 0; n < N; n += 8) {
+        const __mmask8 mask = lane_mask(n, N);
+        _mm512_mask_storeu_pd(alpha + n, mask, _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, alpha + n), c_vec));
+    }
+
+    // recursion step: alpha[t] = (alpha[t-1] * trans_prob) .* emit_prob[obs[t]]
+    for (size_t t = 1; t < T; t++) {
+        double* alpha_t = alpha + t*N;
+        emit = s.emit + observations[t]*Np;
+        vector_matrix(alpha + (t-1)*N, s.trans, s.vec, N, Np);
+
+        // padding lanes are zero, no need to mask the sum
+        c_sum = _mm512_setzero_pd();
+        for (size_t n = 0; n < Np; n += 8) {
+            const __m512d a = _mm512_mul_pd(_mm512_load_pd(s.vec + n), _mm512_load_pd(emit + n));
+            _mm512_store_pd(s.vec + n, a);
+            c_sum = _mm512_add_pd(c_sum, a);
+        }
+        c = 1.0/_mm512_reduce_add_pd(c_sum);
+        c_norm[t] = c;
+        c_vec = _mm512_set1_pd(c);
+        for (size_t n = 0; n < N; n += 8) {
+            _mm512_mask_storeu_pd(alpha_t + n, lane_mask(n, N), _mm512_mul_pd(_mm512_load_pd(s.vec + n), c_vec));
+        }
+    }
+}
+
+
+static inline void backward_step_avx512(const BWdata& bw, const Avx512Scratch& s, const size_t k) {
+    const size_t N = bw.N;
+    const size_t Np = s.Np;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    const double* alpha = bw.alpha + kT*N;
+    const double* c_norm = bw.c_norm + kT;
+    double* beta = bw.beta + kT*N;
+    double* ggamma = bw.ggamma + kT*N;
+
+    // t = T-1, base case
+    const __m512d c_last = _mm512_set1_pd(c_norm[T-1]);
+    for (size_t n = 0; n < N; n += 8) {
+        const __mmask8 mask = lane_mask(n, N);
+        _mm512_mask_storeu_pd(beta + (T-1)*N + n, mask, c_last);
+        _mm512_mask_storeu_pd(ggamma + (T-1)*N + n, mask, _mm512_maskz_loadu_pd(mask, alpha + (T-1)*N + n));
+    }
+    memset(s.outer, 0, N*Np*sizeof(double));
+
+    // recursion step
+    for (int t = T-2; t >= 0; t--) {
+        const double* emit = s.emit + observations[t+1]*Np;
+        const double* alpha_t = alpha + t*N;
+        for (size_t n = 0; n < N; n += 8) {
+            const __mmask8 mask = lane_mask(n, N);
+            _mm512_store_pd(s.beta_emit + n, _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, beta + (t+1)*N + n), _mm512_load_pd(emit + n)));
+        }
+
+        // beta_temp[n0] = sum_n1 trans_prob[n0][n1]*beta_emit[n1]
+        vector_matrix(s.beta_emit, s.trans_t, s.vec, N, Np);
+        const __m512d c = _mm512_set1_pd(c_norm[t]);
+        for (size_t n = 0; n < N; n += 8) {
+            const __mmask8 mask = lane_mask(n, N);
+            const __m512d beta_temp = _mm512_load_pd(s.vec + n);
+            _mm512_mask_storeu_pd(beta + t*N + n, mask, _mm512_mul_pd(beta_temp, c));
+            _mm512_mask_storeu_pd(ggamma + t*N + n, mask, _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, alpha_t + n), beta_temp));
+        }
+
+        // sigma[t][n0][n1] = alpha[t][n0]*trans_prob[n0][n1]*beta_emit[n1]; trans_prob is
+        // factored out of the sum over t and applied once per sequence
+        double* sigma_t = bw.stream_sigma ? nullptr : bw.sigma + (kT + t)*N*N;
+        for (size_t n0 = 0; n0 < N; n0++) {
+            const __m512d a = _mm512_set1_pd(alpha_t[n0]);
+            double* outer_row = s.outer + n0*Np;
+            for (size_t n1 = 0; n1 < Np; n1 += 8) {
+                _mm512_store_pd(outer_row + n1, _mm512_fmadd_pd(a, _mm512_load_pd(s.beta_emit + n1), _mm512_load_pd(outer_row + n1)));
+            }
+            if (sigma_t) {
+                for (size_t n1 = 0; n1 < N; n1 += 8) {
+                    const __m512d st = _mm512_mul_pd(_mm512_mul_pd(a, _mm512_load_pd(s.trans + n0*Np + n1)), _mm512_load_pd(s.beta_emit + n1));
+                    _mm512_mask_storeu_pd(sigma_t + n0*N + n1, lane_mask(n1, N), st);
+                }
+            }
+        }
+    }
+
+    double* sigma_sum = bw.sigma_sum + k*N*N;
+    for (size_t n0 = 0; n0 < N; n0++) {
+        for (size_t n1 = 0; n1 < N; n1 += 8) {
+            const __m512d ss = _mm512_mul_pd(_mm512_load_pd(s.trans + n0*Np + n1), _mm512_load_pd(s.outer + n0*Np + n1));
+            _mm512_mask_storeu_pd(sigma_sum + n0*N + n1, lane_mask(n1, N), ss);
+        }
+    }
+}
+
+
+static inline void accumulate_avx512(const BWdata& bw, const Avx512Scratch& s, const size_t k) {
+    const size_t N = bw.N;
+    const size_t Np = s.Np;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    const double* ggamma = bw.ggamma + kT*N;
+    double* gamma_sum = bw.gamma_sum + k*N;
+
+    for (size_t n = 0; n < N; n += 8) {
+        const __mmask8 mask = lane_mask(n, N);
+        __m512d g_sum = _mm512_setzero_pd();
+        for (size_t t = 0; t < T-1; t++) {
+            const __m512d g = _mm512_maskz_loadu_pd(mask, ggamma + t*N + n);
+            double* numerator = s.numerator + observations[t]*Np + n;
+            _mm512_store_pd(numerator, _mm512_add_pd(_mm512_load_pd(numerator), g));
+            g_sum = _mm512_add_pd(g_sum, g);
+        }
+        _mm512_store_pd(s.init + n, _mm512_add_pd(_mm512_load_pd(s.init + n), _mm512_maskz_loadu_pd(mask, ggamma + n)));
+        _mm512_store_pd(s.trans_denom + n, _mm512_add_pd(_mm512_load_pd(s.trans_denom + n), g_sum));
+
+        // add last time step (denominator of emit_prob)
+        const __m512d g = _mm512_maskz_loadu_pd(mask, ggamma + (T-1)*N + n);
+        double* numerator = s.numerator + observations[T-1]*Np + n;
+        _mm512_store_pd(numerator, _mm512_add_pd(_mm512_load_pd(numerator), g));
+        g_sum = _mm512_add_pd(g_sum, g);
+        _mm512_mask_storeu_pd(gamma_sum + n, mask, g_sum);
+        _mm512_store_pd(s.emit_denom + n, _mm512_add_pd(_mm512_load_pd(s.emit_denom + n), g_sum));
+    }
+}
+
+
+static inline void update_avx512(const BWdata& bw, const Avx512Scratch& s) {
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+    const size_t Np = s.Np;
+
+    const __m512d K_inv = _mm512_set1_pd(1.0/bw.K);
+    for (size_t n = 0; n < N; n += 8) {
+        _mm512_mask_storeu_pd(bw.init_prob + n, lane_mask(n, N), _mm512_mul_pd(_mm512_load_pd(s.init + n), K_inv));
+    }
+
+    // trans_prob[n0][n1] = sum_k sigma_sum[k][n0][n1] / sum_k gamma_sum[k][n0]
+    for (size_t n0 = 0; n0 < N; n0++) {
+        for (size_t n1 = 0; n1 < N; n1 += 8) {
+            const __mmask8 mask = lane_mask(n1, N);
+            __m512d numerator = _mm512_setzero_pd();
+            for (size_t k = 0; k < bw.K; k++) {
+                numerator = _mm512_add_pd(numerator, _mm512_maskz_loadu_pd(mask, bw.sigma_sum + (k*N + n0)*N + n1));
+            }
+            _mm512_mask_storeu_pd(bw.trans_prob + n0*N + n1, mask, _mm512_div_pd(numerator, _mm512_set1_pd(s.trans_denom[n0])));
+        }
+    }
+
+    // emit_prob is stored transposed ([M][N])
+    for (size_t n = 0; n < N; n += 8) {
+        const __mmask8 mask = lane_mask(n, N);
+        const __m512d denominator_inv = _mm512_div_pd(_mm512_set1_pd(1.0), _mm512_mask_blend_pd(mask, _mm512_set1_pd(1.0), _mm512_load_pd(s.emit_denom + n)));
+        for (size_t m = 0; m < M; m++) {
+            _mm512_mask_storeu_pd(bw.emit_prob + m*N + n, mask, _mm512_mul_pd(_mm512_load_pd(s.numerator + m*Np + n), denominator_inv));
+        }
+    }
+}
@@ -0,0 +1,313 @@
+/*
+    Banded transitions implementation
+    For structured models where state n0 only transitions to n0-lower <= n1 <= n0+upper
+    (e.g. duration-like topologies). trans_prob is stored by diagonals (banded_transitions.h),
+    the band is taken from trans_prob at the start of a run (it never grows).
+    Forward, backward, sigma_sum and the update of trans_prob run over the diagonals,
+    4 columns at a time, i.e. O(N*(lower+upper+1)) instead of O(N*N) per time step:
+
+        alpha[t][n1]  = sum_o alpha[t-1][n1-o] * diagonal(o)[n1]
+        beta[t][n0]   = sum_o diagonal(o)[n0+o] * beta[t+1][n0+o] * emit_prob[n0+o]
+        sigma_o[n1]  += alpha[t][n1-o] * diagonal(o)[n1] * beta[t+1][n1] * emit_prob[n1]
+
+    The vectors read at shifted indices are kept in zero padded scratch rows.
+    Requires N to be a multiple of 4, any M, K and T >= 2 (and ragged sequences).
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+
+#include "../common.h"
+#include "../likelihood.h"
+#include "../banded_transitions.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+
+// local buffers of one run, passed along such that concurrent runs don't share them
+struct BandedScratch {
+    double* alpha_pad; //            [margin+N+margin]   alpha[t-1] (forward) or alpha[t] (sigma), zero padded
+    double* beta_emit_pad; //        [margin+N+margin]   beta[t+1][n] * emit_prob[y_(t+1)][n], zero padded
+    double* denominator_pad; //      [margin+N+margin]   1/sum of ggamma for the update of trans_prob, zero padded
+    double* sigma_band; //           [width][stride]     sigma_sum of the current sequence by diagonal
+    double* sigma_band_sum; //       [width][stride]     sigma_sum of all sequences by diagonal
+    double* gamma0_sum; //           [N]                 sum of ggamma[k][0] over all k
+    double* gamma_last; //           [K][N]              ggamma[k][T-1]
+    double* numerator_sum; //        [M][N]              sum of ggamma[k][t] over all k and t with y_t = m
+    double* denominator_sum; //      [N]
+};
+
+static size_t comp_bw_banded(const BWdata& bw);
+static inline double forward_banded(const BWdata& bw, const BWbandedTransitions& trans, const BandedScratch& scratch, const size_t k);
+static inline void backward_banded(const BWdata& bw, const BWbandedTransitions& trans, const BandedScratch& scratch, const size_t k);
+static inline void update_banded(const BWdata& bw, const BWbandedTransitions& trans, const BandedScratch& scratch);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_banded, "banded", "Banded trans_prob: forward, backward and sigma by diagonals", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_BANDED);
+
+
+static size_t comp_bw_banded(const BWdata& bw){
+    assert(bw.N % 4 == 0 && "N has to be a multiple of 4");
+    BWconvergence convergence(bw);
+    const size_t N = bw.N;
+
+    BWbandedTransitions trans(bw);
+    trans.compress();
+    const size_t padded = trans.margin + N + trans.margin;
+
+    BandedScratch scratch;
+    scratch.alpha_pad = (double *)bw_scratch_alloc(bw, "banded/alpha_pad", padded * sizeof(double));
+    scratch.beta_emit_pad = (double *)bw_scratch_alloc(bw, "banded/beta_emit_pad", padded * sizeof(double));
+    scratch.denominator_pad = (double *)bw_scratch_alloc(bw, "banded/denominator_pad", padded * sizeof(double));
+    scratch.sigma_band = (double *)bw_scratch_alloc(bw, "banded/sigma_band", trans.width*trans.stride * sizeof(double));
+    scratch.sigma_band_sum = (double *)bw_scratch_alloc(bw, "banded/sigma_band_sum", trans.width*trans.stride * sizeof(double));
+    scratch.gamma0_sum = (double *)bw_scratch_alloc(bw, "banded/gamma0_sum", N * sizeof(double));
+    scratch.gamma_last = (double *)bw_scratch_alloc(bw, "banded/gamma_last", bw.K*N * sizeof(double));
+    scratch.numerator_sum = (double *)bw_scratch_alloc(bw, "banded/numerator_sum", bw.M*N * sizeof(double));
+    scratch.denominator_sum = (double *)bw_scratch_alloc(bw, "banded/denominator_sum", N * sizeof(double));
+    memset(scratch.alpha_pad, 0, padded * sizeof(double));
+    memset(scratch.beta_emit_pad, 0, padded * sizeof(double));
+    memset(scratch.denominator_pad, 0, padded * sizeof(double));
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+        memset(scratch.gamma0_sum, 0, N * sizeof(double));
+        memset(scratch.numerator_sum, 0, bw.M*N * sizeof(double));
+        memset(scratch.sigma_band_sum, 0, trans.width*trans.stride * sizeof(double));
+
+        double neg_log_likelihood_sum = 0.0;
+        for (size_t k = 0; k < bw.K; k++) {
+            Instrumentation::phase(BW_PHASE_FORWARD);
+            neg_log_likelihood_sum += forward_banded(bw, trans, scratch, k);
+            Instrumentation::phase(BW_PHASE_BACKWARD);
+            backward_banded(bw, trans, scratch, k);
+        }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        update_banded(bw, trans, scratch);
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bw_scratch_free(bw, scratch.alpha_pad);
+    bw_scratch_free(bw, scratch.beta_emit_pad);
+    bw_scratch_free(bw, scratch.denominator_pad);
+    bw_scratch_free(bw, scratch.sigma_band);
+    bw_scratch_free(bw, scratch.sigma_band_sum);
+    bw_scratch_free(bw, scratch.gamma0_sum);
+    bw_scratch_free(bw, scratch.gamma_last);
+    bw_scratch_free(bw, scratch.numerator_sum);
+    bw_scratch_free(bw, scratch.denominator_sum);
+
+    return convergence.converged_at();
+}
+
+/**
+ * Forward pass of sequence k, returns its negative log likelihood
+ */
+static inline double forward_banded(const BWdata& bw, const BWbandedTransitions& trans, const BandedScratch& scratch, const size_t k) {
+    const size_t N = bw.N;
+    const size_t kT = bw.offsets[k];
+    const size_t T = bw.length(k);
+    const ptrdiff_t lower = trans.lower;
+    const ptrdiff_t upper = trans.upper;
+    double* alpha_prev = scratch.alpha_pad + trans.margin;
+    BWlikelihood likelihood;
+
+    for (size_t t = 0; t < T; t++) {
+        double* alpha = bw.alpha + (kT + t)*N;
+        const double* emit_prob = bw.emit_prob + bw.observations[kT + t]*N;
+        __m256d c_sum = _mm256_setzero_pd();
+
+        for (size_t n1 = 0; n1 < N; n1 += 4) {
+            __m256d alpha_sum;
+            if (t == 0) {
+                alpha_sum = _mm256_load_pd(bw.init_prob + n1);
+            } else {
+                alpha_sum = _mm256_setzero_pd();
+                for (ptrdiff_t o = -lower; o <= upper; o++) {
+                    alpha_sum = _mm256_fmadd_pd(_mm256_loadu_pd(alpha_prev + n1 - o), _mm256_load_pd(trans.diagonal(o) + n1), alpha_sum);
+                }
+            }
+            const __m256d alpha_v = _mm256_mul_pd(alpha_sum, _mm256_load_pd(emit_prob + n1));
+            c_sum = _mm256_add_pd(c_sum, alpha_v);
+            _mm256_store_pd(alpha + n1, alpha_v);
+        }
+
+        c_sum = _mm256_hadd_pd(c_sum, c_sum);
+        const double c_norm = 1.0/(_mm256_cvtsd_f64(c_sum) + _mm256_cvtsd_f64(_mm256_permute2f128_pd(c_sum, c_sum, 1)));
+        bw.c_norm[kT + t] = c_norm;
+        likelihood.multiply(c_norm);
+        const __m256d c_norm_v = _mm256_set1_pd(c_norm);
+        for (size_t n = 0; n < N; n += 4) {
+            const __m256d alpha_v = _mm256_mul_pd(_mm256_load_pd(alpha + n), c_norm_v);
+            _mm256_store_pd(alpha + n, alpha_v);
+            _mm256_store_pd(alpha_prev + n, alpha_v);
+        }
+    }
+
+    return likelihood.log();
+}
+
+/**
+ * Backward pass of sequence k with gamma and sigma. Adds ggamma to gamma0_sum (t = 0),
+ * gamma_sum[k] (t <= T-2), gamma_last[k] (t = T-1) and the emission numerators, sets sigma_sum[k]
+ * and adds it to sigma_band_sum.
+ */
+static inline void backward_banded(const BWdata& bw, const BWbandedTransitions& trans, const BandedScratch& scratch, const size_t k) {
+    const size_t N = bw.N;
+    const size_t kT = bw.offsets[k];
+    const size_t T = bw.length(k);
+    const ptrdiff_t lower = trans.lower;
+    const ptrdiff_t upper = trans.upper;
+    const size_t band_size = trans.width*trans.stride;
+    double* alpha_pad = scratch.alpha_pad + trans.margin;
+    double* beta_emit = scratch.beta_emit_pad + trans.margin;
+    double* gamma_sum = bw.gamma_sum + k*N;
+
+    memset(gamma_sum, 0, N * sizeof(double));
+    memset(scratch.sigma_band, 0, band_size * sizeof(double));
+
+    // t = T-1, base case: beta = c_norm, ggamma = alpha
+    {
+        const double* alpha = bw.alpha + (kT + T-1)*N;
+        double* beta = bw.beta + (kT + T-1)*N;
+        double* ggamma = bw.ggamma + (kT + T-1)*N;
+        double* numerator_sum = scratch.numerator_sum + bw.observations[kT + T-1]*N;
+        const __m256d c_norm_v = _mm256_set1_pd(bw.c_norm[kT + T-1]);
+        for (size_t n = 0; n < N; n += 4) {
+            const __m256d gamma_v = _mm256_load_pd(alpha + n);
+            _mm256_store_pd(beta + n, c_norm_v);
+            _mm256_store_pd(ggamma + n, gamma_v);
+            _mm256_store_pd(scratch.gamma_last + k*N + n, gamma_v);
+            _mm256_store_pd(numerator_sum + n, _mm256_add_pd(_mm256_load_pd(numerator_sum + n), gamma_v));
+        }
+    }
+
+    for (size_t t = T-1; t-- > 0; ) {
+        const double* alpha = bw.alpha + (kT + t)*N;
+        const double* beta_next = bw.beta + (kT + t+1)*N;
+        double* beta = bw.beta + (kT + t)*N;
+        double* ggamma = bw.ggamma + (kT + t)*N;
+        double* numerator_sum = scratch.numerator_sum + bw.observations[kT + t]*N;
+        const double* emit_prob = bw.emit_prob + bw.observations[kT + t+1]*N;
+
+        for (size_t n = 0; n < N; n += 4) {
+            _mm256_store_pd(beta_emit + n, _mm256_mul_pd(_mm256_load_pd(beta_next + n), _mm256_load_pd(emit_prob + n)));
+            _mm256_store_pd(alpha_pad + n, _mm256_load_pd(alpha + n));
+        }
+
+        // beta[t][n0] = c_norm * sum_o diagonal(o)[n0+o] * beta_emit[n0+o], ggamma = alpha * beta / c_norm
+        const __m256d c_norm_v = _mm256_set1_pd(bw.c_norm[kT + t]);
+        for (size_t n0 = 0; n0 < N; n0 += 4) {
+            __m256d beta_sum = _mm256_setzero_pd();
+            for (ptrdiff_t o = -lower; o <= upper; o++) {
+                beta_sum = _mm256_fmadd_pd(_mm256_loadu_pd(trans.diagonal(o) + n0 + o), _mm256_loadu_pd(beta_emit + n0 + o), beta_sum);
+            }
+            const __m256d gamma_v = _mm256_mul_pd(beta_sum, _mm256_load_pd(alpha + n0));
+            _mm256_store_pd(beta + n0, _mm256_mul_pd(beta_sum, c_norm_v));
+            _mm256_store_pd(ggamma + n0, gamma_v);
+            _mm256_store_pd(gamma_sum + n0, _mm256_add_pd(_mm256_load_pd(gamma_sum + n0), gamma_v));
+            _mm256_store_pd(numerator_sum + n0, _mm256_add_pd(_mm256_load_pd(numerator_sum + n0), gamma_v));
+            if (t == 0) {
+                _mm256_store_pd(scratch.gamma0_sum + n0, _mm256_add_pd(_mm256_load_pd(scratch.gamma0_sum + n0), gamma_v));
+            }
+        }
+
+        // sigma by diagonal: sigma_o[n1] += alpha[t][n1-o] * diagonal(o)[n1] * beta_emit[n1]
+        for (ptrdiff_t o = -lower; o <= upper; o++) {
+            const double* diagonal = trans.diagonal(o);
+            double* sigma_band = scratch.sigma_band + (o + lower)*trans.stride + trans.margin;
+            for (size_t n1 = 0; n1 < N; n1 += 4) {
+                const __m256d sigma_v = _mm256_mul_pd(_mm256_loadu_pd(alpha_pad + n1 - o), _mm256_mul_pd(_mm256_load_pd(diagonal + n1), _mm256_load_pd(beta_emit + n1)));
+                _mm256_store_pd(sigma_band + n1, _mm256_add_pd(_mm256_load_pd(sigma_band + n1), sigma_v));
+            }
+        }
+
+        // sigma is only materialized if the BWdata has a buffer for it (zeros included)
+        if (bw.sigma) {
+            double* sigma = bw.sigma + (kT + t)*N*N;
+            memset(sigma, 0, N*N * sizeof(double));
+            for (ptrdiff_t o = -lower; o <= upper; o++) {
+                const double* diagonal = trans.diagonal(o);
+                for (ptrdiff_t n1 = 0; n1 < (ptrdiff_t)N; n1++) {
+                    const ptrdiff_t n0 = n1 - o;
+                    if (n0 >= 0 && n0 < (ptrdiff_t)N) sigma[n0*N + n1] = alpha[n0]*diagonal[n1]*beta_emit[n1];
+                }
+            }
+        }
+    }
+
+    trans.expand(scratch.sigma_band, bw.sigma_sum + k*N*N);
+    for (size_t b = 0; b < band_size; b += 4) {
+        _mm256_store_pd(scratch.sigma_band_sum + b, _mm256_add_pd(_mm256_load_pd(scratch.sigma_band_sum + b), _mm256_load_pd(scratch.sigma_band + b)));
+    }
+}
+
+/**
+ * M-step from the sums of backward_banded (adds the last time step to gamma_sum, as the baseline).
+ * trans_prob is updated by diagonal and then expanded, its zeros stay zero.
+ */
+static inline void update_banded(const BWdata& bw, const BWbandedTransitions& trans, const BandedScratch& scratch) {
+    const size_t K = bw.K;
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+    const ptrdiff_t lower = trans.lower;
+    const ptrdiff_t upper = trans.upper;
+    double* denominator = scratch.denominator_pad + trans.margin;
+
+    // init_prob
+    const __m256d K_v = _mm256_set1_pd((double)K);
+    for (size_t n = 0; n < N; n += 4) {
+        _mm256_store_pd(bw.init_prob + n, _mm256_div_pd(_mm256_load_pd(scratch.gamma0_sum + n), K_v));
+    }
+
+    // trans_prob: diagonal(o)[n1] = sigma_o[n1] / gamma[n1-o]
+    const __m256d one = _mm256_set1_pd(1.0);
+    for (size_t n = 0; n < N; n += 4) {
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            g_sum = _mm256_add_pd(g_sum, _mm256_load_pd(bw.gamma_sum + k*N + n));
+        }
+        _mm256_store_pd(denominator + n, _mm256_div_pd(one, g_sum));
+    }
+    for (ptrdiff_t o = -lower; o <= upper; o++) {
+        double* diagonal = trans.diagonal(o);
+        const double* sigma_band_sum = scratch.sigma_band_sum + (o + lower)*trans.stride + trans.margin;
+        for (size_t n1 = 0; n1 < N; n1 += 4) {
+            _mm256_store_pd(diagonal + n1, _mm256_mul_pd(_mm256_load_pd(sigma_band_sum + n1), _mm256_loadu_pd(denominator + n1 - o)));
+        }
+    }
+    trans.expand(trans.diagonals, bw.trans_prob);
+
+    // emit_prob
+    for (size_t n = 0; n < N; n += 4) {
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            const __m256d gamma_sum = _mm256_add_pd(_mm256_load_pd(bw.gamma_sum + k*N + n), _mm256_load_pd(scratch.gamma_last + k*N + n));
+            _mm256_store_pd(bw.gamma_sum + k*N + n, gamma_sum);
+            g_sum = _mm256_add_pd(g_sum, gamma_sum);
+        }
+        _mm256_store_pd(scratch.denominator_sum + n, g_sum);
+    }
+    for (size_t m = 0; m < M; m++) {
+        for (size_t n = 0; n < N; n += 4) {
+            _mm256_store_pd(bw.emit_prob + m*N + n, _mm256_div_pd(_mm256_load_pd(scratch.numerator_sum + m*N + n), _mm256_load_pd(scratch.denominator_sum + n)));
+        }
+    }
+}
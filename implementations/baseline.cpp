@@ -13,6 +13,9 @@
 
     -----------------------------------------------------------------------------------
 
+    Sequence k starts at bw.offsets[k] and has bw.length(k) time steps, such that
+    sequences of different lengths (ragged BWdata) are supported as well.
+
     Make sure you understand it! Refer to
     https://courses.media.mit.edu/2010fall/mas622j/ProblemSets/ps4/tutorial.pdf
     https://www.ece.ucsb.edu/Faculty/Rabiner/ece259/Reprints/tutorial%20on%20hmm%20and%20applications.pdf
@@ -20,8 +23,10 @@
 
 #include <cmath>
 #include <cstring>
+#include <cassert>
 
 #include "../common.h"
+#include "../instrumentation.h"
 
 
 static void forward_step(const BWdata& bw);
@@ -38,73 +43,75 @@ SET_BASELINE(comp_bw, "Baseline");
 
 
 size_t comp_bw(const BWdata& bw){
+    assert(!bw.checkpoint && "The baseline needs alpha, beta and ggamma");
 
-    size_t iter = 0;
-    size_t res = 0;
-    double neg_log_likelihood_sum_old = 0; // Does not have to be initialized as it will be if and only if i > 0
-    bool first = true;
+    BWconvergence convergence(bw);
 
     // run for all iterations
     for (size_t i = 0; i < bw.max_iterations; i++) {
 
-        iter++;
-
+        Instrumentation::phase(BW_PHASE_FORWARD);
         forward_step(bw);
+        Instrumentation::phase(BW_PHASE_BACKWARD);
         backward_step(bw);
+        Instrumentation::phase(BW_PHASE_GAMMA);
         compute_gamma(bw);
+        Instrumentation::phase(BW_PHASE_SIGMA);
         compute_sigma(bw);
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
         update_init_prob(bw);
+        Instrumentation::phase(BW_PHASE_UPDATE_TRANS);
         update_trans_prob(bw);
+        Instrumentation::phase(BW_PHASE_UPDATE_EMIT);
         update_emit_prob(bw);
 
+        Instrumentation::phase(BW_PHASE_LIKELIHOOD);
         double neg_log_likelihood_sum = 0.0;
         for (size_t k = 0; k < bw.K; k++) {
-            for (size_t t = 0; t < bw.T; t++) {
-                neg_log_likelihood_sum = neg_log_likelihood_sum + log(bw.c_norm[k*bw.T + t]);
+            for (size_t t = 0; t < bw.length(k); t++) {
+                neg_log_likelihood_sum = neg_log_likelihood_sum + log(bw.c_norm[bw.offsets[k] + t]);
             }
         }
         bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
 
-        if (first && i > 0 && fabs(neg_log_likelihood_sum - neg_log_likelihood_sum_old) < EPSILON){
-            first = false;
-            res = iter;
-        }
+        convergence.update(i, neg_log_likelihood_sum);
 
-        neg_log_likelihood_sum_old = neg_log_likelihood_sum;
+        if (convergence.stop()) break;
     }
+    Instrumentation::end();
 
-    return res;
+    return convergence.converged_at();
 }
 
 
 inline void forward_step(const BWdata& bw) {
     for (size_t k = 0; k < bw.K; k++) {
         // t = 0, base case
-        bw.c_norm[k*bw.T + 0] = 0;
+        bw.c_norm[bw.offsets[k] + 0] = 0;
         for (size_t n = 0; n < bw.N; n++) {
-            bw.alpha[(k*bw.T + 0)*bw.N + n] = bw.init_prob[n]*bw.emit_prob[n*bw.M + bw.observations[k*bw.T + 0]];
-            bw.c_norm[k*bw.T + 0] += bw.alpha[(k*bw.T + 0)*bw.N + n];
+            bw.alpha[(bw.offsets[k] + 0)*bw.N + n] = bw.init_prob[n]*bw.emit_prob[n*bw.M + bw.observations[bw.offsets[k] + 0]];
+            bw.c_norm[bw.offsets[k] + 0] += bw.alpha[(bw.offsets[k] + 0)*bw.N + n];
         }
 
-        bw.c_norm[k*bw.T + 0] = 1.0/bw.c_norm[k*bw.T + 0];
+        bw.c_norm[bw.offsets[k] + 0] = 1.0/bw.c_norm[bw.offsets[k] + 0];
         for (size_t n = 0; n < bw.N; n++){
-            bw.alpha[(k*bw.T + 0)*bw.N + n] *= bw.c_norm[k*bw.T + 0];
+            bw.alpha[(bw.offsets[k] + 0)*bw.N + n] *= bw.c_norm[bw.offsets[k] + 0];
         }
 
         // recursion step
-        for (size_t t = 1; t < bw.T; t++) {
-            bw.c_norm[k*bw.T + t] = 0;
+        for (size_t t = 1; t < bw.length(k); t++) {
+            bw.c_norm[bw.offsets[k] + t] = 0;
             for (size_t n0 = 0; n0 < bw.N; n0++) {
                 double alpha_temp = 0.0;
                 for (size_t n1 = 0; n1 < bw.N; n1++) {
-                    alpha_temp += bw.alpha[(k*bw.T + (t-1))*bw.N + n1]*bw.trans_prob[n1*bw.N + n0];
+                    alpha_temp += bw.alpha[(bw.offsets[k] + (t-1))*bw.N + n1]*bw.trans_prob[n1*bw.N + n0];
                 }
-                bw.alpha[(k*bw.T + t)*bw.N + n0] = bw.emit_prob[n0*bw.M + bw.observations[k*bw.T + t]] * alpha_temp;
-                bw.c_norm[k*bw.T + t] += bw.alpha[(k*bw.T + t)*bw.N + n0];
+                bw.alpha[(bw.offsets[k] + t)*bw.N + n0] = bw.emit_prob[n0*bw.M + bw.observations[bw.offsets[k] + t]] * alpha_temp;
+                bw.c_norm[bw.offsets[k] + t] += bw.alpha[(bw.offsets[k] + t)*bw.N + n0];
             }
-            bw.c_norm[k*bw.T + t] = 1.0/bw.c_norm[k*bw.T + t];
+            bw.c_norm[bw.offsets[k] + t] = 1.0/bw.c_norm[bw.offsets[k] + t];
             for (size_t n0 = 0; n0 < bw.N; n0++) {
-                bw.alpha[(k*bw.T + t)*bw.N + n0] *= bw.c_norm[k*bw.T + t];
+                bw.alpha[(bw.offsets[k] + t)*bw.N + n0] *= bw.c_norm[bw.offsets[k] + t];
             }
         }
     }
@@ -113,21 +120,21 @@ inline void forward_step(const BWdata& bw) {
 
 inline void backward_step(const BWdata& bw) {
     for (size_t k = 0; k < bw.K; k++) {
-        // t = bw.T, base case
+        // t = bw.length(k), base case
         for (size_t n = 0; n < bw.N; n++) {
-            bw.beta[(k*bw.T + (bw.T-1))*bw.N + n] = bw.c_norm[k*bw.T + (bw.T-1)];
-            bw.ggamma[(k*bw.T + (bw.T-1))*bw.N + n] = bw.alpha[(k*bw.T + (bw.T-1))*bw.N + n];
+            bw.beta[(bw.offsets[k] + (bw.length(k)-1))*bw.N + n] = bw.c_norm[bw.offsets[k] + (bw.length(k)-1)];
+            bw.ggamma[(bw.offsets[k] + (bw.length(k)-1))*bw.N + n] = bw.alpha[(bw.offsets[k] + (bw.length(k)-1))*bw.N + n];
         }
 
         // recursion step
-        for (int t = bw.T-2; t >= 0; t--) {
+        for (int t = bw.length(k)-2; t >= 0; t--) {
             for (size_t n0 = 0; n0 < bw.N; n0++) {
                 double beta_temp = 0.0;
                 for (size_t n1 = 0; n1 < bw.N; n1++) {
-                    beta_temp += bw.beta[(k*bw.T + (t+1))*bw.N + n1] * bw.trans_prob[n0*bw.N + n1] * bw.emit_prob[n1*bw.M + bw.observations[k*bw.T + (t+1)]];
+                    beta_temp += bw.beta[(bw.offsets[k] + (t+1))*bw.N + n1] * bw.trans_prob[n0*bw.N + n1] * bw.emit_prob[n1*bw.M + bw.observations[bw.offsets[k] + (t+1)]];
                 }
-                bw.beta[(k*bw.T + t)*bw.N + n0] = beta_temp * bw.c_norm[k*bw.T + t];
-                bw.ggamma[(k*bw.T + t)*bw.N + n0] = bw.alpha[(k*bw.T + t)*bw.N + n0] * beta_temp;
+                bw.beta[(bw.offsets[k] + t)*bw.N + n0] = beta_temp * bw.c_norm[bw.offsets[k] + t];
+                bw.ggamma[(bw.offsets[k] + t)*bw.N + n0] = bw.alpha[(bw.offsets[k] + t)*bw.N + n0] * beta_temp;
             }
         }
     }
@@ -136,19 +143,19 @@ inline void backward_step(const BWdata& bw) {
 
 inline void compute_gamma(const BWdata& bw) {
     //for (size_t k = 0; k < bw.K; k++) {
-    //    for (size_t t = 0; t < bw.T; t++) {
+    //    for (size_t t = 0; t < bw.length(k); t++) {
     //        for (size_t n = 0; n < bw.N; n++) {
     //            
     //        }
     //    }
     //}
 
-    // sum up bw.ggamma (from t = 0 to bw.T-2; serve as normalizer for bw.trans_prob)
+    // sum up bw.ggamma (from t = 0 to bw.length(k)-2; serve as normalizer for bw.trans_prob)
     for (size_t k = 0; k < bw.K; k++) {
         for (size_t n = 0; n < bw.N; n++) {
             double g_sum = 0.0;
-            for (size_t t = 0; t < bw.T-1; t++) {
-                g_sum += bw.ggamma[(k*bw.T + t)*bw.N + n];
+            for (size_t t = 0; t < bw.length(k)-1; t++) {
+                g_sum += bw.ggamma[(bw.offsets[k] + t)*bw.N + n];
             }
             bw.gamma_sum[k*bw.N + n] = g_sum;
         }
@@ -157,22 +164,38 @@ inline void compute_gamma(const BWdata& bw) {
 
 
 inline void compute_sigma(const BWdata& bw) {
+    if (bw.stream_sigma) {
+        // no sigma buffer: sum up the contributions directly (from t = 0 to bw.length(k)-1)
+        for (size_t k = 0; k < bw.K; k++) {
+            for (size_t n0 = 0; n0 < bw.N; n0++) {
+                for (size_t n1 = 0; n1 < bw.N; n1++) {
+                    double s_sum = 0.0;
+                    for (size_t t = 0; t < bw.length(k)-1; t++) {
+                        s_sum += bw.alpha[(bw.offsets[k] + t)*bw.N + n0]*bw.trans_prob[n0*bw.N + n1]*bw.beta[(bw.offsets[k] + (t+1))*bw.N + n1]*bw.emit_prob[n1*bw.M + bw.observations[bw.offsets[k] + (t+1)]];
+                    }
+                    bw.sigma_sum[(k*bw.N + n0)*bw.N + n1] = s_sum;
+                }
+            }
+        }
+        return;
+    }
+
     for (size_t k = 0; k < bw.K; k++) {
-        for (size_t t = 0; t < bw.T-1; t++) {
+        for (size_t t = 0; t < bw.length(k)-1; t++) {
             for (size_t n0 = 0; n0 < bw.N; n0++) {
                 for (size_t n1 = 0; n1 < bw.N; n1++) {
-                    bw.sigma[((k*bw.T + t)*bw.N + n0)*bw.N + n1] = \
-                        bw.alpha[(k*bw.T + t)*bw.N + n0]*bw.trans_prob[n0*bw.N + n1]*bw.beta[(k*bw.T + (t+1))*bw.N + n1]*bw.emit_prob[n1*bw.M + bw.observations[k*bw.T + (t+1)]];
+                    bw.sigma[((bw.offsets[k] + t)*bw.N + n0)*bw.N + n1] = \
+                        bw.alpha[(bw.offsets[k] + t)*bw.N + n0]*bw.trans_prob[n0*bw.N + n1]*bw.beta[(bw.offsets[k] + (t+1))*bw.N + n1]*bw.emit_prob[n1*bw.M + bw.observations[bw.offsets[k] + (t+1)]];
                 }
             }
         }
 
-        // sum up bw.sigma (from t = 0 to bw.T-1)
+        // sum up bw.sigma (from t = 0 to bw.length(k)-1)
         for (size_t n0 = 0; n0 < bw.N; n0++) {
             for (size_t n1 = 0; n1 < bw.N; n1++) {
                 double s_sum = 0.0;
-                for (size_t t = 0; t < bw.T-1; t++) {
-                    s_sum += bw.sigma[((k*bw.T + t)*bw.N + n0)*bw.N + n1];
+                for (size_t t = 0; t < bw.length(k)-1; t++) {
+                    s_sum += bw.sigma[((bw.offsets[k] + t)*bw.N + n0)*bw.N + n1];
                 }
                 bw.sigma_sum[(k*bw.N + n0)*bw.N + n1] = s_sum;
             }
@@ -185,7 +208,7 @@ inline void update_init_prob(const BWdata& bw) {
     for (size_t n = 0; n < bw.N; n++) {
         double g0_sum = 0.0;
         for (size_t k = 0; k < bw.K; k++) {
-            g0_sum += bw.ggamma[(k*bw.T + 0)*bw.N + n];
+            g0_sum += bw.ggamma[(bw.offsets[k] + 0)*bw.N + n];
         }
         bw.init_prob[n] = g0_sum/bw.K;
     }
@@ -208,10 +231,10 @@ inline void update_trans_prob(const BWdata& bw) {
 
 
 inline void update_emit_prob(const BWdata& bw) {
-    // add last bw.T-step to bw.gamma_sum
+    // add last time step bw.length(k)-1 to bw.gamma_sum
     for (size_t k = 0; k < bw.K; k++) {
         for (size_t n = 0; n < bw.N; n++) {
-            bw.gamma_sum[k*bw.N + n] += bw.ggamma[(k*bw.T + (bw.T-1))*bw.N + n];
+            bw.gamma_sum[k*bw.N + n] += bw.ggamma[(bw.offsets[k] + (bw.length(k)-1))*bw.N + n];
         }
     }
     // update bw.emit_prob
@@ -221,9 +244,9 @@ inline void update_emit_prob(const BWdata& bw) {
             double denominator_sum = 0.0;
             for (size_t k = 0; k < bw.K; k++) {
                 double ggamma_cond_sum = 0.0;
-                for (size_t t = 0; t < bw.T; t++) {
-                    if (bw.observations[k*bw.T + t] == m) {
-                        ggamma_cond_sum += bw.ggamma[(k*bw.T + t)*bw.N + n];
+                for (size_t t = 0; t < bw.length(k); t++) {
+                    if (bw.observations[bw.offsets[k] + t] == m) {
+                        ggamma_cond_sum += bw.ggamma[(bw.offsets[k] + t)*bw.N + n];
                     }
                 }
                 numerator_sum += ggamma_cond_sum;
@@ -39,16 +39,11 @@ REGISTER_FUNCTION_TRANSPOSE_EMIT_PROB(comp_bw_trans, "transposed", "TEST: Baseli
 
 size_t comp_bw_trans(const BWdata& bw){
 
-    size_t iter = 0;
-    size_t res = 0;
-    double neg_log_likelihood_sum_old = 0; // Does not have to be initialized as it will be if and only if i > 0
-    bool first = true;
+    BWconvergence convergence(bw);
 
     // run for all iterations
     for (size_t i = 0; i < bw.max_iterations; i++) {
 
-        iter++;
-
         forward_step(bw);
         backward_step(bw);
         compute_gamma(bw);
@@ -65,15 +60,12 @@ size_t comp_bw_trans(const BWdata& bw){
         }
         bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
 
-        if (first && i > 0 && fabs(neg_log_likelihood_sum - neg_log_likelihood_sum_old) < EPSILON){
-            first = false;
-            res = iter;
-        }
+        convergence.update(i, neg_log_likelihood_sum);
 
-        neg_log_likelihood_sum_old = neg_log_likelihood_sum;
+        if (convergence.stop()) break;
     }
 
-    return res;
+    return convergence.converged_at();
 }
 
 
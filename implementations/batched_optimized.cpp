@@ -0,0 +1,442 @@
+/*
+    Batched implementation
+    Per sequence the forward step is a matrix-vector product per time step, alpha[t] = alpha[t-1] * trans_prob,
+    which reads all of trans_prob for 2*N*N flops (memory bound once trans_prob leaves the L1 cache).
+    Here blocks of BATCHED_BLOCK sequences advance together: the rows alpha[t-1] of the sequences of a
+    block form a matrix and
+
+        alpha[t] = (alpha[t-1] * trans_prob) .* emit_prob[y_t]     for all sequences of the block
+
+    is one matrix-matrix product (GEMM) per time step, in register tiles of 4 sequences x 12 states
+    (12 accumulators, 3 loads of trans_prob per 4 broadcasts), where every panel of trans_prob is
+    reused from the cache by all sequences of the block.
+    The backward step is the same product with the transposed trans_prob and the rows
+    beta[t+1] .* emit_prob[y_(t+1)], sigma_sum is trans_prob .* (alpha^T * beta_emit) per sequence.
+    The sequences are sorted by decreasing length, such that the sequences of a block that are still
+    running at time step t are a prefix of the block (ragged sequences).
+    Requires N to be a multiple of 4, any M, K and T >= 2.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#include "../common.h"
+#include "../likelihood.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+
+// sequences advanced together (rows of the GEMM)
+#define BATCHED_BLOCK 32
+// states of the inner dimension per pass over the rows, such that a panel of trans_prob (12 columns) stays in L1
+#define BATCHED_KC 256
+
+// local buffers of one run, passed along such that concurrent runs don't share them
+struct BatchedScratch {
+    size_t* order; //                [K]         sequences by decreasing length
+    double* trans_transposed; //     [N][N]      trans_prob transposed (backward step)
+    double* beta_emit; //            [BLOCK][N]  beta[t+1] .* emit_prob[y_(t+1)] of the sequences of a block
+    double* gamma0_sum; //           [N]         sum of ggamma[k][0] over all k
+    double* gamma_last; //           [K][N]      ggamma[k][T-1]
+    double* numerator_sum; //        [M][N]      sum of ggamma[k][t] over all k and t with y_t = m
+    double* denominator_sum; //      [N]
+};
+
+static size_t comp_bw_batched(const BWdata& bw);
+static inline void gemm_rows(const size_t rows, const double* const* a, const double* b, const size_t N, double* const* out);
+static inline void forward_batched(const BWdata& bw, const size_t* block, const size_t nb_block);
+static inline void backward_batched(const BWdata& bw, const BatchedScratch& scratch, const size_t* block, const size_t nb_block);
+static inline void sigma_batched(const BWdata& bw, const size_t k);
+static inline void update_batched(const BWdata& bw, const BatchedScratch& scratch);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_batched, "batched", "Blocks of 32 sequences per time step as a register-blocked GEMM", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_BATCHED);
+
+
+static size_t comp_bw_batched(const BWdata& bw){
+    assert(bw.N % 4 == 0 && "N has to be a multiple of 4");
+    BWconvergence convergence(bw);
+    const size_t K = bw.K;
+    const size_t N = bw.N;
+
+    BatchedScratch scratch;
+    scratch.order = (size_t *)bw_scratch_alloc(bw, "batched/order", K * sizeof(size_t));
+    scratch.trans_transposed = (double *)bw_scratch_alloc(bw, "batched/trans_transposed", N*N * sizeof(double));
+    scratch.beta_emit = (double *)bw_scratch_alloc(bw, "batched/beta_emit", BATCHED_BLOCK*N * sizeof(double));
+    scratch.gamma0_sum = (double *)bw_scratch_alloc(bw, "batched/gamma0_sum", N * sizeof(double));
+    scratch.gamma_last = (double *)bw_scratch_alloc(bw, "batched/gamma_last", K*N * sizeof(double));
+    scratch.numerator_sum = (double *)bw_scratch_alloc(bw, "batched/numerator_sum", bw.M*N * sizeof(double));
+    scratch.denominator_sum = (double *)bw_scratch_alloc(bw, "batched/denominator_sum", N * sizeof(double));
+
+    for (size_t k = 0; k < K; k++) {
+        scratch.order[k] = k;
+    }
+    std::stable_sort(scratch.order, scratch.order + K, [&bw](const size_t k0, const size_t k1){ return bw.length(k0) > bw.length(k1); });
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+        memset(scratch.gamma0_sum, 0, N * sizeof(double));
+        memset(scratch.numerator_sum, 0, bw.M*N * sizeof(double));
+        for (size_t n0 = 0; n0 < N; n0++) {
+            for (size_t n1 = 0; n1 < N; n1++) {
+                scratch.trans_transposed[n1*N + n0] = bw.trans_prob[n0*N + n1];
+            }
+        }
+
+        for (size_t b = 0; b < K; b += BATCHED_BLOCK) {
+            const size_t nb_block = std::min((size_t)BATCHED_BLOCK, K - b);
+            Instrumentation::phase(BW_PHASE_FORWARD);
+            forward_batched(bw, scratch.order + b, nb_block);
+            Instrumentation::phase(BW_PHASE_BACKWARD);
+            backward_batched(bw, scratch, scratch.order + b, nb_block);
+            Instrumentation::phase(BW_PHASE_SIGMA);
+            for (size_t r = 0; r < nb_block; r++) {
+                sigma_batched(bw, scratch.order[b + r]);
+            }
+        }
+
+        Instrumentation::phase(BW_PHASE_LIKELIHOOD);
+        double neg_log_likelihood_sum = 0.0;
+        for (size_t k = 0; k < K; k++) {
+            neg_log_likelihood_sum += likelihood_log(bw.c_norm + bw.offsets[k], bw.length(k));
+        }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        update_batched(bw, scratch);
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bw_scratch_free(bw, scratch.order);
+    bw_scratch_free(bw, scratch.trans_transposed);
+    bw_scratch_free(bw, scratch.beta_emit);
+    bw_scratch_free(bw, scratch.gamma0_sum);
+    bw_scratch_free(bw, scratch.gamma_last);
+    bw_scratch_free(bw, scratch.numerator_sum);
+    bw_scratch_free(bw, scratch.denominator_sum);
+
+    return convergence.converged_at();
+}
+
+/**
+ * Microkernel: out[r][c0 : c0+4C] (+)= sum_(n_begin <= n < n_end) a[r][n] * b[n][c0 : c0+4C] for R rows
+ */
+template<size_t R, size_t C>
+static inline void gemm_tile(const double* const* a, const double* b, const size_t N, const size_t n_begin, const size_t n_end, double* const* out, const size_t c0) {
+    __m256d acc[R][C];
+    for (size_t r = 0; r < R; r++) {
+        for (size_t j = 0; j < C; j++) {
+            acc[r][j] = (n_begin == 0) ? _mm256_setzero_pd() : _mm256_load_pd(out[r] + c0 + 4*j);
+        }
+    }
+    for (size_t n = n_begin; n < n_end; n++) {
+        __m256d b_v[C];
+        for (size_t j = 0; j < C; j++) {
+            b_v[j] = _mm256_load_pd(b + n*N + c0 + 4*j);
+        }
+        for (size_t r = 0; r < R; r++) {
+            const __m256d a_v = _mm256_broadcast_sd(a[r] + n);
+            for (size_t j = 0; j < C; j++) {
+                acc[r][j] = _mm256_fmadd_pd(a_v, b_v[j], acc[r][j]);
+            }
+        }
+    }
+    for (size_t r = 0; r < R; r++) {
+        for (size_t j = 0; j < C; j++) {
+            _mm256_store_pd(out[r] + c0 + 4*j, acc[r][j]);
+        }
+    }
+}
+
+/**
+ * Columns c0 : c0+4C of all rows: tiles of 4 rows, the remaining 1 to 3 rows in one tile
+ */
+template<size_t C>
+static inline void gemm_panel(const size_t rows, const double* const* a, const double* b, const size_t N, const size_t n_begin, const size_t n_end, double* const* out, const size_t c0) {
+    size_t r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        gemm_tile<4, C>(a + r, b, N, n_begin, n_end, out + r, c0);
+    }
+    switch (rows - r) {
+        case 3: gemm_tile<3, C>(a + r, b, N, n_begin, n_end, out + r, c0); break;
+        case 2: gemm_tile<2, C>(a + r, b, N, n_begin, n_end, out + r, c0); break;
+        case 1: gemm_tile<1, C>(a + r, b, N, n_begin, n_end, out + r, c0); break;
+        default: break;
+    }
+}
+
+/**
+ * out[r] = a[r] * b for rows row vectors a[r] of length N and the N x N matrix b (row major)
+ */
+static inline void gemm_rows(const size_t rows, const double* const* a, const double* b, const size_t N, double* const* out) {
+    for (size_t n_begin = 0; n_begin < N; n_begin += BATCHED_KC) {
+        const size_t n_end = std::min(n_begin + BATCHED_KC, N);
+        // N is a multiple of 4: panels of 12 columns, the last 16 columns as 8 + 8 instead of 12 + 4
+        size_t c0 = 0;
+        for (; N - c0 >= 12 && N - c0 != 16; c0 += 12) {
+            gemm_panel<3>(rows, a, b, N, n_begin, n_end, out, c0);
+        }
+        for (; c0 + 8 <= N; c0 += 8) {
+            gemm_panel<2>(rows, a, b, N, n_begin, n_end, out, c0);
+        }
+        if (c0 < N) gemm_panel<1>(rows, a, b, N, n_begin, n_end, out, c0);
+    }
+}
+
+/**
+ * Sum of the 4 lanes
+ */
+static inline double reduce_batched(const __m256d v) {
+    const __m256d h = _mm256_hadd_pd(v, v);
+    return _mm256_cvtsd_f64(h) + _mm256_cvtsd_f64(_mm256_permute2f128_pd(h, h, 1));
+}
+
+/**
+ * alpha[t] .*= emit_prob[y_t], then normalized, returns c_norm
+ */
+static inline double scale_alpha(const BWdata& bw, double* alpha, const size_t observation) {
+    const size_t N = bw.N;
+    const double* emit_prob = bw.emit_prob + observation*N;
+    __m256d c_sum = _mm256_setzero_pd();
+    for (size_t n = 0; n < N; n += 4) {
+        const __m256d alpha_v = _mm256_mul_pd(_mm256_load_pd(alpha + n), _mm256_load_pd(emit_prob + n));
+        c_sum = _mm256_add_pd(c_sum, alpha_v);
+        _mm256_store_pd(alpha + n, alpha_v);
+    }
+    const double c_norm = 1.0/reduce_batched(c_sum);
+    const __m256d c_norm_v = _mm256_set1_pd(c_norm);
+    for (size_t n = 0; n < N; n += 4) {
+        _mm256_store_pd(alpha + n, _mm256_mul_pd(_mm256_load_pd(alpha + n), c_norm_v));
+    }
+    return c_norm;
+}
+
+/**
+ * Forward pass of the sequences block[0 : nb_block] (by decreasing length)
+ */
+static inline void forward_batched(const BWdata& bw, const size_t* block, const size_t nb_block) {
+    const size_t N = bw.N;
+    const double* alpha_old[BATCHED_BLOCK];
+    double* alpha[BATCHED_BLOCK];
+
+    // t = 0, base case
+    for (size_t r = 0; r < nb_block; r++) {
+        const size_t kT = bw.offsets[block[r]];
+        memcpy(bw.alpha + kT*N, bw.init_prob, N * sizeof(double));
+        bw.c_norm[kT] = scale_alpha(bw, bw.alpha + kT*N, bw.observations[kT]);
+    }
+
+    size_t rows = nb_block;
+    for (size_t t = 1; t < bw.length(block[0]); t++) {
+        // the sequences that end before t are at the end of the block
+        while (bw.length(block[rows-1]) <= t) rows--;
+        for (size_t r = 0; r < rows; r++) {
+            const size_t kT = bw.offsets[block[r]];
+            alpha_old[r] = bw.alpha + (kT + t-1)*N;
+            alpha[r] = bw.alpha + (kT + t)*N;
+        }
+        gemm_rows(rows, alpha_old, bw.trans_prob, N, alpha);
+        for (size_t r = 0; r < rows; r++) {
+            const size_t kT = bw.offsets[block[r]];
+            bw.c_norm[kT + t] = scale_alpha(bw, alpha[r], bw.observations[kT + t]);
+        }
+    }
+}
+
+/**
+ * Backward pass of the sequences block[0 : nb_block] (by decreasing length) with gamma.
+ * Adds ggamma to gamma0_sum (t = 0), gamma_sum[k] (t <= T-2), gamma_last[k] (t = T-1) and the
+ * emission numerators (and writes sigma if the BWdata has a buffer for it).
+ */
+static inline void backward_batched(const BWdata& bw, const BatchedScratch& scratch, const size_t* block, const size_t nb_block) {
+    const size_t N = bw.N;
+    const double* beta_emit[BATCHED_BLOCK];
+    double* beta[BATCHED_BLOCK];
+
+    // t = T-1, base case: beta = c_norm, ggamma = alpha
+    for (size_t r = 0; r < nb_block; r++) {
+        const size_t k = block[r];
+        const size_t kT = bw.offsets[k];
+        const size_t T = bw.length(k);
+        const double* alpha_v = bw.alpha + (kT + T-1)*N;
+        double* numerator_sum = scratch.numerator_sum + bw.observations[kT + T-1]*N;
+        const __m256d c_norm_v = _mm256_set1_pd(bw.c_norm[kT + T-1]);
+        memset(bw.gamma_sum + k*N, 0, N * sizeof(double));
+        for (size_t n = 0; n < N; n += 4) {
+            const __m256d gamma_v = _mm256_load_pd(alpha_v + n);
+            _mm256_store_pd(bw.beta + (kT + T-1)*N + n, c_norm_v);
+            _mm256_store_pd(bw.ggamma + (kT + T-1)*N + n, gamma_v);
+            _mm256_store_pd(scratch.gamma_last + k*N + n, gamma_v);
+            _mm256_store_pd(numerator_sum + n, _mm256_add_pd(_mm256_load_pd(numerator_sum + n), gamma_v));
+        }
+    }
+
+    size_t rows = 0;
+    for (size_t t = bw.length(block[0]) - 1; t-- > 0; ) {
+        // the sequences with t <= T-2 are a prefix of the block
+        while (rows < nb_block && bw.length(block[rows]) >= t + 2) rows++;
+        for (size_t r = 0; r < rows; r++) {
+            const size_t kT = bw.offsets[block[r]];
+            const double* beta_next = bw.beta + (kT + t+1)*N;
+            const double* emit_prob = bw.emit_prob + bw.observations[kT + t+1]*N;
+            double* beta_emit_r = scratch.beta_emit + r*N;
+            for (size_t n = 0; n < N; n += 4) {
+                _mm256_store_pd(beta_emit_r + n, _mm256_mul_pd(_mm256_load_pd(beta_next + n), _mm256_load_pd(emit_prob + n)));
+            }
+            beta_emit[r] = beta_emit_r;
+            beta[r] = bw.beta + (kT + t)*N;
+        }
+
+        // beta[t][n0] = c_norm * sum_n1 beta_emit[n1] * trans_prob[n0][n1]
+        gemm_rows(rows, beta_emit, scratch.trans_transposed, N, beta);
+
+        for (size_t r = 0; r < rows; r++) {
+            const size_t k = block[r];
+            const size_t kT = bw.offsets[k];
+            const double* alpha = bw.alpha + (kT + t)*N;
+            double* ggamma = bw.ggamma + (kT + t)*N;
+            double* gamma_sum = bw.gamma_sum + k*N;
+            double* numerator_sum = scratch.numerator_sum + bw.observations[kT + t]*N;
+            const __m256d c_norm_v = _mm256_set1_pd(bw.c_norm[kT + t]);
+            for (size_t n = 0; n < N; n += 4) {
+                const __m256d sum = _mm256_load_pd(beta[r] + n);
+                const __m256d gamma_v = _mm256_mul_pd(sum, _mm256_load_pd(alpha + n));
+                _mm256_store_pd(beta[r] + n, _mm256_mul_pd(sum, c_norm_v));
+                _mm256_store_pd(ggamma + n, gamma_v);
+                _mm256_store_pd(gamma_sum + n, _mm256_add_pd(_mm256_load_pd(gamma_sum + n), gamma_v));
+                _mm256_store_pd(numerator_sum + n, _mm256_add_pd(_mm256_load_pd(numerator_sum + n), gamma_v));
+                if (t == 0) {
+                    _mm256_store_pd(scratch.gamma0_sum + n, _mm256_add_pd(_mm256_load_pd(scratch.gamma0_sum + n), gamma_v));
+                }
+            }
+
+            // sigma is only materialized if the BWdata has a buffer for it
+            if (bw.sigma) {
+                double* sigma = bw.sigma + (kT + t)*N*N;
+                for (size_t n0 = 0; n0 < N; n0++) {
+                    const __m256d alpha_v = _mm256_broadcast_sd(alpha + n0);
+                    for (size_t n1 = 0; n1 < N; n1 += 4) {
+                        _mm256_store_pd(sigma + n0*N + n1, _mm256_mul_pd(alpha_v, _mm256_mul_pd(_mm256_load_pd(bw.trans_prob + n0*N + n1), _mm256_load_pd(beta_emit[r] + n1))));
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Tile of sigma_sum: rows n0 : n0+4, columns n1 : n1+4C
+ */
+template<size_t C>
+static inline void sigma_tile(const BWdata& bw, const size_t k, const size_t n0, const size_t n1) {
+    const size_t N = bw.N;
+    const size_t kT = bw.offsets[k];
+    const size_t T = bw.length(k);
+    __m256d s_sum[4][C];
+    for (size_t r = 0; r < 4; r++) {
+        for (size_t j = 0; j < C; j++) {
+            s_sum[r][j] = _mm256_setzero_pd();
+        }
+    }
+    for (size_t t = 0; t + 1 < T; t++) {
+        const double* alpha = bw.alpha + (kT + t)*N + n0;
+        const double* beta_next = bw.beta + (kT + t+1)*N + n1;
+        const double* emit_prob = bw.emit_prob + bw.observations[kT + t+1]*N + n1;
+        __m256d beta_emit[C];
+        for (size_t j = 0; j < C; j++) {
+            beta_emit[j] = _mm256_mul_pd(_mm256_load_pd(beta_next + 4*j), _mm256_load_pd(emit_prob + 4*j));
+        }
+        for (size_t r = 0; r < 4; r++) {
+            const __m256d alpha_v = _mm256_broadcast_sd(alpha + r);
+            for (size_t j = 0; j < C; j++) {
+                s_sum[r][j] = _mm256_fmadd_pd(alpha_v, beta_emit[j], s_sum[r][j]);
+            }
+        }
+    }
+    for (size_t r = 0; r < 4; r++) {
+        for (size_t j = 0; j < C; j++) {
+            const size_t index = (n0 + r)*N + n1 + 4*j;
+            _mm256_store_pd(bw.sigma_sum + k*N*N + index, _mm256_mul_pd(s_sum[r][j], _mm256_load_pd(bw.trans_prob + index)));
+        }
+    }
+}
+
+/**
+ * sigma_sum of sequence k: trans_prob[n0][n1] does not depend on t, thus
+ * sigma_sum[n0][n1] = trans_prob[n0][n1] * sum_(t <= T-2) alpha[t][n0] * beta[t+1][n1] * emit_prob[y_(t+1)][n1]
+ */
+static inline void sigma_batched(const BWdata& bw, const size_t k) {
+    const size_t N = bw.N;
+    for (size_t n0 = 0; n0 < N; n0 += 4) {
+        size_t n1 = 0;
+        for (; n1 + 8 <= N; n1 += 8) {
+            sigma_tile<2>(bw, k, n0, n1);
+        }
+        if (n1 < N) sigma_tile<1>(bw, k, n0, n1);
+    }
+}
+
+/**
+ * M-step from the sums of backward_batched (adds the last time step to gamma_sum, as the baseline)
+ */
+static inline void update_batched(const BWdata& bw, const BatchedScratch& scratch) {
+    const size_t K = bw.K;
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    // init_prob and the denominators of trans_prob (gamma_sum without the last time step)
+    const __m256d K_v = _mm256_set1_pd((double)K);
+    for (size_t n = 0; n < N; n += 4) {
+        _mm256_store_pd(bw.init_prob + n, _mm256_div_pd(_mm256_load_pd(scratch.gamma0_sum + n), K_v));
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            g_sum = _mm256_add_pd(g_sum, _mm256_load_pd(bw.gamma_sum + k*N + n));
+        }
+        _mm256_store_pd(scratch.denominator_sum + n, _mm256_div_pd(one, g_sum));
+    }
+
+    // trans_prob
+    for (size_t n0 = 0; n0 < N; n0++) {
+        const __m256d denominator_v = _mm256_broadcast_sd(scratch.denominator_sum + n0);
+        for (size_t n1 = 0; n1 < N; n1 += 4) {
+            __m256d s_sum = _mm256_setzero_pd();
+            for (size_t k = 0; k < K; k++) {
+                s_sum = _mm256_add_pd(s_sum, _mm256_load_pd(bw.sigma_sum + (k*N + n0)*N + n1));
+            }
+            _mm256_store_pd(bw.trans_prob + n0*N + n1, _mm256_mul_pd(s_sum, denominator_v));
+        }
+    }
+
+    // emit_prob
+    for (size_t n = 0; n < N; n += 4) {
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            const __m256d gamma_sum = _mm256_add_pd(_mm256_load_pd(bw.gamma_sum + k*N + n), _mm256_load_pd(scratch.gamma_last + k*N + n));
+            _mm256_store_pd(bw.gamma_sum + k*N + n, gamma_sum);
+            g_sum = _mm256_add_pd(g_sum, gamma_sum);
+        }
+        _mm256_store_pd(scratch.denominator_sum + n, _mm256_div_pd(one, g_sum));
+    }
+    for (size_t m = 0; m < M; m++) {
+        for (size_t n = 0; n < N; n += 4) {
+            _mm256_store_pd(bw.emit_prob + m*N + n, _mm256_mul_pd(_mm256_load_pd(scratch.numerator_sum + m*N + n), _mm256_load_pd(scratch.denominator_sum + n)));
+        }
+    }
+}
@@ -0,0 +1,311 @@
+/*
+    Checkpointed forward-backward
+    For very long sequences: on a BWdata with checkpoint set, alpha is only kept at every S-th
+    time step (S = ceil(sqrt(T)) per sequence). The backward pass walks the segments from the
+    last to the first and recomputes the S alpha rows of a segment from its checkpoint, which
+    costs about one more forward pass. beta is kept for two time steps and ggamma is summed up
+    right away (init, gamma_sum and the emission numerators), such that one sequence needs
+    O(sqrt(T)*N) instead of O(T*N) memory.
+    On a BWdata with alpha, beta and ggamma (and sigma) buffers the same code writes all of
+    them, with a single segment and nothing recomputed, i.e. the mode is selected per call.
+    Requires N to be a multiple of 4, any M, K and T >= 2 (and ragged sequences).
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#include "../common.h"
+#include "../likelihood.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+
+// local buffers of one run, passed along such that concurrent runs don't share them
+struct CheckpointScratch {
+    double* checkpoints; //          [S][N]      alpha at t = 0, S, 2S, ... (ceil(T/S) <= S, checkpoint only)
+    double* segment; //              [S][N]      alpha of the current segment (checkpoint only)
+    double* beta; //                 [2][N]      beta at t and t+1 (checkpoint only)
+    double* beta_emit_prob; //       [N]         beta[t+1][n] * emit_prob[y_(t+1)][n]
+    double* trans_prob_transpose; // [N][N]
+    double* gamma0_sum; //           [N]         sum of ggamma[k][0] over all k
+    double* gamma_last; //           [K][N]      ggamma[k][T-1]
+    double* numerator_sum; //        [M][N]      sum of ggamma[k][t] over all k and t with y_t = m
+    double* denominator_sum; //      [N]
+};
+
+static size_t comp_bw_checkpoint(const BWdata& bw);
+static inline double forward_backward_checkpoint(const BWdata& bw, const CheckpointScratch& scratch, const size_t k);
+static inline void update_checkpoint(const BWdata& bw, const CheckpointScratch& scratch);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_checkpoint, "checkpoint", "Checkpointed forward-backward, O(sqrt(T)*N) memory per sequence", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_CHECKPOINT);
+
+
+/**
+ * Segment length: ceil(sqrt(T)) if alpha is not stored, T (one segment) otherwise
+ */
+static inline size_t segment_length(const BWdata& bw, const size_t T) {
+    if (bw.alpha) return T;
+    size_t S = (size_t)sqrt((double)T);
+    while (S*S < T) S++;
+    return S;
+}
+
+static size_t comp_bw_checkpoint(const BWdata& bw){
+    assert(bw.N % 4 == 0 && "N has to be a multiple of 4");
+    BWconvergence convergence(bw);
+    const size_t N = bw.N;
+
+    CheckpointScratch scratch;
+    const size_t S_max = segment_length(bw, bw.T);
+    scratch.checkpoints = bw.alpha ? NULL : (double *)bw_scratch_alloc(bw, "checkpoint/checkpoints", S_max*N * sizeof(double));
+    scratch.segment = bw.alpha ? NULL : (double *)bw_scratch_alloc(bw, "checkpoint/segment", S_max*N * sizeof(double));
+    scratch.beta = bw.beta ? NULL : (double *)bw_scratch_alloc(bw, "checkpoint/beta", 2*N * sizeof(double));
+    scratch.beta_emit_prob = (double *)bw_scratch_alloc(bw, "checkpoint/beta_emit_prob", N * sizeof(double));
+    scratch.trans_prob_transpose = (double *)bw_scratch_alloc(bw, "checkpoint/trans_prob_transpose", N*N * sizeof(double));
+    scratch.gamma0_sum = (double *)bw_scratch_alloc(bw, "checkpoint/gamma0_sum", N * sizeof(double));
+    scratch.gamma_last = (double *)bw_scratch_alloc(bw, "checkpoint/gamma_last", bw.K*N * sizeof(double));
+    scratch.numerator_sum = (double *)bw_scratch_alloc(bw, "checkpoint/numerator_sum", bw.M*N * sizeof(double));
+    scratch.denominator_sum = (double *)bw_scratch_alloc(bw, "checkpoint/denominator_sum", N * sizeof(double));
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+        for (size_t n0 = 0; n0 < N; n0++) {
+            for (size_t n1 = 0; n1 < N; n1++) {
+                scratch.trans_prob_transpose[n1*N + n0] = bw.trans_prob[n0*N + n1];
+            }
+        }
+        memset(scratch.gamma0_sum, 0, N * sizeof(double));
+        memset(scratch.numerator_sum, 0, bw.M*N * sizeof(double));
+
+        double neg_log_likelihood_sum = 0.0;
+        for (size_t k = 0; k < bw.K; k++) {
+            neg_log_likelihood_sum += forward_backward_checkpoint(bw, scratch, k);
+        }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        update_checkpoint(bw, scratch);
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bw_scratch_free(bw, scratch.checkpoints);
+    bw_scratch_free(bw, scratch.segment);
+    bw_scratch_free(bw, scratch.beta);
+    bw_scratch_free(bw, scratch.beta_emit_prob);
+    bw_scratch_free(bw, scratch.trans_prob_transpose);
+    bw_scratch_free(bw, scratch.gamma0_sum);
+    bw_scratch_free(bw, scratch.gamma_last);
+    bw_scratch_free(bw, scratch.numerator_sum);
+    bw_scratch_free(bw, scratch.denominator_sum);
+
+    return convergence.converged_at();
+}
+
+/**
+ * alpha at time step i = offsets[k] + t from alpha at t-1 (alpha_old, NULL for t = 0),
+ * stores and returns c_norm[i]. Recomputing a time step gives exactly the same values.
+ */
+static inline double alpha_step(const BWdata& bw, const double* alpha_old, double* alpha, const size_t i) {
+    const size_t N = bw.N;
+    const double* emit_prob = bw.emit_prob + bw.observations[i]*N;
+    __m256d c_sum = _mm256_setzero_pd();
+
+    for (size_t n0 = 0; n0 < N; n0 += 4) {
+        __m256d alpha_sum;
+        if (alpha_old == NULL) {
+            alpha_sum = _mm256_load_pd(bw.init_prob + n0);
+        } else {
+            __m256d alpha_sum0 = _mm256_setzero_pd();
+            __m256d alpha_sum1 = _mm256_setzero_pd();
+            for (size_t n1 = 0; n1 < N; n1 += 2) {
+                alpha_sum0 = _mm256_fmadd_pd(_mm256_broadcast_sd(alpha_old + n1 + 0), _mm256_load_pd(bw.trans_prob + (n1+0)*N + n0), alpha_sum0);
+                alpha_sum1 = _mm256_fmadd_pd(_mm256_broadcast_sd(alpha_old + n1 + 1), _mm256_load_pd(bw.trans_prob + (n1+1)*N + n0), alpha_sum1);
+            }
+            alpha_sum = _mm256_add_pd(alpha_sum0, alpha_sum1);
+        }
+        const __m256d alpha_v = _mm256_mul_pd(alpha_sum, _mm256_load_pd(emit_prob + n0));
+        c_sum = _mm256_add_pd(c_sum, alpha_v);
+        _mm256_store_pd(alpha + n0, alpha_v);
+    }
+
+    c_sum = _mm256_hadd_pd(c_sum, c_sum);
+    const double c_norm = 1.0/(_mm256_cvtsd_f64(c_sum) + _mm256_cvtsd_f64(_mm256_permute2f128_pd(c_sum, c_sum, 1)));
+    bw.c_norm[i] = c_norm;
+    const __m256d c_norm_v = _mm256_set1_pd(c_norm);
+    for (size_t n = 0; n < N; n += 4) {
+        _mm256_store_pd(alpha + n, _mm256_mul_pd(_mm256_load_pd(alpha + n), c_norm_v));
+    }
+    return c_norm;
+}
+
+/**
+ * Forward and backward pass of sequence k with gamma and sigma, returns its negative log likelihood.
+ * Adds ggamma to gamma0_sum (t = 0), gamma_sum[k] (t <= T-2), gamma_last[k] (t = T-1) and the
+ * emission numerators, sigma to sigma_sum[k].
+ */
+static inline double forward_backward_checkpoint(const BWdata& bw, const CheckpointScratch& scratch, const size_t k) {
+    const size_t N = bw.N;
+    const size_t kT = bw.offsets[k];
+    const size_t T = bw.length(k);
+    const size_t S = segment_length(bw, T);
+    // alpha at time step t: alpha_base + (t % S)*N (the whole sequence if S = T)
+    double* alpha_base = bw.alpha ? bw.alpha + kT*N : scratch.segment;
+    double* gamma_sum = bw.gamma_sum + k*N;
+    double* sigma_sum = bw.sigma_sum + k*N*N;
+
+    // forward pass, keeping every S-th row
+    Instrumentation::phase(BW_PHASE_FORWARD);
+    BWlikelihood likelihood;
+    for (size_t t = 0; t < T; t++) {
+        double* alpha = alpha_base + (t % S)*N;
+        const double* alpha_old = (t == 0) ? NULL : alpha_base + ((t-1) % S)*N;
+        likelihood.multiply(alpha_step(bw, alpha_old, alpha, kT + t));
+        if (!bw.alpha && t % S == 0) {
+            memcpy(scratch.checkpoints + (t/S)*N, alpha, N * sizeof(double));
+        }
+    }
+    // -log P = sum of log(c_norm), one log for the whole sequence
+    const double neg_log_likelihood = likelihood.log();
+
+    // backward pass, segment by segment from the end
+    Instrumentation::phase(BW_PHASE_BACKWARD);
+    memset(gamma_sum, 0, N * sizeof(double));
+    memset(sigma_sum, 0, N*N * sizeof(double));
+    for (size_t segment = (T + S - 1)/S; segment-- > 0; ) {
+        const size_t t_begin = segment*S;
+        const size_t t_end = std::min(t_begin + S, T);
+
+        // recompute the alpha rows of the segment from its checkpoint
+        if (!bw.alpha) {
+            memcpy(scratch.segment, scratch.checkpoints + segment*N, N * sizeof(double));
+            for (size_t t = t_begin + 1; t < t_end; t++) {
+                alpha_step(bw, scratch.segment + (t - t_begin - 1)*N, scratch.segment + (t - t_begin)*N, kT + t);
+            }
+        }
+
+        for (size_t t = t_end; t-- > t_begin; ) {
+            const double* alpha = alpha_base + (t % S)*N;
+            double* beta = bw.beta ? bw.beta + (kT + t)*N : scratch.beta + (t % 2)*N;
+            double* numerator_sum = scratch.numerator_sum + bw.observations[kT + t]*N;
+
+            if (t == T-1) {
+                // base case: beta = c_norm, ggamma = alpha
+                const __m256d c_norm_v = _mm256_set1_pd(bw.c_norm[kT + t]);
+                for (size_t n = 0; n < N; n += 4) {
+                    const __m256d gamma_v = _mm256_load_pd(alpha + n);
+                    _mm256_store_pd(beta + n, c_norm_v);
+                    if (bw.ggamma) _mm256_store_pd(bw.ggamma + (kT + t)*N + n, gamma_v);
+                    _mm256_store_pd(scratch.gamma_last + k*N + n, gamma_v);
+                    _mm256_store_pd(numerator_sum + n, _mm256_add_pd(_mm256_load_pd(numerator_sum + n), gamma_v));
+                }
+                continue;
+            }
+
+            const double* beta_next = bw.beta ? bw.beta + (kT + t+1)*N : scratch.beta + ((t+1) % 2)*N;
+            const double* emit_prob = bw.emit_prob + bw.observations[kT + t+1]*N;
+            for (size_t n = 0; n < N; n += 4) {
+                _mm256_store_pd(scratch.beta_emit_prob + n, _mm256_mul_pd(_mm256_load_pd(beta_next + n), _mm256_load_pd(emit_prob + n)));
+            }
+
+            // beta, ggamma = alpha * beta / c_norm and the sums of ggamma
+            const __m256d c_norm_v = _mm256_set1_pd(bw.c_norm[kT + t]);
+            for (size_t n0 = 0; n0 < N; n0 += 4) {
+                __m256d beta_sum0 = _mm256_setzero_pd();
+                __m256d beta_sum1 = _mm256_setzero_pd();
+                for (size_t n1 = 0; n1 < N; n1 += 2) {
+                    beta_sum0 = _mm256_fmadd_pd(_mm256_broadcast_sd(scratch.beta_emit_prob + n1 + 0), _mm256_load_pd(scratch.trans_prob_transpose + (n1+0)*N + n0), beta_sum0);
+                    beta_sum1 = _mm256_fmadd_pd(_mm256_broadcast_sd(scratch.beta_emit_prob + n1 + 1), _mm256_load_pd(scratch.trans_prob_transpose + (n1+1)*N + n0), beta_sum1);
+                }
+                const __m256d beta_sum = _mm256_add_pd(beta_sum0, beta_sum1);
+                const __m256d gamma_v = _mm256_mul_pd(beta_sum, _mm256_load_pd(alpha + n0));
+                _mm256_store_pd(beta + n0, _mm256_mul_pd(beta_sum, c_norm_v));
+                if (bw.ggamma) _mm256_store_pd(bw.ggamma + (kT + t)*N + n0, gamma_v);
+                _mm256_store_pd(gamma_sum + n0, _mm256_add_pd(_mm256_load_pd(gamma_sum + n0), gamma_v));
+                _mm256_store_pd(numerator_sum + n0, _mm256_add_pd(_mm256_load_pd(numerator_sum + n0), gamma_v));
+                if (t == 0) {
+                    _mm256_store_pd(scratch.gamma0_sum + n0, _mm256_add_pd(_mm256_load_pd(scratch.gamma0_sum + n0), gamma_v));
+                }
+            }
+
+            // sigma[t][n0][n1] = alpha[t][n0] * trans_prob[n0][n1] * beta[t+1][n1] * emit_prob[n1][y_(t+1)]
+            for (size_t n0 = 0; n0 < N; n0++) {
+                const __m256d alpha_v = _mm256_broadcast_sd(alpha + n0);
+                for (size_t n1 = 0; n1 < N; n1 += 4) {
+                    const __m256d sigma_v = _mm256_mul_pd(alpha_v, _mm256_mul_pd(_mm256_load_pd(bw.trans_prob + n0*N + n1), _mm256_load_pd(scratch.beta_emit_prob + n1)));
+                    if (bw.sigma) _mm256_store_pd(bw.sigma + ((kT + t)*N + n0)*N + n1, sigma_v);
+                    _mm256_store_pd(sigma_sum + n0*N + n1, _mm256_add_pd(_mm256_load_pd(sigma_sum + n0*N + n1), sigma_v));
+                }
+            }
+        }
+    }
+
+    return neg_log_likelihood;
+}
+
+/**
+ * M-step from the sums of forward_backward_checkpoint
+ * (adds the last time step to gamma_sum, as the baseline)
+ */
+static inline void update_checkpoint(const BWdata& bw, const CheckpointScratch& scratch) {
+    const size_t K = bw.K;
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+
+    // init_prob
+    const __m256d K_v = _mm256_set1_pd((double)K);
+    for (size_t n = 0; n < N; n += 4) {
+        _mm256_store_pd(bw.init_prob + n, _mm256_div_pd(_mm256_load_pd(scratch.gamma0_sum + n), K_v));
+    }
+
+    // trans_prob
+    for (size_t n = 0; n < N; n += 4) {
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            g_sum = _mm256_add_pd(g_sum, _mm256_load_pd(bw.gamma_sum + k*N + n));
+        }
+        _mm256_store_pd(scratch.denominator_sum + n, g_sum);
+    }
+    for (size_t n0 = 0; n0 < N; n0++) {
+        const __m256d denominator = _mm256_broadcast_sd(scratch.denominator_sum + n0);
+        for (size_t n1 = 0; n1 < N; n1 += 4) {
+            __m256d s_sum = _mm256_setzero_pd();
+            for (size_t k = 0; k < K; k++) {
+                s_sum = _mm256_add_pd(s_sum, _mm256_load_pd(bw.sigma_sum + (k*N + n0)*N + n1));
+            }
+            _mm256_store_pd(bw.trans_prob + n0*N + n1, _mm256_div_pd(s_sum, denominator));
+        }
+    }
+
+    // emit_prob
+    for (size_t n = 0; n < N; n += 4) {
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            const __m256d gamma_sum = _mm256_add_pd(_mm256_load_pd(bw.gamma_sum + k*N + n), _mm256_load_pd(scratch.gamma_last + k*N + n));
+            _mm256_store_pd(bw.gamma_sum + k*N + n, gamma_sum);
+            g_sum = _mm256_add_pd(g_sum, gamma_sum);
+        }
+        _mm256_store_pd(scratch.denominator_sum + n, g_sum);
+    }
+    for (size_t m = 0; m < M; m++) {
+        for (size_t n = 0; n < N; n += 4) {
+            _mm256_store_pd(bw.emit_prob + m*N + n, _mm256_div_pd(_mm256_load_pd(scratch.numerator_sum + m*N + n), _mm256_load_pd(scratch.denominator_sum + n)));
+        }
+    }
+}
@@ -17,13 +17,65 @@
 
 #include <cmath>
 #include <cstring>
+#include <algorithm>
 
 #include "../common.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+#include "../decoding.h"
+#include "../packed_observations.h"
+#include "../likelihood.h"
+
+
+/**
+ * Scaled forward step of one time step (rows of N doubles, N a multiple of 4): alpha[n] =
+ * c_norm * emit_prob[n] * (alpha_prev == NULL ? init_prob[n] : sum_n1 alpha_prev[n1]*trans_prob[n1][n]),
+ * emit_prob is the row of the observation (transposed emit_prob). Returns c_norm.
+ * Shared by "combined" (rows of the BWdata) and "posterior-combined" (rows of its scratch).
+ */
+static inline double forward_row_comb(const double* init_prob, const double* trans_prob, const double* emit_prob, const double* alpha_prev, const size_t N, double* alpha_row) {
+    __m256d alpha, alpha_sum, c_norm_v, trans_prob_v;
+
+    c_norm_v = _mm256_setzero_pd();
+    for (size_t n0 = 0; n0 < N; n0+=4) {
+        if (alpha_prev == NULL) {
+            // t = 0, base case
+            alpha_sum = _mm256_load_pd(init_prob + n0);
+        } else {
+            alpha_sum = _mm256_setzero_pd();
+            for (size_t n1 = 0; n1 < N; n1++) {
+                trans_prob_v = _mm256_load_pd(trans_prob + n1*N + n0);
+                alpha = _mm256_broadcast_sd(alpha_prev + n1);
+                alpha_sum = _mm256_fmadd_pd(alpha, trans_prob_v, alpha_sum);
+            }
+        }
+        alpha = _mm256_mul_pd(alpha_sum, _mm256_load_pd(emit_prob + n0));
+        c_norm_v = _mm256_add_pd(c_norm_v, alpha);
+        _mm256_store_pd(alpha_row + n0, alpha);
+    }
+    c_norm_v = _mm256_hadd_pd(c_norm_v, c_norm_v);
+    const double c_norm = 1.0/(_mm256_cvtsd_f64(c_norm_v) + _mm256_cvtsd_f64(_mm256_permute2f128_pd(c_norm_v, c_norm_v, 1)));
+    c_norm_v = _mm256_set1_pd(c_norm);
+    for (size_t n = 0; n < N; n+=4){
+        alpha = _mm256_load_pd(alpha_row + n);
+        _mm256_store_pd(alpha_row + n, _mm256_mul_pd(alpha, c_norm_v));
+    }
+    return c_norm;
+}
 
-static double* denominator_sum = nullptr;
-static double* numerator_sum = nullptr;
+/**
+ * Forward step of a single sequence k for the time steps t_begin <= t < bw.length(k)
+ * Used for the tails of ragged sequences that are longer than the others of their group of 4
+ */
+static inline void forward_step_comb_single(const BWdata& bw, const BWpackedObservations& packed, const size_t k, const size_t t_begin) {
+    const size_t kT = bw.offsets[k];
+    for (size_t t = t_begin; t < bw.length(k); t++) {
+        const double* alpha_prev = (t == 0) ? NULL : bw.alpha + (kT + t - 1)*bw.N;
+        bw.c_norm[kT + t] = forward_row_comb(bw.init_prob, bw.trans_prob, bw.emit_prob + packed.at(kT + t)*bw.N, alpha_prev, bw.N, bw.alpha + (kT + t)*bw.N);
+    }
+}
 
-static inline void forward_step_comb(const BWdata& bw) {
+static inline void forward_step_comb(const BWdata& bw, const BWpackedObservations& packed) {
     //Init
     __m256d init_prob, emit_prob, alpha, alpha_sum, c_norm_v, trans_prob;
     __m256d emit_prob0, alpha0, c_norm_v0, alpha_sum0, trans_prob0;
@@ -32,7 +84,15 @@ static inline void forward_step_comb(const BWdata& bw) {
     __m256d emit_prob3, alpha3, c_norm_v3, alpha_sum3, trans_prob3;
 
     __m256d ones = _mm256_set1_pd(1);
-    for(size_t k=0; k < bw.K; k+=4){
+    size_t k;
+    for(k=0; k + 4 <= bw.K; k+=4){
+        // Sequences k to k+3 are processed together up to the shortest of them
+        const size_t kT0 = bw.offsets[k+0];
+        const size_t kT1 = bw.offsets[k+1];
+        const size_t kT2 = bw.offsets[k+2];
+        const size_t kT3 = bw.offsets[k+3];
+        const size_t T_common = std::min(std::min(bw.length(k+0), bw.length(k+1)), std::min(bw.length(k+2), bw.length(k+3)));
+
         // t = 0, base case
 
         // Init
@@ -41,10 +101,10 @@ static inline void forward_step_comb(const BWdata& bw) {
         c_norm_v2 = _mm256_setzero_pd();
         c_norm_v3 = _mm256_setzero_pd();
 
-        size_t observations0 = bw.observations[(k+0)*bw.T];
-        size_t observations1 = bw.observations[(k+1)*bw.T];
-        size_t observations2 = bw.observations[(k+2)*bw.T];
-        size_t observations3 = bw.observations[(k+3)*bw.T];
+        size_t observations0 = packed.at(kT0);
+        size_t observations1 = packed.at(kT1);
+        size_t observations2 = packed.at(kT2);
+        size_t observations3 = packed.at(kT3);
 
         for (size_t n = 0; n < bw.N; n+=4){
             // Load
@@ -65,10 +125,10 @@ static inline void forward_step_comb(const BWdata& bw) {
             c_norm_v3 = _mm256_fmadd_pd(init_prob, emit_prob3, c_norm_v3);
 
             // Store
-            _mm256_store_pd(bw.alpha + (k+0)*bw.T*bw.N + n, alpha0);
-            _mm256_store_pd(bw.alpha + (k+1)*bw.T*bw.N + n, alpha1);
-            _mm256_store_pd(bw.alpha + (k+2)*bw.T*bw.N + n, alpha2);
-            _mm256_store_pd(bw.alpha + (k+3)*bw.T*bw.N + n, alpha3);
+            _mm256_store_pd(bw.alpha + kT0*bw.N + n, alpha0);
+            _mm256_store_pd(bw.alpha + kT1*bw.N + n, alpha1);
+            _mm256_store_pd(bw.alpha + kT2*bw.N + n, alpha2);
+            _mm256_store_pd(bw.alpha + kT3*bw.N + n, alpha3);
         }
 
         // Calculate
@@ -84,23 +144,23 @@ static inline void forward_step_comb(const BWdata& bw) {
         __m128d a = _mm256_castpd256_pd128(c_norm_v);
         __m128d b = _mm256_extractf128_pd(c_norm_v, 1);
 
-        _mm_storel_pd(bw.c_norm + (k+0)*bw.T, a);
-        _mm_storeh_pd(bw.c_norm + (k+1)*bw.T, a);
-        _mm_storel_pd(bw.c_norm + (k+2)*bw.T, b);
-        _mm_storeh_pd(bw.c_norm + (k+3)*bw.T, b);
+        _mm_storel_pd(bw.c_norm + kT0, a);
+        _mm_storeh_pd(bw.c_norm + kT1, a);
+        _mm_storel_pd(bw.c_norm + kT2, b);
+        _mm_storeh_pd(bw.c_norm + kT3, b);
 
         //c_norm_v0 = _mm256_set1_pd(c_norm);
-        c_norm_v0 = _mm256_broadcast_sd(bw.c_norm + (k+0)*bw.T);
-        c_norm_v1 = _mm256_broadcast_sd(bw.c_norm + (k+1)*bw.T);
-        c_norm_v2 = _mm256_broadcast_sd(bw.c_norm + (k+2)*bw.T);
-        c_norm_v3 = _mm256_broadcast_sd(bw.c_norm + (k+3)*bw.T);
+        c_norm_v0 = _mm256_broadcast_sd(bw.c_norm + kT0);
+        c_norm_v1 = _mm256_broadcast_sd(bw.c_norm + kT1);
+        c_norm_v2 = _mm256_broadcast_sd(bw.c_norm + kT2);
+        c_norm_v3 = _mm256_broadcast_sd(bw.c_norm + kT3);
 
         for (size_t n = 0; n < bw.N; n+=4){
             // Load
-            alpha0 = _mm256_load_pd(bw.alpha + (k+0)*bw.T*bw.N + n);
-            alpha1 = _mm256_load_pd(bw.alpha + (k+1)*bw.T*bw.N + n);
-            alpha2 = _mm256_load_pd(bw.alpha + (k+2)*bw.T*bw.N + n);
-            alpha3 = _mm256_load_pd(bw.alpha + (k+3)*bw.T*bw.N + n);
+            alpha0 = _mm256_load_pd(bw.alpha + kT0*bw.N + n);
+            alpha1 = _mm256_load_pd(bw.alpha + kT1*bw.N + n);
+            alpha2 = _mm256_load_pd(bw.alpha + kT2*bw.N + n);
+            alpha3 = _mm256_load_pd(bw.alpha + kT3*bw.N + n);
 
             // Calculate
             alpha0 = _mm256_mul_pd(alpha0, c_norm_v0);
@@ -109,21 +169,21 @@ static inline void forward_step_comb(const BWdata& bw) {
             alpha3 = _mm256_mul_pd(alpha3, c_norm_v3);
 
             // Store
-            _mm256_store_pd(bw.alpha + (k+0)*bw.T*bw.N + n, alpha0);
-            _mm256_store_pd(bw.alpha + (k+1)*bw.T*bw.N + n, alpha1);
-            _mm256_store_pd(bw.alpha + (k+2)*bw.T*bw.N + n, alpha2);
-            _mm256_store_pd(bw.alpha + (k+3)*bw.T*bw.N + n, alpha3);
+            _mm256_store_pd(bw.alpha + kT0*bw.N + n, alpha0);
+            _mm256_store_pd(bw.alpha + kT1*bw.N + n, alpha1);
+            _mm256_store_pd(bw.alpha + kT2*bw.N + n, alpha2);
+            _mm256_store_pd(bw.alpha + kT3*bw.N + n, alpha3);
         }
         // recursion step
-        for (size_t t = 1; t < bw.T; t++) {
+        for (size_t t = 1; t < T_common; t++) {
             c_norm_v0 = _mm256_setzero_pd();
             c_norm_v1 = _mm256_setzero_pd();
             c_norm_v2 = _mm256_setzero_pd();
             c_norm_v3 = _mm256_setzero_pd();
-            size_t observations0 = bw.observations[(k+0)*bw.T + t];
-            size_t observations1 = bw.observations[(k+1)*bw.T + t];
-            size_t observations2 = bw.observations[(k+2)*bw.T + t];
-            size_t observations3 = bw.observations[(k+3)*bw.T + t];
+            size_t observations0 = packed.at(kT0 + t);
+            size_t observations1 = packed.at(kT1 + t);
+            size_t observations2 = packed.at(kT2 + t);
+            size_t observations3 = packed.at(kT3 + t);
 
             for (size_t n0 = 0; n0 < bw.N; n0+=4) {
 
@@ -138,10 +198,10 @@ static inline void forward_step_comb(const BWdata& bw) {
                     // Load
                     trans_prob = _mm256_load_pd(bw.trans_prob + n1*bw.N + n0);
 
-                    alpha0 = _mm256_broadcast_sd(bw.alpha + ((k+0)*bw.T + t - 1)*bw.N + n1);
-                    alpha1 = _mm256_broadcast_sd(bw.alpha + ((k+1)*bw.T + t - 1)*bw.N + n1);
-                    alpha2 = _mm256_broadcast_sd(bw.alpha + ((k+2)*bw.T + t - 1)*bw.N + n1);
-                    alpha3 = _mm256_broadcast_sd(bw.alpha + ((k+3)*bw.T + t - 1)*bw.N + n1);
+                    alpha0 = _mm256_broadcast_sd(bw.alpha + (kT0 + t - 1)*bw.N + n1);
+                    alpha1 = _mm256_broadcast_sd(bw.alpha + (kT1 + t - 1)*bw.N + n1);
+                    alpha2 = _mm256_broadcast_sd(bw.alpha + (kT2 + t - 1)*bw.N + n1);
+                    alpha3 = _mm256_broadcast_sd(bw.alpha + (kT3 + t - 1)*bw.N + n1);
 
                     // Calculate
                     alpha_sum0 = _mm256_fmadd_pd(alpha0, trans_prob, alpha_sum0);
@@ -165,10 +225,10 @@ static inline void forward_step_comb(const BWdata& bw) {
                 c_norm_v3 = _mm256_fmadd_pd(alpha_sum3, emit_prob3, c_norm_v3);
 
                 // Store
-                _mm256_store_pd(bw.alpha + ((k+0)*bw.T + t)*bw.N + n0, alpha0);
-                _mm256_store_pd(bw.alpha + ((k+1)*bw.T + t)*bw.N + n0, alpha1);
-                _mm256_store_pd(bw.alpha + ((k+2)*bw.T + t)*bw.N + n0, alpha2);
-                _mm256_store_pd(bw.alpha + ((k+3)*bw.T + t)*bw.N + n0, alpha3);
+                _mm256_store_pd(bw.alpha + (kT0 + t)*bw.N + n0, alpha0);
+                _mm256_store_pd(bw.alpha + (kT1 + t)*bw.N + n0, alpha1);
+                _mm256_store_pd(bw.alpha + (kT2 + t)*bw.N + n0, alpha2);
+                _mm256_store_pd(bw.alpha + (kT3 + t)*bw.N + n0, alpha3);
             }
 
             // Calculate
@@ -184,21 +244,21 @@ static inline void forward_step_comb(const BWdata& bw) {
             __m128d a = _mm256_castpd256_pd128(c_norm_v);
             __m128d b = _mm256_extractf128_pd(c_norm_v, 1);
 
-            _mm_storel_pd(bw.c_norm + (k+0)*bw.T + t, a);
-            _mm_storeh_pd(bw.c_norm + (k+1)*bw.T + t, a);
-            _mm_storel_pd(bw.c_norm + (k+2)*bw.T + t, b);
-            _mm_storeh_pd(bw.c_norm + (k+3)*bw.T + t, b);
+            _mm_storel_pd(bw.c_norm + kT0 + t, a);
+            _mm_storeh_pd(bw.c_norm + kT1 + t, a);
+            _mm_storel_pd(bw.c_norm + kT2 + t, b);
+            _mm_storeh_pd(bw.c_norm + kT3 + t, b);
 
-            c_norm_v0 = _mm256_broadcast_sd(bw.c_norm + (k+0)*bw.T + t);
-            c_norm_v1 = _mm256_broadcast_sd(bw.c_norm + (k+1)*bw.T + t);
-            c_norm_v2 = _mm256_broadcast_sd(bw.c_norm + (k+2)*bw.T + t);
-            c_norm_v3 = _mm256_broadcast_sd(bw.c_norm + (k+3)*bw.T + t);
+            c_norm_v0 = _mm256_broadcast_sd(bw.c_norm + kT0 + t);
+            c_norm_v1 = _mm256_broadcast_sd(bw.c_norm + kT1 + t);
+            c_norm_v2 = _mm256_broadcast_sd(bw.c_norm + kT2 + t);
+            c_norm_v3 = _mm256_broadcast_sd(bw.c_norm + kT3 + t);
             for (volatile size_t n = 0; n < bw.N; n+=4){
                 // Load
-                alpha0 = _mm256_load_pd(bw.alpha + ((k+0)*bw.T + t)*bw.N + n);
-                alpha1 = _mm256_load_pd(bw.alpha + ((k+1)*bw.T + t)*bw.N + n);
-                alpha2 = _mm256_load_pd(bw.alpha + ((k+2)*bw.T + t)*bw.N + n);
-                alpha3 = _mm256_load_pd(bw.alpha + ((k+3)*bw.T + t)*bw.N + n);
+                alpha0 = _mm256_load_pd(bw.alpha + (kT0 + t)*bw.N + n);
+                alpha1 = _mm256_load_pd(bw.alpha + (kT1 + t)*bw.N + n);
+                alpha2 = _mm256_load_pd(bw.alpha + (kT2 + t)*bw.N + n);
+                alpha3 = _mm256_load_pd(bw.alpha + (kT3 + t)*bw.N + n);
 
                 // Calculate
                 alpha0 = _mm256_mul_pd(alpha0, c_norm_v0);
@@ -207,108 +267,148 @@ static inline void forward_step_comb(const BWdata& bw) {
                 alpha3 = _mm256_mul_pd(alpha3, c_norm_v3);
 
                 // Store
-                _mm256_store_pd(bw.alpha + ((k+0)*bw.T + t)*bw.N + n, alpha0);
-                _mm256_store_pd(bw.alpha + ((k+1)*bw.T + t)*bw.N + n, alpha1);
-                _mm256_store_pd(bw.alpha + ((k+2)*bw.T + t)*bw.N + n, alpha2);
-                _mm256_store_pd(bw.alpha + ((k+3)*bw.T + t)*bw.N + n, alpha3);
+                _mm256_store_pd(bw.alpha + (kT0 + t)*bw.N + n, alpha0);
+                _mm256_store_pd(bw.alpha + (kT1 + t)*bw.N + n, alpha1);
+                _mm256_store_pd(bw.alpha + (kT2 + t)*bw.N + n, alpha2);
+                _mm256_store_pd(bw.alpha + (kT3 + t)*bw.N + n, alpha3);
             }
         }
+
+        // tails of the longer sequences
+        forward_step_comb_single(bw, packed, k+0, T_common);
+        forward_step_comb_single(bw, packed, k+1, T_common);
+        forward_step_comb_single(bw, packed, k+2, T_common);
+        forward_step_comb_single(bw, packed, k+3, T_common);
+    }
+
+    // remaining sequences if K is not divisible by 4
+    for (; k < bw.K; k++) {
+        forward_step_comb_single(bw, packed, k, 0);
     }
 }
 
 
-static inline void backward_step_comb(const BWdata& bw, const size_t& k) {
+/**
+ * Backward step of one time step t < T-1 (rows of N doubles, N a multiple of 4):
+ * beta_emit[n1] = beta_next[n1] * emit_prob[n1] (emit_prob is the row of y_(t+1)),
+ * beta[n0] = c_norm * sum_n1 trans_prob[n0][n1]*beta_emit[n1] and gamma[n0] = alpha[n0] * sum(...).
+ * sigma[n0][n1] = alpha[n0]*trans_prob[n0][n1]*beta_emit[n1] is stored into sigma, or added to it
+ * if accumulate_sigma (sigma_sum of the sequence), or not computed at all if sigma is NULL.
+ * Shared by "combined" (rows of the BWdata) and "posterior-combined" (rows of its scratch).
+ */
+static inline void backward_row_comb(const double* trans_prob, const double* emit_prob, const double* alpha_row, const double* beta_next, const double c_norm_t, const size_t N, double* beta_emit, double* beta_row, double* gamma_row, double* sigma, const bool accumulate_sigma) {
     // Init
-    __m256d c_norm, beta, gamma, emit_prob, beta_emit_prob, alpha;
+    __m256d c_norm, beta, gamma, emit_prob_v, beta_emit_prob, alpha;
     __m256d beta_sum0, beta_temp0, trans_prob0, alpha0;
     __m256d beta_sum1, beta_temp1, trans_prob1, alpha1;
     __m256d beta_sum2, beta_temp2, trans_prob2, alpha2;
     __m256d beta_sum3, beta_temp3, trans_prob3, alpha3;
-
-    size_t observations, kTN, kT, nN;
-    // t = bw.T, base case
-    kTN = (k*bw.T + (bw.T-1))*bw.N;
-
-    // Load
-    memcpy(bw.ggamma + kTN, bw.alpha + kTN, bw.N * sizeof(double));
-    c_norm = _mm256_broadcast_sd(bw.c_norm + k*bw.T + (bw.T-1));
-    for (size_t n = 0; n < bw.N; n+=4) {
-        // Store
-        _mm256_store_pd(bw.beta + kTN + n, c_norm);
+    __m256d s_sum0, s_sum1, s_sum2, s_sum3;
+
+    c_norm = _mm256_set1_pd(c_norm_t);
+    for (size_t n1 = 0; n1 < N; n1+=4) {
+        beta = _mm256_load_pd(beta_next + n1);
+        emit_prob_v = _mm256_load_pd(emit_prob + n1);
+        beta_emit_prob = _mm256_mul_pd(beta, emit_prob_v);
+        _mm256_store_pd(beta_emit + n1, beta_emit_prob);
     }
 
-    // Recursion step
-    kT = k*bw.T;
-    for (int t = bw.T-2; t >= 0; t--) {
-        // Load
-        observations = bw.observations[kT + (t+1)];
-        c_norm = _mm256_broadcast_sd(bw.c_norm + kT + t);
-        kTN = (kT+t)*bw.N;
+    for (size_t n0 = 0; n0 < N; n0+=4) {
 
-        for (size_t n1 = 0; n1 < bw.N; n1+=4) {
-            beta = _mm256_load_pd(bw.beta + (kT+t)*bw.N + bw.N + n1);
-            emit_prob = _mm256_load_pd(bw.emit_prob + observations*bw.N + n1);
-            beta_emit_prob = _mm256_mul_pd(beta, emit_prob);
-            _mm256_store_pd(denominator_sum + n1, beta_emit_prob);
+        // Load
+        beta_sum0 = _mm256_setzero_pd();
+        beta_sum1 = _mm256_setzero_pd();
+        beta_sum2 = _mm256_setzero_pd();
+        beta_sum3 = _mm256_setzero_pd();
+        alpha0 = _mm256_broadcast_sd(alpha_row + n0 + 0);
+        alpha1 = _mm256_broadcast_sd(alpha_row + n0 + 1);
+        alpha2 = _mm256_broadcast_sd(alpha_row + n0 + 2);
+        alpha3 = _mm256_broadcast_sd(alpha_row + n0 + 3);
+
+        for (size_t n1 = 0; n1 < N; n1+=4) {
+            // Load
+            beta_emit_prob = _mm256_load_pd(beta_emit + n1);
+
+            trans_prob0 = _mm256_load_pd(trans_prob + (n0+0) * N + n1);
+            trans_prob1 = _mm256_load_pd(trans_prob + (n0+1) * N + n1);
+            trans_prob2 = _mm256_load_pd(trans_prob + (n0+2) * N + n1);
+            trans_prob3 = _mm256_load_pd(trans_prob + (n0+3) * N + n1);
+
+            beta_sum0 = _mm256_fmadd_pd(beta_emit_prob, trans_prob0, beta_sum0);
+            beta_sum1 = _mm256_fmadd_pd(beta_emit_prob, trans_prob1, beta_sum1);
+            beta_sum2 = _mm256_fmadd_pd(beta_emit_prob, trans_prob2, beta_sum2);
+            beta_sum3 = _mm256_fmadd_pd(beta_emit_prob, trans_prob3, beta_sum3);
+
+            if (sigma == NULL) continue;
+
+            beta_temp0 = _mm256_mul_pd(beta_emit_prob, trans_prob0);
+            beta_temp1 = _mm256_mul_pd(beta_emit_prob, trans_prob1);
+            beta_temp2 = _mm256_mul_pd(beta_emit_prob, trans_prob2);
+            beta_temp3 = _mm256_mul_pd(beta_emit_prob, trans_prob3);
+
+            beta_temp0 = _mm256_mul_pd(alpha0, beta_temp0);
+            beta_temp1 = _mm256_mul_pd(alpha1, beta_temp1);
+            beta_temp2 = _mm256_mul_pd(alpha2, beta_temp2);
+            beta_temp3 = _mm256_mul_pd(alpha3, beta_temp3);
+
+            if (accumulate_sigma) {
+                // accumulate directly into sigma_sum instead of materializing sigma
+                s_sum0 = _mm256_load_pd(sigma + (n0+0)*N + n1);
+                s_sum1 = _mm256_load_pd(sigma + (n0+1)*N + n1);
+                s_sum2 = _mm256_load_pd(sigma + (n0+2)*N + n1);
+                s_sum3 = _mm256_load_pd(sigma + (n0+3)*N + n1);
+
+                beta_temp0 = _mm256_add_pd(s_sum0, beta_temp0);
+                beta_temp1 = _mm256_add_pd(s_sum1, beta_temp1);
+                beta_temp2 = _mm256_add_pd(s_sum2, beta_temp2);
+                beta_temp3 = _mm256_add_pd(s_sum3, beta_temp3);
+            }
+            _mm256_store_pd(sigma + (n0+0)*N + n1, beta_temp0);
+            _mm256_store_pd(sigma + (n0+1)*N + n1, beta_temp1);
+            _mm256_store_pd(sigma + (n0+2)*N + n1, beta_temp2);
+            _mm256_store_pd(sigma + (n0+3)*N + n1, beta_temp3);
         }
 
-        for (size_t n0 = 0; n0 < bw.N; n0+=4) {
+        // Calculate & store
+        __m256d sum_01 = _mm256_hadd_pd(beta_sum0, beta_sum1);
+        __m256d sum_23 = _mm256_hadd_pd(beta_sum2, beta_sum3);
 
-            // Load
-            beta_sum0 = _mm256_setzero_pd();
-            beta_sum1 = _mm256_setzero_pd();
-            beta_sum2 = _mm256_setzero_pd();
-            beta_sum3 = _mm256_setzero_pd();
-            alpha0 = _mm256_broadcast_sd(bw.alpha + (kT + t)*bw.N + n0 + 0);
-            alpha1 = _mm256_broadcast_sd(bw.alpha + (kT + t)*bw.N + n0 + 1);
-            alpha2 = _mm256_broadcast_sd(bw.alpha + (kT + t)*bw.N + n0 + 2);
-            alpha3 = _mm256_broadcast_sd(bw.alpha + (kT + t)*bw.N + n0 + 3);
-
-            for (size_t n1 = 0; n1 < bw.N; n1+=4) {
-                // Load
-                beta_emit_prob = _mm256_load_pd(denominator_sum + n1);
-
-                trans_prob0 = _mm256_load_pd(bw.trans_prob + (n0+0) * bw.N + n1);
-                trans_prob1 = _mm256_load_pd(bw.trans_prob + (n0+1) * bw.N + n1);
-                trans_prob2 = _mm256_load_pd(bw.trans_prob + (n0+2) * bw.N + n1);
-                trans_prob3 = _mm256_load_pd(bw.trans_prob + (n0+3) * bw.N + n1);
-
-                beta_temp0 = _mm256_mul_pd(beta_emit_prob, trans_prob0);
-                beta_temp1 = _mm256_mul_pd(beta_emit_prob, trans_prob1);
-                beta_temp2 = _mm256_mul_pd(beta_emit_prob, trans_prob2);
-                beta_temp3 = _mm256_mul_pd(beta_emit_prob, trans_prob3);
-
-                beta_sum0 = _mm256_fmadd_pd(beta_emit_prob, trans_prob0, beta_sum0);
-                beta_sum1 = _mm256_fmadd_pd(beta_emit_prob, trans_prob1, beta_sum1);
-                beta_sum2 = _mm256_fmadd_pd(beta_emit_prob, trans_prob2, beta_sum2);
-                beta_sum3 = _mm256_fmadd_pd(beta_emit_prob, trans_prob3, beta_sum3);
-
-                beta_temp0 = _mm256_mul_pd(alpha0, beta_temp0);
-                beta_temp1 = _mm256_mul_pd(alpha1, beta_temp1);
-                beta_temp2 = _mm256_mul_pd(alpha2, beta_temp2);
-                beta_temp3 = _mm256_mul_pd(alpha3, beta_temp3);
-
-                _mm256_store_pd(bw.sigma + (kTN + n0+0)*bw.N + n1, beta_temp0);
-                _mm256_store_pd(bw.sigma + (kTN + n0+1)*bw.N + n1, beta_temp1);
-                _mm256_store_pd(bw.sigma + (kTN + n0+2)*bw.N + n1, beta_temp2);
-                _mm256_store_pd(bw.sigma + (kTN + n0+3)*bw.N + n1, beta_temp3);
-            }
+        __m256d blended = _mm256_blend_pd(sum_01, sum_23, 0b1100);
 
-            // Calculate & store
-            __m256d sum_01 = _mm256_hadd_pd(beta_sum0, beta_sum1);
-            __m256d sum_23 = _mm256_hadd_pd(beta_sum2, beta_sum3);
+        __m256d permuted = _mm256_permute2f128_pd(sum_01, sum_23, 0b00100001);
 
-            __m256d blended = _mm256_blend_pd(sum_01, sum_23, 0b1100);
+        __m256d tmp = _mm256_add_pd(blended, permuted);
+        beta = _mm256_mul_pd(tmp, c_norm);
+        alpha = _mm256_load_pd(alpha_row + n0);
+        gamma = _mm256_mul_pd(tmp, alpha);
+        _mm256_store_pd(beta_row + n0, beta);
+        _mm256_store_pd(gamma_row + n0, gamma);
+    }
+}
 
-            __m256d permuted = _mm256_permute2f128_pd(sum_01, sum_23, 0b00100001);
+/**
+ * Backward step of sequence k with gamma (ggamma) and sigma (or sigma_sum if stream_sigma) fused in.
+ */
+static inline void backward_step_comb(const BWdata& bw, const BWpackedObservations& packed, const size_t& k, double* denominator_sum) {
+    const size_t N = bw.N;
+    const size_t kT = bw.offsets[k];
+
+    // t = bw.length(k), base case
+    const size_t kTN = (kT + (bw.length(k)-1))*N;
+    memcpy(bw.ggamma + kTN, bw.alpha + kTN, N * sizeof(double));
+    const __m256d c_norm = _mm256_broadcast_sd(bw.c_norm + kT + (bw.length(k)-1));
+    for (size_t n = 0; n < N; n+=4) {
+        _mm256_store_pd(bw.beta + kTN + n, c_norm);
+    }
+    if (bw.stream_sigma) {
+        memset(bw.sigma_sum + k*N*N, 0, N*N * sizeof(double));
+    }
 
-            __m256d tmp = _mm256_add_pd(blended, permuted);
-            beta = _mm256_mul_pd(tmp, c_norm);
-            alpha = _mm256_load_pd(bw.alpha + (kT + t)*bw.N + n0);
-            gamma = _mm256_mul_pd(tmp, alpha);
-            _mm256_store_pd(bw.beta + kTN + n0, beta);
-            _mm256_store_pd(bw.ggamma + kTN + n0, gamma);
-        }
+    // Recursion step
+    for (int t = bw.length(k)-2; t >= 0; t--) {
+        double* sigma = bw.stream_sigma ? bw.sigma_sum + k*N*N : bw.sigma + (kT + t)*N*N;
+        backward_row_comb(bw.trans_prob, bw.emit_prob + packed.at(kT + (t+1))*N, bw.alpha + (kT + t)*N, bw.beta + (kT + t + 1)*N, bw.c_norm[kT + t], N,
+                          denominator_sum, bw.beta + (kT + t)*N, bw.ggamma + (kT + t)*N, sigma, bw.stream_sigma);
     }
 }
 
@@ -318,26 +418,29 @@ static inline void compute_gamma_comb(const BWdata& bw, const size_t& k) {
 
     for (size_t n0 = 0; n0 < bw.N; n0+=4) {
         // blocking here if you want to include n1 in this loop instead of after this loop
-        g_sum = _mm256_load_pd(bw.ggamma + (k*bw.T + 0)*bw.N + n0);
-        for (size_t t = 1; t < bw.T-1; t++) {
-            gamma = _mm256_load_pd(bw.ggamma + (k*bw.T + t)*bw.N + n0);
+        g_sum = _mm256_load_pd(bw.ggamma + (bw.offsets[k] + 0)*bw.N + n0);
+        for (size_t t = 1; t < bw.length(k)-1; t++) {
+            gamma = _mm256_load_pd(bw.ggamma + (bw.offsets[k] + t)*bw.N + n0);
             g_sum = _mm256_add_pd(g_sum, gamma);
         }
         // Store
         _mm256_store_pd(bw.gamma_sum + k*bw.N + n0, g_sum);
 
+        // sigma_sum was already accumulated in backward_step_comb
+        if (bw.stream_sigma) continue;
+
         for (size_t n1 = 0; n1 < bw.N; n1+=4) {
-            s_sum0 = _mm256_load_pd(bw.sigma + ((k*bw.T + 0)*bw.N + n0+0) * bw.N + n1);
-            s_sum1 = _mm256_load_pd(bw.sigma + ((k*bw.T + 0)*bw.N + n0+1) * bw.N + n1);
-            s_sum2 = _mm256_load_pd(bw.sigma + ((k*bw.T + 0)*bw.N + n0+2) * bw.N + n1);
-            s_sum3 = _mm256_load_pd(bw.sigma + ((k*bw.T + 0)*bw.N + n0+3) * bw.N + n1);
+            s_sum0 = _mm256_load_pd(bw.sigma + ((bw.offsets[k] + 0)*bw.N + n0+0) * bw.N + n1);
+            s_sum1 = _mm256_load_pd(bw.sigma + ((bw.offsets[k] + 0)*bw.N + n0+1) * bw.N + n1);
+            s_sum2 = _mm256_load_pd(bw.sigma + ((bw.offsets[k] + 0)*bw.N + n0+2) * bw.N + n1);
+            s_sum3 = _mm256_load_pd(bw.sigma + ((bw.offsets[k] + 0)*bw.N + n0+3) * bw.N + n1);
 
-            for (size_t t = 1; t < bw.T-1; t++) {
+            for (size_t t = 1; t < bw.length(k)-1; t++) {
                 // Calculation
-                sigma0 = _mm256_load_pd(bw.sigma + ((k*bw.T + t)*bw.N + n0+0) * bw.N + n1);
-                sigma1 = _mm256_load_pd(bw.sigma + ((k*bw.T + t)*bw.N + n0+1) * bw.N + n1);
-                sigma2 = _mm256_load_pd(bw.sigma + ((k*bw.T + t)*bw.N + n0+2) * bw.N + n1);
-                sigma3 = _mm256_load_pd(bw.sigma + ((k*bw.T + t)*bw.N + n0+3) * bw.N + n1);
+                sigma0 = _mm256_load_pd(bw.sigma + ((bw.offsets[k] + t)*bw.N + n0+0) * bw.N + n1);
+                sigma1 = _mm256_load_pd(bw.sigma + ((bw.offsets[k] + t)*bw.N + n0+1) * bw.N + n1);
+                sigma2 = _mm256_load_pd(bw.sigma + ((bw.offsets[k] + t)*bw.N + n0+2) * bw.N + n1);
+                sigma3 = _mm256_load_pd(bw.sigma + ((bw.offsets[k] + t)*bw.N + n0+3) * bw.N + n1);
 
                 s_sum0 = _mm256_add_pd(s_sum0, sigma0);
                 s_sum1 = _mm256_add_pd(s_sum1, sigma1);
@@ -354,7 +457,7 @@ static inline void compute_gamma_comb(const BWdata& bw, const size_t& k) {
     }
 }
 
-inline void update_trans_prob_comb(const BWdata& bw) {
+static inline void update_trans_prob_comb(const BWdata& bw, double* denominator_sum) {
     //Init (init_prob)
     __m256d ones, gamma_sum, gamma, g0_sum, denominator_sum_n, K_inv, numerator_sum, sigma_sum, denominator_sum_n0;
 
@@ -363,13 +466,13 @@ inline void update_trans_prob_comb(const BWdata& bw) {
 
     for (size_t n = 0; n < bw.N; n+=4) {
         denominator_sum_n = _mm256_load_pd(bw.gamma_sum + 0*bw.N + n);
-        g0_sum = _mm256_load_pd(bw.ggamma + (0*bw.T)*bw.N + n);
+        g0_sum = _mm256_load_pd(bw.ggamma + bw.offsets[0]*bw.N + n);
 
         for (size_t k = 1; k < bw.K; k++) {
             gamma_sum = _mm256_load_pd(bw.gamma_sum + k*bw.N + n);
             denominator_sum_n = _mm256_add_pd(denominator_sum_n, gamma_sum);
 
-            gamma = _mm256_load_pd(bw.ggamma + (k*bw.T)*bw.N + n);
+            gamma = _mm256_load_pd(bw.ggamma + bw.offsets[k]*bw.N + n);
             g0_sum = _mm256_add_pd(gamma, g0_sum);
         }
 
@@ -399,7 +502,7 @@ inline void update_trans_prob_comb(const BWdata& bw) {
     }
 }
 
-static inline void update_emit_prob_comb(const BWdata& bw) {
+static inline void update_emit_prob_comb(const BWdata& bw, const BWpackedObservations& packed, double* denominator_sum, double* numerator_sum, uint32_t* positions, size_t* positions_end) {
     // Init
     __m256d ggamma, gamma_sum, gamma_sum0, gamma_sum1, denominator_sum0, denominator_sum1;
     __m256d ones, ggamma_cond_sum_tot, ggamma_cond_sum, denominator_sum_inv;
@@ -407,10 +510,10 @@ static inline void update_emit_prob_comb(const BWdata& bw) {
     __m256d denominator_sum_n1, numerator_sum_n1;
     ones = _mm256_set1_pd(1.0);
 
-    // add last bw.T-step to bw.gamma_sum
+    // add last time step to bw.gamma_sum
     for (size_t k = 0; k < bw.K; k++) {
         for (size_t n = 0; n < bw.N; n+=4) {
-            ggamma = _mm256_load_pd(bw.ggamma + (k*bw.T + (bw.T-1))*bw.N + n);
+            ggamma = _mm256_load_pd(bw.ggamma + (bw.offsets[k+1]-1)*bw.N + n);
             gamma_sum = _mm256_load_pd(bw.gamma_sum + k*bw.N + n);
             gamma_sum = _mm256_add_pd(gamma_sum, ggamma);
             _mm256_store_pd(bw.gamma_sum + k*bw.N + n, gamma_sum);
@@ -435,35 +538,35 @@ static inline void update_emit_prob_comb(const BWdata& bw) {
         _mm256_store_pd(denominator_sum + n+4, denominator_sum1);
     }
 
-    // numerator_sum
+    // numerator_sum: the positions of observation m first (32 packed observations per compare),
+    // then the ggamma rows at these positions are summed in the same order as over all time steps
     for (size_t m = 0; m < bw.M; m++) {
+        size_t nb_positions = 0;
+        for (size_t k = 0; k < bw.K; k++) {
+            const size_t kT = bw.offsets[k];
+            const size_t T = bw.length(k);
+            for (size_t t = 0; t < T; t += 32) {
+                uint32_t match = packed_match(packed, kT + t, m);
+                // tail: the next sequence (or the padding)
+                if (T - t < 32) match &= (1u << (T - t)) - 1;
+                while (match) {
+                    positions[nb_positions++] = (uint32_t)(kT + t + __builtin_ctz(match));
+                    match &= match - 1;
+                }
+            }
+            positions_end[k] = nb_positions;
+        }
+
         for (size_t n = 0; n < bw.N; n+=4) {
             ggamma_cond_sum_tot = _mm256_setzero_pd();
-
+            size_t p = 0;
             for (size_t k = 0; k < bw.K; k++) {
                 ggamma_cond_sum = _mm256_setzero_pd();
-
-                for (size_t t = 0; t < bw.T; t+=4) {
-                    if (bw.observations[k*bw.T + t] == m) {
-                        ggamma = _mm256_load_pd(bw.ggamma + (k*bw.T + t)*bw.N + n);
-                        ggamma_cond_sum = _mm256_add_pd(ggamma_cond_sum, ggamma);
-                    }
-                    if (bw.observations[k*bw.T + t+1] == m) {
-                        ggamma = _mm256_load_pd(bw.ggamma + (k*bw.T + t+1)*bw.N + n);
-                        ggamma_cond_sum = _mm256_add_pd(ggamma_cond_sum, ggamma);
-                    }
-                    if (bw.observations[k*bw.T + t+2] == m) {
-                        ggamma = _mm256_load_pd(bw.ggamma + (k*bw.T + t+2)*bw.N + n);
-                        ggamma_cond_sum = _mm256_add_pd(ggamma_cond_sum, ggamma);
-                    }
-
-                    if (bw.observations[k*bw.T + t+3] == m) {
-                        ggamma = _mm256_load_pd(bw.ggamma + (k*bw.T + t+3)*bw.N + n);
-                        ggamma_cond_sum = _mm256_add_pd(ggamma_cond_sum, ggamma);
-                    }
+                for (; p < positions_end[k]; p++) {
+                    ggamma = _mm256_load_pd(bw.ggamma + positions[p]*bw.N + n);
+                    ggamma_cond_sum = _mm256_add_pd(ggamma_cond_sum, ggamma);
                 }
                 ggamma_cond_sum_tot = _mm256_add_pd(ggamma_cond_sum_tot, ggamma_cond_sum);
-
             }
             _mm256_store_pd(numerator_sum + m*bw.N + n, ggamma_cond_sum_tot);
         }
@@ -485,79 +588,181 @@ static inline void update_emit_prob_comb(const BWdata& bw) {
 }
 
 static size_t comp_bw_combined(const BWdata& bw){
-    size_t res = 0;
-    double neg_log_likelihood_sum, neg_log_likelihood_sum_old = 0;
-    bool first = true;
+    BWconvergence convergence(bw);
+    double neg_log_likelihood_sum;
 
-    denominator_sum = (double *)aligned_alloc(32,bw.N * sizeof(double));
-    numerator_sum = (double *)aligned_alloc(32,bw.N*bw.M * sizeof(double));
+    double* denominator_sum = (double *)bw_scratch_alloc(bw, "combined/denominator_sum", bw.N * sizeof(double));
+    double* numerator_sum = (double *)bw_scratch_alloc(bw, "combined/numerator_sum", bw.N*bw.M * sizeof(double));
     assert(denominator_sum != nullptr && "Failed to allocate memory");
     assert(numerator_sum != nullptr && "Failed to allocate memory");
 
+    // observations in 8 (16) bit, decoded by all steps
+    const BWpackedObservations packed(bw);
+    assert(bw.total_length() <= UINT32_MAX && "Positions do not fit into 32 bit");
+    uint32_t* positions = (uint32_t *)bw_scratch_alloc(bw, "combined/positions", bw.total_length() * sizeof(uint32_t));
+    size_t* positions_end = (size_t *)bw_scratch_alloc(bw, "combined/positions_end", bw.K * sizeof(size_t));
+
     // run for all iterations
     for (size_t i = 0; i < bw.max_iterations; i++) {
         neg_log_likelihood_sum = 0.0;
 
-        forward_step_comb(bw);
+        Instrumentation::phase(BW_PHASE_FORWARD);
+        forward_step_comb(bw, packed);
+        // sigma and gamma are fused into the backward step (per sequence)
+        Instrumentation::phase(BW_PHASE_BACKWARD);
         for (size_t k = 0; k < bw.K; k++) {
-            backward_step_comb(bw, k);
+            backward_step_comb(bw, packed, k, denominator_sum);
             compute_gamma_comb(bw, k);
         }
 
+        Instrumentation::phase(BW_PHASE_LIKELIHOOD);
+        // one log per sequence, the exponents of the products are tracked (likelihood.h)
         for (size_t k = 0; k < bw.K; k++) {
-            // Need to do this in blocks to prevent the numbers from getting too big
-            size_t t_block = 0;
-            // Found by experiments
-            #define T_BLOCK_SIZE 64
-            for (t_block = 0; t_block + T_BLOCK_SIZE < bw.T; t_block+=T_BLOCK_SIZE) {
-                __m256d mult = _mm256_set1_pd(1);
-                for (size_t t = t_block; t < t_block+T_BLOCK_SIZE; t+=4) {
-                    __m256d c_norm0 = _mm256_load_pd(bw.c_norm + (k+0)*bw.T + t);
-                    mult = _mm256_mul_pd(mult, c_norm0);
-                }
+            neg_log_likelihood_sum += likelihood_log(bw.c_norm + bw.offsets[k], bw.length(k));
+        }
 
-                __m128d vlow  = _mm256_castpd256_pd128(mult);
-                __m128d vhigh = _mm256_extractf128_pd(mult, 1); // high 128
-                vlow  = _mm_mul_pd(vlow, vhigh);     // reduce down to 128
-                __m128d high64 = _mm_unpackhi_pd(vlow, vlow);
-                double sum = _mm_cvtsd_f64(_mm_mul_sd(vlow, high64));  // reduce to scalar
-                // Cannot take log out of this loop because the number would be too big and go to inf.
-                neg_log_likelihood_sum += log(sum);
-            }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
 
-            // do rest of the block
-            __m256d mult = _mm256_set1_pd(1);
-            for (size_t t = t_block; t < bw.T; t+=4) {
-                __m256d c_norm0 = _mm256_load_pd(bw.c_norm + (k+0)*bw.T + t);
-                mult = _mm256_mul_pd(mult, c_norm0);
-            }
+        convergence.update(i, neg_log_likelihood_sum);
 
-            __m128d vlow  = _mm256_castpd256_pd128(mult);
-            __m128d vhigh = _mm256_extractf128_pd(mult, 1); // high 128
-            vlow  = _mm_mul_pd(vlow, vhigh);     // reduce down to 128
-            __m128d high64 = _mm_unpackhi_pd(vlow, vlow);
-            double sum = _mm_cvtsd_f64(_mm_mul_sd(vlow, high64));  // reduce to scalar
-            // Cannot take log out of this loop because the number would go too big
-            neg_log_likelihood_sum += log(sum);
-        }
+        // the update of init_prob is fused into update_trans_prob_comb
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        update_trans_prob_comb(bw, denominator_sum);
+        Instrumentation::phase(BW_PHASE_UPDATE_EMIT);
+        update_emit_prob_comb(bw, packed, denominator_sum, numerator_sum, positions, positions_end);
 
-        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
 
-        if (first && i > 0 && fabs(neg_log_likelihood_sum - neg_log_likelihood_sum_old) < EPSILON){
-            first = false;
-            res = i+1;
+    bw_scratch_free(bw, denominator_sum);
+    bw_scratch_free(bw, numerator_sum);
+    bw_scratch_free(bw, positions);
+    bw_scratch_free(bw, positions_end);
+
+    return convergence.converged_at();
+}
+
+REGISTER_FUNCTION_FEATURES(comp_bw_combined, "combined", "Combined Optimized", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED);
+
+// padded model and the buffers of one sequence, see posterior_combined
+struct PosteriorScratch {
+    size_t Np; //                            N rounded up to a multiple of 4
+    double* init_prob; //   [Np]
+    double* trans_prob; //  [Np][Np]
+    double* emit_prob; //   [M][Np]          transposed
+    double* alpha; //       [T_max][Np]      of the current sequence
+    double* c_norm; //      [T_max]
+    double* beta; //        [2][Np]          beta[t+1] and beta[t]
+    double* beta_emit; //   [Np]             beta[t+1] .* emit_prob[y_(t+1)]
+    double* gamma; //       [Np]             gamma[t]
+};
+
+/**
+ * Scaled forward step of one sequence (forward_row_comb on the padded model)
+ */
+static inline void posterior_forward(const PosteriorScratch& s, const size_t* observations, const size_t T) {
+    const size_t Np = s.Np;
+    for (size_t t = 0; t < T; t++) {
+        const double* alpha_prev = (t == 0) ? NULL : s.alpha + (t-1)*Np;
+        s.c_norm[t] = forward_row_comb(s.init_prob, s.trans_prob, s.emit_prob + observations[t]*Np, alpha_prev, Np, s.alpha + t*Np);
+    }
+}
+
+/**
+ * Writes gamma[t] (N of the Np states) and/or its argmax, either may be NULL
+ */
+static inline void posterior_emit(const double* ggamma, const size_t N, double* gamma, size_t* state) {
+    if (gamma) {
+        memcpy(gamma, ggamma, N * sizeof(double));
+    }
+    if (state) {
+        size_t best_state = 0;
+        double best = ggamma[0];
+        for (size_t n = 1; n < N; n++) {
+            best_state = ggamma[n] > best ? n : best_state;
+            best = std::max(best, ggamma[n]);
         }
+        *state = best_state;
+    }
+}
 
-        neg_log_likelihood_sum_old = neg_log_likelihood_sum;
+/**
+ * Backward step of one sequence (backward_row_comb on the padded model, without sigma):
+ * only two rows of beta are kept, gamma[t] is written (or reduced to its argmax) as soon as
+ * it is known
+ */
+static inline void posterior_backward(const PosteriorScratch& s, const size_t N, const size_t* observations, const size_t T, double* gamma, size_t* states) {
+    const size_t Np = s.Np;
+
+    // t = T-1, base case: beta = c_norm, gamma = alpha
+    double* beta_next = s.beta;
+    double* beta = s.beta + Np;
+    for (size_t n = 0; n < Np; n+=4) {
+        _mm256_store_pd(beta_next + n, _mm256_set1_pd(s.c_norm[T-1]));
+    }
+    posterior_emit(s.alpha + (T-1)*Np, N, gamma ? gamma + (T-1)*N : NULL, states ? states + T-1 : NULL);
+
+    for (int t = T-2; t >= 0; t--) {
+        backward_row_comb(s.trans_prob, s.emit_prob + observations[t+1]*Np, s.alpha + t*Np, beta_next, s.c_norm[t], Np,
+                          s.beta_emit, beta, s.gamma, NULL, false);
+        posterior_emit(s.gamma, N, gamma ? gamma + t*N : NULL, states ? states + t : NULL);
+        std::swap(beta, beta_next);
+    }
+}
 
-        update_trans_prob_comb(bw);
-        update_emit_prob_comb(bw);
+/**
+ * Posterior decoding (decoding.h) with the forward and backward kernels of "combined"
+ * (forward_row_comb and backward_row_comb), one sequence at a time and without sigma.
+ * The model is padded to N rounded up to a multiple of 4 (the padded states have probability 0,
+ * thus alpha, beta and gamma are 0 there), so any N works.
+ * Only alpha and c_norm of the current sequence are stored (T_max*Np), beta is kept for two time
+ * steps and gamma goes straight to the output; without gamma, only the states are written.
+ */
+static void posterior_combined(const BWmodel& model, const BWsequences& sequences, double* gamma, size_t* states){
+    const size_t K = sequences.K;
+    const size_t N = model.N;
+    const size_t M = model.M;
+    const size_t Np = (N + 3) & ~(size_t)3;
+    if (K == 0) return;
+
+    size_t T_max = 0;
+    for (size_t k = 0; k < K; k++) {
+        T_max = std::max(T_max, sequences.length(k));
     }
 
-    free(denominator_sum);
-    free(numerator_sum);
+    PosteriorScratch s;
+    s.Np = Np;
+    const size_t total = Np + Np*Np + M*Np + T_max*Np + T_max + 4*Np;
+    // rounded up to whole vectors (aligned_alloc requires a multiple of the alignment)
+    double* storage = (double *)aligned_alloc(32, ((total * sizeof(double) + 31) / 32) * 32);
+    assert(storage != nullptr && "Failed to allocate memory");
+    s.init_prob = storage;
+    s.trans_prob = s.init_prob + Np;
+    s.emit_prob = s.trans_prob + Np*Np;
+    s.alpha = s.emit_prob + M*Np;
+    s.beta = s.alpha + T_max*Np;
+    s.beta_emit = s.beta + 2*Np;
+    s.gamma = s.beta_emit + Np;
+    s.c_norm = s.gamma + Np; // last, T_max is not a multiple of 4
+
+    memset(s.init_prob, 0, (Np + Np*Np + M*Np) * sizeof(double));
+    memcpy(s.init_prob, model.init_prob, N * sizeof(double));
+    for (size_t n0 = 0; n0 < N; n0++) {
+        memcpy(s.trans_prob + n0*Np, model.trans_prob + n0*N, N * sizeof(double));
+        for (size_t m = 0; m < M; m++) {
+            s.emit_prob[m*Np + n0] = model.emit_prob[n0*M + m];
+        }
+    }
+
+    for (size_t k = 0; k < K; k++) {
+        const size_t offset = sequences.offsets[k];
+        const size_t T = sequences.length(k);
+        posterior_forward(s, sequences.observations + offset, T);
+        posterior_backward(s, N, sequences.observations + offset, T, gamma ? gamma + offset*N : NULL, states ? states + offset : NULL);
+    }
 
-    return res;
+    free(storage);
 }
 
-REGISTER_FUNCTION_TRANSPOSE_EMIT_PROB(comp_bw_combined, "combined", "Combined Optimized");
+REGISTER_POSTERIOR_FUNCTION(posterior_combined, "posterior-combined", "Forward-backward pass with the combined kernels, without sigma");
@@ -0,0 +1,274 @@
+/*
+    Single precision (float32) implementation
+    Same algorithm as the baseline on a BWdataFloat: every AVX2 instruction processes 8 states
+    and alpha, beta and ggamma need half the memory bandwidth of the double implementations.
+    Per sequence: forward step, then the backward step with gamma, gamma_sum and sigma_sum
+    fused in (sigma is never materialized). The negative log likelihood is accumulated in double.
+    Requires N to be a multiple of 8, any M, K and T >= 2 (and ragged sequences).
+    The results are only approximately equal to the baseline (see check_float_functions).
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+
+#include "../common.h"
+#include "../likelihood.h"
+#include "../float_data.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+
+static size_t comp_bw_float(const BWdata& bw);
+static inline double forward_step_float(const BWdataFloat& bwf, const size_t k);
+static inline void backward_step_float(const BWdataFloat& bwf, const size_t k, const float* trans_prob_transpose, float* beta_emit_prob);
+static inline void update_float(const BWdataFloat& bwf, float* numerator_sum, float* denominator_sum);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_float, "float", "Single precision (float32), 8 states per AVX2 instruction", false, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_FLOAT32);
+
+
+/**
+ * Sum of the 8 lanes
+ */
+static inline float reduce_float(const __m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+static size_t comp_bw_float(const BWdata& bw){
+    assert(bw.N % 8 == 0 && "N has to be a multiple of 8");
+    BWconvergence convergence(bw);
+    const size_t N = bw.N;
+
+    const BWdataFloat bwf(bw);
+    float* trans_prob_transpose = (float *)bw_scratch_alloc(bw, "float/trans_prob_transpose", N*N * sizeof(float));
+    float* beta_emit_prob = (float *)bw_scratch_alloc(bw, "float/beta_emit_prob", N * sizeof(float));
+    float* numerator_sum = (float *)bw_scratch_alloc(bw, "float/numerator_sum", bw.M*N * sizeof(float));
+    float* denominator_sum = (float *)bw_scratch_alloc(bw, "float/denominator_sum", N * sizeof(float));
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+        for (size_t n0 = 0; n0 < N; n0++) {
+            for (size_t n1 = 0; n1 < N; n1++) {
+                trans_prob_transpose[n1*N + n0] = bwf.trans_prob[n0*N + n1];
+            }
+        }
+
+        double neg_log_likelihood_sum = 0.0;
+        for (size_t k = 0; k < bw.K; k++) {
+            Instrumentation::phase(BW_PHASE_FORWARD);
+            neg_log_likelihood_sum += forward_step_float(bwf, k);
+            // gamma and sigma are fused into the backward step
+            Instrumentation::phase(BW_PHASE_BACKWARD);
+            backward_step_float(bwf, k, trans_prob_transpose, beta_emit_prob);
+        }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        Instrumentation::phase(BW_PHASE_UPDATE_TRANS);
+        update_float(bwf, numerator_sum, denominator_sum);
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bwf.store(bw);
+
+    bw_scratch_free(bw, trans_prob_transpose);
+    bw_scratch_free(bw, beta_emit_prob);
+    bw_scratch_free(bw, numerator_sum);
+    bw_scratch_free(bw, denominator_sum);
+
+    return convergence.converged_at();
+}
+
+/**
+ * Forward step of sequence k, returns its negative log likelihood
+ */
+static inline double forward_step_float(const BWdataFloat& bwf, const size_t k) {
+    const size_t N = bwf.N;
+    const size_t kT = bwf.offsets[k];
+    const size_t T = bwf.length(k);
+    BWlikelihood likelihood;
+
+    for (size_t t = 0; t < T; t++) {
+        float* alpha = bwf.alpha + (kT + t)*N;
+        const float* emit_prob = bwf.emit_prob + bwf.observations[kT + t]*N;
+        __m256 c_sum_v = _mm256_setzero_ps();
+
+        for (size_t n0 = 0; n0 < N; n0 += 8) {
+            __m256 alpha_sum;
+            if (t == 0) {
+                // t = 0, base case
+                alpha_sum = _mm256_load_ps(bwf.init_prob + n0);
+            } else {
+                // four partial sums to hide the latency of the fma
+                const float* alpha_old = alpha - N;
+                __m256 alpha_sum0 = _mm256_setzero_ps();
+                __m256 alpha_sum1 = _mm256_setzero_ps();
+                __m256 alpha_sum2 = _mm256_setzero_ps();
+                __m256 alpha_sum3 = _mm256_setzero_ps();
+                for (size_t n1 = 0; n1 < N; n1 += 4) {
+                    alpha_sum0 = _mm256_fmadd_ps(_mm256_broadcast_ss(alpha_old + n1 + 0), _mm256_load_ps(bwf.trans_prob + (n1+0)*N + n0), alpha_sum0);
+                    alpha_sum1 = _mm256_fmadd_ps(_mm256_broadcast_ss(alpha_old + n1 + 1), _mm256_load_ps(bwf.trans_prob + (n1+1)*N + n0), alpha_sum1);
+                    alpha_sum2 = _mm256_fmadd_ps(_mm256_broadcast_ss(alpha_old + n1 + 2), _mm256_load_ps(bwf.trans_prob + (n1+2)*N + n0), alpha_sum2);
+                    alpha_sum3 = _mm256_fmadd_ps(_mm256_broadcast_ss(alpha_old + n1 + 3), _mm256_load_ps(bwf.trans_prob + (n1+3)*N + n0), alpha_sum3);
+                }
+                alpha_sum = _mm256_add_ps(_mm256_add_ps(alpha_sum0, alpha_sum1), _mm256_add_ps(alpha_sum2, alpha_sum3));
+            }
+            const __m256 alpha_v = _mm256_mul_ps(alpha_sum, _mm256_load_ps(emit_prob + n0));
+            c_sum_v = _mm256_add_ps(c_sum_v, alpha_v);
+            _mm256_store_ps(alpha + n0, alpha_v);
+        }
+
+        const float c_norm = 1.0f/reduce_float(c_sum_v);
+        bwf.c_norm[kT + t] = c_norm;
+        const __m256 c_norm_v = _mm256_set1_ps(c_norm);
+        for (size_t n = 0; n < N; n += 8) {
+            _mm256_store_ps(alpha + n, _mm256_mul_ps(_mm256_load_ps(alpha + n), c_norm_v));
+        }
+
+        // -log P = sum of log(c_norm), in double with the exponent tracked against over- and underflow
+        likelihood.multiply(c_norm);
+    }
+
+    return likelihood.log();
+}
+
+/**
+ * Backward step of sequence k with ggamma, gamma_sum (up to T-2) and sigma_sum
+ */
+static inline void backward_step_float(const BWdataFloat& bwf, const size_t k, const float* trans_prob_transpose, float* beta_emit_prob) {
+    const size_t N = bwf.N;
+    const size_t kT = bwf.offsets[k];
+    const size_t T = bwf.length(k);
+    float* gamma_sum = bwf.gamma_sum + k*N;
+    float* sigma_sum = bwf.sigma_sum + k*N*N;
+
+    // t = T-1, base case
+    const __m256 c_norm_last = _mm256_set1_ps(bwf.c_norm[kT + T-1]);
+    for (size_t n = 0; n < N; n += 8) {
+        _mm256_store_ps(bwf.beta + (kT + T-1)*N + n, c_norm_last);
+        _mm256_store_ps(bwf.ggamma + (kT + T-1)*N + n, _mm256_load_ps(bwf.alpha + (kT + T-1)*N + n));
+        _mm256_store_ps(gamma_sum + n, _mm256_setzero_ps());
+    }
+    memset(sigma_sum, 0, N*N * sizeof(float));
+
+    // recursion step
+    for (size_t t = T-1; t-- > 0; ) {
+        const float* alpha = bwf.alpha + (kT + t)*N;
+        const float* beta_next = bwf.beta + (kT + t+1)*N;
+        const float* emit_prob = bwf.emit_prob + bwf.observations[kT + t+1]*N;
+        float* beta = bwf.beta + (kT + t)*N;
+        float* ggamma = bwf.ggamma + (kT + t)*N;
+        const __m256 c_norm_v = _mm256_set1_ps(bwf.c_norm[kT + t]);
+
+        for (size_t n = 0; n < N; n += 8) {
+            _mm256_store_ps(beta_emit_prob + n, _mm256_mul_ps(_mm256_load_ps(beta_next + n), _mm256_load_ps(emit_prob + n)));
+        }
+
+        for (size_t n0 = 0; n0 < N; n0 += 8) {
+            __m256 beta_sum0 = _mm256_setzero_ps();
+            __m256 beta_sum1 = _mm256_setzero_ps();
+            __m256 beta_sum2 = _mm256_setzero_ps();
+            __m256 beta_sum3 = _mm256_setzero_ps();
+            for (size_t n1 = 0; n1 < N; n1 += 4) {
+                beta_sum0 = _mm256_fmadd_ps(_mm256_broadcast_ss(beta_emit_prob + n1 + 0), _mm256_load_ps(trans_prob_transpose + (n1+0)*N + n0), beta_sum0);
+                beta_sum1 = _mm256_fmadd_ps(_mm256_broadcast_ss(beta_emit_prob + n1 + 1), _mm256_load_ps(trans_prob_transpose + (n1+1)*N + n0), beta_sum1);
+                beta_sum2 = _mm256_fmadd_ps(_mm256_broadcast_ss(beta_emit_prob + n1 + 2), _mm256_load_ps(trans_prob_transpose + (n1+2)*N + n0), beta_sum2);
+                beta_sum3 = _mm256_fmadd_ps(_mm256_broadcast_ss(beta_emit_prob + n1 + 3), _mm256_load_ps(trans_prob_transpose + (n1+3)*N + n0), beta_sum3);
+            }
+            const __m256 beta_sum = _mm256_add_ps(_mm256_add_ps(beta_sum0, beta_sum1), _mm256_add_ps(beta_sum2, beta_sum3));
+            const __m256 ggamma_v = _mm256_mul_ps(beta_sum, _mm256_load_ps(alpha + n0));
+            _mm256_store_ps(beta + n0, _mm256_mul_ps(beta_sum, c_norm_v));
+            _mm256_store_ps(ggamma + n0, ggamma_v);
+            _mm256_store_ps(gamma_sum + n0, _mm256_add_ps(_mm256_load_ps(gamma_sum + n0), ggamma_v));
+        }
+
+        // sigma[t][n0][n1] = alpha[t][n0] * trans_prob[n0][n1] * beta[t+1][n1] * emit_prob[n1][y_(t+1)]
+        for (size_t n0 = 0; n0 < N; n0++) {
+            const __m256 alpha_v = _mm256_broadcast_ss(alpha + n0);
+            for (size_t n1 = 0; n1 < N; n1 += 8) {
+                const __m256 beta_trans = _mm256_mul_ps(_mm256_load_ps(bwf.trans_prob + n0*N + n1), _mm256_load_ps(beta_emit_prob + n1));
+                _mm256_store_ps(sigma_sum + n0*N + n1, _mm256_fmadd_ps(alpha_v, beta_trans, _mm256_load_ps(sigma_sum + n0*N + n1)));
+            }
+        }
+    }
+}
+
+/**
+ * M-step: init_prob, trans_prob and emit_prob (adds the last time step to gamma_sum, as the baseline)
+ */
+static inline void update_float(const BWdataFloat& bwf, float* numerator_sum, float* denominator_sum) {
+    const size_t K = bwf.K;
+    const size_t N = bwf.N;
+    const size_t M = bwf.M;
+    const __m256 K_inv = _mm256_set1_ps(1.0f/K);
+
+    // init_prob and the denominator of trans_prob
+    for (size_t n = 0; n < N; n += 8) {
+        __m256 g0_sum = _mm256_setzero_ps();
+        __m256 g_sum = _mm256_setzero_ps();
+        for (size_t k = 0; k < K; k++) {
+            g0_sum = _mm256_add_ps(g0_sum, _mm256_load_ps(bwf.ggamma + bwf.offsets[k]*N + n));
+            g_sum = _mm256_add_ps(g_sum, _mm256_load_ps(bwf.gamma_sum + k*N + n));
+        }
+        _mm256_store_ps(bwf.init_prob + n, _mm256_mul_ps(g0_sum, K_inv));
+        _mm256_store_ps(denominator_sum + n, g_sum);
+    }
+
+    // trans_prob
+    for (size_t n0 = 0; n0 < N; n0++) {
+        const __m256 denominator = _mm256_set1_ps(1.0f/denominator_sum[n0]);
+        for (size_t n1 = 0; n1 < N; n1 += 8) {
+            __m256 s_sum = _mm256_setzero_ps();
+            for (size_t k = 0; k < K; k++) {
+                s_sum = _mm256_add_ps(s_sum, _mm256_load_ps(bwf.sigma_sum + (k*N + n0)*N + n1));
+            }
+            _mm256_store_ps(bwf.trans_prob + n0*N + n1, _mm256_mul_ps(s_sum, denominator));
+        }
+    }
+
+    // emit_prob: numerator per observation, denominator over all time steps
+    memset(numerator_sum, 0, M*N * sizeof(float));
+    for (size_t k = 0; k < K; k++) {
+        const size_t kT = bwf.offsets[k];
+        const size_t T = bwf.length(k);
+        for (size_t t = 0; t < T; t++) {
+            float* numerator = numerator_sum + bwf.observations[kT + t]*N;
+            for (size_t n = 0; n < N; n += 8) {
+                _mm256_store_ps(numerator + n, _mm256_add_ps(_mm256_load_ps(numerator + n), _mm256_load_ps(bwf.ggamma + (kT + t)*N + n)));
+            }
+        }
+        for (size_t n = 0; n < N; n += 8) {
+            const __m256 last = _mm256_load_ps(bwf.ggamma + (kT + T-1)*N + n);
+            _mm256_store_ps(bwf.gamma_sum + k*N + n, _mm256_add_ps(_mm256_load_ps(bwf.gamma_sum + k*N + n), last));
+        }
+    }
+    for (size_t n = 0; n < N; n += 8) {
+        __m256 g_sum = _mm256_setzero_ps();
+        for (size_t k = 0; k < K; k++) {
+            g_sum = _mm256_add_ps(g_sum, _mm256_load_ps(bwf.gamma_sum + k*N + n));
+        }
+        _mm256_store_ps(denominator_sum + n, _mm256_div_ps(_mm256_set1_ps(1.0f), g_sum));
+    }
+    for (size_t m = 0; m < M; m++) {
+        for (size_t n = 0; n < N; n += 8) {
+            _mm256_store_ps(bwf.emit_prob + m*N + n, _mm256_mul_ps(_mm256_load_ps(numerator_sum + m*N + n), _mm256_load_ps(denominator_sum + n)));
+        }
+    }
+}
@@ -0,0 +1,457 @@
+/*
+    Interleaved implementation
+    "combined" interleaves four sequences per AVX register for the common time steps of the forward
+    step only, backward and gamma go back to one sequence at a time (with horizontal sums for c_norm).
+    Here groups of four sequences stay in the lanes for all phases of the E-step: alpha, beta and
+    ggamma of a group are stored as [t][n][lane] (interleaved_layout.h), so
+
+        forward:  alpha[t][n1] = emit_prob[y_t][n1] * sum_n0 alpha[t-1][n0] * trans_prob[n0][n1]
+        backward: beta[t][n0] = c_norm[t] * sum_n1 trans_prob[n0][n1] * emit_prob[y_(t+1)][n1] * beta[t+1][n1]
+        gamma:    ggamma[t][n] = alpha[t][n] * beta[t][n] / c_norm[t]
+        sigma:    sigma_sum[n0][n1] = trans_prob[n0][n1] * sum_t alpha[t][n0] * emit_prob[y_(t+1)][n1] * beta[t+1][n1]
+
+    are all vertical (a broadcast of trans_prob times a vector of four sequences), c_norm of the four
+    sequences is one vector and emit_prob[y_t] is a gather. The lanes of a group end at different time
+    steps, which is handled with masks (lanes past their end keep alpha and a c_norm of 1).
+    Meant for many short sequences and small N; requires N to be a multiple of 4, any M, K and T >= 2.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+
+#include "../common.h"
+#include "../likelihood.h"
+#include "../interleaved_layout.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+
+// local buffers of one run, passed along such that concurrent runs don't share them
+struct InterleavedScratch {
+    double* beta_emit; //            [T][N][LANES] beta[t] .* emit_prob[y_t] of the current group
+    double* gamma_lanes; //          [N][LANES]    sum of ggamma[t] over t <= T-2 of the current group
+    double* gamma_last_lanes; //     [N][LANES]    ggamma[T-1] of the current group
+    double* gamma0_sum; //           [N][LANES]    sum of ggamma[k][0] over all groups
+    double* gamma_last; //           [K][N]        ggamma[k][T-1]
+    double* numerator_sum; //        [M][N]        sum of ggamma[k][t] over all k and t with y_t = m
+    double* denominator_sum; //      [N]
+};
+
+static size_t comp_bw_interleaved(const BWdata& bw);
+static inline void forward_interleaved(const BWdata& bw, const BWinterleavedLayout& layout, const size_t g);
+static inline double likelihood_interleaved(const BWinterleavedLayout& layout, const size_t g);
+static inline void backward_interleaved(const BWdata& bw, const BWinterleavedLayout& layout, const InterleavedScratch& scratch, const size_t g);
+static inline void sigma_interleaved(const BWdata& bw, const BWinterleavedLayout& layout, const InterleavedScratch& scratch, const size_t g);
+static inline void sigma_materialize(const BWdata& bw, const size_t k);
+static inline void update_interleaved(const BWdata& bw, const InterleavedScratch& scratch);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_interleaved, "interleaved", "Four sequences in the lanes of every phase ([t][n][lane] layout)", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_INTERLEAVED);
+
+
+static size_t comp_bw_interleaved(const BWdata& bw){
+    assert(bw.N % 4 == 0 && "N has to be a multiple of 4");
+    BWconvergence convergence(bw);
+    const size_t N = bw.N;
+
+    BWinterleavedLayout layout(bw);
+    InterleavedScratch scratch;
+    scratch.beta_emit = (double *)bw_scratch_alloc(bw, "interleaved/beta_emit", bw.T*N*BW_LANES * sizeof(double));
+    scratch.gamma_lanes = (double *)bw_scratch_alloc(bw, "interleaved/gamma_lanes", N*BW_LANES * sizeof(double));
+    scratch.gamma_last_lanes = (double *)bw_scratch_alloc(bw, "interleaved/gamma_last_lanes", N*BW_LANES * sizeof(double));
+    scratch.gamma0_sum = (double *)bw_scratch_alloc(bw, "interleaved/gamma0_sum", N*BW_LANES * sizeof(double));
+    scratch.gamma_last = (double *)bw_scratch_alloc(bw, "interleaved/gamma_last", bw.K*N * sizeof(double));
+    scratch.numerator_sum = (double *)bw_scratch_alloc(bw, "interleaved/numerator_sum", bw.M*N * sizeof(double));
+    scratch.denominator_sum = (double *)bw_scratch_alloc(bw, "interleaved/denominator_sum", N * sizeof(double));
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+        memset(scratch.gamma0_sum, 0, N*BW_LANES * sizeof(double));
+        memset(scratch.numerator_sum, 0, bw.M*N * sizeof(double));
+
+        double neg_log_likelihood_sum = 0.0;
+        for (size_t g = 0; g < layout.nb_groups; g++) {
+            Instrumentation::phase(BW_PHASE_FORWARD);
+            forward_interleaved(bw, layout, g);
+            Instrumentation::phase(BW_PHASE_LIKELIHOOD);
+            neg_log_likelihood_sum += likelihood_interleaved(layout, g);
+            Instrumentation::phase(BW_PHASE_BACKWARD);
+            backward_interleaved(bw, layout, scratch, g);
+            Instrumentation::phase(BW_PHASE_SIGMA);
+            sigma_interleaved(bw, layout, scratch, g);
+            // back into the [k][t][N] layout of bw
+            Instrumentation::phase(BW_PHASE_LAYOUT);
+            interleaved_store_group(bw, layout, g);
+            Instrumentation::phase(BW_PHASE_SIGMA);
+            if (bw.sigma) {
+                for (size_t l = 0; l < BW_LANES; l++) {
+                    if (layout.lengths[g*BW_LANES + l] > 0) sigma_materialize(bw, layout.sequence(g, l));
+                }
+            }
+        }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        update_interleaved(bw, scratch);
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bw_scratch_free(bw, scratch.beta_emit);
+    bw_scratch_free(bw, scratch.gamma_lanes);
+    bw_scratch_free(bw, scratch.gamma_last_lanes);
+    bw_scratch_free(bw, scratch.gamma0_sum);
+    bw_scratch_free(bw, scratch.gamma_last);
+    bw_scratch_free(bw, scratch.numerator_sum);
+    bw_scratch_free(bw, scratch.denominator_sum);
+
+    return convergence.converged_at();
+}
+
+/**
+ * Row offsets (y_t * N) of the observations of the four lanes into emit_prob, which is [M][N]
+ * during the run (registered with transpose_emit_prob)
+ */
+static inline __m256i emit_rows(const size_t* observations, const size_t N) {
+    return _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *)observations), _mm256_set1_epi64x(N));
+}
+
+/**
+ * Lanes whose sequence is longer than t
+ */
+static inline __m256d lanes_longer(const __m256i lengths, const size_t t) {
+    return _mm256_castsi256_pd(_mm256_cmpgt_epi64(lengths, _mm256_set1_epi64x(t)));
+}
+
+/**
+ * States n1 : n1+B of alpha[t] (before scaling), returns their sum per lane
+ */
+template<size_t B>
+static inline __m256d forward_block(const BWdata& bw, const double* alpha_old, double* alpha, const __m256i rows, const size_t n1) {
+    const size_t N = bw.N;
+    __m256d acc[B];
+    for (size_t j = 0; j < B; j++) {
+        acc[j] = _mm256_setzero_pd();
+    }
+    for (size_t n0 = 0; n0 < N; n0++) {
+        const __m256d alpha_v = _mm256_load_pd(alpha_old + n0*BW_LANES);
+        const double* trans_prob = bw.trans_prob + n0*N + n1;
+        for (size_t j = 0; j < B; j++) {
+            acc[j] = _mm256_fmadd_pd(alpha_v, _mm256_broadcast_sd(trans_prob + j), acc[j]);
+        }
+    }
+    __m256d c_sum = _mm256_setzero_pd();
+    for (size_t j = 0; j < B; j++) {
+        const __m256d alpha_v = _mm256_mul_pd(acc[j], _mm256_i64gather_pd(bw.emit_prob + n1 + j, rows, 8));
+        _mm256_store_pd(alpha + (n1 + j)*BW_LANES, alpha_v);
+        c_sum = _mm256_add_pd(c_sum, alpha_v);
+    }
+    return c_sum;
+}
+
+/**
+ * Forward pass of group g into layout.alpha and layout.c_norm
+ */
+static inline void forward_interleaved(const BWdata& bw, const BWinterleavedLayout& layout, const size_t g) {
+    const size_t N = bw.N;
+    const size_t T = layout.length(g);
+    const size_t* observations = layout.observations + layout.offsets[g]*BW_LANES;
+    const __m256i lengths = _mm256_loadu_si256((const __m256i *)(layout.lengths + g*BW_LANES));
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    // t = 0, base case
+    const __m256i rows = emit_rows(observations, N);
+    __m256d c_sum = _mm256_setzero_pd();
+    for (size_t n = 0; n < N; n++) {
+        const __m256d alpha_v = _mm256_mul_pd(_mm256_broadcast_sd(bw.init_prob + n), _mm256_i64gather_pd(bw.emit_prob + n, rows, 8));
+        _mm256_store_pd(layout.alpha + n*BW_LANES, alpha_v);
+        c_sum = _mm256_add_pd(c_sum, alpha_v);
+    }
+    const __m256d c_norm = _mm256_div_pd(one, c_sum);
+    _mm256_store_pd(layout.c_norm, c_norm);
+    for (size_t n = 0; n < N; n++) {
+        _mm256_store_pd(layout.alpha + n*BW_LANES, _mm256_mul_pd(_mm256_load_pd(layout.alpha + n*BW_LANES), c_norm));
+    }
+
+    for (size_t t = 1; t < T; t++) {
+        const double* alpha_old = layout.alpha + (t-1)*N*BW_LANES;
+        double* alpha = layout.alpha + t*N*BW_LANES;
+        const __m256i rows = emit_rows(observations + t*BW_LANES, N);
+        __m256d c_sum = _mm256_setzero_pd();
+        size_t n1 = 0;
+        for (; n1 + 8 <= N; n1 += 8) {
+            c_sum = _mm256_add_pd(c_sum, forward_block<8>(bw, alpha_old, alpha, rows, n1));
+        }
+        if (n1 < N) c_sum = _mm256_add_pd(c_sum, forward_block<4>(bw, alpha_old, alpha, rows, n1));
+
+        // lanes past the end of their sequence keep alpha (finite values for the masked backward step)
+        const __m256d active = lanes_longer(lengths, t);
+        const __m256d c_norm = _mm256_blendv_pd(one, _mm256_div_pd(one, c_sum), active);
+        _mm256_store_pd(layout.c_norm + t*BW_LANES, c_norm);
+        for (size_t n = 0; n < N; n++) {
+            const __m256d alpha_v = _mm256_mul_pd(_mm256_load_pd(alpha + n*BW_LANES), c_norm);
+            _mm256_store_pd(alpha + n*BW_LANES, _mm256_blendv_pd(_mm256_load_pd(alpha_old + n*BW_LANES), alpha_v, active));
+        }
+    }
+}
+
+/**
+ * Sum of the negative log likelihoods of the sequences of group g (c_norm is 1 past their ends)
+ */
+static inline double likelihood_interleaved(const BWinterleavedLayout& layout, const size_t g) {
+    __m256d mantissa = _mm256_set1_pd(1.0);
+    __m256i exponent = _mm256_setzero_si256();
+    for (size_t t = 0; t < layout.length(g); t++) {
+        likelihood_multiply_lanes(mantissa, exponent, _mm256_load_pd(layout.c_norm + t*BW_LANES));
+    }
+    double neg_log_likelihood = 0.0;
+    for (size_t l = 0; l < BW_LANES; l++) {
+        if (layout.lengths[g*BW_LANES + l] > 0) neg_log_likelihood += likelihood_lane(mantissa, exponent, l).log();
+    }
+    return neg_log_likelihood;
+}
+
+/**
+ * States n0 : n0+B of beta[t] (before scaling) from beta_emit = beta[t+1] .* emit_prob[y_(t+1)]
+ */
+template<size_t B>
+static inline void backward_block(const BWdata& bw, const double* beta_emit, const size_t n0, __m256d* sum) {
+    const size_t N = bw.N;
+    for (size_t j = 0; j < B; j++) {
+        sum[j] = _mm256_setzero_pd();
+    }
+    for (size_t n1 = 0; n1 < N; n1++) {
+        const __m256d beta_emit_v = _mm256_load_pd(beta_emit + n1*BW_LANES);
+        const double* trans_prob = bw.trans_prob + n0*N + n1;
+        for (size_t j = 0; j < B; j++) {
+            sum[j] = _mm256_fmadd_pd(beta_emit_v, _mm256_broadcast_sd(trans_prob + j*N), sum[j]);
+        }
+    }
+}
+
+/**
+ * beta[t], ggamma[t] and the gamma sums of the states n0 : n0+B; the lanes in base (t = T-1 of
+ * their sequence) take beta = c_norm, i.e. ggamma = alpha. Only the time steps within a
+ * sequence are added (gamma_lanes for t <= T-2, numerator_sum and gamma0_sum for t <= T-1).
+ */
+template<size_t B>
+static inline void gamma_block(const BWdata& bw, const BWinterleavedLayout& layout, const InterleavedScratch& scratch, const size_t g, const size_t t, const size_t n0, const __m256d* sum, const __m256d active, const __m256d inner, const __m256d base) {
+    const size_t N = bw.N;
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d c_norm = _mm256_load_pd(layout.c_norm + t*BW_LANES);
+    const double* alpha = layout.alpha + t*N*BW_LANES;
+    double* beta = layout.beta + t*N*BW_LANES;
+    double* ggamma = layout.ggamma + t*N*BW_LANES;
+
+    __m256d gamma[B];
+    for (size_t j = 0; j < B; j++) {
+        const size_t index = (n0 + j)*BW_LANES;
+        const __m256d sum_v = _mm256_blendv_pd(sum[j], one, base);
+        gamma[j] = _mm256_mul_pd(sum_v, _mm256_load_pd(alpha + index));
+        _mm256_store_pd(beta + index, _mm256_mul_pd(sum_v, c_norm));
+        _mm256_store_pd(ggamma + index, gamma[j]);
+        _mm256_store_pd(scratch.gamma_lanes + index, _mm256_add_pd(_mm256_load_pd(scratch.gamma_lanes + index), _mm256_and_pd(gamma[j], inner)));
+        _mm256_store_pd(scratch.gamma_last_lanes + index, _mm256_blendv_pd(_mm256_load_pd(scratch.gamma_last_lanes + index), gamma[j], base));
+        if (t == 0) {
+            _mm256_store_pd(scratch.gamma0_sum + index, _mm256_add_pd(_mm256_load_pd(scratch.gamma0_sum + index), _mm256_and_pd(gamma[j], active)));
+        }
+    }
+
+    // the emission numerators: four states of the four lanes, transposed to one vector per lane
+    const size_t* observations = layout.observations + (layout.offsets[g] + t)*BW_LANES;
+    const size_t* lengths = layout.lengths + g*BW_LANES;
+    for (size_t j = 0; j < B; j += 4) {
+        __m256d v[BW_LANES] = {gamma[j], gamma[j+1], gamma[j+2], gamma[j+3]};
+        interleaved_transpose(v[0], v[1], v[2], v[3]);
+        for (size_t l = 0; l < BW_LANES; l++) {
+            if (t >= lengths[l]) continue;
+            double* numerator_sum = scratch.numerator_sum + observations[l]*N + n0 + j;
+            _mm256_store_pd(numerator_sum, _mm256_add_pd(_mm256_load_pd(numerator_sum), v[l]));
+        }
+    }
+}
+
+/**
+ * Backward pass of group g with gamma (into layout.beta and layout.ggamma); keeps beta[t] .* emit_prob[y_t]
+ * for sigma and writes gamma_sum and gamma_last of the sequences of the group
+ */
+static inline void backward_interleaved(const BWdata& bw, const BWinterleavedLayout& layout, const InterleavedScratch& scratch, const size_t g) {
+    const size_t N = bw.N;
+    const size_t T = layout.length(g);
+    const size_t* observations = layout.observations + layout.offsets[g]*BW_LANES;
+    const __m256i lengths = _mm256_loadu_si256((const __m256i *)(layout.lengths + g*BW_LANES));
+    const __m256d one = _mm256_set1_pd(1.0);
+    memset(scratch.gamma_lanes, 0, N*BW_LANES * sizeof(double));
+
+    for (size_t t = T; t-- > 0; ) {
+        const __m256d active = lanes_longer(lengths, t);
+        const __m256d inner = lanes_longer(lengths, t + 1);
+        const __m256d base = _mm256_andnot_pd(inner, active);
+
+        __m256d sum[8] = {one, one, one, one, one, one, one, one};
+        const double* beta_emit = scratch.beta_emit + (t+1)*N*BW_LANES;
+        if (t + 1 < T) {
+            const __m256i rows = emit_rows(observations + (t+1)*BW_LANES, N);
+            const double* beta_next = layout.beta + (t+1)*N*BW_LANES;
+            for (size_t n = 0; n < N; n++) {
+                _mm256_store_pd(scratch.beta_emit + ((t+1)*N + n)*BW_LANES, _mm256_mul_pd(_mm256_load_pd(beta_next + n*BW_LANES), _mm256_i64gather_pd(bw.emit_prob + n, rows, 8)));
+            }
+        }
+
+        size_t n0 = 0;
+        for (; n0 + 8 <= N; n0 += 8) {
+            if (t + 1 < T) backward_block<8>(bw, beta_emit, n0, sum);
+            gamma_block<8>(bw, layout, scratch, g, t, n0, sum, active, inner, base);
+        }
+        if (n0 < N) {
+            if (t + 1 < T) backward_block<4>(bw, beta_emit, n0, sum);
+            gamma_block<4>(bw, layout, scratch, g, t, n0, sum, active, inner, base);
+        }
+    }
+
+    double* gamma_sum[BW_LANES];
+    double* gamma_last[BW_LANES];
+    for (size_t l = 0; l < BW_LANES; l++) {
+        const size_t k = layout.sequence(g, l);
+        gamma_sum[l] = (k < bw.K) ? bw.gamma_sum + k*N : NULL;
+        gamma_last[l] = (k < bw.K) ? scratch.gamma_last + k*N : NULL;
+    }
+    interleaved_store_lanes(scratch.gamma_lanes, N, gamma_sum);
+    interleaved_store_lanes(scratch.gamma_last_lanes, N, gamma_last);
+}
+
+/**
+ * sigma_sum of the sequences of group g: trans_prob[n0][n1] does not depend on t, thus
+ * sigma_sum[n0][n1] = trans_prob[n0][n1] * sum_(t <= T-2) alpha[t][n0] * beta_emit[t+1][n1],
+ * in tiles of 2 x 4 states (of four lanes each)
+ */
+static inline void sigma_interleaved(const BWdata& bw, const BWinterleavedLayout& layout, const InterleavedScratch& scratch, const size_t g) {
+    const size_t N = bw.N;
+    const size_t T = layout.length(g);
+    const __m256i lengths = _mm256_loadu_si256((const __m256i *)(layout.lengths + g*BW_LANES));
+    double* sigma_sum[BW_LANES];
+    for (size_t l = 0; l < BW_LANES; l++) {
+        const size_t k = layout.sequence(g, l);
+        sigma_sum[l] = (k < bw.K) ? bw.sigma_sum + k*N*N : NULL;
+    }
+
+    for (size_t n0 = 0; n0 < N; n0 += 2) {
+        for (size_t n1 = 0; n1 < N; n1 += 4) {
+            __m256d s_sum[2][4];
+            for (size_t r = 0; r < 2; r++) {
+                for (size_t j = 0; j < 4; j++) {
+                    s_sum[r][j] = _mm256_setzero_pd();
+                }
+            }
+            for (size_t t = 0; t + 1 < T; t++) {
+                const __m256d inner = lanes_longer(lengths, t + 1);
+                const double* alpha = layout.alpha + (t*N + n0)*BW_LANES;
+                const double* beta_emit = scratch.beta_emit + ((t+1)*N + n1)*BW_LANES;
+                const __m256d alpha0 = _mm256_load_pd(alpha);
+                const __m256d alpha1 = _mm256_load_pd(alpha + BW_LANES);
+                for (size_t j = 0; j < 4; j++) {
+                    const __m256d beta_emit_v = _mm256_and_pd(_mm256_load_pd(beta_emit + j*BW_LANES), inner);
+                    s_sum[0][j] = _mm256_fmadd_pd(alpha0, beta_emit_v, s_sum[0][j]);
+                    s_sum[1][j] = _mm256_fmadd_pd(alpha1, beta_emit_v, s_sum[1][j]);
+                }
+            }
+            for (size_t r = 0; r < 2; r++) {
+                interleaved_transpose(s_sum[r][0], s_sum[r][1], s_sum[r][2], s_sum[r][3]);
+                const size_t index = (n0 + r)*N + n1;
+                const __m256d trans_prob = _mm256_load_pd(bw.trans_prob + index);
+                for (size_t l = 0; l < BW_LANES; l++) {
+                    if (sigma_sum[l]) _mm256_store_pd(sigma_sum[l] + index, _mm256_mul_pd(s_sum[r][l], trans_prob));
+                }
+            }
+        }
+    }
+}
+
+/**
+ * sigma of sequence k from alpha and beta in the layout of bw (only if the BWdata has a buffer for it)
+ */
+static inline void sigma_materialize(const BWdata& bw, const size_t k) {
+    const size_t N = bw.N;
+    const size_t kT = bw.offsets[k];
+    for (size_t t = 0; t + 1 < bw.length(k); t++) {
+        const double* alpha = bw.alpha + (kT + t)*N;
+        const double* beta_next = bw.beta + (kT + t+1)*N;
+        const double* emit_prob = bw.emit_prob + bw.observations[kT + t+1]*N;
+        double* sigma = bw.sigma + (kT + t)*N*N;
+        for (size_t n0 = 0; n0 < N; n0++) {
+            const __m256d alpha_v = _mm256_broadcast_sd(alpha + n0);
+            for (size_t n1 = 0; n1 < N; n1 += 4) {
+                const __m256d beta_emit_v = _mm256_mul_pd(_mm256_load_pd(beta_next + n1), _mm256_load_pd(emit_prob + n1));
+                _mm256_store_pd(sigma + n0*N + n1, _mm256_mul_pd(alpha_v, _mm256_mul_pd(_mm256_load_pd(bw.trans_prob + n0*N + n1), beta_emit_v)));
+            }
+        }
+    }
+}
+
+/**
+ * M-step from the sums of backward_interleaved (adds the last time step to gamma_sum, as the baseline)
+ */
+static inline void update_interleaved(const BWdata& bw, const InterleavedScratch& scratch) {
+    const size_t K = bw.K;
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    // init_prob (the lanes of gamma0_sum added once per iteration) and the denominators of trans_prob
+    for (size_t n = 0; n < N; n++) {
+        double g0_sum = 0.0;
+        for (size_t l = 0; l < BW_LANES; l++) {
+            g0_sum += scratch.gamma0_sum[n*BW_LANES + l];
+        }
+        bw.init_prob[n] = g0_sum/K;
+    }
+    for (size_t n = 0; n < N; n += 4) {
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            g_sum = _mm256_add_pd(g_sum, _mm256_load_pd(bw.gamma_sum + k*N + n));
+        }
+        _mm256_store_pd(scratch.denominator_sum + n, _mm256_div_pd(one, g_sum));
+    }
+
+    // trans_prob
+    for (size_t n0 = 0; n0 < N; n0++) {
+        const __m256d denominator_v = _mm256_broadcast_sd(scratch.denominator_sum + n0);
+        for (size_t n1 = 0; n1 < N; n1 += 4) {
+            __m256d s_sum = _mm256_setzero_pd();
+            for (size_t k = 0; k < K; k++) {
+                s_sum = _mm256_add_pd(s_sum, _mm256_load_pd(bw.sigma_sum + (k*N + n0)*N + n1));
+            }
+            _mm256_store_pd(bw.trans_prob + n0*N + n1, _mm256_mul_pd(s_sum, denominator_v));
+        }
+    }
+
+    // emit_prob
+    for (size_t n = 0; n < N; n += 4) {
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            const __m256d gamma_sum = _mm256_add_pd(_mm256_load_pd(bw.gamma_sum + k*N + n), _mm256_load_pd(scratch.gamma_last + k*N + n));
+            _mm256_store_pd(bw.gamma_sum + k*N + n, gamma_sum);
+            g_sum = _mm256_add_pd(g_sum, gamma_sum);
+        }
+        _mm256_store_pd(scratch.denominator_sum + n, _mm256_div_pd(one, g_sum));
+    }
+    for (size_t m = 0; m < M; m++) {
+        for (size_t n = 0; n < N; n += 4) {
+            _mm256_store_pd(bw.emit_prob + m*N + n, _mm256_mul_pd(_mm256_load_pd(scratch.numerator_sum + m*N + n), _mm256_load_pd(scratch.denominator_sum + n)));
+        }
+    }
+}
@@ -0,0 +1,68 @@
+/*
+    Likelihood accumulations
+    The ways the training implementations turn c_norm into the negative log likelihood,
+    registered side by side for the microbenchmark (benchmarks --likelihood):
+    - "likelihood-log":      one log per time step (baseline, vector_optimized, ...)
+    - "likelihood-blocked":  one log per product of 64 time steps (combined, checkpoint, float)
+    - "likelihood-exponent": products with exponent tracking, one log per sequence (likelihood.h)
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+
+#include "../common.h"
+#include "../likelihood.h"
+
+// time steps per log of "likelihood-blocked"
+#define LIKELIHOOD_LOG_BLOCK 64
+
+static void likelihood_log_per_step(const double* c_norm, const size_t K, const size_t* offsets, double* neg_log_likelihoods);
+static void likelihood_blocked(const double* c_norm, const size_t K, const size_t* offsets, double* neg_log_likelihoods);
+static void likelihood_exponent(const double* c_norm, const size_t K, const size_t* offsets, double* neg_log_likelihoods);
+
+REGISTER_LIKELIHOOD_FUNCTION(likelihood_log_per_step, "likelihood-log", "One log per time step");
+REGISTER_LIKELIHOOD_FUNCTION(likelihood_blocked, "likelihood-blocked", "One log per product of 64 time steps");
+REGISTER_LIKELIHOOD_FUNCTION(likelihood_exponent, "likelihood-exponent", "SIMD products with exponent tracking, one log per sequence");
+
+
+static void likelihood_log_per_step(const double* c_norm, const size_t K, const size_t* offsets, double* neg_log_likelihoods){
+    for (size_t k = 0; k < K; k++) {
+        double neg_log_likelihood = 0.0;
+        for (size_t i = offsets[k]; i < offsets[k+1]; i++) {
+            neg_log_likelihood += log(c_norm[i]);
+        }
+        neg_log_likelihoods[k] = neg_log_likelihood;
+    }
+}
+
+static void likelihood_blocked(const double* c_norm, const size_t K, const size_t* offsets, double* neg_log_likelihoods){
+    for (size_t k = 0; k < K; k++) {
+        double neg_log_likelihood = 0.0;
+        double product = 1.0;
+        for (size_t i = offsets[k]; i < offsets[k+1]; i++) {
+            product *= c_norm[i];
+            if ((i - offsets[k] + 1) % LIKELIHOOD_LOG_BLOCK == 0) {
+                neg_log_likelihood += log(product);
+                product = 1.0;
+            }
+        }
+        neg_log_likelihoods[k] = neg_log_likelihood + log(product);
+    }
+}
+
+static void likelihood_exponent(const double* c_norm, const size_t K, const size_t* offsets, double* neg_log_likelihoods){
+    for (size_t k = 0; k < K; k++) {
+        neg_log_likelihoods[k] = likelihood_log(c_norm + offsets[k], offsets[k+1] - offsets[k]);
+    }
+}
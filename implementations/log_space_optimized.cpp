@@ -0,0 +1,439 @@
+/*
+    Log-space forward-backward
+    For models with very peaked emissions (or long runs of unlikely observations), where the
+    product alpha[t-1] * trans_prob * emit_prob of the scaled forward underflows before c_norm
+    can rescale it. Here alpha and beta are kept as logarithms and every sum over states is a
+    logsumexp, shifted by the maximum of the vector it is taken over:
+
+        log alpha[t][n1] = log emit_prob[n1][y_t] + m + log sum_n0 exp(log alpha[t-1][n0] - m) * trans_prob[n0][n1]
+        log beta[t][n0]  = m' + log sum_n1 trans_prob[n0][n1] * exp(log emit_prob[n1][y_(t+1)] + log beta[t+1][n1] - m')
+
+    i.e. one exp per state and one log per state and time step, the O(N*N) part stays a
+    multiply-add. exp and log are evaluated 4 at a time with AVX2 (range reduction and a
+    polynomial, accurate to about 1e-15). The largest term of every sum is exp(0) = 1, so
+    nothing the sum depends on underflows.
+    For the comparison with the other implementations the usual scaled alpha, beta, ggamma,
+    c_norm and sigma are written as well (c_norm[t] = P(y_0..y_(t-1)) / P(y_0..y_t)).
+    Requires N to be a multiple of 4, any M, K and T >= 2 (and ragged sequences).
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <cassert>
+
+#include "../common.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+
+// log(0), finite such that -ffast-math can assume there are no infinities
+#define LOG_SPACE_ZERO (-1e300)
+// exp(x) = 0 below (the smallest normal double is exp(-708.39)), exp(x) is clamped above
+#define LOG_SPACE_EXP_MIN (-708.0)
+#define LOG_SPACE_EXP_MAX (709.0)
+
+// local buffers of one run, passed along such that concurrent runs don't share them
+struct LogSpaceScratch {
+    double* log_alpha; //            [T][N]      log alpha of the current sequence (unscaled)
+    double* log_likelihood; //       [T]         log P(y_0..y_t) of the current sequence
+    double* log_beta; //             [2][N]      log beta at t and t+1 (unscaled)
+    double* log_beta_emit_prob; //   [N]         log beta[t+1][n] + log emit_prob[n][y_(t+1)]
+    double* exp_shifted; //          [N]         exp of a log vector minus its maximum
+    double* beta_sum; //             [N]         beta[t] up to a factor (the sum of the backward logsumexp)
+    double* log_init_prob; //        [N]
+    double* log_emit_prob; //        [M][N]
+    double* trans_prob_transpose; // [N][N]
+    double* gamma0_sum; //           [N]         sum of ggamma[k][0] over all k
+    double* gamma_last; //           [K][N]      ggamma[k][T-1]
+    double* numerator_sum; //        [M][N]      sum of ggamma[k][t] over all k and t with y_t = m
+    double* denominator_sum; //      [N]
+};
+
+static size_t comp_bw_log_space(const BWdata& bw);
+static inline double forward_log_space(const BWdata& bw, const LogSpaceScratch& scratch, const size_t k);
+static inline void backward_log_space(const BWdata& bw, const LogSpaceScratch& scratch, const size_t k);
+static inline void update_log_space(const BWdata& bw, const LogSpaceScratch& scratch);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_log_space, "log-space", "Log-space forward-backward with AVX2 logsumexp", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_LOG_SPACE);
+
+
+/**
+ * exp(x) for 4 doubles: x = n*log(2) + r with |r| <= log(2)/2, exp(r) by its Taylor polynomial
+ * of degree 11 and 2^n through the exponent bits. 0 for x < LOG_SPACE_EXP_MIN.
+ */
+static inline __m256d exp256_pd(__m256d x) {
+    const __m256d underflow = _mm256_cmp_pd(x, _mm256_set1_pd(LOG_SPACE_EXP_MIN), _CMP_LT_OQ);
+    x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(LOG_SPACE_EXP_MIN)), _mm256_set1_pd(LOG_SPACE_EXP_MAX));
+
+    const __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.4426950408889634)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(6.93147180369123816490e-01), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(1.90821492927058770002e-10), r);
+
+    __m256d p = _mm256_set1_pd(1.0/39916800.0);
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0/3628800.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0/362880.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0/40320.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0/5040.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0/720.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0/120.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0/24.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0/6.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(0.5));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+
+    // 2^n, -1021 <= n <= 1023
+    const __m256i n64 = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+    const __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(n64, _mm256_set1_epi64x(1023)), 52));
+    return _mm256_andnot_pd(underflow, _mm256_mul_pd(p, scale));
+}
+
+/**
+ * log(x) for 4 doubles: x = m*2^e with sqrt(1/2) <= m < sqrt(2), log(m) = 2*atanh((m-1)/(m+1))
+ * by its series up to s^19. LOG_SPACE_ZERO for x = 0 (and denormals).
+ */
+static inline __m256d log256_pd(__m256d x) {
+    const __m256d zero = _mm256_cmp_pd(x, _mm256_set1_pd(DBL_MIN), _CMP_LT_OQ);
+    x = _mm256_max_pd(x, _mm256_set1_pd(DBL_MIN));
+
+    const __m256i bits = _mm256_castpd_si256(x);
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL)), _mm256_set1_epi64x(0x3FF0000000000000LL)));
+    // biased exponent (x > 0) to double through the mantissa of 2^52
+    __m256d e = _mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(0x4330000000000000LL)));
+    e = _mm256_sub_pd(e, _mm256_set1_pd(4503599627370496.0 + 1023.0));
+    const __m256d large = _mm256_cmp_pd(m, _mm256_set1_pd(1.4142135623730951), _CMP_GT_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), large);
+    e = _mm256_add_pd(e, _mm256_and_pd(large, _mm256_set1_pd(1.0)));
+
+    const __m256d f = _mm256_sub_pd(m, _mm256_set1_pd(1.0));
+    const __m256d s = _mm256_div_pd(f, _mm256_add_pd(f, _mm256_set1_pd(2.0)));
+    const __m256d s2 = _mm256_mul_pd(s, s);
+    __m256d p = _mm256_set1_pd(2.0/19.0);
+    p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(2.0/17.0));
+    p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(2.0/15.0));
+    p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(2.0/13.0));
+    p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(2.0/11.0));
+    p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(2.0/9.0));
+    p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(2.0/7.0));
+    p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(2.0/5.0));
+    p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(2.0/3.0));
+    p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(2.0));
+    __m256d result = _mm256_mul_pd(p, s);
+
+    result = _mm256_fmadd_pd(e, _mm256_set1_pd(1.90821492927058770002e-10), result);
+    result = _mm256_fmadd_pd(e, _mm256_set1_pd(6.93147180369123816490e-01), result);
+    return _mm256_blendv_pd(result, _mm256_set1_pd(LOG_SPACE_ZERO), zero);
+}
+
+static inline double hmax256_pd(const __m256d x) {
+    const __m256d y = _mm256_max_pd(x, _mm256_permute2f128_pd(x, x, 1));
+    return _mm256_cvtsd_f64(_mm256_max_pd(y, _mm256_permute_pd(y, 1)));
+}
+
+static inline double hsum256_pd(__m256d x) {
+    x = _mm256_hadd_pd(x, x);
+    return _mm256_cvtsd_f64(x) + _mm256_cvtsd_f64(_mm256_permute2f128_pd(x, x, 1));
+}
+
+/**
+ * Writes exp(x[n] - max) of the log vector x[N] to scratch.exp_shifted, returns max and
+ * sets sum to the sum of exp_shifted, i.e. the logsumexp of x is max + log(sum)
+ */
+static inline double shift_exp(const size_t N, const double* x, const LogSpaceScratch& scratch, double& sum) {
+    __m256d max_v = _mm256_set1_pd(LOG_SPACE_ZERO);
+    for (size_t n = 0; n < N; n += 4) {
+        max_v = _mm256_max_pd(max_v, _mm256_load_pd(x + n));
+    }
+    const double max = hmax256_pd(max_v);
+    max_v = _mm256_set1_pd(max);
+    __m256d sum_v = _mm256_setzero_pd();
+    for (size_t n = 0; n < N; n += 4) {
+        const __m256d exp_v = exp256_pd(_mm256_sub_pd(_mm256_load_pd(x + n), max_v));
+        _mm256_store_pd(scratch.exp_shifted + n, exp_v);
+        sum_v = _mm256_add_pd(sum_v, exp_v);
+    }
+    sum = hsum256_pd(sum_v);
+    return max;
+}
+
+static size_t comp_bw_log_space(const BWdata& bw){
+    assert(bw.N % 4 == 0 && "N has to be a multiple of 4");
+    BWconvergence convergence(bw);
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+
+    LogSpaceScratch scratch;
+    scratch.log_alpha = (double *)bw_scratch_alloc(bw, "log_space/log_alpha", bw.T*N * sizeof(double));
+    scratch.log_likelihood = (double *)bw_scratch_alloc(bw, "log_space/log_likelihood", bw.T * sizeof(double));
+    scratch.log_beta = (double *)bw_scratch_alloc(bw, "log_space/log_beta", 2*N * sizeof(double));
+    scratch.log_beta_emit_prob = (double *)bw_scratch_alloc(bw, "log_space/log_beta_emit_prob", N * sizeof(double));
+    scratch.exp_shifted = (double *)bw_scratch_alloc(bw, "log_space/exp_shifted", N * sizeof(double));
+    scratch.beta_sum = (double *)bw_scratch_alloc(bw, "log_space/beta_sum", N * sizeof(double));
+    scratch.log_init_prob = (double *)bw_scratch_alloc(bw, "log_space/log_init_prob", N * sizeof(double));
+    scratch.log_emit_prob = (double *)bw_scratch_alloc(bw, "log_space/log_emit_prob", M*N * sizeof(double));
+    scratch.trans_prob_transpose = (double *)bw_scratch_alloc(bw, "log_space/trans_prob_transpose", N*N * sizeof(double));
+    scratch.gamma0_sum = (double *)bw_scratch_alloc(bw, "log_space/gamma0_sum", N * sizeof(double));
+    scratch.gamma_last = (double *)bw_scratch_alloc(bw, "log_space/gamma_last", bw.K*N * sizeof(double));
+    scratch.numerator_sum = (double *)bw_scratch_alloc(bw, "log_space/numerator_sum", M*N * sizeof(double));
+    scratch.denominator_sum = (double *)bw_scratch_alloc(bw, "log_space/denominator_sum", N * sizeof(double));
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+        for (size_t n = 0; n < N; n += 4) {
+            _mm256_store_pd(scratch.log_init_prob + n, log256_pd(_mm256_load_pd(bw.init_prob + n)));
+        }
+        for (size_t m = 0; m < M; m++) {
+            for (size_t n = 0; n < N; n += 4) {
+                _mm256_store_pd(scratch.log_emit_prob + m*N + n, log256_pd(_mm256_load_pd(bw.emit_prob + m*N + n)));
+            }
+        }
+        for (size_t n0 = 0; n0 < N; n0++) {
+            for (size_t n1 = 0; n1 < N; n1++) {
+                scratch.trans_prob_transpose[n1*N + n0] = bw.trans_prob[n0*N + n1];
+            }
+        }
+        memset(scratch.gamma0_sum, 0, N * sizeof(double));
+        memset(scratch.numerator_sum, 0, M*N * sizeof(double));
+
+        double neg_log_likelihood_sum = 0.0;
+        for (size_t k = 0; k < bw.K; k++) {
+            Instrumentation::phase(BW_PHASE_FORWARD);
+            neg_log_likelihood_sum += forward_log_space(bw, scratch, k);
+            Instrumentation::phase(BW_PHASE_BACKWARD);
+            backward_log_space(bw, scratch, k);
+        }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        update_log_space(bw, scratch);
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bw_scratch_free(bw, scratch.log_alpha);
+    bw_scratch_free(bw, scratch.log_likelihood);
+    bw_scratch_free(bw, scratch.log_beta);
+    bw_scratch_free(bw, scratch.log_beta_emit_prob);
+    bw_scratch_free(bw, scratch.exp_shifted);
+    bw_scratch_free(bw, scratch.beta_sum);
+    bw_scratch_free(bw, scratch.log_init_prob);
+    bw_scratch_free(bw, scratch.log_emit_prob);
+    bw_scratch_free(bw, scratch.trans_prob_transpose);
+    bw_scratch_free(bw, scratch.gamma0_sum);
+    bw_scratch_free(bw, scratch.gamma_last);
+    bw_scratch_free(bw, scratch.numerator_sum);
+    bw_scratch_free(bw, scratch.denominator_sum);
+
+    return convergence.converged_at();
+}
+
+/**
+ * Forward pass of sequence k in log space, returns its negative log likelihood.
+ * The exp_shifted of the logsumexp of log alpha[t] is the shifted alpha[t] of step t+1
+ * (and alpha[t] itself after dividing by its sum), so every step takes N exps and N logs.
+ */
+static inline double forward_log_space(const BWdata& bw, const LogSpaceScratch& scratch, const size_t k) {
+    const size_t N = bw.N;
+    const size_t kT = bw.offsets[k];
+    const size_t T = bw.length(k);
+    double log_likelihood_old = 0.0;
+
+    for (size_t t = 0; t < T; t++) {
+        double* log_alpha = scratch.log_alpha + t*N;
+        const double* log_emit_prob = scratch.log_emit_prob + bw.observations[kT + t]*N;
+
+        if (t == 0) {
+            for (size_t n = 0; n < N; n += 4) {
+                _mm256_store_pd(log_alpha + n, _mm256_add_pd(_mm256_load_pd(scratch.log_init_prob + n), _mm256_load_pd(log_emit_prob + n)));
+            }
+        } else {
+            // exp_shifted = exp(log alpha[t-1] - log_likelihood_old) = alpha[t-1] (scaled), from the previous step
+            const __m256d shift_v = _mm256_set1_pd(log_likelihood_old);
+            for (size_t n1 = 0; n1 < N; n1 += 4) {
+                __m256d alpha_sum0 = _mm256_setzero_pd();
+                __m256d alpha_sum1 = _mm256_setzero_pd();
+                for (size_t n0 = 0; n0 < N; n0 += 2) {
+                    alpha_sum0 = _mm256_fmadd_pd(_mm256_broadcast_sd(scratch.exp_shifted + n0 + 0), _mm256_load_pd(bw.trans_prob + (n0+0)*N + n1), alpha_sum0);
+                    alpha_sum1 = _mm256_fmadd_pd(_mm256_broadcast_sd(scratch.exp_shifted + n0 + 1), _mm256_load_pd(bw.trans_prob + (n0+1)*N + n1), alpha_sum1);
+                }
+                const __m256d log_alpha_v = _mm256_add_pd(_mm256_add_pd(log256_pd(_mm256_add_pd(alpha_sum0, alpha_sum1)), shift_v), _mm256_load_pd(log_emit_prob + n1));
+                _mm256_store_pd(log_alpha + n1, log_alpha_v);
+            }
+        }
+
+        // log P(y_0..y_t), alpha[t] = exp(log alpha[t] - log P(y_0..y_t)) and c_norm
+        double sum;
+        const double max = shift_exp(N, log_alpha, scratch, sum);
+        const double log_likelihood = max + log(sum);
+        double* alpha = bw.alpha + (kT + t)*N;
+        const __m256d scale_v = _mm256_set1_pd(1.0/sum);
+        for (size_t n = 0; n < N; n += 4) {
+            const __m256d alpha_v = _mm256_mul_pd(_mm256_load_pd(scratch.exp_shifted + n), scale_v);
+            _mm256_store_pd(alpha + n, alpha_v);
+            _mm256_store_pd(scratch.exp_shifted + n, alpha_v);
+        }
+        bw.c_norm[kT + t] = exp(log_likelihood_old - log_likelihood);
+        scratch.log_likelihood[t] = log_likelihood;
+        log_likelihood_old = log_likelihood;
+    }
+
+    return -log_likelihood_old;
+}
+
+/**
+ * Backward pass of sequence k in log space with gamma and sigma. Adds ggamma to gamma0_sum (t = 0),
+ * gamma_sum[k] (t <= T-2), gamma_last[k] (t = T-1) and the emission numerators, sigma to sigma_sum[k].
+ * With s[n0] = sum_n1 trans_prob[n0][n1] * exp_shifted[n1], the shifted beta_emit_prob:
+ * log beta[t][n0] = m' + log s[n0], ggamma[t][n0] = s[n0] * exp(log alpha[t][n0] + m' - log P)
+ * and sigma[t][n0][n1] = exp(log alpha[t][n0] + m' - log P) * trans_prob[n0][n1] * exp_shifted[n1].
+ */
+static inline void backward_log_space(const BWdata& bw, const LogSpaceScratch& scratch, const size_t k) {
+    const size_t N = bw.N;
+    const size_t kT = bw.offsets[k];
+    const size_t T = bw.length(k);
+    const double log_likelihood = scratch.log_likelihood[T-1];
+    double* gamma_sum = bw.gamma_sum + k*N;
+    double* sigma_sum = bw.sigma_sum + k*N*N;
+
+    memset(gamma_sum, 0, N * sizeof(double));
+    memset(sigma_sum, 0, N*N * sizeof(double));
+
+    // t = T-1, base case: log beta = 0, beta = c_norm, ggamma = alpha
+    {
+        double* log_beta = scratch.log_beta + ((T-1) % 2)*N;
+        double* numerator_sum = scratch.numerator_sum + bw.observations[kT + T-1]*N;
+        const __m256d c_norm_v = _mm256_set1_pd(bw.c_norm[kT + T-1]);
+        for (size_t n = 0; n < N; n += 4) {
+            const __m256d gamma_v = _mm256_load_pd(bw.alpha + (kT + T-1)*N + n);
+            _mm256_store_pd(log_beta + n, _mm256_setzero_pd());
+            _mm256_store_pd(bw.beta + (kT + T-1)*N + n, c_norm_v);
+            _mm256_store_pd(bw.ggamma + (kT + T-1)*N + n, gamma_v);
+            _mm256_store_pd(scratch.gamma_last + k*N + n, gamma_v);
+            _mm256_store_pd(numerator_sum + n, _mm256_add_pd(_mm256_load_pd(numerator_sum + n), gamma_v));
+        }
+    }
+
+    for (size_t t = T-1; t-- > 0; ) {
+        const double* log_alpha = scratch.log_alpha + t*N;
+        const double* log_beta_next = scratch.log_beta + ((t+1) % 2)*N;
+        double* log_beta = scratch.log_beta + (t % 2)*N;
+        double* beta = bw.beta + (kT + t)*N;
+        double* ggamma = bw.ggamma + (kT + t)*N;
+        double* numerator_sum = scratch.numerator_sum + bw.observations[kT + t]*N;
+        const double* log_emit_prob = scratch.log_emit_prob + bw.observations[kT + t+1]*N;
+
+        for (size_t n = 0; n < N; n += 4) {
+            _mm256_store_pd(scratch.log_beta_emit_prob + n, _mm256_add_pd(_mm256_load_pd(log_beta_next + n), _mm256_load_pd(log_emit_prob + n)));
+        }
+        double sum;
+        const double max = shift_exp(N, scratch.log_beta_emit_prob, scratch, sum);
+
+        // beta[t] (scaled) = exp(log beta[t] + log P(y_0..y_(t-1)) - log P)
+        const double log_likelihood_old = (t == 0) ? 0.0 : scratch.log_likelihood[t-1];
+        const __m256d max_v = _mm256_set1_pd(max);
+        const __m256d beta_scale_v = _mm256_set1_pd(exp(max + log_likelihood_old - log_likelihood));
+        const __m256d gamma_shift_v = _mm256_set1_pd(max - log_likelihood);
+        for (size_t n0 = 0; n0 < N; n0 += 4) {
+            __m256d beta_sum0 = _mm256_setzero_pd();
+            __m256d beta_sum1 = _mm256_setzero_pd();
+            for (size_t n1 = 0; n1 < N; n1 += 2) {
+                beta_sum0 = _mm256_fmadd_pd(_mm256_broadcast_sd(scratch.exp_shifted + n1 + 0), _mm256_load_pd(scratch.trans_prob_transpose + (n1+0)*N + n0), beta_sum0);
+                beta_sum1 = _mm256_fmadd_pd(_mm256_broadcast_sd(scratch.exp_shifted + n1 + 1), _mm256_load_pd(scratch.trans_prob_transpose + (n1+1)*N + n0), beta_sum1);
+            }
+            const __m256d beta_sum = _mm256_add_pd(beta_sum0, beta_sum1);
+            _mm256_store_pd(scratch.beta_sum + n0, beta_sum);
+            _mm256_store_pd(log_beta + n0, _mm256_add_pd(log256_pd(beta_sum), max_v));
+            _mm256_store_pd(beta + n0, _mm256_mul_pd(beta_sum, beta_scale_v));
+
+            // the factor of row n0 of sigma, kept in ggamma until sigma is done
+            const __m256d alpha_v = exp256_pd(_mm256_add_pd(_mm256_load_pd(log_alpha + n0), gamma_shift_v));
+            _mm256_store_pd(ggamma + n0, alpha_v);
+        }
+
+        // sigma[t][n0][n1] = exp(log alpha[t][n0] + m' - log P) * trans_prob[n0][n1] * exp_shifted[n1]
+        for (size_t n0 = 0; n0 < N; n0++) {
+            const __m256d alpha_v = _mm256_broadcast_sd(ggamma + n0);
+            for (size_t n1 = 0; n1 < N; n1 += 4) {
+                const __m256d sigma_v = _mm256_mul_pd(alpha_v, _mm256_mul_pd(_mm256_load_pd(bw.trans_prob + n0*N + n1), _mm256_load_pd(scratch.exp_shifted + n1)));
+                if (bw.sigma) _mm256_store_pd(bw.sigma + ((kT + t)*N + n0)*N + n1, sigma_v);
+                _mm256_store_pd(sigma_sum + n0*N + n1, _mm256_add_pd(_mm256_load_pd(sigma_sum + n0*N + n1), sigma_v));
+            }
+        }
+
+        // ggamma = factor * s = exp(log alpha + log beta - log P) and the sums of ggamma
+        for (size_t n0 = 0; n0 < N; n0 += 4) {
+            const __m256d gamma_v = _mm256_mul_pd(_mm256_load_pd(ggamma + n0), _mm256_load_pd(scratch.beta_sum + n0));
+            _mm256_store_pd(ggamma + n0, gamma_v);
+            _mm256_store_pd(gamma_sum + n0, _mm256_add_pd(_mm256_load_pd(gamma_sum + n0), gamma_v));
+            _mm256_store_pd(numerator_sum + n0, _mm256_add_pd(_mm256_load_pd(numerator_sum + n0), gamma_v));
+            if (t == 0) {
+                _mm256_store_pd(scratch.gamma0_sum + n0, _mm256_add_pd(_mm256_load_pd(scratch.gamma0_sum + n0), gamma_v));
+            }
+        }
+    }
+}
+
+/**
+ * M-step from the sums of backward_log_space (adds the last time step to gamma_sum, as the baseline)
+ */
+static inline void update_log_space(const BWdata& bw, const LogSpaceScratch& scratch) {
+    const size_t K = bw.K;
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+
+    // init_prob
+    const __m256d K_v = _mm256_set1_pd((double)K);
+    for (size_t n = 0; n < N; n += 4) {
+        _mm256_store_pd(bw.init_prob + n, _mm256_div_pd(_mm256_load_pd(scratch.gamma0_sum + n), K_v));
+    }
+
+    // trans_prob
+    for (size_t n = 0; n < N; n += 4) {
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            g_sum = _mm256_add_pd(g_sum, _mm256_load_pd(bw.gamma_sum + k*N + n));
+        }
+        _mm256_store_pd(scratch.denominator_sum + n, g_sum);
+    }
+    for (size_t n0 = 0; n0 < N; n0++) {
+        const __m256d denominator = _mm256_broadcast_sd(scratch.denominator_sum + n0);
+        for (size_t n1 = 0; n1 < N; n1 += 4) {
+            __m256d s_sum = _mm256_setzero_pd();
+            for (size_t k = 0; k < K; k++) {
+                s_sum = _mm256_add_pd(s_sum, _mm256_load_pd(bw.sigma_sum + (k*N + n0)*N + n1));
+            }
+            _mm256_store_pd(bw.trans_prob + n0*N + n1, _mm256_div_pd(s_sum, denominator));
+        }
+    }
+
+    // emit_prob
+    for (size_t n = 0; n < N; n += 4) {
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            const __m256d gamma_sum = _mm256_add_pd(_mm256_load_pd(bw.gamma_sum + k*N + n), _mm256_load_pd(scratch.gamma_last + k*N + n));
+            _mm256_store_pd(bw.gamma_sum + k*N + n, gamma_sum);
+            g_sum = _mm256_add_pd(g_sum, gamma_sum);
+        }
+        _mm256_store_pd(scratch.denominator_sum + n, g_sum);
+    }
+    for (size_t m = 0; m < M; m++) {
+        for (size_t n = 0; n < N; n += 4) {
+            _mm256_store_pd(bw.emit_prob + m*N + n, _mm256_div_pd(_mm256_load_pd(scratch.numerator_sum + m*N + n), _mm256_load_pd(scratch.denominator_sum + n)));
+        }
+    }
+}
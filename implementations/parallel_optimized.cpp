@@ -0,0 +1,307 @@
+/*
+    Parallel implementation
+    Shards the K observation sequences over the threads of the persistent ThreadPool.
+    Every thread keeps private (cache line padded) sufficient statistics that are
+    reduced before the M-step, such that the updates are O(threads) instead of O(K).
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+
+#include "../common.h"
+#include "../likelihood.h"
+#include "../thread_pool.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+
+// doubles per cache line; every per-thread block is a multiple of it
+#define CACHE_LINE_DOUBLES 8
+
+/**
+ * Per-thread sufficient statistics, all summed over the sequences of the thread
+ */
+struct ThreadStats {
+    double* init; //        [N]         sum_k ggamma[k][0][n]
+    double* gamma; //       [N]         sum_k sum_{t < T-1} ggamma[k][t][n]
+    double* gamma_full; //  [N]         sum_k sum_{t} ggamma[k][t][n]
+    double* sigma; //       [N][N]      sum_k sigma_sum[k][n0][n1]
+    double* emit; //        [M][N]      sum_k sum_{t : obs[k][t] == m} ggamma[k][t][n]
+    double* beta_emit; //   [N]         scratch for the backward step
+    double* neg_log_likelihood; // [1]  sum_k sum_t log(c_norm[k][t])
+};
+
+static inline size_t pad(const size_t count){
+    return ((count + CACHE_LINE_DOUBLES - 1) / CACHE_LINE_DOUBLES) * CACHE_LINE_DOUBLES;
+}
+
+static void forward_step_par(const BWdata& bw, const size_t k);
+static void backward_step_par(const BWdata& bw, const size_t k, ThreadStats& stats);
+static void accumulate_par(const BWdata& bw, const size_t k, ThreadStats& stats);
+static void reduce_and_update(const BWdata& bw, ThreadStats* stats, const size_t num_threads);
+static size_t comp_bw_parallel(const BWdata& bw);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_parallel, "parallel", "Parallel over K: thread pool with per-thread statistics", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED);
+
+
+size_t comp_bw_parallel(const BWdata& bw){
+    BWconvergence convergence(bw);
+    double neg_log_likelihood_sum;
+
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+    const size_t num_threads = ThreadPool::get_num_threads();
+
+    // One contiguous block per thread, padded to whole cache lines to avoid false sharing
+    const size_t block = 4*pad(N) + pad(N*N) + pad(M*N) + pad(1);
+    double* storage = (double *)bw_scratch_alloc(bw, "parallel/storage", num_threads*block*sizeof(double));
+    ThreadStats* stats = (ThreadStats *)bw_scratch_alloc(bw, "parallel/stats", num_threads*sizeof(ThreadStats));
+
+    for (size_t p = 0; p < num_threads; p++) {
+        double* base = storage + p*block;
+        stats[p].init = base;
+        stats[p].gamma = stats[p].init + pad(N);
+        stats[p].gamma_full = stats[p].gamma + pad(N);
+        stats[p].beta_emit = stats[p].gamma_full + pad(N);
+        stats[p].sigma = stats[p].beta_emit + pad(N);
+        stats[p].emit = stats[p].sigma + pad(N*N);
+        stats[p].neg_log_likelihood = stats[p].emit + pad(M*N);
+    }
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+
+        // the whole E-step is fused and runs on the pool
+        Instrumentation::phase(BW_PHASE_FORWARD);
+        ThreadPool::run([&](const size_t thread_id, const size_t threads){
+            ThreadStats& s = stats[thread_id];
+            memset(s.init, 0, block*sizeof(double));
+
+            size_t k_begin, k_end;
+            ThreadPool::shard(bw.K, thread_id, threads, k_begin, k_end);
+            for (size_t k = k_begin; k < k_end; k++) {
+                forward_step_par(bw, k);
+                backward_step_par(bw, k, s);
+                accumulate_par(bw, k, s);
+            }
+        });
+
+        Instrumentation::phase(BW_PHASE_LIKELIHOOD);
+        neg_log_likelihood_sum = 0.0;
+        for (size_t p = 0; p < num_threads; p++) {
+            neg_log_likelihood_sum += *stats[p].neg_log_likelihood;
+        }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        // all three updates are fused
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        reduce_and_update(bw, stats, num_threads);
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bw_scratch_free(bw, stats);
+    bw_scratch_free(bw, storage);
+
+    return convergence.converged_at();
+}
+
+
+static inline void forward_step_par(const BWdata& bw, const size_t k) {
+    const size_t N = bw.N;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    double* alpha = bw.alpha + kT*N;
+    double* c_norm = bw.c_norm + kT;
+
+    // t = 0, base case
+    double c_sum = 0.0;
+    const double* emit = bw.emit_prob + observations[0]*N;
+    for (size_t n = 0; n < N; n++) {
+        alpha[n] = bw.init_prob[n]*emit[n];
+        c_sum += alpha[n];
+    }
+    double c = 1.0/c_sum;
+    c_norm[0] = c;
+    for (size_t n = 0; n < N; n++) {
+        alpha[n] *= c;
+    }
+
+    // recursion step: alpha[t] = (alpha[t-1] * trans_prob) .* emit_prob[obs[t]]
+    for (size_t t = 1; t < T; t++) {
+        const double* alpha_prev = alpha + (t-1)*N;
+        double* alpha_t = alpha + t*N;
+        emit = bw.emit_prob + observations[t]*N;
+
+        memset(alpha_t, 0, N*sizeof(double));
+        for (size_t n1 = 0; n1 < N; n1++) {
+            const double a = alpha_prev[n1];
+            const double* trans = bw.trans_prob + n1*N;
+            for (size_t n0 = 0; n0 < N; n0++) {
+                alpha_t[n0] += a*trans[n0];
+            }
+        }
+
+        c_sum = 0.0;
+        for (size_t n0 = 0; n0 < N; n0++) {
+            alpha_t[n0] *= emit[n0];
+            c_sum += alpha_t[n0];
+        }
+        c = 1.0/c_sum;
+        c_norm[t] = c;
+        for (size_t n0 = 0; n0 < N; n0++) {
+            alpha_t[n0] *= c;
+        }
+    }
+}
+
+
+static inline void backward_step_par(const BWdata& bw, const size_t k, ThreadStats& stats) {
+    const size_t N = bw.N;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    const double* alpha = bw.alpha + kT*N;
+    const double* c_norm = bw.c_norm + kT;
+    double* beta = bw.beta + kT*N;
+    double* ggamma = bw.ggamma + kT*N;
+    double* sigma_sum = bw.sigma_sum + k*N*N;
+    double* beta_emit = stats.beta_emit;
+
+    // t = T-1, base case
+    for (size_t n = 0; n < N; n++) {
+        beta[(T-1)*N + n] = c_norm[T-1];
+        ggamma[(T-1)*N + n] = alpha[(T-1)*N + n];
+    }
+    memset(sigma_sum, 0, N*N*sizeof(double));
+
+    // recursion step
+    for (int t = T-2; t >= 0; t--) {
+        const double* emit = bw.emit_prob + observations[t+1]*N;
+        const double* beta_next = beta + (t+1)*N;
+        for (size_t n1 = 0; n1 < N; n1++) {
+            beta_emit[n1] = beta_next[n1]*emit[n1];
+        }
+
+        // sigma is only materialized if the BWdata has a buffer for it
+        double* sigma_t = bw.stream_sigma ? nullptr : bw.sigma + (kT + t)*N*N;
+        for (size_t n0 = 0; n0 < N; n0++) {
+            const double a = alpha[t*N + n0];
+            const double* trans = bw.trans_prob + n0*N;
+            double* sigma_sum_row = sigma_sum + n0*N;
+            double beta_sum = 0.0;
+            for (size_t n1 = 0; n1 < N; n1++) {
+                const double s = trans[n1]*beta_emit[n1];
+                beta_sum += s;
+                sigma_sum_row[n1] += a*s;
+            }
+            if (sigma_t) {
+                double* sigma_row = sigma_t + n0*N;
+                for (size_t n1 = 0; n1 < N; n1++) {
+                    sigma_row[n1] = a*trans[n1]*beta_emit[n1];
+                }
+            }
+            beta[t*N + n0] = beta_sum*c_norm[t];
+            ggamma[t*N + n0] = a*beta_sum;
+        }
+    }
+}
+
+
+static inline void accumulate_par(const BWdata& bw, const size_t k, ThreadStats& stats) {
+    const size_t N = bw.N;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    const double* ggamma = bw.ggamma + kT*N;
+    double* gamma_sum = bw.gamma_sum + k*N;
+    const double* sigma_sum = bw.sigma_sum + k*N*N;
+
+    // gamma_sum over t < T-1 (denominator of trans_prob) and the emission numerators
+    memset(gamma_sum, 0, N*sizeof(double));
+    for (size_t t = 0; t < T-1; t++) {
+        double* emit = stats.emit + observations[t]*N;
+        for (size_t n = 0; n < N; n++) {
+            gamma_sum[n] += ggamma[t*N + n];
+            emit[n] += ggamma[t*N + n];
+        }
+    }
+
+    for (size_t n = 0; n < N; n++) {
+        stats.init[n] += ggamma[n];
+        stats.gamma[n] += gamma_sum[n];
+    }
+
+    // add last time step (denominator of emit_prob)
+    double* emit = stats.emit + observations[T-1]*N;
+    for (size_t n = 0; n < N; n++) {
+        gamma_sum[n] += ggamma[(T-1)*N + n];
+        emit[n] += ggamma[(T-1)*N + n];
+        stats.gamma_full[n] += gamma_sum[n];
+    }
+
+    for (size_t nn = 0; nn < N*N; nn++) {
+        stats.sigma[nn] += sigma_sum[nn];
+    }
+
+    *stats.neg_log_likelihood += likelihood_log(bw.c_norm + kT, T);
+}
+
+
+static inline void reduce_and_update(const BWdata& bw, ThreadStats* stats, const size_t num_threads) {
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+    ThreadStats& total = stats[0];
+
+    // reduce into the statistics of thread 0
+    for (size_t p = 1; p < num_threads; p++) {
+        for (size_t n = 0; n < N; n++) {
+            total.init[n] += stats[p].init[n];
+            total.gamma[n] += stats[p].gamma[n];
+            total.gamma_full[n] += stats[p].gamma_full[n];
+        }
+        for (size_t nn = 0; nn < N*N; nn++) {
+            total.sigma[nn] += stats[p].sigma[nn];
+        }
+        for (size_t mn = 0; mn < M*N; mn++) {
+            total.emit[mn] += stats[p].emit[mn];
+        }
+    }
+
+    const double K_inv = 1.0/bw.K;
+    for (size_t n = 0; n < N; n++) {
+        bw.init_prob[n] = total.init[n]*K_inv;
+    }
+
+    for (size_t n0 = 0; n0 < N; n0++) {
+        const double denominator_inv = 1.0/total.gamma[n0];
+        for (size_t n1 = 0; n1 < N; n1++) {
+            bw.trans_prob[n0*N + n1] = total.sigma[n0*N + n1]*denominator_inv;
+        }
+    }
+
+    // emit_prob is stored transposed ([M][N])
+    for (size_t n = 0; n < N; n++) {
+        total.gamma_full[n] = 1.0/total.gamma_full[n];
+    }
+    for (size_t m = 0; m < M; m++) {
+        for (size_t n = 0; n < N; n++) {
+            bw.emit_prob[m*N + n] = total.emit[m*N + n]*total.gamma_full[n];
+        }
+    }
+}
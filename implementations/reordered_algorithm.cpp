@@ -19,9 +19,11 @@
 #include <cstring>
 
 #include "../common.h"
+#include "../likelihood.h"
+#include "../instrumentation.h"
 
 
-static void forward_step_jc(const BWdata& bw, const int& i, const size_t& iter, size_t& res, bool& first, double& neg_log_likelihood_sum_old);
+static void forward_step_jc(const BWdata& bw, const int& i, BWconvergence& convergence);
 static void update_trans_prob_jc(const BWdata& bw);
 static size_t comp_bw_scalar_jc1(const BWdata& bw);
 
@@ -31,26 +33,27 @@ REGISTER_FUNCTION(comp_bw_scalar_jc1, "jc-reordered", "Reordering of the computa
 
 size_t comp_bw_scalar_jc1(const BWdata& bw){
 
-    size_t iter = 0;
-    size_t res = 0;
-    double neg_log_likelihood_sum_old = 0; // Does not have to be initialized as it will be if and only if i > 0
-    bool first = true;
+    BWconvergence convergence(bw);
 
     // run for all iterations
     for (size_t i = 0; i < bw.max_iterations; i++) {
 
-        iter++;
-
-        forward_step_jc(bw, i, iter, res, first, neg_log_likelihood_sum_old);
+        // forward_step_jc fuses the E-step and the likelihood, update_trans_prob_jc all updates
+        Instrumentation::phase(BW_PHASE_FORWARD);
+        forward_step_jc(bw, i, convergence);
+        Instrumentation::phase(BW_PHASE_UPDATE_TRANS);
         update_trans_prob_jc(bw);
+
+        if (convergence.stop()) break;
     }
+    Instrumentation::end();
 
-    return res;
+    return convergence.converged_at();
 }
 
 
-inline void forward_step_jc(const BWdata& bw, const int& i, const size_t& iter, size_t& res, bool& first, double& neg_log_likelihood_sum_old) {
-    double neg_log_likelihood_sum = 0.0;
+inline void forward_step_jc(const BWdata& bw, const int& i, BWconvergence& convergence) {
+    BWlikelihood likelihood;
     for (size_t k = 0; k < bw.K; k++) {
         // t = 0, base case
         double c_norm = 0;
@@ -67,7 +70,7 @@ inline void forward_step_jc(const BWdata& bw, const int& i, const size_t& iter,
             bw.alpha[(k*bw.T + 0)*bw.N + n] *= c_norm;
         }
         bw.c_norm[k*bw.T + 0] = c_norm;
-        neg_log_likelihood_sum += log(c_norm);
+        likelihood.multiply(c_norm);
 
         // recursion step
         for (size_t t = 1; t < bw.T; t++) {
@@ -87,7 +90,7 @@ inline void forward_step_jc(const BWdata& bw, const int& i, const size_t& iter,
             }
             bw.c_norm[k*bw.T + t] = c_norm;
 
-            neg_log_likelihood_sum += log(c_norm);
+            likelihood.multiply(c_norm);
         }
         c_norm = bw.c_norm[k*bw.T + (bw.T-1)];
         for (size_t n = 0; n < bw.N; n++) {
@@ -129,14 +132,10 @@ inline void forward_step_jc(const BWdata& bw, const int& i, const size_t& iter,
     }
 
     // Neg log likelihood sum check
+    const double neg_log_likelihood_sum = likelihood.log();
     bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
 
-    if (first && i > 0 && fabs(neg_log_likelihood_sum - neg_log_likelihood_sum_old) < EPSILON){
-        first = false;
-        res = iter;
-    }
-
-    neg_log_likelihood_sum_old = neg_log_likelihood_sum;
+    convergence.update(i, neg_log_likelihood_sum);
 }
 
 
@@ -19,6 +19,8 @@
 #include <cstring>
 
 #include "../common.h"
+#include "../likelihood.h"
+#include "../instrumentation.h"
 
 
 static void forward_step(const BWdata& bw);
@@ -36,40 +38,34 @@ REGISTER_FUNCTION(comp_bw_scalar_reorder, "scalar-reorder", "Scalar Optimized: r
 
 size_t comp_bw_scalar_reorder(const BWdata& bw){
 
-    size_t iter = 0;
-    size_t res = 0;
-    double neg_log_likelihood_sum_old = 0; // Does not have to be initialized as it will be if and only if i > 0
-    bool first = true;
+    BWconvergence convergence(bw);
 
     // run for all iterations
     for (size_t i = 0; i < bw.max_iterations; i++) {
-        iter++;
-
+        Instrumentation::phase(BW_PHASE_FORWARD);
         forward_step(bw);
+        Instrumentation::phase(BW_PHASE_BACKWARD);
         backward_step(bw);
+        Instrumentation::phase(BW_PHASE_GAMMA);
         compute_gamma(bw);
         //compute_sigma(bw);
         //update_init_prob(bw);
+        Instrumentation::phase(BW_PHASE_UPDATE_TRANS);
         update_trans_prob(bw);
+        Instrumentation::phase(BW_PHASE_UPDATE_EMIT);
         update_emit_prob(bw);
 
-        double neg_log_likelihood_sum = 0.0;
-        for (size_t k = 0; k < bw.K; k++) {
-            for (size_t t = 0; t < bw.T; t++) {
-                neg_log_likelihood_sum = neg_log_likelihood_sum + log(bw.c_norm[k*bw.T + t]);
-            }
-        }
+        Instrumentation::phase(BW_PHASE_LIKELIHOOD);
+        const double neg_log_likelihood_sum = likelihood_log(bw.c_norm, bw.total_length());
         bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
 
-        if (first && i > 0 && fabs(neg_log_likelihood_sum - neg_log_likelihood_sum_old) < EPSILON){
-            first = false;
-            res = iter;
-        }
+        convergence.update(i, neg_log_likelihood_sum);
 
-        neg_log_likelihood_sum_old = neg_log_likelihood_sum;
+        if (convergence.stop()) break;
     }
+    Instrumentation::end();
 
-    return res;
+    return convergence.converged_at();
 }
 
 
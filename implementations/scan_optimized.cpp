@@ -0,0 +1,516 @@
+/*
+    Parallel-in-time implementation
+    For few but very long sequences (K = 1), where sharding K does not help: every sequence
+    is split into one chunk of time steps per thread of the ThreadPool.
+    The forward recursion alpha[t] ~ alpha[t-1] * trans_prob * diag(emit_prob[y_t]) is a product
+    of N x N matrices, which is associative:
+    1. (parallel) every chunk multiplies its matrices, normalized to sum 1 after every step
+    2. (serial)   scan over the chunk products: alpha at the last time step of every chunk
+    3. (parallel) every chunk runs the usual scaled forward recursion from the alpha of the
+                  previous chunk, which gives exactly the c_norm (and likelihood) of the serial one
+    4. (serial)   the same scan from the end with the same products for beta, each scaled such that
+                  sum(alpha[t] * beta[t]) = c_norm[t] (i.e. gamma sums to 1, as in the serial recursion)
+    5. (parallel) every chunk runs the usual backward recursion with gamma, sigma and the statistics
+    Step 1 costs N times the work of the serial forward recursion, such that this only pays off for
+    moderate N and many threads. Sequences shorter than two chunks of SCAN_MIN_CHUNK run serially.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+
+#include "../common.h"
+#include "../likelihood.h"
+#include "../thread_pool.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+
+// doubles per cache line; every per-chunk block is a multiple of it
+#define CACHE_LINE_DOUBLES 8
+
+// minimum number of time steps per chunk
+#define SCAN_MIN_CHUNK 32
+
+/**
+ * Per-chunk buffers and statistics
+ */
+struct ChunkStats {
+    double* product; //     [N][N]      normalized product of the transition matrices of the chunk
+    double* temp; //        [N][N]      scratch for the product
+    double* alpha_end; //   [N]         alpha at the last time step of the chunk (step 2)
+    double* beta_end; //    [N]         beta at the last time step of the chunk (step 4)
+    double* beta_emit; //   [N]         scratch for the backward step
+    double* gamma; //       [N]         sum_{t < T-1} ggamma[k][t][n] of the chunk (current sequence)
+    double* sigma; //       [N][N]      sigma of the chunk (current sequence)
+    double* emit; //        [M][N]      sum_k sum_{t : obs[k][t] == m} ggamma[k][t][n] of the chunks
+    double* neg_log_likelihood; // [1]  sum_k sum_t log(c_norm[k][t]) of the chunks
+};
+
+static inline size_t pad(const size_t count){
+    return ((count + CACHE_LINE_DOUBLES - 1) / CACHE_LINE_DOUBLES) * CACHE_LINE_DOUBLES;
+}
+
+static void chunk_product(const BWdata& bw, const size_t k, const size_t t_begin, const size_t t_end, ChunkStats& stats);
+static double forward_chunk(const BWdata& bw, const size_t k, const size_t t_begin, const size_t t_end, const double* alpha_in);
+static void backward_chunk(const BWdata& bw, const size_t k, const size_t t_begin, const size_t t_end, const double* beta_end, ChunkStats& stats);
+static void scan_alpha(const BWdata& bw, const size_t k, ChunkStats* stats, const size_t chunks);
+static void scan_beta(const BWdata& bw, const size_t k, ChunkStats* stats, const size_t chunks);
+static void update_scan(const BWdata& bw, ChunkStats* stats, const size_t num_chunks, double* denominator);
+static size_t comp_bw_scan(const BWdata& bw);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_scan, "parallel-scan", "Parallel over T: associative scan over the transition products", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_ANY_NM | BW_FEATURE_PARALLEL_T);
+
+
+/**
+ * Number of chunks of a sequence of length T, at most one per thread
+ */
+static inline size_t scan_chunks(const size_t T, const size_t num_threads){
+    const size_t chunks = T / SCAN_MIN_CHUNK;
+    if (chunks < 2) return 1;
+    return chunks < num_threads ? chunks : num_threads;
+}
+
+size_t comp_bw_scan(const BWdata& bw){
+    BWconvergence convergence(bw);
+    double neg_log_likelihood_sum;
+
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+    const size_t num_threads = ThreadPool::get_num_threads();
+
+    // One contiguous block per chunk, padded to whole cache lines to avoid false sharing
+    const size_t block = 3*pad(N*N) + 4*pad(N) + pad(M*N) + pad(1);
+    double* storage = (double *)bw_scratch_alloc(bw, "scan/storage", num_threads*block*sizeof(double));
+    ChunkStats* stats = (ChunkStats *)bw_scratch_alloc(bw, "scan/stats", num_threads*sizeof(ChunkStats));
+    double* denominator = (double *)bw_scratch_alloc(bw, "scan/denominator", N*sizeof(double));
+
+    for (size_t c = 0; c < num_threads; c++) {
+        double* base = storage + c*block;
+        stats[c].product = base;
+        stats[c].temp = stats[c].product + pad(N*N);
+        stats[c].sigma = stats[c].temp + pad(N*N);
+        stats[c].alpha_end = stats[c].sigma + pad(N*N);
+        stats[c].beta_end = stats[c].alpha_end + pad(N);
+        stats[c].beta_emit = stats[c].beta_end + pad(N);
+        stats[c].gamma = stats[c].beta_emit + pad(N);
+        stats[c].emit = stats[c].gamma + pad(N);
+        stats[c].neg_log_likelihood = stats[c].emit + pad(M*N);
+    }
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+        for (size_t c = 0; c < num_threads; c++) {
+            memset(stats[c].emit, 0, M*N*sizeof(double));
+            *stats[c].neg_log_likelihood = 0.0;
+        }
+
+        for (size_t k = 0; k < bw.K; k++) {
+            const size_t T = bw.length(k);
+            const size_t chunks = scan_chunks(T, num_threads);
+
+            if (chunks == 1) {
+                Instrumentation::phase(BW_PHASE_FORWARD);
+                *stats[0].neg_log_likelihood += forward_chunk(bw, k, 0, T, NULL);
+                Instrumentation::phase(BW_PHASE_BACKWARD);
+                backward_chunk(bw, k, 0, T, NULL, stats[0]);
+            } else {
+                Instrumentation::phase(BW_PHASE_FORWARD);
+                ThreadPool::run([&](const size_t thread_id, const size_t threads){
+                    for (size_t c = thread_id; c < chunks; c += threads) {
+                        size_t t_begin, t_end;
+                        ThreadPool::shard(T, c, chunks, t_begin, t_end);
+                        chunk_product(bw, k, t_begin, t_end, stats[c]);
+                    }
+                });
+                scan_alpha(bw, k, stats, chunks);
+                ThreadPool::run([&](const size_t thread_id, const size_t threads){
+                    for (size_t c = thread_id; c < chunks; c += threads) {
+                        size_t t_begin, t_end;
+                        ThreadPool::shard(T, c, chunks, t_begin, t_end);
+                        *stats[c].neg_log_likelihood += forward_chunk(bw, k, t_begin, t_end, (c == 0) ? NULL : stats[c-1].alpha_end);
+                    }
+                });
+
+                Instrumentation::phase(BW_PHASE_BACKWARD);
+                scan_beta(bw, k, stats, chunks);
+                ThreadPool::run([&](const size_t thread_id, const size_t threads){
+                    for (size_t c = thread_id; c < chunks; c += threads) {
+                        size_t t_begin, t_end;
+                        ThreadPool::shard(T, c, chunks, t_begin, t_end);
+                        backward_chunk(bw, k, t_begin, t_end, (c + 1 == chunks) ? NULL : stats[c].beta_end, stats[c]);
+                    }
+                });
+            }
+
+            // gamma_sum and sigma_sum of the sequence from the chunks
+            Instrumentation::phase(BW_PHASE_GAMMA);
+            double* gamma_sum = bw.gamma_sum + k*N;
+            double* sigma_sum = bw.sigma_sum + k*N*N;
+            memcpy(gamma_sum, stats[0].gamma, N*sizeof(double));
+            memcpy(sigma_sum, stats[0].sigma, N*N*sizeof(double));
+            for (size_t c = 1; c < chunks; c++) {
+                for (size_t n = 0; n < N; n++) {
+                    gamma_sum[n] += stats[c].gamma[n];
+                }
+                for (size_t nn = 0; nn < N*N; nn++) {
+                    sigma_sum[nn] += stats[c].sigma[nn];
+                }
+            }
+        }
+
+        Instrumentation::phase(BW_PHASE_LIKELIHOOD);
+        neg_log_likelihood_sum = 0.0;
+        for (size_t c = 0; c < num_threads; c++) {
+            neg_log_likelihood_sum += *stats[c].neg_log_likelihood;
+        }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        // all three updates are fused
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        update_scan(bw, stats, num_threads, denominator);
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bw_scratch_free(bw, denominator);
+    bw_scratch_free(bw, stats);
+    bw_scratch_free(bw, storage);
+
+    return convergence.converged_at();
+}
+
+
+/**
+ * Product of trans_prob * diag(emit_prob[y_t]) over t_begin <= t < t_end (t >= 1), normalized to sum 1
+ */
+static inline void chunk_product(const BWdata& bw, const size_t k, const size_t t_begin, const size_t t_end, ChunkStats& stats) {
+    const size_t N = bw.N;
+    const size_t* observations = bw.observations + bw.offsets[k];
+    double* product = stats.product;
+    double* temp = stats.temp;
+
+    // first factor
+    const size_t t_first = (t_begin == 0) ? 1 : t_begin;
+    const double* emit = bw.emit_prob + observations[t_first]*N;
+    double p_sum = 0.0;
+    for (size_t n0 = 0; n0 < N; n0++) {
+        for (size_t n1 = 0; n1 < N; n1++) {
+            product[n0*N + n1] = bw.trans_prob[n0*N + n1]*emit[n1];
+            p_sum += product[n0*N + n1];
+        }
+    }
+    double p_inv = 1.0/p_sum;
+    for (size_t nn = 0; nn < N*N; nn++) {
+        product[nn] *= p_inv;
+    }
+
+    for (size_t t = t_first + 1; t < t_end; t++) {
+        emit = bw.emit_prob + observations[t]*N;
+
+        // temp = product * trans_prob
+        memset(temp, 0, N*N*sizeof(double));
+        for (size_t n0 = 0; n0 < N; n0++) {
+            double* temp_row = temp + n0*N;
+            for (size_t n = 0; n < N; n++) {
+                const double p = product[n0*N + n];
+                const double* trans = bw.trans_prob + n*N;
+                for (size_t n1 = 0; n1 < N; n1++) {
+                    temp_row[n1] += p*trans[n1];
+                }
+            }
+        }
+
+        // product = temp * diag(emit), normalized
+        p_sum = 0.0;
+        for (size_t n0 = 0; n0 < N; n0++) {
+            for (size_t n1 = 0; n1 < N; n1++) {
+                temp[n0*N + n1] *= emit[n1];
+                p_sum += temp[n0*N + n1];
+            }
+        }
+        p_inv = 1.0/p_sum;
+        for (size_t nn = 0; nn < N*N; nn++) {
+            product[nn] = temp[nn]*p_inv;
+        }
+    }
+}
+
+
+/**
+ * alpha at the last time step of every chunk but the last (up to scale, normalized to sum 1)
+ */
+static inline void scan_alpha(const BWdata& bw, const size_t k, ChunkStats* stats, const size_t chunks) {
+    const size_t N = bw.N;
+    const double* emit = bw.emit_prob + bw.observations[bw.offsets[k]]*N;
+    double* v = stats[chunks-1].alpha_end; // free, the last chunk has none
+
+    // alpha at t = 0
+    for (size_t n = 0; n < N; n++) {
+        v[n] = bw.init_prob[n]*emit[n];
+    }
+
+    for (size_t c = 0; c + 1 < chunks; c++) {
+        double* alpha_end = stats[c].alpha_end;
+        double a_sum = 0.0;
+        for (size_t n1 = 0; n1 < N; n1++) {
+            alpha_end[n1] = 0.0;
+        }
+        for (size_t n0 = 0; n0 < N; n0++) {
+            const double a = v[n0];
+            const double* product = stats[c].product + n0*N;
+            for (size_t n1 = 0; n1 < N; n1++) {
+                alpha_end[n1] += a*product[n1];
+            }
+        }
+        for (size_t n1 = 0; n1 < N; n1++) {
+            a_sum += alpha_end[n1];
+        }
+        const double a_inv = 1.0/a_sum;
+        for (size_t n1 = 0; n1 < N; n1++) {
+            alpha_end[n1] *= a_inv;
+        }
+        v = alpha_end;
+    }
+}
+
+
+/**
+ * beta at the last time step of every chunk but the last, from the beta of the next chunk
+ * (needs alpha and c_norm of the forward pass)
+ */
+static inline void scan_beta(const BWdata& bw, const size_t k, ChunkStats* stats, const size_t chunks) {
+    const size_t N = bw.N;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+
+    // beta at t = T-1
+    double* v = stats[chunks-1].beta_end;
+    for (size_t n = 0; n < N; n++) {
+        v[n] = bw.c_norm[kT + T-1];
+    }
+
+    for (size_t c = chunks-1; c-- > 0; ) {
+        size_t t_begin, t_end;
+        ThreadPool::shard(T, c, chunks, t_begin, t_end);
+        const double* alpha = bw.alpha + (kT + t_end-1)*N;
+        const double* product = stats[c+1].product;
+        double* beta_end = stats[c].beta_end;
+
+        double ab_sum = 0.0;
+        for (size_t n0 = 0; n0 < N; n0++) {
+            double b = 0.0;
+            for (size_t n1 = 0; n1 < N; n1++) {
+                b += product[n0*N + n1]*v[n1];
+            }
+            beta_end[n0] = b;
+            ab_sum += alpha[n0]*b;
+        }
+        // scale such that sum(alpha * beta) = c_norm
+        const double scale = bw.c_norm[kT + t_end-1]/ab_sum;
+        for (size_t n = 0; n < N; n++) {
+            beta_end[n] *= scale;
+        }
+        v = beta_end;
+    }
+}
+
+
+/**
+ * Scaled forward recursion over t_begin <= t < t_end, starting from alpha_in (alpha at t_begin-1,
+ * up to scale) or init_prob (NULL). Returns the sum of log(c_norm) of the chunk.
+ */
+static inline double forward_chunk(const BWdata& bw, const size_t k, const size_t t_begin, const size_t t_end, const double* alpha_in) {
+    const size_t N = bw.N;
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    double* alpha = bw.alpha + kT*N;
+    double* c_norm = bw.c_norm + kT;
+
+    for (size_t t = t_begin; t < t_end; t++) {
+        const double* alpha_prev = (t == t_begin) ? alpha_in : alpha + (t-1)*N;
+        double* alpha_t = alpha + t*N;
+        const double* emit = bw.emit_prob + observations[t]*N;
+
+        if (alpha_prev == NULL) {
+            // t = 0, base case
+            for (size_t n = 0; n < N; n++) {
+                alpha_t[n] = bw.init_prob[n];
+            }
+        } else {
+            // recursion step: alpha[t] = (alpha[t-1] * trans_prob) .* emit_prob[obs[t]]
+            memset(alpha_t, 0, N*sizeof(double));
+            for (size_t n1 = 0; n1 < N; n1++) {
+                const double a = alpha_prev[n1];
+                const double* trans = bw.trans_prob + n1*N;
+                for (size_t n0 = 0; n0 < N; n0++) {
+                    alpha_t[n0] += a*trans[n0];
+                }
+            }
+        }
+
+        double c_sum = 0.0;
+        for (size_t n0 = 0; n0 < N; n0++) {
+            alpha_t[n0] *= emit[n0];
+            c_sum += alpha_t[n0];
+        }
+        const double c = 1.0/c_sum;
+        c_norm[t] = c;
+        for (size_t n0 = 0; n0 < N; n0++) {
+            alpha_t[n0] *= c;
+        }
+    }
+
+    return likelihood_log(c_norm + t_begin, t_end - t_begin);
+}
+
+
+/**
+ * Backward recursion over t_begin <= t < t_end, starting from beta_end (beta at t_end-1, NULL if
+ * t_end = T). Computes ggamma and sigma of the chunk, plus sigma[t_begin-1] of the edge to the
+ * previous chunk, and sums them up into stats.
+ */
+static inline void backward_chunk(const BWdata& bw, const size_t k, const size_t t_begin, const size_t t_end, const double* beta_end, ChunkStats& stats) {
+    const size_t N = bw.N;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    const double* alpha = bw.alpha + kT*N;
+    const double* c_norm = bw.c_norm + kT;
+    double* beta = bw.beta + kT*N;
+    double* ggamma = bw.ggamma + kT*N;
+    double* beta_emit = stats.beta_emit;
+
+    memset(stats.gamma, 0, N*sizeof(double));
+    memset(stats.sigma, 0, N*N*sizeof(double));
+
+    // t = t_end-1, base case
+    const size_t t_last = t_end-1;
+    double* emit_last = stats.emit + observations[t_last]*N;
+    for (size_t n = 0; n < N; n++) {
+        const double b = (beta_end == NULL) ? c_norm[t_last] : beta_end[n];
+        const double g = alpha[t_last*N + n]*b/c_norm[t_last];
+        beta[t_last*N + n] = b;
+        ggamma[t_last*N + n] = g;
+        emit_last[n] += g;
+        if (t_last < T-1) stats.gamma[n] += g;
+    }
+
+    // recursion step, including the edge t = t_begin-1 (sigma only)
+    const size_t t_stop = (t_begin == 0) ? 0 : t_begin-1;
+    for (size_t t = t_last; t-- > t_stop; ) {
+        const bool edge = (t < t_begin);
+        const double* emit = bw.emit_prob + observations[t+1]*N;
+        const double* beta_next = beta + (t+1)*N;
+        for (size_t n1 = 0; n1 < N; n1++) {
+            beta_emit[n1] = beta_next[n1]*emit[n1];
+        }
+
+        // sigma is only materialized if the BWdata has a buffer for it
+        double* sigma_t = bw.stream_sigma ? nullptr : bw.sigma + (kT + t)*N*N;
+        double* emit_t = stats.emit + observations[t]*N;
+        for (size_t n0 = 0; n0 < N; n0++) {
+            const double a = alpha[t*N + n0];
+            const double* trans = bw.trans_prob + n0*N;
+            double* sigma_sum_row = stats.sigma + n0*N;
+            double beta_sum = 0.0;
+            for (size_t n1 = 0; n1 < N; n1++) {
+                const double s = trans[n1]*beta_emit[n1];
+                beta_sum += s;
+                sigma_sum_row[n1] += a*s;
+            }
+            if (sigma_t) {
+                double* sigma_row = sigma_t + n0*N;
+                for (size_t n1 = 0; n1 < N; n1++) {
+                    sigma_row[n1] = a*trans[n1]*beta_emit[n1];
+                }
+            }
+            if (!edge) {
+                const double g = a*beta_sum;
+                beta[t*N + n0] = beta_sum*c_norm[t];
+                ggamma[t*N + n0] = g;
+                stats.gamma[n0] += g;
+                emit_t[n0] += g;
+            }
+        }
+    }
+}
+
+
+/**
+ * M-step from the statistics of the chunks (adds the last time step to gamma_sum, as the baseline)
+ */
+static inline void update_scan(const BWdata& bw, ChunkStats* stats, const size_t num_chunks, double* denominator) {
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+    const size_t K = bw.K;
+    double* emit_total = stats[0].emit;
+
+    // reduce into the statistics of chunk 0
+    for (size_t c = 1; c < num_chunks; c++) {
+        for (size_t mn = 0; mn < M*N; mn++) {
+            emit_total[mn] += stats[c].emit[mn];
+        }
+    }
+
+    const double K_inv = 1.0/K;
+    for (size_t n = 0; n < N; n++) {
+        double g0_sum = 0.0;
+        for (size_t k = 0; k < K; k++) {
+            g0_sum += bw.ggamma[bw.offsets[k]*N + n];
+        }
+        bw.init_prob[n] = g0_sum*K_inv;
+    }
+
+    for (size_t n = 0; n < N; n++) {
+        denominator[n] = 0.0;
+    }
+    for (size_t k = 0; k < K; k++) {
+        for (size_t n = 0; n < N; n++) {
+            denominator[n] += bw.gamma_sum[k*N + n];
+        }
+    }
+    for (size_t n0 = 0; n0 < N; n0++) {
+        const double denominator_inv = 1.0/denominator[n0];
+        for (size_t n1 = 0; n1 < N; n1++) {
+            double s_sum = 0.0;
+            for (size_t k = 0; k < K; k++) {
+                s_sum += bw.sigma_sum[(k*N + n0)*N + n1];
+            }
+            bw.trans_prob[n0*N + n1] = s_sum*denominator_inv;
+        }
+    }
+
+    // add the last time step and update emit_prob (stored transposed, [M][N])
+    for (size_t n = 0; n < N; n++) {
+        denominator[n] = 0.0;
+    }
+    for (size_t k = 0; k < K; k++) {
+        const double* ggamma_last = bw.ggamma + (bw.offsets[k+1]-1)*N;
+        for (size_t n = 0; n < N; n++) {
+            bw.gamma_sum[k*N + n] += ggamma_last[n];
+            denominator[n] += bw.gamma_sum[k*N + n];
+        }
+    }
+    for (size_t n = 0; n < N; n++) {
+        denominator[n] = 1.0/denominator[n];
+    }
+    for (size_t m = 0; m < M; m++) {
+        for (size_t n = 0; n < N; n++) {
+            bw.emit_prob[m*N + n] = emit_total[m*N + n]*denominator[n];
+        }
+    }
+}
@@ -0,0 +1,230 @@
+/*
+    Scoring: forward recursion with four sequences interleaved
+    Same scheme as forward_step_comb: the four sequences share every load of trans_prob.
+    Only two alpha rows per sequence are kept and the log is taken once per sequence
+    (product of the normalization sums per lane, with the exponents tracked, see likelihood.h).
+    The model is copied into zero padded buffers (N rounded up to a multiple of 4), so any N works.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#include "../common.h"
+#include "../scoring.h"
+#include "../likelihood.h"
+
+struct ScoreScratch {
+    size_t Np;         // N rounded up to a multiple of 4
+    double* trans;     // [N][Np]   trans_prob, zero padded
+    double* emit;      // [M][Np]   emit_prob transposed, zero padded
+    double* init;      // [Np]
+    double* alpha;     // [2][4][Np] two rows of four sequences
+};
+
+static void score_interleaved(const BWmodel& model, const BWsequences& sequences, double* log_likelihoods);
+static inline void score_group(const ScoreScratch& s, const BWmodel& model, const BWsequences& sequences, const size_t k, double* log_likelihoods);
+static inline void score_single(const ScoreScratch& s, const BWmodel& model, const BWsequences& sequences, const size_t k, const size_t t_begin, double* alpha_old, double* alpha_new, BWlikelihood likelihood, double* log_likelihoods);
+
+REGISTER_SCORE_FUNCTION(score_interleaved, "score-interleaved", "Forward recursion, 4 sequences interleaved (AVX2 & FMA)");
+
+
+static void score_interleaved(const BWmodel& model, const BWsequences& sequences, double* log_likelihoods){
+    const size_t N = model.N;
+    const size_t M = model.M;
+
+    ScoreScratch s;
+    s.Np = (N + 3) & ~(size_t)3;
+    const size_t Np = s.Np;
+    const size_t total = N*Np + M*Np + Np + 2*4*Np;
+    double* storage = (double *)aligned_alloc(32, total * sizeof(double));
+    assert(storage != NULL && "Failed to allocate memory");
+    memset(storage, 0, total * sizeof(double));
+    s.trans = storage;
+    s.emit = s.trans + N*Np;
+    s.init = s.emit + M*Np;
+    s.alpha = s.init + Np;
+
+    for (size_t n0 = 0; n0 < N; n0++) {
+        memcpy(s.trans + n0*Np, model.trans_prob + n0*N, N * sizeof(double));
+        for (size_t m = 0; m < M; m++) {
+            s.emit[m*Np + n0] = model.emit_prob[n0*M + m];
+        }
+    }
+    memcpy(s.init, model.init_prob, N * sizeof(double));
+
+    size_t k;
+    for (k = 0; k + 4 <= sequences.K; k += 4) {
+        score_group(s, model, sequences, k, log_likelihoods);
+    }
+
+    // remaining sequences if K is not divisible by 4
+    for (; k < sequences.K; k++) {
+        score_single(s, model, sequences, k, 0, s.alpha, s.alpha + Np, BWlikelihood(), log_likelihoods);
+    }
+
+    free(storage);
+}
+
+/**
+ * Sequences k to k+3 up to the shortest of them, then the tails one by one
+ */
+static inline void score_group(const ScoreScratch& s, const BWmodel& model, const BWsequences& sequences, const size_t k, double* log_likelihoods) {
+    const size_t N = model.N;
+    const size_t Np = s.Np;
+    const size_t* observations0 = sequences.observations + sequences.offsets[k+0];
+    const size_t* observations1 = sequences.observations + sequences.offsets[k+1];
+    const size_t* observations2 = sequences.observations + sequences.offsets[k+2];
+    const size_t* observations3 = sequences.observations + sequences.offsets[k+3];
+    const size_t T_common = std::min(std::min(sequences.length(k+0), sequences.length(k+1)), std::min(sequences.length(k+2), sequences.length(k+3)));
+
+    // alpha rows: [row][sequence][Np]
+    double* alpha_old = s.alpha;
+    double* alpha_new = s.alpha + 4*Np;
+
+    __m256d alpha0, alpha1, alpha2, alpha3;
+    __m256d emit_prob0, emit_prob1, emit_prob2, emit_prob3;
+    __m256d c_sum_v0, c_sum_v1, c_sum_v2, c_sum_v3;
+    __m256d alpha_sum0, alpha_sum1, alpha_sum2, alpha_sum3;
+    const __m256d ones = _mm256_set1_pd(1.0);
+
+    // per lane product of the normalization sums
+    __m256d mantissa = ones;
+    __m256i exponent = _mm256_setzero_si256();
+    double helper[4] __attribute__((aligned(32)));
+
+    for (size_t t = 0; t < T_common; t++) {
+        c_sum_v0 = _mm256_setzero_pd();
+        c_sum_v1 = _mm256_setzero_pd();
+        c_sum_v2 = _mm256_setzero_pd();
+        c_sum_v3 = _mm256_setzero_pd();
+
+        for (size_t n0 = 0; n0 < Np; n0 += 4) {
+            if (t == 0) {
+                // t = 0, base case
+                alpha_sum0 = _mm256_load_pd(s.init + n0);
+                alpha_sum1 = alpha_sum0;
+                alpha_sum2 = alpha_sum0;
+                alpha_sum3 = alpha_sum0;
+            } else {
+                alpha_sum0 = _mm256_setzero_pd();
+                alpha_sum1 = _mm256_setzero_pd();
+                alpha_sum2 = _mm256_setzero_pd();
+                alpha_sum3 = _mm256_setzero_pd();
+                for (size_t n1 = 0; n1 < N; n1++) {
+                    const __m256d trans_prob = _mm256_load_pd(s.trans + n1*Np + n0);
+                    alpha_sum0 = _mm256_fmadd_pd(_mm256_broadcast_sd(alpha_old + 0*Np + n1), trans_prob, alpha_sum0);
+                    alpha_sum1 = _mm256_fmadd_pd(_mm256_broadcast_sd(alpha_old + 1*Np + n1), trans_prob, alpha_sum1);
+                    alpha_sum2 = _mm256_fmadd_pd(_mm256_broadcast_sd(alpha_old + 2*Np + n1), trans_prob, alpha_sum2);
+                    alpha_sum3 = _mm256_fmadd_pd(_mm256_broadcast_sd(alpha_old + 3*Np + n1), trans_prob, alpha_sum3);
+                }
+            }
+
+            emit_prob0 = _mm256_load_pd(s.emit + observations0[t]*Np + n0);
+            emit_prob1 = _mm256_load_pd(s.emit + observations1[t]*Np + n0);
+            emit_prob2 = _mm256_load_pd(s.emit + observations2[t]*Np + n0);
+            emit_prob3 = _mm256_load_pd(s.emit + observations3[t]*Np + n0);
+
+            alpha0 = _mm256_mul_pd(alpha_sum0, emit_prob0);
+            alpha1 = _mm256_mul_pd(alpha_sum1, emit_prob1);
+            alpha2 = _mm256_mul_pd(alpha_sum2, emit_prob2);
+            alpha3 = _mm256_mul_pd(alpha_sum3, emit_prob3);
+            c_sum_v0 = _mm256_add_pd(c_sum_v0, alpha0);
+            c_sum_v1 = _mm256_add_pd(c_sum_v1, alpha1);
+            c_sum_v2 = _mm256_add_pd(c_sum_v2, alpha2);
+            c_sum_v3 = _mm256_add_pd(c_sum_v3, alpha3);
+
+            _mm256_store_pd(alpha_new + 0*Np + n0, alpha0);
+            _mm256_store_pd(alpha_new + 1*Np + n0, alpha1);
+            _mm256_store_pd(alpha_new + 2*Np + n0, alpha2);
+            _mm256_store_pd(alpha_new + 3*Np + n0, alpha3);
+        }
+
+        // lane i := sum of sequence k+i
+        const __m256d sum_01 = _mm256_hadd_pd(c_sum_v0, c_sum_v1);
+        const __m256d sum_23 = _mm256_hadd_pd(c_sum_v2, c_sum_v3);
+        const __m256d blended = _mm256_blend_pd(sum_01, sum_23, 0b1100);
+        const __m256d permuted = _mm256_permute2f128_pd(sum_01, sum_23, 0b00100001);
+        const __m256d c_sum = _mm256_add_pd(blended, permuted);
+
+        likelihood_multiply_lanes(mantissa, exponent, c_sum);
+
+        _mm256_store_pd(helper, _mm256_div_pd(ones, c_sum));
+        const __m256d c_norm_v0 = _mm256_set1_pd(helper[0]);
+        const __m256d c_norm_v1 = _mm256_set1_pd(helper[1]);
+        const __m256d c_norm_v2 = _mm256_set1_pd(helper[2]);
+        const __m256d c_norm_v3 = _mm256_set1_pd(helper[3]);
+        for (size_t n = 0; n < Np; n += 4) {
+            _mm256_store_pd(alpha_new + 0*Np + n, _mm256_mul_pd(_mm256_load_pd(alpha_new + 0*Np + n), c_norm_v0));
+            _mm256_store_pd(alpha_new + 1*Np + n, _mm256_mul_pd(_mm256_load_pd(alpha_new + 1*Np + n), c_norm_v1));
+            _mm256_store_pd(alpha_new + 2*Np + n, _mm256_mul_pd(_mm256_load_pd(alpha_new + 2*Np + n), c_norm_v2));
+            _mm256_store_pd(alpha_new + 3*Np + n, _mm256_mul_pd(_mm256_load_pd(alpha_new + 3*Np + n), c_norm_v3));
+        }
+
+        double* swap = alpha_old;
+        alpha_old = alpha_new;
+        alpha_new = swap;
+    }
+
+    // tails of the longer sequences (continue from their row in alpha_old)
+    for (size_t i = 0; i < 4; i++) {
+        score_single(s, model, sequences, k + i, T_common, alpha_old + i*Np, alpha_new + i*Np, likelihood_lane(mantissa, exponent, i), log_likelihoods);
+    }
+}
+
+/**
+ * Sequence k from time step t_begin on, alpha_old holds the row of t_begin-1 (if t_begin > 0)
+ */
+static inline void score_single(const ScoreScratch& s, const BWmodel& model, const BWsequences& sequences, const size_t k, const size_t t_begin, double* alpha_old, double* alpha_new, BWlikelihood likelihood, double* log_likelihoods) {
+    const size_t N = model.N;
+    const size_t Np = s.Np;
+    const size_t* observations = sequences.observations + sequences.offsets[k];
+    const size_t T = sequences.length(k);
+    const __m256d ones = _mm256_set1_pd(1.0);
+
+    for (size_t t = t_begin; t < T; t++) {
+        __m256d c_sum_v = _mm256_setzero_pd();
+        for (size_t n0 = 0; n0 < Np; n0 += 4) {
+            __m256d alpha_sum;
+            if (t == 0) {
+                alpha_sum = _mm256_load_pd(s.init + n0);
+            } else {
+                alpha_sum = _mm256_setzero_pd();
+                for (size_t n1 = 0; n1 < N; n1++) {
+                    alpha_sum = _mm256_fmadd_pd(_mm256_broadcast_sd(alpha_old + n1), _mm256_load_pd(s.trans + n1*Np + n0), alpha_sum);
+                }
+            }
+            const __m256d alpha = _mm256_mul_pd(alpha_sum, _mm256_load_pd(s.emit + observations[t]*Np + n0));
+            c_sum_v = _mm256_add_pd(c_sum_v, alpha);
+            _mm256_store_pd(alpha_new + n0, alpha);
+        }
+        c_sum_v = _mm256_hadd_pd(c_sum_v, c_sum_v);
+        const double c_sum = _mm256_cvtsd_f64(c_sum_v) + _mm256_cvtsd_f64(_mm256_permute2f128_pd(c_sum_v, c_sum_v, 1));
+
+        likelihood.multiply(c_sum);
+
+        const __m256d c_norm_v = _mm256_div_pd(ones, _mm256_set1_pd(c_sum));
+        for (size_t n = 0; n < Np; n += 4) {
+            _mm256_store_pd(alpha_new + n, _mm256_mul_pd(_mm256_load_pd(alpha_new + n), c_norm_v));
+        }
+
+        double* swap = alpha_old;
+        alpha_old = alpha_new;
+        alpha_new = swap;
+    }
+
+    log_likelihoods[k] = likelihood.log();
+}
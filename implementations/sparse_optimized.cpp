@@ -0,0 +1,329 @@
+/*
+    Sparse transitions implementation
+    For left-to-right and pruned topologies with few nonzeros per row of trans_prob.
+    Runs dense until trans_prob has a density of at most BWsparseTransitions::max_density()
+    (checked before the first iteration and after every update of trans_prob), then switches
+    to the CSR form (sparse_transitions.h): forward, backward and sigma only touch the nonzeros,
+    i.e. O(nnz) instead of O(N*N) per time step. The zeros stay zero in the updates.
+    "sparse-dense" runs the same kernels, but never switches (reference for the benchmarks).
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+
+#include "../common.h"
+#include "../likelihood.h"
+#include "../sparse_transitions.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+
+/**
+ * Sufficient statistics, summed over all sequences
+ */
+struct SparseStats {
+    double* init; //        [N]         sum_k ggamma[k][0][n]
+    double* gamma; //       [N]         sum_k sum_{t < T-1} ggamma[k][t][n]
+    double* gamma_full; //  [N]         sum_k sum_{t} ggamma[k][t][n]
+    double* emit; //        [M][N]      sum_k sum_{t : obs[k][t] == m} ggamma[k][t][n]
+    double* beta_emit; //   [N]         scratch for the backward step
+};
+
+static size_t comp_bw_sparse_run(const BWdata& bw, const double max_density);
+static void forward_sparse(const BWdata& bw, const size_t k, const BWsparseTransitions* sparse);
+static void backward_sparse(const BWdata& bw, const size_t k, const BWsparseTransitions* sparse, SparseStats& stats);
+static void accumulate_sparse(const BWdata& bw, const size_t k, SparseStats& stats);
+static void update_sparse(const BWdata& bw, const BWsparseTransitions* sparse, SparseStats& stats);
+static size_t comp_bw_sparse(const BWdata& bw);
+static size_t comp_bw_sparse_dense(const BWdata& bw);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_sparse, "sparse", "Sparse (CSR) trans_prob once it is sparse enough", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_ANY_NM | BW_FEATURE_SPARSE);
+REGISTER_FUNCTION_FEATURES(comp_bw_sparse_dense, "sparse-dense", "Kernels of 'sparse', always with the dense trans_prob", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_ANY_NM | BW_FEATURE_SPARSE);
+
+
+size_t comp_bw_sparse(const BWdata& bw){
+    return comp_bw_sparse_run(bw, BWsparseTransitions::max_density());
+}
+
+size_t comp_bw_sparse_dense(const BWdata& bw){
+    return comp_bw_sparse_run(bw, -1.0);
+}
+
+static size_t comp_bw_sparse_run(const BWdata& bw, const double max_density){
+    BWconvergence convergence(bw);
+    double neg_log_likelihood_sum;
+
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+
+    double* storage = (double *)bw_scratch_alloc(bw, "sparse/storage", (4*N + M*N)*sizeof(double));
+    SparseStats stats;
+    stats.init = storage;
+    stats.gamma = stats.init + N;
+    stats.gamma_full = stats.gamma + N;
+    stats.beta_emit = stats.gamma_full + N;
+    stats.emit = stats.beta_emit + N;
+
+    // NULL := dense kernels
+    BWsparseTransitions trans(bw);
+    const BWsparseTransitions* sparse = NULL;
+    if (BWsparseTransitions::density(bw.trans_prob, N) <= max_density) {
+        trans.compress();
+        sparse = &trans;
+    }
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+        memset(storage, 0, (4*N + M*N)*sizeof(double));
+
+        Instrumentation::phase(BW_PHASE_FORWARD);
+        for (size_t k = 0; k < bw.K; k++) {
+            forward_sparse(bw, k, sparse);
+        }
+        Instrumentation::phase(BW_PHASE_BACKWARD);
+        for (size_t k = 0; k < bw.K; k++) {
+            backward_sparse(bw, k, sparse, stats);
+        }
+        Instrumentation::phase(BW_PHASE_GAMMA);
+        for (size_t k = 0; k < bw.K; k++) {
+            accumulate_sparse(bw, k, stats);
+        }
+
+        Instrumentation::phase(BW_PHASE_LIKELIHOOD);
+        neg_log_likelihood_sum = likelihood_log(bw.c_norm, bw.total_length());
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        update_sparse(bw, sparse, stats);
+
+        // switch to the sparse kernels as soon as the update pruned enough transitions
+        if (sparse == NULL && BWsparseTransitions::density(bw.trans_prob, N) <= max_density) {
+            trans.compress();
+            sparse = &trans;
+        }
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bw_scratch_free(bw, storage);
+
+    return convergence.converged_at();
+}
+
+
+static inline void forward_sparse(const BWdata& bw, const size_t k, const BWsparseTransitions* sparse) {
+    const size_t N = bw.N;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    double* alpha = bw.alpha + kT*N;
+    double* c_norm = bw.c_norm + kT;
+
+    // t = 0, base case
+    double c_sum = 0.0;
+    const double* emit = bw.emit_prob + observations[0]*N;
+    for (size_t n = 0; n < N; n++) {
+        alpha[n] = bw.init_prob[n]*emit[n];
+        c_sum += alpha[n];
+    }
+    double c = 1.0/c_sum;
+    c_norm[0] = c;
+    for (size_t n = 0; n < N; n++) {
+        alpha[n] *= c;
+    }
+
+    // recursion step: alpha[t] = (alpha[t-1] * trans_prob) .* emit_prob[obs[t]]
+    for (size_t t = 1; t < T; t++) {
+        const double* alpha_prev = alpha + (t-1)*N;
+        double* alpha_t = alpha + t*N;
+        emit = bw.emit_prob + observations[t]*N;
+
+        memset(alpha_t, 0, N*sizeof(double));
+        if (sparse) {
+            // scatter the nonzeros of row n0
+            for (size_t n0 = 0; n0 < N; n0++) {
+                const double a = alpha_prev[n0];
+                for (size_t j = sparse->row_offsets[n0]; j < sparse->row_offsets[n0+1]; j++) {
+                    alpha_t[sparse->columns[j]] += a*sparse->values[j];
+                }
+            }
+        } else {
+            for (size_t n0 = 0; n0 < N; n0++) {
+                const double a = alpha_prev[n0];
+                const double* trans = bw.trans_prob + n0*N;
+                for (size_t n1 = 0; n1 < N; n1++) {
+                    alpha_t[n1] += a*trans[n1];
+                }
+            }
+        }
+
+        c_sum = 0.0;
+        for (size_t n1 = 0; n1 < N; n1++) {
+            alpha_t[n1] *= emit[n1];
+            c_sum += alpha_t[n1];
+        }
+        c = 1.0/c_sum;
+        c_norm[t] = c;
+        for (size_t n1 = 0; n1 < N; n1++) {
+            alpha_t[n1] *= c;
+        }
+    }
+}
+
+
+static inline void backward_sparse(const BWdata& bw, const size_t k, const BWsparseTransitions* sparse, SparseStats& stats) {
+    const size_t N = bw.N;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    const double* alpha = bw.alpha + kT*N;
+    const double* c_norm = bw.c_norm + kT;
+    double* beta = bw.beta + kT*N;
+    double* ggamma = bw.ggamma + kT*N;
+    double* sigma_sum = bw.sigma_sum + k*N*N;
+    double* beta_emit = stats.beta_emit;
+
+    // t = T-1, base case
+    for (size_t n = 0; n < N; n++) {
+        beta[(T-1)*N + n] = c_norm[T-1];
+        ggamma[(T-1)*N + n] = alpha[(T-1)*N + n];
+    }
+    memset(sigma_sum, 0, N*N*sizeof(double));
+
+    // recursion step
+    for (size_t t = T-1; t-- > 0; ) {
+        const double* emit = bw.emit_prob + observations[t+1]*N;
+        const double* beta_next = beta + (t+1)*N;
+        for (size_t n1 = 0; n1 < N; n1++) {
+            beta_emit[n1] = beta_next[n1]*emit[n1];
+        }
+
+        // sigma is only materialized if the BWdata has a buffer for it (zeros included)
+        double* sigma_t = bw.stream_sigma ? nullptr : bw.sigma + (kT + t)*N*N;
+        if (sigma_t && sparse) memset(sigma_t, 0, N*N*sizeof(double));
+
+        for (size_t n0 = 0; n0 < N; n0++) {
+            const double a = alpha[t*N + n0];
+            double* sigma_sum_row = sigma_sum + n0*N;
+            double beta_sum = 0.0;
+            if (sparse) {
+                // gather the nonzeros of row n0
+                for (size_t j = sparse->row_offsets[n0]; j < sparse->row_offsets[n0+1]; j++) {
+                    const size_t n1 = sparse->columns[j];
+                    const double s = sparse->values[j]*beta_emit[n1];
+                    beta_sum += s;
+                    sigma_sum_row[n1] += a*s;
+                    if (sigma_t) sigma_t[n0*N + n1] = a*s;
+                }
+            } else {
+                const double* trans = bw.trans_prob + n0*N;
+                for (size_t n1 = 0; n1 < N; n1++) {
+                    const double s = trans[n1]*beta_emit[n1];
+                    beta_sum += s;
+                    sigma_sum_row[n1] += a*s;
+                }
+                if (sigma_t) {
+                    double* sigma_row = sigma_t + n0*N;
+                    for (size_t n1 = 0; n1 < N; n1++) {
+                        sigma_row[n1] = a*trans[n1]*beta_emit[n1];
+                    }
+                }
+            }
+            beta[t*N + n0] = beta_sum*c_norm[t];
+            ggamma[t*N + n0] = a*beta_sum;
+        }
+    }
+}
+
+
+static inline void accumulate_sparse(const BWdata& bw, const size_t k, SparseStats& stats) {
+    const size_t N = bw.N;
+    const size_t T = bw.length(k);
+    const size_t kT = bw.offsets[k];
+    const size_t* observations = bw.observations + kT;
+    const double* ggamma = bw.ggamma + kT*N;
+    double* gamma_sum = bw.gamma_sum + k*N;
+
+    // gamma_sum over t < T-1 (denominator of trans_prob) and the emission numerators
+    memset(gamma_sum, 0, N*sizeof(double));
+    for (size_t t = 0; t < T-1; t++) {
+        double* emit = stats.emit + observations[t]*N;
+        for (size_t n = 0; n < N; n++) {
+            gamma_sum[n] += ggamma[t*N + n];
+            emit[n] += ggamma[t*N + n];
+        }
+    }
+
+    for (size_t n = 0; n < N; n++) {
+        stats.init[n] += ggamma[n];
+        stats.gamma[n] += gamma_sum[n];
+    }
+
+    // add last time step (denominator of emit_prob)
+    double* emit = stats.emit + observations[T-1]*N;
+    for (size_t n = 0; n < N; n++) {
+        gamma_sum[n] += ggamma[(T-1)*N + n];
+        emit[n] += ggamma[(T-1)*N + n];
+        stats.gamma_full[n] += gamma_sum[n];
+    }
+}
+
+
+static inline void update_sparse(const BWdata& bw, const BWsparseTransitions* sparse, SparseStats& stats) {
+    const size_t K = bw.K;
+    const size_t N = bw.N;
+    const size_t M = bw.M;
+
+    const double K_inv = 1.0/K;
+    for (size_t n = 0; n < N; n++) {
+        bw.init_prob[n] = stats.init[n]*K_inv;
+    }
+
+    // trans_prob, only the nonzeros (in both forms) if sparse
+    for (size_t n0 = 0; n0 < N; n0++) {
+        const double denominator_inv = 1.0/stats.gamma[n0];
+        if (sparse) {
+            for (size_t j = sparse->row_offsets[n0]; j < sparse->row_offsets[n0+1]; j++) {
+                const size_t n1 = sparse->columns[j];
+                double s_sum = 0.0;
+                for (size_t k = 0; k < K; k++) {
+                    s_sum += bw.sigma_sum[(k*N + n0)*N + n1];
+                }
+                sparse->values[j] = s_sum*denominator_inv;
+                bw.trans_prob[n0*N + n1] = sparse->values[j];
+            }
+        } else {
+            for (size_t n1 = 0; n1 < N; n1++) {
+                double s_sum = 0.0;
+                for (size_t k = 0; k < K; k++) {
+                    s_sum += bw.sigma_sum[(k*N + n0)*N + n1];
+                }
+                bw.trans_prob[n0*N + n1] = s_sum*denominator_inv;
+            }
+        }
+    }
+
+    // emit_prob is stored transposed ([M][N])
+    for (size_t n = 0; n < N; n++) {
+        stats.gamma_full[n] = 1.0/stats.gamma_full[n];
+    }
+    for (size_t m = 0; m < M; m++) {
+        for (size_t n = 0; n < N; n++) {
+            bw.emit_prob[m*N + n] = stats.emit[m*N + n]*stats.gamma_full[n];
+        }
+    }
+}
@@ -0,0 +1,376 @@
+/*
+    Specialized implementation
+    The state counts of the models used in practice (16, 32, 64 and 128) get their own
+    instantiation of the forward, backward (with gamma), sigma and update kernels, N is a
+    template parameter: every loop over the states has a constant trip count and is unrolled,
+    the addressing is by constant offsets.
+    The forward step accumulates SPECIALIZED_BLOCK vectors (32 states) of alpha[t] at once in
+    registers, i.e. for N <= 32 the whole row: it is scaled by c_norm before it is stored once.
+    The backward step keeps beta[t+1] .* emit_prob[y_(t+1)] in registers for N <= 32 and stores
+    it, sigma_sum is then one product over t per sequence (trans_prob does not depend on t).
+    comp_bw_specialized dispatches on bw.N at run time, any other N runs "combined".
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+
+#include "../common.h"
+#include "../likelihood.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+
+// vectors of alpha[t] accumulated in registers at once (8 of the 16 ymm registers)
+#define SPECIALIZED_BLOCK 8
+
+// local buffers of one run, passed along such that concurrent runs don't share them
+struct SpecializedScratch {
+    double* gamma0_sum; //           [N]         sum of ggamma[k][0] over all k
+    double* gamma_last; //           [K][N]      ggamma[k][T-1]
+    double* numerator_sum; //        [M][N]      sum of ggamma[k][t] over all k and t with y_t = m
+    double* denominator_sum; //      [N]
+    double* beta_emit; //            [T][N]      beta[t+1] .* emit_prob[y_(t+1)] of the current sequence
+};
+
+static size_t comp_bw_specialized(const BWdata& bw);
+template<size_t N> static size_t comp_bw_specialized_n(const BWdata& bw);
+template<size_t N> static inline double forward_specialized(const BWdata& bw, const size_t k);
+template<size_t N> static inline void backward_specialized(const BWdata& bw, const SpecializedScratch& scratch, const size_t k);
+template<size_t N> static inline void sigma_specialized(const BWdata& bw, const SpecializedScratch& scratch, const size_t k);
+template<size_t N> static inline void update_specialized(const BWdata& bw, const SpecializedScratch& scratch);
+
+REGISTER_FUNCTION_FEATURES(comp_bw_specialized, "specialized", "Kernels compiled for N = 16, 32, 64 and 128, combined otherwise", true, BW_FEATURE_STREAM_SIGMA | BW_FEATURE_RAGGED | BW_FEATURE_SPECIALIZED);
+
+
+static size_t comp_bw_specialized(const BWdata& bw){
+    switch (bw.N) {
+        case 16: return comp_bw_specialized_n<16>(bw);
+        case 32: return comp_bw_specialized_n<32>(bw);
+        case 64: return comp_bw_specialized_n<64>(bw);
+        case 128: return comp_bw_specialized_n<128>(bw);
+        default: break;
+    }
+    // generic path (registered for the same ISA levels, with the same features)
+    const compute_bw_func combined = FuncRegister::find("combined");
+    assert(combined != NULL && "The generic path 'combined' is not registered");
+    return combined(bw);
+}
+
+template<size_t N>
+static size_t comp_bw_specialized_n(const BWdata& bw){
+    BWconvergence convergence(bw);
+
+    SpecializedScratch scratch;
+    scratch.gamma0_sum = (double *)bw_scratch_alloc(bw, "specialized/gamma0_sum", N * sizeof(double));
+    scratch.gamma_last = (double *)bw_scratch_alloc(bw, "specialized/gamma_last", bw.K*N * sizeof(double));
+    scratch.numerator_sum = (double *)bw_scratch_alloc(bw, "specialized/numerator_sum", bw.M*N * sizeof(double));
+    scratch.denominator_sum = (double *)bw_scratch_alloc(bw, "specialized/denominator_sum", N * sizeof(double));
+    scratch.beta_emit = (double *)bw_scratch_alloc(bw, "specialized/beta_emit", bw.T*N * sizeof(double));
+
+    // run for all iterations
+    for (size_t i = 0; i < bw.max_iterations; i++) {
+        memset(scratch.gamma0_sum, 0, N * sizeof(double));
+        memset(scratch.numerator_sum, 0, bw.M*N * sizeof(double));
+
+        double neg_log_likelihood_sum = 0.0;
+        for (size_t k = 0; k < bw.K; k++) {
+            Instrumentation::phase(BW_PHASE_FORWARD);
+            neg_log_likelihood_sum += forward_specialized<N>(bw, k);
+            Instrumentation::phase(BW_PHASE_BACKWARD);
+            backward_specialized<N>(bw, scratch, k);
+            Instrumentation::phase(BW_PHASE_SIGMA);
+            sigma_specialized<N>(bw, scratch, k);
+        }
+        bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
+
+        convergence.update(i, neg_log_likelihood_sum);
+
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
+        update_specialized<N>(bw, scratch);
+
+        if (convergence.stop()) break;
+    }
+    Instrumentation::end();
+
+    bw_scratch_free(bw, scratch.gamma0_sum);
+    bw_scratch_free(bw, scratch.gamma_last);
+    bw_scratch_free(bw, scratch.numerator_sum);
+    bw_scratch_free(bw, scratch.denominator_sum);
+    bw_scratch_free(bw, scratch.beta_emit);
+
+    return convergence.converged_at();
+}
+
+/**
+ * Sum of the 4 lanes
+ */
+static inline double reduce_specialized(const __m256d v) {
+    const __m256d h = _mm256_hadd_pd(v, v);
+    return _mm256_cvtsd_f64(h) + _mm256_cvtsd_f64(_mm256_permute2f128_pd(h, h, 1));
+}
+
+/**
+ * Forward pass of sequence k, returns its negative log likelihood
+ */
+template<size_t N>
+static inline double forward_specialized(const BWdata& bw, const size_t k) {
+    constexpr size_t V = N/4;
+    constexpr size_t B = (V < SPECIALIZED_BLOCK) ? V : SPECIALIZED_BLOCK;
+    // independent partial sums per vector, such that there are always SPECIALIZED_BLOCK fma chains
+    constexpr size_t P = SPECIALIZED_BLOCK/B;
+    const size_t kT = bw.offsets[k];
+    const size_t T = bw.length(k);
+    BWlikelihood likelihood;
+
+    // t = 0, base case
+    {
+        double* alpha = bw.alpha + kT*N;
+        const double* emit_prob = bw.emit_prob + bw.observations[kT]*N;
+        __m256d c_sum = _mm256_setzero_pd();
+        for (size_t v = 0; v < V; v++) {
+            const __m256d alpha_v = _mm256_mul_pd(_mm256_load_pd(bw.init_prob + 4*v), _mm256_load_pd(emit_prob + 4*v));
+            c_sum = _mm256_add_pd(c_sum, alpha_v);
+            _mm256_store_pd(alpha + 4*v, alpha_v);
+        }
+        const double c_norm = 1.0/reduce_specialized(c_sum);
+        bw.c_norm[kT] = c_norm;
+        likelihood.multiply(c_norm);
+        const __m256d c_norm_v = _mm256_set1_pd(c_norm);
+        for (size_t v = 0; v < V; v++) {
+            _mm256_store_pd(alpha + 4*v, _mm256_mul_pd(_mm256_load_pd(alpha + 4*v), c_norm_v));
+        }
+    }
+
+    for (size_t t = 1; t < T; t++) {
+        const double* alpha_old = bw.alpha + (kT + t-1)*N;
+        double* alpha = bw.alpha + (kT + t)*N;
+        const double* emit_prob = bw.emit_prob + bw.observations[kT + t]*N;
+        __m256d c_sum = _mm256_setzero_pd();
+        __m256d alpha_sum[B];
+
+        // alpha[t] = (alpha[t-1] * trans_prob) .* emit_prob[y_t], B vectors at a time
+        for (size_t b = 0; b < V; b += B) {
+            __m256d partial_sum[P][B];
+            for (size_t p = 0; p < P; p++) {
+                for (size_t j = 0; j < B; j++) {
+                    partial_sum[p][j] = _mm256_setzero_pd();
+                }
+            }
+            for (size_t n0 = 0; n0 < N; n0 += P) {
+                for (size_t p = 0; p < P; p++) {
+                    const __m256d alpha_old_v = _mm256_broadcast_sd(alpha_old + n0 + p);
+                    const double* trans_prob = bw.trans_prob + (n0 + p)*N + 4*b;
+                    for (size_t j = 0; j < B; j++) {
+                        partial_sum[p][j] = _mm256_fmadd_pd(alpha_old_v, _mm256_load_pd(trans_prob + 4*j), partial_sum[p][j]);
+                    }
+                }
+            }
+            for (size_t j = 0; j < B; j++) {
+                alpha_sum[j] = partial_sum[0][j];
+                for (size_t p = 1; p < P; p++) {
+                    alpha_sum[j] = _mm256_add_pd(alpha_sum[j], partial_sum[p][j]);
+                }
+                alpha_sum[j] = _mm256_mul_pd(alpha_sum[j], _mm256_load_pd(emit_prob + 4*(b + j)));
+                c_sum = _mm256_add_pd(c_sum, alpha_sum[j]);
+                if (V > B) _mm256_store_pd(alpha + 4*(b + j), alpha_sum[j]);
+            }
+        }
+
+        const double c_norm = 1.0/reduce_specialized(c_sum);
+        bw.c_norm[kT + t] = c_norm;
+        likelihood.multiply(c_norm);
+        const __m256d c_norm_v = _mm256_set1_pd(c_norm);
+        for (size_t v = 0; v < V; v++) {
+            // the whole row is still in registers if it fits into one block
+            const __m256d alpha_v = (V > B) ? _mm256_load_pd(alpha + 4*v) : alpha_sum[v % B];
+            _mm256_store_pd(alpha + 4*v, _mm256_mul_pd(alpha_v, c_norm_v));
+        }
+    }
+
+    return likelihood.log();
+}
+
+/**
+ * Backward pass of sequence k with gamma. Adds ggamma to gamma0_sum (t = 0), gamma_sum[k] (t <= T-2),
+ * gamma_last[k] (t = T-1) and the emission numerators, keeps beta[t+1] .* emit_prob[y_(t+1)] for
+ * sigma_specialized (and writes sigma if the BWdata has a buffer for it).
+ */
+template<size_t N>
+static inline void backward_specialized(const BWdata& bw, const SpecializedScratch& scratch, const size_t k) {
+    constexpr size_t V = N/4;
+    const size_t kT = bw.offsets[k];
+    const size_t T = bw.length(k);
+    double* gamma_sum = bw.gamma_sum + k*N;
+
+    memset(gamma_sum, 0, N * sizeof(double));
+
+    // t = T-1, base case: beta = c_norm, ggamma = alpha
+    {
+        const double* alpha = bw.alpha + (kT + T-1)*N;
+        double* beta = bw.beta + (kT + T-1)*N;
+        double* ggamma = bw.ggamma + (kT + T-1)*N;
+        double* numerator_sum = scratch.numerator_sum + bw.observations[kT + T-1]*N;
+        const __m256d c_norm_v = _mm256_set1_pd(bw.c_norm[kT + T-1]);
+        for (size_t v = 0; v < V; v++) {
+            const __m256d gamma_v = _mm256_load_pd(alpha + 4*v);
+            _mm256_store_pd(beta + 4*v, c_norm_v);
+            _mm256_store_pd(ggamma + 4*v, gamma_v);
+            _mm256_store_pd(scratch.gamma_last + k*N + 4*v, gamma_v);
+            _mm256_store_pd(numerator_sum + 4*v, _mm256_add_pd(_mm256_load_pd(numerator_sum + 4*v), gamma_v));
+        }
+    }
+
+    for (size_t t = T-1; t-- > 0; ) {
+        const double* alpha = bw.alpha + (kT + t)*N;
+        const double* beta_next = bw.beta + (kT + t+1)*N;
+        double* beta = bw.beta + (kT + t)*N;
+        double* ggamma = bw.ggamma + (kT + t)*N;
+        double* numerator_sum = scratch.numerator_sum + bw.observations[kT + t]*N;
+        const double* emit_prob = bw.emit_prob + bw.observations[kT + t+1]*N;
+        double* beta_emit_row = scratch.beta_emit + t*N;
+
+        __m256d beta_emit[V];
+        for (size_t v = 0; v < V; v++) {
+            beta_emit[v] = _mm256_mul_pd(_mm256_load_pd(beta_next + 4*v), _mm256_load_pd(emit_prob + 4*v));
+            _mm256_store_pd(beta_emit_row + 4*v, beta_emit[v]);
+        }
+
+        // 4 rows of trans_prob at a time: beta[t][n0] = c_norm * sum_n1 trans_prob[n0][n1] * beta_emit[n1]
+        const __m256d c_norm_v = _mm256_set1_pd(bw.c_norm[kT + t]);
+        for (size_t n0 = 0; n0 < N; n0 += 4) {
+            __m256d beta_sum[4];
+            for (size_t r = 0; r < 4; r++) {
+                const double* trans_prob = bw.trans_prob + (n0 + r)*N;
+                beta_sum[r] = _mm256_setzero_pd();
+                for (size_t v = 0; v < V; v++) {
+                    beta_sum[r] = _mm256_fmadd_pd(_mm256_load_pd(trans_prob + 4*v), beta_emit[v], beta_sum[r]);
+                }
+            }
+
+            // lane r := sum of beta_sum[r]
+            const __m256d sum_01 = _mm256_hadd_pd(beta_sum[0], beta_sum[1]);
+            const __m256d sum_23 = _mm256_hadd_pd(beta_sum[2], beta_sum[3]);
+            const __m256d sum = _mm256_add_pd(_mm256_blend_pd(sum_01, sum_23, 0b1100), _mm256_permute2f128_pd(sum_01, sum_23, 0b00100001));
+
+            const __m256d gamma_v = _mm256_mul_pd(sum, _mm256_load_pd(alpha + n0));
+            _mm256_store_pd(beta + n0, _mm256_mul_pd(sum, c_norm_v));
+            _mm256_store_pd(ggamma + n0, gamma_v);
+            _mm256_store_pd(gamma_sum + n0, _mm256_add_pd(_mm256_load_pd(gamma_sum + n0), gamma_v));
+            _mm256_store_pd(numerator_sum + n0, _mm256_add_pd(_mm256_load_pd(numerator_sum + n0), gamma_v));
+            if (t == 0) {
+                _mm256_store_pd(scratch.gamma0_sum + n0, _mm256_add_pd(_mm256_load_pd(scratch.gamma0_sum + n0), gamma_v));
+            }
+        }
+
+        // sigma is only materialized if the BWdata has a buffer for it
+        if (bw.sigma) {
+            double* sigma = bw.sigma + (kT + t)*N*N;
+            for (size_t n0 = 0; n0 < N; n0++) {
+                const __m256d alpha_v = _mm256_broadcast_sd(alpha + n0);
+                for (size_t v = 0; v < V; v++) {
+                    _mm256_store_pd(sigma + n0*N + 4*v, _mm256_mul_pd(alpha_v, _mm256_mul_pd(_mm256_load_pd(bw.trans_prob + n0*N + 4*v), beta_emit[v])));
+                }
+            }
+        }
+    }
+}
+
+/**
+ * sigma_sum of sequence k: trans_prob[n0][n1] does not depend on t, thus
+ * sigma_sum[n0][n1] = trans_prob[n0][n1] * sum_(t <= T-2) alpha[t][n0] * beta_emit[t][n1],
+ * the sum over t is a product of two T x N matrices, in tiles of 4 x 8 accumulators
+ */
+template<size_t N>
+static inline void sigma_specialized(const BWdata& bw, const SpecializedScratch& scratch, const size_t k) {
+    const size_t kT = bw.offsets[k];
+    const size_t T = bw.length(k);
+    double* sigma_sum = bw.sigma_sum + k*N*N;
+
+    for (size_t n0 = 0; n0 < N; n0 += 4) {
+        for (size_t n1 = 0; n1 < N; n1 += 8) {
+            __m256d s_sum[4][2];
+            for (size_t r = 0; r < 4; r++) {
+                s_sum[r][0] = _mm256_setzero_pd();
+                s_sum[r][1] = _mm256_setzero_pd();
+            }
+            const double* alpha = bw.alpha + kT*N + n0;
+            const double* beta_emit = scratch.beta_emit + n1;
+            for (size_t t = 0; t + 1 < T; t++) {
+                const __m256d beta_emit0 = _mm256_load_pd(beta_emit + t*N);
+                const __m256d beta_emit1 = _mm256_load_pd(beta_emit + t*N + 4);
+                for (size_t r = 0; r < 4; r++) {
+                    const __m256d alpha_v = _mm256_broadcast_sd(alpha + t*N + r);
+                    s_sum[r][0] = _mm256_fmadd_pd(alpha_v, beta_emit0, s_sum[r][0]);
+                    s_sum[r][1] = _mm256_fmadd_pd(alpha_v, beta_emit1, s_sum[r][1]);
+                }
+            }
+            for (size_t r = 0; r < 4; r++) {
+                const double* trans_prob = bw.trans_prob + (n0 + r)*N + n1;
+                _mm256_store_pd(sigma_sum + (n0 + r)*N + n1, _mm256_mul_pd(s_sum[r][0], _mm256_load_pd(trans_prob)));
+                _mm256_store_pd(sigma_sum + (n0 + r)*N + n1 + 4, _mm256_mul_pd(s_sum[r][1], _mm256_load_pd(trans_prob + 4)));
+            }
+        }
+    }
+}
+
+/**
+ * M-step from the sums of backward_specialized (adds the last time step to gamma_sum, as the baseline)
+ */
+template<size_t N>
+static inline void update_specialized(const BWdata& bw, const SpecializedScratch& scratch) {
+    constexpr size_t V = N/4;
+    const size_t K = bw.K;
+    const size_t M = bw.M;
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    // init_prob and the denominators of trans_prob (gamma_sum without the last time step)
+    const __m256d K_v = _mm256_set1_pd((double)K);
+    for (size_t v = 0; v < V; v++) {
+        _mm256_store_pd(bw.init_prob + 4*v, _mm256_div_pd(_mm256_load_pd(scratch.gamma0_sum + 4*v), K_v));
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            g_sum = _mm256_add_pd(g_sum, _mm256_load_pd(bw.gamma_sum + k*N + 4*v));
+        }
+        _mm256_store_pd(scratch.denominator_sum + 4*v, _mm256_div_pd(one, g_sum));
+    }
+
+    // trans_prob
+    for (size_t n0 = 0; n0 < N; n0++) {
+        const __m256d denominator_v = _mm256_broadcast_sd(scratch.denominator_sum + n0);
+        for (size_t v = 0; v < V; v++) {
+            __m256d s_sum = _mm256_setzero_pd();
+            for (size_t k = 0; k < K; k++) {
+                s_sum = _mm256_add_pd(s_sum, _mm256_load_pd(bw.sigma_sum + (k*N + n0)*N + 4*v));
+            }
+            _mm256_store_pd(bw.trans_prob + n0*N + 4*v, _mm256_mul_pd(s_sum, denominator_v));
+        }
+    }
+
+    // emit_prob
+    for (size_t v = 0; v < V; v++) {
+        __m256d g_sum = _mm256_setzero_pd();
+        for (size_t k = 0; k < K; k++) {
+            const __m256d gamma_sum = _mm256_add_pd(_mm256_load_pd(bw.gamma_sum + k*N + 4*v), _mm256_load_pd(scratch.gamma_last + k*N + 4*v));
+            _mm256_store_pd(bw.gamma_sum + k*N + 4*v, gamma_sum);
+            g_sum = _mm256_add_pd(g_sum, gamma_sum);
+        }
+        _mm256_store_pd(scratch.denominator_sum + 4*v, _mm256_div_pd(one, g_sum));
+    }
+    for (size_t m = 0; m < M; m++) {
+        for (size_t v = 0; v < V; v++) {
+            _mm256_store_pd(bw.emit_prob + m*N + 4*v, _mm256_mul_pd(_mm256_load_pd(scratch.numerator_sum + m*N + 4*v), _mm256_load_pd(scratch.denominator_sum + 4*v)));
+        }
+    }
+}
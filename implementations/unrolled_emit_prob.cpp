@@ -19,6 +19,9 @@
 #include <cstring>
 
 #include "../common.h"
+#include "../likelihood.h"
+#include "../instrumentation.h"
+#include "../workspace.h"
 
 
 static void forward_step(const BWdata& bw);
@@ -27,56 +30,50 @@ static void compute_gamma(const BWdata& bw);
 static void compute_sigma(const BWdata& bw);
 static void update_init_prob(const BWdata& bw);
 static void update_trans_prob(const BWdata& bw);
-static void update_emit_prob(const BWdata& bw);
+static void update_emit_prob(const BWdata& bw, double* denominator_sum, double* numerator_sum);
 static size_t comp_bw_emit_unrolled(const BWdata& bw);
 
 
 REGISTER_FUNCTION(comp_bw_emit_unrolled, "unroll-emitprob", "Unrolled ");
-static double* denominator_sum = nullptr;
-static double* numerator_sum = nullptr;
 
 size_t comp_bw_emit_unrolled(const BWdata& bw){
 
-    size_t iter = 0;
-    size_t res = 0;
-    double neg_log_likelihood_sum_old = 0; // Does not have to be initialized as it will be if and only if i > 0
-    bool first = true;
-    denominator_sum = (double *)aligned_alloc(32,bw.N * sizeof(double));
-    numerator_sum = (double *)aligned_alloc(32,bw.N*bw.M * sizeof(double));
+    BWconvergence convergence(bw);
+    double* denominator_sum = (double *)bw_scratch_alloc(bw, "unroll-emitprob/denominator_sum", bw.N * sizeof(double));
+    double* numerator_sum = (double *)bw_scratch_alloc(bw, "unroll-emitprob/numerator_sum", bw.N*bw.M * sizeof(double));
 
     // run for all iterations
     for (size_t i = 0; i < bw.max_iterations; i++) {
 
-        iter++;
-
+        Instrumentation::phase(BW_PHASE_FORWARD);
         forward_step(bw);
+        Instrumentation::phase(BW_PHASE_BACKWARD);
         backward_step(bw);
+        Instrumentation::phase(BW_PHASE_GAMMA);
         compute_gamma(bw);
+        Instrumentation::phase(BW_PHASE_SIGMA);
         compute_sigma(bw);
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
         update_init_prob(bw);
+        Instrumentation::phase(BW_PHASE_UPDATE_TRANS);
         update_trans_prob(bw);
-        update_emit_prob(bw);
+        Instrumentation::phase(BW_PHASE_UPDATE_EMIT);
+        update_emit_prob(bw, denominator_sum, numerator_sum);
 
-        double neg_log_likelihood_sum = 0.0;
-        for (size_t k = 0; k < bw.K; k++) {
-            for (size_t t = 0; t < bw.T; t++) {
-                neg_log_likelihood_sum = neg_log_likelihood_sum + log(bw.c_norm[k*bw.T + t]);
-            }
-        }
+        Instrumentation::phase(BW_PHASE_LIKELIHOOD);
+        const double neg_log_likelihood_sum = likelihood_log(bw.c_norm, bw.total_length());
         bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
 
-        if (first && i > 0 && fabs(neg_log_likelihood_sum - neg_log_likelihood_sum_old) < EPSILON){
-            first = false;
-            res = iter;
-        }
+        convergence.update(i, neg_log_likelihood_sum);
 
-        neg_log_likelihood_sum_old = neg_log_likelihood_sum;
 
+        if (convergence.stop()) break;
     }
-    free(denominator_sum);
-    free(numerator_sum);
+    Instrumentation::end();
+    bw_scratch_free(bw, denominator_sum);
+    bw_scratch_free(bw, numerator_sum);
 
-    return res;
+    return convergence.converged_at();
 }
 
 
@@ -211,7 +208,7 @@ inline void update_trans_prob(const BWdata& bw) {
 }
 
 
-inline void update_emit_prob(const BWdata& bw) {
+inline void update_emit_prob(const BWdata& bw, double* denominator_sum, double* numerator_sum) {
     // Init
     double denominator_sum0, denominator_sum1, denominator_sum2, denominator_sum3, denominator_sum4, denominator_sum5, denominator_sum6, denominator_sum7;
     double ggamma_cond_sum_tot0, ggamma_cond_sum_tot1, ggamma_cond_sum_tot2, ggamma_cond_sum_tot3;
@@ -19,33 +19,36 @@
 #include <cstring>
 
 #include "../common.h"
+#include "../likelihood.h"
+#include "../instrumentation.h"
+#include "../workspace.h"
 
 
 static void forward_step(const BWdata& bw, double& neg_log_likelihood_sum);
 static void backward_step(const BWdata& bw, const size_t& k);
 static void compute_gamma(const BWdata& bw, const size_t& k);
-static void update_trans_prob(const BWdata& bw);
-static void update_emit_prob(const BWdata& bw);
+static void update_trans_prob(const BWdata& bw, double* denominator_sum);
+static void update_emit_prob(const BWdata& bw, double* denominator_sum, double* numerator_sum);
 static size_t comp_bw_scalar_unroll(const BWdata& bw);
 
 
 REGISTER_FUNCTION(comp_bw_scalar_unroll, "other-unroll", "Another approach to unrolling the code");
 
-static double* denominator_sum = nullptr;
-static double* numerator_sum = nullptr;
 
 static size_t comp_bw_scalar_unroll(const BWdata& bw){
-    size_t res = 0;
-    double neg_log_likelihood_sum, neg_log_likelihood_sum_old = 0; // Does not have to be initialized as it will be if and only if i > 0
-    bool first = true;
-    denominator_sum = (double *)aligned_alloc(32,bw.N * sizeof(double));
-    numerator_sum = (double *)aligned_alloc(32,bw.N*bw.M * sizeof(double));
+    BWconvergence convergence(bw);
+    double neg_log_likelihood_sum;
+    double* denominator_sum = (double *)bw_scratch_alloc(bw, "other-unroll/denominator_sum", bw.N * sizeof(double));
+    double* numerator_sum = (double *)bw_scratch_alloc(bw, "other-unroll/numerator_sum", bw.N*bw.M * sizeof(double));
 
     // run for all iterations
     for (size_t i = 0; i < bw.max_iterations; i++) {
         neg_log_likelihood_sum = 0.0;
 
+        // the likelihood is fused into the forward step, gamma into the backward step
+        Instrumentation::phase(BW_PHASE_FORWARD);
         forward_step(bw, neg_log_likelihood_sum);
+        Instrumentation::phase(BW_PHASE_BACKWARD);
         for (size_t k = 0; k < bw.K; k++) {
 
             backward_step(bw, k);
@@ -55,20 +58,20 @@ static size_t comp_bw_scalar_unroll(const BWdata& bw){
 
         bw.neg_log_likelihoods[i] = neg_log_likelihood_sum;
 
-        if (first && i > 0 && fabs(neg_log_likelihood_sum - neg_log_likelihood_sum_old) < EPSILON){
-            first = false;
-            res = i+1;
-        }
+        convergence.update(i, neg_log_likelihood_sum);
 
-        neg_log_likelihood_sum_old = neg_log_likelihood_sum;
 
+        Instrumentation::phase(BW_PHASE_UPDATE_TRANS);
+        update_trans_prob(bw, denominator_sum);
+        Instrumentation::phase(BW_PHASE_UPDATE_EMIT);
+        update_emit_prob(bw, denominator_sum, numerator_sum);
 
-        update_trans_prob(bw);
-        update_emit_prob(bw);
+        if (convergence.stop()) break;
     }
-    free(denominator_sum);
-    free(numerator_sum);
-    return res;
+    Instrumentation::end();
+    bw_scratch_free(bw, denominator_sum);
+    bw_scratch_free(bw, numerator_sum);
+    return convergence.converged_at();
 }
 
 
@@ -82,6 +85,7 @@ static inline void forward_step(const BWdata& bw, double& neg_log_likelihood_sum
 
     size_t kTN, kT;
     size_t kT0N, kT1N, kT2N, kT3N;
+    BWlikelihood likelihood;
     // t = 0, base case
 
     // Init
@@ -149,7 +153,7 @@ static inline void forward_step(const BWdata& bw, double& neg_log_likelihood_sum
 
         // Store
         bw.c_norm[kT] = c_norm;
-        neg_log_likelihood_sum += log(c_norm);
+        likelihood.multiply(c_norm);
 
         // recursion step
         for (size_t t = 1; t < bw.T; t++) {
@@ -222,9 +226,10 @@ static inline void forward_step(const BWdata& bw, double& neg_log_likelihood_sum
 
             // Store
             bw.c_norm[kT + t] = c_norm;
-            neg_log_likelihood_sum += log(c_norm);
+            likelihood.multiply(c_norm);
         }
     }
+    neg_log_likelihood_sum += likelihood.log();
 }
 
 static inline void backward_step(const BWdata& bw, const size_t& k) {
@@ -384,7 +389,7 @@ static inline void compute_gamma(const BWdata& bw, const size_t& k) {
 }
 
 
-static inline void update_trans_prob(const BWdata& bw) {
+static inline void update_trans_prob(const BWdata& bw, double* denominator_sum) {
     //Init (init_prob)
     double g0_sum, denominator_sum_n, denominator_sum_inv;
     double numerator_sum0, numerator_sum1, numerator_sum2, numerator_sum3;
@@ -429,7 +434,7 @@ static inline void update_trans_prob(const BWdata& bw) {
 }
 
 
-static inline void update_emit_prob(const BWdata& bw) {
+static inline void update_emit_prob(const BWdata& bw, double* denominator_sum, double* numerator_sum) {
     // Init
     double denominator_sum0, denominator_sum1, denominator_sum2, denominator_sum3, denominator_sum4, denominator_sum5, denominator_sum6, denominator_sum7;
     double ggamma_cond_sum_tot0, ggamma_cond_sum_tot1, ggamma_cond_sum_tot2, ggamma_cond_sum_tot3;
@@ -23,14 +23,27 @@
 #include <cmath>
 #include <cstring>
 #include "../common.h"
-
-static void forward_step(const BWdata& bw);
-static void backward_step(const BWdata& bw);
+#include "../likelihood.h"
+#include "../workspace.h"
+#include "../instrumentation.h"
+#include "../packed_observations.h"
+
+// local "globals" of one run (heh), passed along such that concurrent runs don't share them
+struct VectorScratch {
+    double* ggamma_N_K_T;
+    double* helper_4_doubles;
+    double* emit_prob_transpose;
+    double* trans_prob_transpose;
+    const BWpackedObservations* observations;
+};
+
+static void forward_step(const BWdata& bw, const VectorScratch& scratch);
+static void backward_step(const BWdata& bw, const VectorScratch& scratch);
 static void compute_gamma(const BWdata& bw);
-static void compute_sigma(const BWdata& bw);
+static void compute_sigma(const BWdata& bw, const VectorScratch& scratch);
 static void update_init_prob(const BWdata& bw);
-static void update_trans_prob(const BWdata& bw);
-static void update_emit_prob(const BWdata& bw);
+static void update_trans_prob(const BWdata& bw, const VectorScratch& scratch);
+static void update_emit_prob(const BWdata& bw, const VectorScratch& scratch);
 static size_t comp_bw_vector_optimized(const BWdata& bw);
 
 REGISTER_FUNCTION(comp_bw_vector_optimized, "vector_optimized", "Vector Optimized: AVX2 & FMA");
@@ -55,15 +68,6 @@ static __m256d _mm256_sumFourRowsIntoOneCol_pd(const __m256d row_0, const __m256
 #define STRIDE_LAYER_M 4
 #define STRIDE_LAYER_K 4
 
-// local globals (heh)
-static double* ggamma_N_K_T;
-static double* helper_4_doubles;
-static double* emit_prob_transpose;
-static double* trans_prob_transpose;
-static double* observations_double_array;
-static const __m256d ones = _mm256_set1_pd(1.0);
-static const __m256d zeros = _mm256_setzero_pd();
-
 /* END DECLARE HELPER STUFF */
 
 
@@ -71,85 +75,75 @@ size_t comp_bw_vector_optimized(const BWdata& bw){
 
     /* BEGIN INIT HELPER STUFF */
 
-    helper_4_doubles = (double *)aligned_alloc(32, 4*sizeof(double));
+    VectorScratch scratch;
 
-    emit_prob_transpose = (double *)aligned_alloc(32, bw.N*bw.M*sizeof(double));
-    trans_prob_transpose = (double *)aligned_alloc(32, bw.N*bw.N*sizeof(double));
+    scratch.helper_4_doubles = (double *)bw_scratch_alloc(bw, "vector_optimized/helper_4_doubles", 4*sizeof(double));
 
-    ggamma_N_K_T = (double *)aligned_alloc(32, bw.N*bw.K*bw.T*sizeof(double));
+    scratch.emit_prob_transpose = (double *)bw_scratch_alloc(bw, "vector_optimized/emit_prob_transpose", bw.N*bw.M*sizeof(double));
+    scratch.trans_prob_transpose = (double *)bw_scratch_alloc(bw, "vector_optimized/trans_prob_transpose", bw.N*bw.N*sizeof(double));
 
-    // AVX doesn't play nice with "size_t"
-    // currently affects only update_emit_prob
-    // quadratic overhead: relatively negligible, but fixing would be dope
-    observations_double_array = (double *)aligned_alloc(32, bw.K*bw.T*sizeof(double));
-    for (size_t k = 0; k < bw.K; k++) {
-        for (size_t t = 0; t < bw.T; t++) {
-            observations_double_array[k*bw.T + t] = (double) bw.observations[k*bw.T + t];
-        }
-    }
+    scratch.ggamma_N_K_T = (double *)bw_scratch_alloc(bw, "vector_optimized/ggamma_N_K_T", bw.N*bw.K*bw.T*sizeof(double));
+
+    // the observations in 8 (16) bit, converted to double 4 at a time in update_emit_prob
+    const BWpackedObservations observations(bw);
+    scratch.observations = &observations;
 
     /* END INIT HELPER STUFF */
 
-    size_t itera = 0;
-    size_t res = 0;
-    double neg_log_likelihood_sum_old = 0; // Does not have to be initialized as it will be if and only if i > 0
-    bool first = true;
+    BWconvergence convergence(bw);
 
     // run for all iterations
     for (size_t iter = 0; iter < bw.max_iterations; iter++) {
-        itera++;
-
         // this must be here (before the backward_step)
-        transpose_matrix(emit_prob_transpose, bw.emit_prob, bw.N, bw.M); // actually worth
+        transpose_matrix(scratch.emit_prob_transpose, bw.emit_prob, bw.N, bw.M); // actually worth
 
         // this must be here (before the forward_step)
-        transpose_matrix(trans_prob_transpose, bw.trans_prob, bw.N, bw.N); // actually worth
+        transpose_matrix(scratch.trans_prob_transpose, bw.trans_prob, bw.N, bw.N); // actually worth
 
-        forward_step(bw);
-        backward_step(bw);
+        Instrumentation::phase(BW_PHASE_FORWARD);
+        forward_step(bw, scratch);
+        Instrumentation::phase(BW_PHASE_BACKWARD);
+        backward_step(bw, scratch);
+        Instrumentation::phase(BW_PHASE_GAMMA);
         compute_gamma(bw);
-        compute_sigma(bw);
+        Instrumentation::phase(BW_PHASE_SIGMA);
+        compute_sigma(bw, scratch);
+        Instrumentation::phase(BW_PHASE_UPDATE_INIT);
         update_init_prob(bw);
-        update_trans_prob(bw);
+        Instrumentation::phase(BW_PHASE_UPDATE_TRANS);
+        update_trans_prob(bw, scratch);
 
         // used for update_emit_prob
         // needs to be done after compute_gamma
-        rotate_indices_left(ggamma_N_K_T, bw.ggamma, bw.N, bw.K, bw.T);
+        Instrumentation::phase(BW_PHASE_UPDATE_EMIT);
+        rotate_indices_left(scratch.ggamma_N_K_T, bw.ggamma, bw.N, bw.K, bw.T);
 
-        update_emit_prob(bw);
+        update_emit_prob(bw, scratch);
 
-        double neg_log_likelihood_sum = 0.0;
-        for (size_t k = 0; k < bw.K; k++) {
-            for (size_t t = 0; t < bw.T; t++) {
-                // there's no AVX instruction for the logarithm ._.
-                neg_log_likelihood_sum = neg_log_likelihood_sum + log(bw.c_norm[k*bw.T + t]);
-            }
-        }
+        Instrumentation::phase(BW_PHASE_LIKELIHOOD);
+        // there's no AVX instruction for the logarithm ._. so there is only one (likelihood.h)
+        const double neg_log_likelihood_sum = likelihood_log(bw.c_norm, bw.total_length());
         bw.neg_log_likelihoods[iter] = neg_log_likelihood_sum;
 
-        if (first && iter > 0 && fabs(neg_log_likelihood_sum - neg_log_likelihood_sum_old) < EPSILON){
-            first = false;
-            res = itera;
-        }
+        convergence.update(iter, neg_log_likelihood_sum);
 
-        neg_log_likelihood_sum_old = neg_log_likelihood_sum;
 
+        if (convergence.stop()) break;
     }
+    Instrumentation::end();
 
     /* BEGIN FREEING HELPER STUFF */
 
-    free(helper_4_doubles);
-
-    free(emit_prob_transpose);
-    free(trans_prob_transpose);
+    bw_scratch_free(bw, scratch.helper_4_doubles);
 
-    free(ggamma_N_K_T);
+    bw_scratch_free(bw, scratch.emit_prob_transpose);
+    bw_scratch_free(bw, scratch.trans_prob_transpose);
 
-    free(observations_double_array);
+    bw_scratch_free(bw, scratch.ggamma_N_K_T);
 
     /* END FREEING HELPER STUFF */
 
-    return res;
+    return convergence.converged_at();
 }
 
 
@@ -196,7 +190,9 @@ inline void rotate_indices_left(double* output, const double* input, const size_
 /* END IMPLEMENTING HELPER STUFF */
 
 
-inline void forward_step(const BWdata& bw) {
+inline void forward_step(const BWdata& bw, const VectorScratch& scratch) {
+    const __m256d ones = _mm256_set1_pd(1.0);
+    const __m256d zeros = _mm256_setzero_pd();
 
     // very tedious to vectorize; T is recursively dependent
     for (size_t k = 0; k < bw.K; k += STRIDE_LAYER_K) {
@@ -255,12 +251,12 @@ inline void forward_step(const BWdata& bw) {
         }
 
         vec_c_norm = _mm256_div_pd(ones, vec_c_norm);
-        _mm256_store_pd(helper_4_doubles, vec_c_norm);
+        _mm256_store_pd(scratch.helper_4_doubles, vec_c_norm);
 
-        const __m256d vec_c_norm_kp0 = _mm256_set1_pd(helper_4_doubles[0]);
-        const __m256d vec_c_norm_kp1 = _mm256_set1_pd(helper_4_doubles[1]);
-        const __m256d vec_c_norm_kp2 = _mm256_set1_pd(helper_4_doubles[2]);
-        const __m256d vec_c_norm_kp3 = _mm256_set1_pd(helper_4_doubles[3]);
+        const __m256d vec_c_norm_kp0 = _mm256_set1_pd(scratch.helper_4_doubles[0]);
+        const __m256d vec_c_norm_kp1 = _mm256_set1_pd(scratch.helper_4_doubles[1]);
+        const __m256d vec_c_norm_kp2 = _mm256_set1_pd(scratch.helper_4_doubles[2]);
+        const __m256d vec_c_norm_kp3 = _mm256_set1_pd(scratch.helper_4_doubles[3]);
 
         for (size_t n = 0; n < bw.N; n += STRIDE_LAYER_N){
 
@@ -280,10 +276,10 @@ inline void forward_step(const BWdata& bw) {
             _mm256_store_pd(index_kp3, _mm256_mul_pd(vec_alpha_kp3, vec_c_norm_kp3));
         }
 
-        bw.c_norm[(k + 0)*bw.T + 0] = helper_4_doubles[0];
-        bw.c_norm[(k + 1)*bw.T + 0] = helper_4_doubles[1];
-        bw.c_norm[(k + 2)*bw.T + 0] = helper_4_doubles[2];
-        bw.c_norm[(k + 3)*bw.T + 0] = helper_4_doubles[3];
+        bw.c_norm[(k + 0)*bw.T + 0] = scratch.helper_4_doubles[0];
+        bw.c_norm[(k + 1)*bw.T + 0] = scratch.helper_4_doubles[1];
+        bw.c_norm[(k + 2)*bw.T + 0] = scratch.helper_4_doubles[2];
+        bw.c_norm[(k + 3)*bw.T + 0] = scratch.helper_4_doubles[3];
 
         // recursion step
         for (size_t t = 1; t < bw.T; t += STRIDE_LAYER_T_RECURSIVE) {
@@ -347,10 +343,10 @@ inline void forward_step(const BWdata& bw) {
                     const double* index_alpha_kp2 = bw.alpha + ((k + 2)*bw.T + (t-1))*bw.N + n1;
                     const double* index_alpha_kp3 = bw.alpha + ((k + 3)*bw.T + (t-1))*bw.N + n1;
 
-                    const __m256d vec_trans_np0 = _mm256_load_pd(trans_prob_transpose + ((n0 + 0)*bw.N + n1));
-                    const __m256d vec_trans_np1 = _mm256_load_pd(trans_prob_transpose + ((n0 + 1)*bw.N + n1));
-                    const __m256d vec_trans_np2 = _mm256_load_pd(trans_prob_transpose + ((n0 + 2)*bw.N + n1));
-                    const __m256d vec_trans_np3 = _mm256_load_pd(trans_prob_transpose + ((n0 + 3)*bw.N + n1));
+                    const __m256d vec_trans_np0 = _mm256_load_pd(scratch.trans_prob_transpose + ((n0 + 0)*bw.N + n1));
+                    const __m256d vec_trans_np1 = _mm256_load_pd(scratch.trans_prob_transpose + ((n0 + 1)*bw.N + n1));
+                    const __m256d vec_trans_np2 = _mm256_load_pd(scratch.trans_prob_transpose + ((n0 + 2)*bw.N + n1));
+                    const __m256d vec_trans_np3 = _mm256_load_pd(scratch.trans_prob_transpose + ((n0 + 3)*bw.N + n1));
 
                     const __m256d vec_alpha_kp0 = _mm256_load_pd(index_alpha_kp0);
                     const __m256d vec_alpha_kp1 = _mm256_load_pd(index_alpha_kp1);
@@ -422,12 +418,12 @@ inline void forward_step(const BWdata& bw) {
             }
 
             vec_c_norm = _mm256_div_pd(ones, vec_c_norm);
-            _mm256_store_pd(helper_4_doubles, vec_c_norm);
+            _mm256_store_pd(scratch.helper_4_doubles, vec_c_norm);
 
-            const __m256d vec_c_norm_kp0 = _mm256_set1_pd(helper_4_doubles[0]);
-            const __m256d vec_c_norm_kp1 = _mm256_set1_pd(helper_4_doubles[1]);
-            const __m256d vec_c_norm_kp2 = _mm256_set1_pd(helper_4_doubles[2]);
-            const __m256d vec_c_norm_kp3 = _mm256_set1_pd(helper_4_doubles[3]);
+            const __m256d vec_c_norm_kp0 = _mm256_set1_pd(scratch.helper_4_doubles[0]);
+            const __m256d vec_c_norm_kp1 = _mm256_set1_pd(scratch.helper_4_doubles[1]);
+            const __m256d vec_c_norm_kp2 = _mm256_set1_pd(scratch.helper_4_doubles[2]);
+            const __m256d vec_c_norm_kp3 = _mm256_set1_pd(scratch.helper_4_doubles[3]);
 
             for (size_t n = 0; n < bw.N; n += STRIDE_LAYER_N){
 
@@ -447,10 +443,10 @@ inline void forward_step(const BWdata& bw) {
                 _mm256_store_pd(index_kp3, _mm256_mul_pd(vec_alpha_kp3, vec_c_norm_kp3));
             }
 
-            bw.c_norm[(k + 0)*bw.T + t] = helper_4_doubles[0];
-            bw.c_norm[(k + 1)*bw.T + t] = helper_4_doubles[1];
-            bw.c_norm[(k + 2)*bw.T + t] = helper_4_doubles[2];
-            bw.c_norm[(k + 3)*bw.T + t] = helper_4_doubles[3];
+            bw.c_norm[(k + 0)*bw.T + t] = scratch.helper_4_doubles[0];
+            bw.c_norm[(k + 1)*bw.T + t] = scratch.helper_4_doubles[1];
+            bw.c_norm[(k + 2)*bw.T + t] = scratch.helper_4_doubles[2];
+            bw.c_norm[(k + 3)*bw.T + t] = scratch.helper_4_doubles[3];
 
         }
 
@@ -458,7 +454,8 @@ inline void forward_step(const BWdata& bw) {
 }
 
 
-inline void backward_step(const BWdata& bw) {
+inline void backward_step(const BWdata& bw, const VectorScratch& scratch) {
+    const __m256d zeros = _mm256_setzero_pd();
 
     for (size_t k = 0; k < bw.K; k += STRIDE_LAYER_K) {
 
@@ -512,10 +509,10 @@ inline void backward_step(const BWdata& bw) {
                     const __m256d vec_trans_prob_np2 = _mm256_load_pd(bw.trans_prob + (n0 + 2)*bw.N + n1);
                     const __m256d vec_trans_prob_np3 = _mm256_load_pd(bw.trans_prob + (n0 + 3)*bw.N + n1);
 
-                    const __m256d vec_emit_prob_kp0 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp0*bw.N + n1));
-                    const __m256d vec_emit_prob_kp1 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp1*bw.N + n1));
-                    const __m256d vec_emit_prob_kp2 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp2*bw.N + n1));
-                    const __m256d vec_emit_prob_kp3 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp3*bw.N + n1));
+                    const __m256d vec_emit_prob_kp0 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp0*bw.N + n1));
+                    const __m256d vec_emit_prob_kp1 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp1*bw.N + n1));
+                    const __m256d vec_emit_prob_kp2 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp2*bw.N + n1));
+                    const __m256d vec_emit_prob_kp3 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp3*bw.N + n1));
 
                     vec_beta_tmp_np0_kp0 = _mm256_fmadd_pd(vec_beta_kp0, _mm256_mul_pd(vec_trans_prob_np0, vec_emit_prob_kp0), vec_beta_tmp_np0_kp0);
                     vec_beta_tmp_np0_kp1 = _mm256_fmadd_pd(vec_beta_kp1, _mm256_mul_pd(vec_trans_prob_np0, vec_emit_prob_kp1), vec_beta_tmp_np0_kp1);
@@ -578,6 +575,8 @@ inline void backward_step(const BWdata& bw) {
 
 
 inline void compute_gamma(const BWdata& bw) {
+    const __m256d ones = _mm256_set1_pd(1.0);
+    const __m256d zeros = _mm256_setzero_pd();
 
 
     for (size_t k = 0; k < bw.K; k += STRIDE_LAYER_K) {
@@ -758,7 +757,8 @@ inline void compute_gamma(const BWdata& bw) {
 }
 
 
-inline void compute_sigma(const BWdata& bw) {
+inline void compute_sigma(const BWdata& bw, const VectorScratch& scratch) {
+    const __m256d zeros = _mm256_setzero_pd();
 
     for (size_t k = 0; k < bw.K; k += STRIDE_LAYER_K) {
 
@@ -915,25 +915,25 @@ inline void compute_sigma(const BWdata& bw) {
                         const __m256d beta_kp3_tp1p2 = _mm256_load_pd(bw.beta + ((kp3*bw.T + tp1p2)*bw.N + n1));
                         const __m256d beta_kp3_tp1p3 = _mm256_load_pd(bw.beta + ((kp3*bw.T + tp1p3)*bw.N + n1));
 
-                        const __m256d emit_kp0_tp1p0 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp0_tp1p0*bw.N + n1));
-                        const __m256d emit_kp0_tp1p1 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp0_tp1p1*bw.N + n1));
-                        const __m256d emit_kp0_tp1p2 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp0_tp1p2*bw.N + n1));
-                        const __m256d emit_kp0_tp1p3 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp0_tp1p3*bw.N + n1));
+                        const __m256d emit_kp0_tp1p0 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp0_tp1p0*bw.N + n1));
+                        const __m256d emit_kp0_tp1p1 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp0_tp1p1*bw.N + n1));
+                        const __m256d emit_kp0_tp1p2 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp0_tp1p2*bw.N + n1));
+                        const __m256d emit_kp0_tp1p3 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp0_tp1p3*bw.N + n1));
 
-                        const __m256d emit_kp1_tp1p0 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp1_tp1p0*bw.N + n1));
-                        const __m256d emit_kp1_tp1p1 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp1_tp1p1*bw.N + n1));
-                        const __m256d emit_kp1_tp1p2 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp1_tp1p2*bw.N + n1));
-                        const __m256d emit_kp1_tp1p3 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp1_tp1p3*bw.N + n1));
+                        const __m256d emit_kp1_tp1p0 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp1_tp1p0*bw.N + n1));
+                        const __m256d emit_kp1_tp1p1 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp1_tp1p1*bw.N + n1));
+                        const __m256d emit_kp1_tp1p2 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp1_tp1p2*bw.N + n1));
+                        const __m256d emit_kp1_tp1p3 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp1_tp1p3*bw.N + n1));
 
-                        const __m256d emit_kp2_tp1p0 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp2_tp1p0*bw.N + n1));
-                        const __m256d emit_kp2_tp1p1 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp2_tp1p1*bw.N + n1));
-                        const __m256d emit_kp2_tp1p2 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp2_tp1p2*bw.N + n1));
-                        const __m256d emit_kp2_tp1p3 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp2_tp1p3*bw.N + n1));
+                        const __m256d emit_kp2_tp1p0 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp2_tp1p0*bw.N + n1));
+                        const __m256d emit_kp2_tp1p1 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp2_tp1p1*bw.N + n1));
+                        const __m256d emit_kp2_tp1p2 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp2_tp1p2*bw.N + n1));
+                        const __m256d emit_kp2_tp1p3 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp2_tp1p3*bw.N + n1));
 
-                        const __m256d emit_kp3_tp1p0 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp3_tp1p0*bw.N + n1));
-                        const __m256d emit_kp3_tp1p1 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp3_tp1p1*bw.N + n1));
-                        const __m256d emit_kp3_tp1p2 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp3_tp1p2*bw.N + n1));
-                        const __m256d emit_kp3_tp1p3 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp3_tp1p3*bw.N + n1));
+                        const __m256d emit_kp3_tp1p0 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp3_tp1p0*bw.N + n1));
+                        const __m256d emit_kp3_tp1p1 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp3_tp1p1*bw.N + n1));
+                        const __m256d emit_kp3_tp1p2 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp3_tp1p2*bw.N + n1));
+                        const __m256d emit_kp3_tp1p3 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp3_tp1p3*bw.N + n1));
 
                         _mm256_store_pd((bw.sigma + (((kp0*bw.T + tp0)*bw.N + n0p0)*bw.N + n1)), _mm256_mul_pd(alpha_kp0_tp0_n0p0, _mm256_mul_pd(trans_n0p0, _mm256_mul_pd(beta_kp0_tp1p0, emit_kp0_tp1p0))));
                         _mm256_store_pd((bw.sigma + (((kp0*bw.T + tp0)*bw.N + n0p1)*bw.N + n1)), _mm256_mul_pd(alpha_kp0_tp0_n0p1, _mm256_mul_pd(trans_n0p1, _mm256_mul_pd(beta_kp0_tp1p0, emit_kp0_tp1p0))));
@@ -1111,21 +1111,21 @@ inline void compute_sigma(const BWdata& bw) {
                         const __m256d beta_kp3_tp1p1 = _mm256_load_pd(bw.beta + ((kp3*bw.T + tp1p1)*bw.N + n1));
                         const __m256d beta_kp3_tp1p2 = _mm256_load_pd(bw.beta + ((kp3*bw.T + tp1p2)*bw.N + n1));
 
-                        const __m256d emit_kp0_tp1p0 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp0_tp1p0*bw.N + n1));
-                        const __m256d emit_kp0_tp1p1 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp0_tp1p1*bw.N + n1));
-                        const __m256d emit_kp0_tp1p2 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp0_tp1p2*bw.N + n1));
+                        const __m256d emit_kp0_tp1p0 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp0_tp1p0*bw.N + n1));
+                        const __m256d emit_kp0_tp1p1 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp0_tp1p1*bw.N + n1));
+                        const __m256d emit_kp0_tp1p2 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp0_tp1p2*bw.N + n1));
 
-                        const __m256d emit_kp1_tp1p0 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp1_tp1p0*bw.N + n1));
-                        const __m256d emit_kp1_tp1p1 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp1_tp1p1*bw.N + n1));
-                        const __m256d emit_kp1_tp1p2 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp1_tp1p2*bw.N + n1));
+                        const __m256d emit_kp1_tp1p0 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp1_tp1p0*bw.N + n1));
+                        const __m256d emit_kp1_tp1p1 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp1_tp1p1*bw.N + n1));
+                        const __m256d emit_kp1_tp1p2 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp1_tp1p2*bw.N + n1));
 
-                        const __m256d emit_kp2_tp1p0 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp2_tp1p0*bw.N + n1));
-                        const __m256d emit_kp2_tp1p1 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp2_tp1p1*bw.N + n1));
-                        const __m256d emit_kp2_tp1p2 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp2_tp1p2*bw.N + n1));
+                        const __m256d emit_kp2_tp1p0 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp2_tp1p0*bw.N + n1));
+                        const __m256d emit_kp2_tp1p1 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp2_tp1p1*bw.N + n1));
+                        const __m256d emit_kp2_tp1p2 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp2_tp1p2*bw.N + n1));
 
-                        const __m256d emit_kp3_tp1p0 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp3_tp1p0*bw.N + n1));
-                        const __m256d emit_kp3_tp1p1 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp3_tp1p1*bw.N + n1));
-                        const __m256d emit_kp3_tp1p2 = _mm256_load_pd(emit_prob_transpose + (index_emitobs_kp3_tp1p2*bw.N + n1));
+                        const __m256d emit_kp3_tp1p0 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp3_tp1p0*bw.N + n1));
+                        const __m256d emit_kp3_tp1p1 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp3_tp1p1*bw.N + n1));
+                        const __m256d emit_kp3_tp1p2 = _mm256_load_pd(scratch.emit_prob_transpose + (index_emitobs_kp3_tp1p2*bw.N + n1));
 
                         _mm256_store_pd((bw.sigma + (((kp0*bw.T + tp0)*bw.N + n0p0)*bw.N + n1)), _mm256_mul_pd(alpha_kp0_tp0_n0p0, _mm256_mul_pd(trans_n0p0, _mm256_mul_pd(beta_kp0_tp1p0, emit_kp0_tp1p0))));
                         _mm256_store_pd((bw.sigma + (((kp0*bw.T + tp0)*bw.N + n0p1)*bw.N + n1)), _mm256_mul_pd(alpha_kp0_tp0_n0p1, _mm256_mul_pd(trans_n0p1, _mm256_mul_pd(beta_kp0_tp1p0, emit_kp0_tp1p0))));
@@ -1281,6 +1281,7 @@ inline void compute_sigma(const BWdata& bw) {
 
 
 inline void update_init_prob(const BWdata& bw) {
+    const __m256d zeros = _mm256_setzero_pd();
 
     const __m256d vec_K_inv = _mm256_set1_pd(1.0/bw.K);
 
@@ -1313,7 +1314,8 @@ inline void update_init_prob(const BWdata& bw) {
 }
 
 
-inline void update_trans_prob(const BWdata& bw) {
+inline void update_trans_prob(const BWdata& bw, const VectorScratch& scratch) {
+    const __m256d zeros = _mm256_setzero_pd();
 
     for (size_t n0 = 0; n0 < bw.N; n0 += STRIDE_LAYER_N) {
 
@@ -1380,12 +1382,12 @@ inline void update_trans_prob(const BWdata& bw) {
 
             }
 
-            _mm256_store_pd(helper_4_doubles, vec_denominator_sum);
+            _mm256_store_pd(scratch.helper_4_doubles, vec_denominator_sum);
 
-            _mm256_store_pd((bw.trans_prob + ((n0 + 0)*bw.N + n1)), _mm256_div_pd(vec_numerator_sum_np0, _mm256_set1_pd(helper_4_doubles[0])));
-            _mm256_store_pd((bw.trans_prob + ((n0 + 1)*bw.N + n1)), _mm256_div_pd(vec_numerator_sum_np1, _mm256_set1_pd(helper_4_doubles[1])));
-            _mm256_store_pd((bw.trans_prob + ((n0 + 2)*bw.N + n1)), _mm256_div_pd(vec_numerator_sum_np2, _mm256_set1_pd(helper_4_doubles[2])));
-            _mm256_store_pd((bw.trans_prob + ((n0 + 3)*bw.N + n1)), _mm256_div_pd(vec_numerator_sum_np3, _mm256_set1_pd(helper_4_doubles[3])));
+            _mm256_store_pd((bw.trans_prob + ((n0 + 0)*bw.N + n1)), _mm256_div_pd(vec_numerator_sum_np0, _mm256_set1_pd(scratch.helper_4_doubles[0])));
+            _mm256_store_pd((bw.trans_prob + ((n0 + 1)*bw.N + n1)), _mm256_div_pd(vec_numerator_sum_np1, _mm256_set1_pd(scratch.helper_4_doubles[1])));
+            _mm256_store_pd((bw.trans_prob + ((n0 + 2)*bw.N + n1)), _mm256_div_pd(vec_numerator_sum_np2, _mm256_set1_pd(scratch.helper_4_doubles[2])));
+            _mm256_store_pd((bw.trans_prob + ((n0 + 3)*bw.N + n1)), _mm256_div_pd(vec_numerator_sum_np3, _mm256_set1_pd(scratch.helper_4_doubles[3])));
 
         }
 
@@ -1394,7 +1396,8 @@ inline void update_trans_prob(const BWdata& bw) {
 }
 
 
-inline void update_emit_prob(const BWdata& bw) {
+inline void update_emit_prob(const BWdata& bw, const VectorScratch& scratch) {
+    const __m256d zeros = _mm256_setzero_pd();
 
     // add last bw.T-step to bw.gamma_sum
     for (size_t k = 0; k < bw.K; k += STRIDE_LAYER_K) {
@@ -1569,10 +1572,10 @@ inline void update_emit_prob(const BWdata& bw) {
 
                 for (size_t t = 0; t < bw.T; t += STRIDE_LAYER_T_NON_RECURSIVE) {
 
-                    const __m256d vec_observations_kp0 = _mm256_load_pd(observations_double_array + ((k + 0)*bw.T + t));
-                    const __m256d vec_observations_kp1 = _mm256_load_pd(observations_double_array + ((k + 1)*bw.T + t));
-                    const __m256d vec_observations_kp2 = _mm256_load_pd(observations_double_array + ((k + 2)*bw.T + t));
-                    const __m256d vec_observations_kp3 = _mm256_load_pd(observations_double_array + ((k + 3)*bw.T + t));
+                    const __m256d vec_observations_kp0 = packed_load4_pd(*scratch.observations, (k + 0)*bw.T + t);
+                    const __m256d vec_observations_kp1 = packed_load4_pd(*scratch.observations, (k + 1)*bw.T + t);
+                    const __m256d vec_observations_kp2 = packed_load4_pd(*scratch.observations, (k + 2)*bw.T + t);
+                    const __m256d vec_observations_kp3 = packed_load4_pd(*scratch.observations, (k + 3)*bw.T + t);
 
                     const __m256d mask_mp0_kp0 = _mm256_cmp_pd(vec_observations_kp0, mask_mp0, _CMP_EQ_OQ);
                     const __m256d mask_mp0_kp1 = _mm256_cmp_pd(vec_observations_kp1, mask_mp0, _CMP_EQ_OQ);
@@ -1594,25 +1597,25 @@ inline void update_emit_prob(const BWdata& bw) {
                     const __m256d mask_mp3_kp2 = _mm256_cmp_pd(vec_observations_kp2, mask_mp3, _CMP_EQ_OQ);
                     const __m256d mask_mp3_kp3 = _mm256_cmp_pd(vec_observations_kp3, mask_mp3, _CMP_EQ_OQ);
 
-                    __m256d vec_ggamma_np0_kp0 = _mm256_load_pd(ggamma_N_K_T + (((n + 0)*bw.K + (k + 0))*bw.T + t));
-                    __m256d vec_ggamma_np0_kp1 = _mm256_load_pd(ggamma_N_K_T + (((n + 0)*bw.K + (k + 1))*bw.T + t));
-                    __m256d vec_ggamma_np0_kp2 = _mm256_load_pd(ggamma_N_K_T + (((n + 0)*bw.K + (k + 2))*bw.T + t));
-                    __m256d vec_ggamma_np0_kp3 = _mm256_load_pd(ggamma_N_K_T + (((n + 0)*bw.K + (k + 3))*bw.T + t));
+                    __m256d vec_ggamma_np0_kp0 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 0)*bw.K + (k + 0))*bw.T + t));
+                    __m256d vec_ggamma_np0_kp1 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 0)*bw.K + (k + 1))*bw.T + t));
+                    __m256d vec_ggamma_np0_kp2 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 0)*bw.K + (k + 2))*bw.T + t));
+                    __m256d vec_ggamma_np0_kp3 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 0)*bw.K + (k + 3))*bw.T + t));
 
-                    __m256d vec_ggamma_np1_kp0 = _mm256_load_pd(ggamma_N_K_T + (((n + 1)*bw.K + (k + 0))*bw.T + t));
-                    __m256d vec_ggamma_np1_kp1 = _mm256_load_pd(ggamma_N_K_T + (((n + 1)*bw.K + (k + 1))*bw.T + t));
-                    __m256d vec_ggamma_np1_kp2 = _mm256_load_pd(ggamma_N_K_T + (((n + 1)*bw.K + (k + 2))*bw.T + t));
-                    __m256d vec_ggamma_np1_kp3 = _mm256_load_pd(ggamma_N_K_T + (((n + 1)*bw.K + (k + 3))*bw.T + t));
+                    __m256d vec_ggamma_np1_kp0 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 1)*bw.K + (k + 0))*bw.T + t));
+                    __m256d vec_ggamma_np1_kp1 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 1)*bw.K + (k + 1))*bw.T + t));
+                    __m256d vec_ggamma_np1_kp2 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 1)*bw.K + (k + 2))*bw.T + t));
+                    __m256d vec_ggamma_np1_kp3 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 1)*bw.K + (k + 3))*bw.T + t));
 
-                    __m256d vec_ggamma_np2_kp0 = _mm256_load_pd(ggamma_N_K_T + (((n + 2)*bw.K + (k + 0))*bw.T + t));
-                    __m256d vec_ggamma_np2_kp1 = _mm256_load_pd(ggamma_N_K_T + (((n + 2)*bw.K + (k + 1))*bw.T + t));
-                    __m256d vec_ggamma_np2_kp2 = _mm256_load_pd(ggamma_N_K_T + (((n + 2)*bw.K + (k + 2))*bw.T + t));
-                    __m256d vec_ggamma_np2_kp3 = _mm256_load_pd(ggamma_N_K_T + (((n + 2)*bw.K + (k + 3))*bw.T + t));
+                    __m256d vec_ggamma_np2_kp0 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 2)*bw.K + (k + 0))*bw.T + t));
+                    __m256d vec_ggamma_np2_kp1 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 2)*bw.K + (k + 1))*bw.T + t));
+                    __m256d vec_ggamma_np2_kp2 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 2)*bw.K + (k + 2))*bw.T + t));
+                    __m256d vec_ggamma_np2_kp3 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 2)*bw.K + (k + 3))*bw.T + t));
 
-                    __m256d vec_ggamma_np3_kp0 = _mm256_load_pd(ggamma_N_K_T + (((n + 3)*bw.K + (k + 0))*bw.T + t));
-                    __m256d vec_ggamma_np3_kp1 = _mm256_load_pd(ggamma_N_K_T + (((n + 3)*bw.K + (k + 1))*bw.T + t));
-                    __m256d vec_ggamma_np3_kp2 = _mm256_load_pd(ggamma_N_K_T + (((n + 3)*bw.K + (k + 2))*bw.T + t));
-                    __m256d vec_ggamma_np3_kp3 = _mm256_load_pd(ggamma_N_K_T + (((n + 3)*bw.K + (k + 3))*bw.T + t));
+                    __m256d vec_ggamma_np3_kp0 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 3)*bw.K + (k + 0))*bw.T + t));
+                    __m256d vec_ggamma_np3_kp1 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 3)*bw.K + (k + 1))*bw.T + t));
+                    __m256d vec_ggamma_np3_kp2 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 3)*bw.K + (k + 2))*bw.T + t));
+                    __m256d vec_ggamma_np3_kp3 = _mm256_load_pd(scratch.ggamma_N_K_T + (((n + 3)*bw.K + (k + 3))*bw.T + t));
 
                     csum_np0_mp0_kp0 = _mm256_add_pd(_mm256_and_pd(vec_ggamma_np0_kp0, mask_mp0_kp0), csum_np0_mp0_kp0);
                     csum_np0_mp0_kp1 = _mm256_add_pd(_mm256_and_pd(vec_ggamma_np0_kp1, mask_mp0_kp1), csum_np0_mp0_kp1);
@@ -1723,12 +1726,12 @@ inline void update_emit_prob(const BWdata& bw) {
             vec_numerator_sum_np2 = _mm256_add_pd(vec_numerator_sum_np2, _mm256_sumFourRowsIntoOneCol_pd(vec_numerator_sum_np2_mp0, vec_numerator_sum_np2_mp1, vec_numerator_sum_np2_mp2, vec_numerator_sum_np2_mp3));
             vec_numerator_sum_np3 = _mm256_add_pd(vec_numerator_sum_np3, _mm256_sumFourRowsIntoOneCol_pd(vec_numerator_sum_np3_mp0, vec_numerator_sum_np3_mp1, vec_numerator_sum_np3_mp2, vec_numerator_sum_np3_mp3));
 
-            _mm256_store_pd(helper_4_doubles, _mm256_sumFourRowsIntoOneCol_pd(vec_denominator_sum_np0, vec_denominator_sum_np1, vec_denominator_sum_np2, vec_denominator_sum_np3));
+            _mm256_store_pd(scratch.helper_4_doubles, _mm256_sumFourRowsIntoOneCol_pd(vec_denominator_sum_np0, vec_denominator_sum_np1, vec_denominator_sum_np2, vec_denominator_sum_np3));
 
-            vec_denominator_sum_np0 = _mm256_set1_pd(helper_4_doubles[0]);
-            vec_denominator_sum_np1 = _mm256_set1_pd(helper_4_doubles[1]);
-            vec_denominator_sum_np2 = _mm256_set1_pd(helper_4_doubles[2]);
-            vec_denominator_sum_np3 = _mm256_set1_pd(helper_4_doubles[3]);
+            vec_denominator_sum_np0 = _mm256_set1_pd(scratch.helper_4_doubles[0]);
+            vec_denominator_sum_np1 = _mm256_set1_pd(scratch.helper_4_doubles[1]);
+            vec_denominator_sum_np2 = _mm256_set1_pd(scratch.helper_4_doubles[2]);
+            vec_denominator_sum_np3 = _mm256_set1_pd(scratch.helper_4_doubles[3]);
 
             const __m256d result_np0 = _mm256_div_pd(vec_numerator_sum_np0, vec_denominator_sum_np0);
             const __m256d result_np1 = _mm256_div_pd(vec_numerator_sum_np1, vec_denominator_sum_np1);
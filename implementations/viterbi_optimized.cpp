@@ -0,0 +1,235 @@
+/*
+    Viterbi: max-product recursion in log space with four sequences per vector
+    Lane i of every vector belongs to sequence i of a group, the max and argmax over the
+    previous states are a compare and two blends per state (same tie breaking as the scalar
+    reference: the smallest state wins). Four target states are processed at once.
+    trans_prob and emit_prob are used transposed (as in vector_optimized), so the row of a
+    target state and of an observation are contiguous.
+    The sequences are grouped by length (longest first), lanes of shorter sequences run
+    along until the group is done and are finished when they reach their last time step.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "../common.h"
+#include "../decoding.h"
+
+struct ViterbiScratch {
+    double* log_trans;  // [N][N]    log_trans[n0*N + n1] = log trans_prob[n1][n0]
+    double* log_emit;   // [M][N]    log_emit[m*N + n] = log emit_prob[n][m]
+    double* log_init;   // [N]
+    double* delta;      // [2][N][4] two rows of four sequences (lane = sequence)
+    int32_t* psi;       // [T_max][N][4] back pointers
+};
+
+static void viterbi_interleaved(const BWmodel& model, const BWsequences& sequences, size_t* paths, double* log_probabilities);
+static inline void viterbi_group(const ViterbiScratch& s, const BWmodel& model, const BWsequences& sequences, const size_t* group, const size_t nb_valid, size_t* paths, double* log_probabilities);
+static inline void viterbi_finish(const ViterbiScratch& s, const BWmodel& model, const BWsequences& sequences, const size_t k, const size_t lane, const size_t t, const double* delta, size_t* paths, double* log_probabilities);
+
+REGISTER_VITERBI_FUNCTION(viterbi_interleaved, "viterbi-interleaved", "Max-product in log space, 4 sequences per vector (AVX2)");
+
+
+static void viterbi_interleaved(const BWmodel& model, const BWsequences& sequences, size_t* paths, double* log_probabilities){
+    const size_t N = model.N;
+    const size_t M = model.M;
+    const size_t K = sequences.K;
+    if (K == 0) return;
+
+    // longest first, such that the sequences of a group have similar lengths
+    std::vector<size_t> order(K);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sequences](const size_t a, const size_t b){
+        return sequences.length(a) > sequences.length(b);
+    });
+    const size_t T_max = sequences.length(order.at(0));
+    assert(sequences.length(order.at(K-1)) >= 1 && "Viterbi needs sequences of at least one time step");
+
+    ViterbiScratch s;
+    const size_t total = N*N + M*N + N + 2*N*4;
+    // delta first, as it is accessed with aligned loads; sizes rounded up to whole vectors
+    // (aligned_alloc requires a multiple of the alignment, N and T_max may be odd)
+    s.delta = (double *)aligned_alloc(32, ((total * sizeof(double) + 31) / 32) * 32);
+    s.psi = (int32_t *)aligned_alloc(32, ((T_max*N*4 * sizeof(int32_t) + 31) / 32) * 32);
+    assert(s.delta != NULL && s.psi != NULL && "Failed to allocate memory");
+    s.log_trans = s.delta + 2*N*4;
+    s.log_emit = s.log_trans + N*N;
+    s.log_init = s.log_emit + M*N;
+
+    for (size_t n0 = 0; n0 < N; n0++) {
+        for (size_t n1 = 0; n1 < N; n1++) {
+            s.log_trans[n0*N + n1] = bw_log(model.trans_prob[n1*N + n0]);
+        }
+        for (size_t m = 0; m < M; m++) {
+            s.log_emit[m*N + n0] = bw_log(model.emit_prob[n0*M + m]);
+        }
+        s.log_init[n0] = bw_log(model.init_prob[n0]);
+    }
+
+    for (size_t g = 0; g < K; g += 4) {
+        // missing lanes of the last group repeat its first sequence and are not written back
+        const size_t nb_valid = std::min((size_t)4, K - g);
+        size_t group[4];
+        for (size_t i = 0; i < 4; i++) {
+            group[i] = order.at(i < nb_valid ? g + i : g);
+        }
+        viterbi_group(s, model, sequences, group, nb_valid, paths, log_probabilities);
+    }
+
+    free(s.delta);
+    free(s.psi);
+}
+
+/**
+ * Sequences group[0..3] (group[0] is the longest)
+ */
+static inline void viterbi_group(const ViterbiScratch& s, const BWmodel& model, const BWsequences& sequences, const size_t* group, const size_t nb_valid, size_t* paths, double* log_probabilities) {
+    const size_t N = model.N;
+    const size_t* observations[4];
+    size_t T[4];
+    for (size_t i = 0; i < 4; i++) {
+        observations[i] = sequences.observations + sequences.offsets[group[i]];
+        T[i] = sequences.length(group[i]);
+    }
+    const size_t T_group = T[0];
+
+    // delta rows: [row][N][4]
+    double* delta_old = s.delta;
+    double* delta_new = s.delta + N*4;
+
+    // t = 0, base case
+    for (size_t n = 0; n < N; n++) {
+        for (size_t i = 0; i < 4; i++) {
+            delta_old[n*4 + i] = s.log_init[n] + s.log_emit[observations[i][0]*N + n];
+        }
+    }
+    for (size_t i = 0; i < nb_valid; i++) {
+        if (T[i] == 1) viterbi_finish(s, model, sequences, group[i], i, 0, delta_old, paths, log_probabilities);
+    }
+
+    // recursion step
+    for (size_t t = 1; t < T_group; t++) {
+        // lanes past their end keep running on observation 0
+        const double* log_emit0 = s.log_emit + (t < T[0] ? observations[0][t] : 0)*N;
+        const double* log_emit1 = s.log_emit + (t < T[1] ? observations[1][t] : 0)*N;
+        const double* log_emit2 = s.log_emit + (t < T[2] ? observations[2][t] : 0)*N;
+        const double* log_emit3 = s.log_emit + (t < T[3] ? observations[3][t] : 0)*N;
+        int32_t* psi = s.psi + t*N*4;
+
+        size_t n0;
+        for (n0 = 0; n0 + 4 <= N; n0 += 4) {
+            const double* log_trans0 = s.log_trans + (n0+0)*N;
+            const double* log_trans1 = s.log_trans + (n0+1)*N;
+            const double* log_trans2 = s.log_trans + (n0+2)*N;
+            const double* log_trans3 = s.log_trans + (n0+3)*N;
+
+            const __m256d delta0 = _mm256_load_pd(delta_old);
+            __m256d best0 = _mm256_add_pd(delta0, _mm256_broadcast_sd(log_trans0));
+            __m256d best1 = _mm256_add_pd(delta0, _mm256_broadcast_sd(log_trans1));
+            __m256d best2 = _mm256_add_pd(delta0, _mm256_broadcast_sd(log_trans2));
+            __m256d best3 = _mm256_add_pd(delta0, _mm256_broadcast_sd(log_trans3));
+            __m256d arg0 = _mm256_setzero_pd();
+            __m256d arg1 = _mm256_setzero_pd();
+            __m256d arg2 = _mm256_setzero_pd();
+            __m256d arg3 = _mm256_setzero_pd();
+
+            for (size_t n1 = 1; n1 < N; n1++) {
+                const __m256d delta = _mm256_load_pd(delta_old + n1*4);
+                const __m256d state = _mm256_set1_pd((double)n1);
+
+                const __m256d candidate0 = _mm256_add_pd(delta, _mm256_broadcast_sd(log_trans0 + n1));
+                const __m256d candidate1 = _mm256_add_pd(delta, _mm256_broadcast_sd(log_trans1 + n1));
+                const __m256d candidate2 = _mm256_add_pd(delta, _mm256_broadcast_sd(log_trans2 + n1));
+                const __m256d candidate3 = _mm256_add_pd(delta, _mm256_broadcast_sd(log_trans3 + n1));
+                const __m256d greater0 = _mm256_cmp_pd(candidate0, best0, _CMP_GT_OQ);
+                const __m256d greater1 = _mm256_cmp_pd(candidate1, best1, _CMP_GT_OQ);
+                const __m256d greater2 = _mm256_cmp_pd(candidate2, best2, _CMP_GT_OQ);
+                const __m256d greater3 = _mm256_cmp_pd(candidate3, best3, _CMP_GT_OQ);
+
+                best0 = _mm256_blendv_pd(best0, candidate0, greater0);
+                best1 = _mm256_blendv_pd(best1, candidate1, greater1);
+                best2 = _mm256_blendv_pd(best2, candidate2, greater2);
+                best3 = _mm256_blendv_pd(best3, candidate3, greater3);
+                arg0 = _mm256_blendv_pd(arg0, state, greater0);
+                arg1 = _mm256_blendv_pd(arg1, state, greater1);
+                arg2 = _mm256_blendv_pd(arg2, state, greater2);
+                arg3 = _mm256_blendv_pd(arg3, state, greater3);
+            }
+
+            // emission of lane i from the (transposed) row of its observation
+            const __m256d emit0 = _mm256_set_pd(log_emit3[n0+0], log_emit2[n0+0], log_emit1[n0+0], log_emit0[n0+0]);
+            const __m256d emit1 = _mm256_set_pd(log_emit3[n0+1], log_emit2[n0+1], log_emit1[n0+1], log_emit0[n0+1]);
+            const __m256d emit2 = _mm256_set_pd(log_emit3[n0+2], log_emit2[n0+2], log_emit1[n0+2], log_emit0[n0+2]);
+            const __m256d emit3 = _mm256_set_pd(log_emit3[n0+3], log_emit2[n0+3], log_emit1[n0+3], log_emit0[n0+3]);
+
+            _mm256_store_pd(delta_new + (n0+0)*4, _mm256_add_pd(best0, emit0));
+            _mm256_store_pd(delta_new + (n0+1)*4, _mm256_add_pd(best1, emit1));
+            _mm256_store_pd(delta_new + (n0+2)*4, _mm256_add_pd(best2, emit2));
+            _mm256_store_pd(delta_new + (n0+3)*4, _mm256_add_pd(best3, emit3));
+            _mm_store_si128((__m128i *)(psi + (n0+0)*4), _mm256_cvtpd_epi32(arg0));
+            _mm_store_si128((__m128i *)(psi + (n0+1)*4), _mm256_cvtpd_epi32(arg1));
+            _mm_store_si128((__m128i *)(psi + (n0+2)*4), _mm256_cvtpd_epi32(arg2));
+            _mm_store_si128((__m128i *)(psi + (n0+3)*4), _mm256_cvtpd_epi32(arg3));
+        }
+
+        // remaining target states if N is not divisible by 4
+        for (; n0 < N; n0++) {
+            const double* log_trans0 = s.log_trans + n0*N;
+            __m256d best0 = _mm256_add_pd(_mm256_load_pd(delta_old), _mm256_broadcast_sd(log_trans0));
+            __m256d arg0 = _mm256_setzero_pd();
+            for (size_t n1 = 1; n1 < N; n1++) {
+                const __m256d candidate0 = _mm256_add_pd(_mm256_load_pd(delta_old + n1*4), _mm256_broadcast_sd(log_trans0 + n1));
+                const __m256d greater0 = _mm256_cmp_pd(candidate0, best0, _CMP_GT_OQ);
+                best0 = _mm256_blendv_pd(best0, candidate0, greater0);
+                arg0 = _mm256_blendv_pd(arg0, _mm256_set1_pd((double)n1), greater0);
+            }
+            const __m256d emit0 = _mm256_set_pd(log_emit3[n0], log_emit2[n0], log_emit1[n0], log_emit0[n0]);
+            _mm256_store_pd(delta_new + n0*4, _mm256_add_pd(best0, emit0));
+            _mm_store_si128((__m128i *)(psi + n0*4), _mm256_cvtpd_epi32(arg0));
+        }
+
+        for (size_t i = 0; i < nb_valid; i++) {
+            if (T[i] == t + 1) viterbi_finish(s, model, sequences, group[i], i, t, delta_new, paths, log_probabilities);
+        }
+
+        double* swap = delta_old;
+        delta_old = delta_new;
+        delta_new = swap;
+    }
+}
+
+/**
+ * Sequence k (lane of its group) ends at time step t, delta is the row of t: argmax and backtracking
+ */
+static inline void viterbi_finish(const ViterbiScratch& s, const BWmodel& model, const BWsequences& sequences, const size_t k, const size_t lane, const size_t t, const double* delta, size_t* paths, double* log_probabilities) {
+    const size_t N = model.N;
+
+    size_t state = 0;
+    for (size_t n = 1; n < N; n++) {
+        if (delta[n*4 + lane] > delta[state*4 + lane]) state = n;
+    }
+    log_probabilities[k] = delta[state*4 + lane];
+
+    size_t* path = paths + sequences.offsets[k];
+    path[t] = state;
+    for (size_t t0 = t; t0 > 0; t0--) {
+        state = s.psi[(t0*N + state)*4 + lane];
+        path[t0-1] = state;
+    }
+}
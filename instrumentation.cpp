@@ -0,0 +1,149 @@
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <x86intrin.h>
+
+#include "instrumentation.h"
+
+thread_local bool Instrumentation::enabled = false;
+
+// all state is per thread, such that models trained concurrently do not mix their phases
+static thread_local PhaseCounters totals[BW_PHASE_COUNT];
+static thread_local bw_phase current_phase = BW_PHASE_COUNT;
+static thread_local unsigned long long phase_start_cycles = 0;
+static thread_local long long phase_start_counters[BW_COUNTER_COUNT];
+
+// perf_event_open group of a thread: leader is the group fd, slot[c] is the position of counter c
+// in a group read (-1 := not available). The counters are closed when the thread exits.
+struct CounterGroup {
+    bool opened = false;
+    int leader = -1;
+    int fds[BW_COUNTER_COUNT];
+    int slot[BW_COUNTER_COUNT];
+    size_t nb_slots = 0;
+
+    CounterGroup(){
+        for(size_t c = 0; c < BW_COUNTER_COUNT; c++){
+            fds[c] = -1;
+            slot[c] = -1;
+        }
+    }
+
+    ~CounterGroup(){
+        for(size_t c = 0; c < BW_COUNTER_COUNT; c++){
+            if(fds[c] >= 0) close(fds[c]);
+        }
+    }
+};
+static thread_local CounterGroup group;
+
+static int open_counter(const unsigned int type, const unsigned long long config, const int leader){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = (leader == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+static void open_counters(){
+    group.opened = true;
+    const unsigned int types[BW_COUNTER_COUNT] = {PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+    const unsigned long long configs[BW_COUNTER_COUNT] = {
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for(size_t c = 0; c < BW_COUNTER_COUNT; c++){
+        const int fd = open_counter(types[c], configs[c], group.leader);
+        if(fd < 0) continue;
+        if(group.leader == -1) group.leader = fd;
+        group.fds[c] = fd;
+        group.slot[c] = group.nb_slots++;
+    }
+
+    if(group.leader != -1){
+        ioctl(group.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+static void read_counters(long long* values){
+    unsigned long long buffer[1 + BW_COUNTER_COUNT];
+    const bool ok = group.leader != -1 && read(group.leader, buffer, sizeof(buffer)) > 0;
+    for(size_t c = 0; c < BW_COUNTER_COUNT; c++){
+        values[c] = (ok && group.slot[c] >= 0) ? (long long)buffer[1 + group.slot[c]] : -1;
+    }
+}
+
+void Instrumentation::start(){
+    if(!group.opened) open_counters();
+    for(size_t p = 0; p < BW_PHASE_COUNT; p++){
+        totals[p].cycles = 0;
+        for(size_t c = 0; c < BW_COUNTER_COUNT; c++){
+            totals[p].counters[c] = (group.slot[c] >= 0) ? 0 : -1;
+        }
+    }
+    current_phase = BW_PHASE_COUNT;
+    enabled = true;
+}
+
+void Instrumentation::stop(){
+    if(enabled) switch_phase(BW_PHASE_COUNT);
+    enabled = false;
+}
+
+void Instrumentation::switch_phase(const bw_phase p){
+    long long values[BW_COUNTER_COUNT];
+    read_counters(values);
+    const unsigned long long cycles = __rdtsc();
+
+    if(current_phase != BW_PHASE_COUNT){
+        PhaseCounters& total = totals[current_phase];
+        total.cycles += (double)(cycles - phase_start_cycles);
+        for(size_t c = 0; c < BW_COUNTER_COUNT; c++){
+            if(total.counters[c] >= 0 && values[c] >= 0) total.counters[c] += values[c] - phase_start_counters[c];
+        }
+    }
+
+    current_phase = p;
+    phase_start_cycles = cycles;
+    memcpy(phase_start_counters, values, sizeof(values));
+}
+
+const PhaseCounters& Instrumentation::get(const bw_phase p){
+    return totals[p];
+}
+
+const char* Instrumentation::phase_name(const bw_phase p){
+    switch(p){
+        case BW_PHASE_FORWARD: return "forward";
+        case BW_PHASE_BACKWARD: return "backward";
+        case BW_PHASE_GAMMA: return "gamma";
+        case BW_PHASE_SIGMA: return "sigma";
+        case BW_PHASE_UPDATE_INIT: return "update_init";
+        case BW_PHASE_UPDATE_TRANS: return "update_trans";
+        case BW_PHASE_UPDATE_EMIT: return "update_emit";
+        case BW_PHASE_LIKELIHOOD: return "likelihood";
+        case BW_PHASE_LAYOUT: return "layout";
+        default: return "none";
+    }
+}
+
+const char* Instrumentation::counter_name(const bw_counter c){
+    switch(c){
+        case BW_COUNTER_INSTRUCTIONS: return "instructions";
+        case BW_COUNTER_L1D_MISSES: return "L1D misses";
+        case BW_COUNTER_LLC_MISSES: return "LLC misses";
+        case BW_COUNTER_BRANCH_MISSES: return "branch misses";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,106 @@
+/*
+    Instrumentation
+    Per-phase cycle and hardware counter breakdown of an implementation. Implementations
+    mark the phase they are entering; when the instrumentation is disabled (default) the
+    marks cost a single predictable branch.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_INSTRUMENTATION_H)
+#define __BW_INSTRUMENTATION_H
+
+#include <cstdlib>
+
+/**
+ * Phases of one Baum-Welch iteration.
+ * Implementations that fuse phases attribute the fused work to the first phase it contains.
+ */
+enum bw_phase {
+    BW_PHASE_FORWARD = 0,
+    BW_PHASE_BACKWARD,
+    BW_PHASE_GAMMA,
+    BW_PHASE_SIGMA,
+    BW_PHASE_UPDATE_INIT,
+    BW_PHASE_UPDATE_TRANS,
+    BW_PHASE_UPDATE_EMIT,
+    BW_PHASE_LIKELIHOOD,
+    BW_PHASE_LAYOUT, // conversion between data layouts (e.g. of interleaved lanes back into the BWdata)
+    BW_PHASE_COUNT // no phase
+};
+
+// Hardware counters recorded per phase (perf_event_open, user space only)
+enum bw_counter {
+    BW_COUNTER_INSTRUCTIONS = 0,
+    BW_COUNTER_L1D_MISSES,
+    BW_COUNTER_LLC_MISSES,
+    BW_COUNTER_BRANCH_MISSES,
+    BW_COUNTER_COUNT
+};
+
+/**
+ * Totals of one phase since the last Instrumentation::start()
+ */
+struct PhaseCounters {
+    double cycles;
+    long long counters[BW_COUNTER_COUNT]; // -1 if the counter is not available
+};
+
+/**
+ * Static class that accumulates the counters per phase.
+ * The instrumentation is per thread: phases are only recorded on the thread that called
+ * start(), as the hardware counters only count that thread (mark fused parallel regions
+ * around ThreadPool::run). Other threads running models at the same time are not affected.
+ */
+class Instrumentation
+{
+public:
+
+    /**
+     * Resets all totals, opens the hardware counters (once) and enables the instrumentation
+     */
+    static void start();
+
+    /**
+     * Closes the current phase and disables the instrumentation
+     */
+    static void stop();
+
+    /**
+     * Closes the current phase (if any) and opens phase p
+     */
+    static inline void phase(const bw_phase p){
+        if(enabled) switch_phase(p);
+    }
+
+    /**
+     * Closes the current phase, the following code is not attributed to any phase
+     */
+    static inline void end(){
+        if(enabled) switch_phase(BW_PHASE_COUNT);
+    }
+
+    static const PhaseCounters& get(const bw_phase p);
+
+    static const char* phase_name(const bw_phase p);
+
+    static const char* counter_name(const bw_counter c);
+
+    static thread_local bool enabled;
+
+private:
+
+    static void switch_phase(const bw_phase p);
+};
+
+#endif /* __BW_INSTRUMENTATION_H */
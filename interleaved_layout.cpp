@@ -0,0 +1,58 @@
+#include <cassert>
+#include <algorithm>
+
+#include "interleaved_layout.h"
+#include "workspace.h"
+
+BWinterleavedLayout::BWinterleavedLayout(const BWdata& bw): bw(bw){
+    const size_t K = bw.K;
+    const size_t N = bw.N;
+    nb_groups = (K + BW_LANES - 1) / BW_LANES;
+    sequences = (size_t *)bw_scratch_alloc(bw, "interleaved_layout/sequences", nb_groups*BW_LANES * sizeof(size_t));
+    lengths = (size_t *)bw_scratch_alloc(bw, "interleaved_layout/lengths", nb_groups*BW_LANES * sizeof(size_t));
+    offsets = (size_t *)bw_scratch_alloc(bw, "interleaved_layout/offsets", (nb_groups+1) * sizeof(size_t));
+    assert(sequences != NULL && lengths != NULL && offsets != NULL && "Failed to allocate the interleaved layout");
+
+    // sequences by decreasing length, empty lanes at the end of the last group
+    for (size_t i = 0; i < nb_groups*BW_LANES; i++) {
+        sequences[i] = (i < K) ? i : K;
+    }
+    std::stable_sort(sequences, sequences + K, [&bw](const size_t k0, const size_t k1){ return bw.length(k0) > bw.length(k1); });
+    offsets[0] = 0;
+    for (size_t g = 0; g < nb_groups; g++) {
+        for (size_t l = 0; l < BW_LANES; l++) {
+            const size_t k = sequences[g*BW_LANES + l];
+            lengths[g*BW_LANES + l] = (k < K) ? bw.length(k) : 0;
+        }
+        offsets[g+1] = offsets[g] + lengths[g*BW_LANES];
+    }
+
+    observations = (size_t *)bw_scratch_alloc(bw, "interleaved_layout/observations", offsets[nb_groups]*BW_LANES * sizeof(size_t));
+    alpha = (double *)bw_scratch_alloc(bw, "interleaved_layout/alpha", bw.T*N*BW_LANES * sizeof(double));
+    beta = (double *)bw_scratch_alloc(bw, "interleaved_layout/beta", bw.T*N*BW_LANES * sizeof(double));
+    ggamma = (double *)bw_scratch_alloc(bw, "interleaved_layout/ggamma", bw.T*N*BW_LANES * sizeof(double));
+    c_norm = (double *)bw_scratch_alloc(bw, "interleaved_layout/c_norm", bw.T*BW_LANES * sizeof(double));
+    assert(observations != NULL && alpha != NULL && beta != NULL && ggamma != NULL && c_norm != NULL && "Failed to allocate the interleaved layout");
+
+    for (size_t g = 0; g < nb_groups; g++) {
+        for (size_t l = 0; l < BW_LANES; l++) {
+            // empty lanes repeat lane 0
+            const size_t k = (lengths[g*BW_LANES + l] > 0) ? sequences[g*BW_LANES + l] : sequences[g*BW_LANES];
+            const size_t T = bw.length(k);
+            for (size_t t = 0; t < length(g); t++) {
+                observations[(offsets[g] + t)*BW_LANES + l] = bw.observations[bw.offsets[k] + std::min(t, T-1)];
+            }
+        }
+    }
+}
+
+BWinterleavedLayout::~BWinterleavedLayout(){
+    bw_scratch_free(bw, sequences);
+    bw_scratch_free(bw, lengths);
+    bw_scratch_free(bw, offsets);
+    bw_scratch_free(bw, observations);
+    bw_scratch_free(bw, alpha);
+    bw_scratch_free(bw, beta);
+    bw_scratch_free(bw, ggamma);
+    bw_scratch_free(bw, c_norm);
+}
@@ -0,0 +1,134 @@
+/*
+    Interleaved layout
+    Groups of BW_LANES sequences stored with the sequence index innermost, [t][n][lane], such that
+    one AVX register holds a state of four sequences and every step of the forward-backward
+    algorithm is vertical (no horizontal reductions, e.g. c_norm of four sequences is one vector).
+    The sequences are sorted by decreasing length, so the lanes of a group are about equally long.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_INTERLEAVED_LAYOUT_H)
+#define __BW_INTERLEAVED_LAYOUT_H
+
+#include <cstdlib>
+#include <cstddef>
+
+#include "common.h"
+
+// sequences per group (doubles per AVX register)
+#define BW_LANES 4
+
+/**
+ * Lane assignment and buffers of one group in the interleaved layout. A group is as long as its
+ * first (longest) lane; the observations of the other lanes are padded with their last observation
+ * (empty lanes, if K is not a multiple of BW_LANES, repeat lane 0), such that every lane computes
+ * finite values which are masked out with lengths.
+ * The buffers are scratch buffers of the BWdata (see workspace.h).
+ *
+ *     BWinterleavedLayout layout(bw);
+ *     for (size_t g = 0; g < layout.nb_groups; g++) {
+ *         ... layout.alpha[(t*N + n)*BW_LANES + l] is alpha[t][n] of sequence layout.sequence(g, l)
+ *         interleaved_store_group(bw, layout, g);
+ *     }
+ */
+struct BWinterleavedLayout {
+    size_t nb_groups;     // ceil(K / BW_LANES)
+    size_t* sequences;    // [nb_groups][BW_LANES] sequence of every lane (K for an empty lane)
+    size_t* lengths;      // [nb_groups][BW_LANES] length of the sequence of every lane (0 for an empty lane)
+    size_t* offsets;      // [nb_groups+1] first time step of every group in observations
+    size_t* observations; // [offsets[nb_groups]][BW_LANES] observations of the lanes, padded
+    double* alpha;        // [T][N][BW_LANES] of the current group
+    double* beta;         // [T][N][BW_LANES] of the current group
+    double* ggamma;       // [T][N][BW_LANES] of the current group
+    double* c_norm;       // [T][BW_LANES] of the current group
+
+    /**
+     * Sorts the sequences by decreasing length into groups and interleaves their observations
+     */
+    BWinterleavedLayout(const BWdata& bw);
+
+    ~BWinterleavedLayout();
+
+    inline size_t length(const size_t g) const{
+        return offsets[g+1] - offsets[g];
+    }
+
+    inline size_t sequence(const size_t g, const size_t l) const{
+        return sequences[g*BW_LANES + l];
+    }
+
+private:
+    const BWdata& bw;
+};
+
+#if BW_ISA >= BW_ISA_AVX2
+/**
+ * [n][lane] -> [lane][n] of four vectors (4 states of 4 lanes)
+ */
+static inline void interleaved_transpose(__m256d& v0, __m256d& v1, __m256d& v2, __m256d& v3){
+    const __m256d t0 = _mm256_unpacklo_pd(v0, v1);
+    const __m256d t1 = _mm256_unpackhi_pd(v0, v1);
+    const __m256d t2 = _mm256_unpacklo_pd(v2, v3);
+    const __m256d t3 = _mm256_unpackhi_pd(v2, v3);
+    v0 = _mm256_permute2f128_pd(t0, t2, 0x20);
+    v1 = _mm256_permute2f128_pd(t1, t3, 0x20);
+    v2 = _mm256_permute2f128_pd(t0, t2, 0x31);
+    v3 = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+/**
+ * Writes the N states of the lanes ([N][BW_LANES], N a multiple of 4) into one row of length N per
+ * lane, lanes whose row is NULL are skipped
+ */
+static inline void interleaved_store_lanes(const double* lanes, const size_t N, double* const rows[BW_LANES]){
+    for (size_t n = 0; n < N; n += 4) {
+        __m256d v0 = _mm256_load_pd(lanes + (n+0)*BW_LANES);
+        __m256d v1 = _mm256_load_pd(lanes + (n+1)*BW_LANES);
+        __m256d v2 = _mm256_load_pd(lanes + (n+2)*BW_LANES);
+        __m256d v3 = _mm256_load_pd(lanes + (n+3)*BW_LANES);
+        interleaved_transpose(v0, v1, v2, v3);
+        if (rows[0]) _mm256_store_pd(rows[0] + n, v0);
+        if (rows[1]) _mm256_store_pd(rows[1] + n, v1);
+        if (rows[2]) _mm256_store_pd(rows[2] + n, v2);
+        if (rows[3]) _mm256_store_pd(rows[3] + n, v3);
+    }
+}
+
+/**
+ * Writes alpha, beta, ggamma and c_norm of group g back into the [k][t][N] layout of bw
+ * (the time steps of each lane within the length of its sequence)
+ */
+static inline void interleaved_store_group(const BWdata& bw, const BWinterleavedLayout& layout, const size_t g){
+    const size_t N = bw.N;
+    const size_t* lengths = layout.lengths + g*BW_LANES;
+    for (size_t t = 0; t < layout.length(g); t++) {
+        double* alpha[BW_LANES];
+        double* beta[BW_LANES];
+        double* ggamma[BW_LANES];
+        for (size_t l = 0; l < BW_LANES; l++) {
+            const bool active = t < lengths[l];
+            const size_t kt = active ? bw.offsets[layout.sequence(g, l)] + t : 0;
+            alpha[l] = active ? bw.alpha + kt*N : NULL;
+            beta[l] = active ? bw.beta + kt*N : NULL;
+            ggamma[l] = active ? bw.ggamma + kt*N : NULL;
+            if (active) bw.c_norm[kt] = layout.c_norm[t*BW_LANES + l];
+        }
+        interleaved_store_lanes(layout.alpha + t*N*BW_LANES, N, alpha);
+        interleaved_store_lanes(layout.beta + t*N*BW_LANES, N, beta);
+        interleaved_store_lanes(layout.ggamma + t*N*BW_LANES, N, ggamma);
+    }
+}
+#endif
+
+#endif /* __BW_INTERLEAVED_LAYOUT_H */
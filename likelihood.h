@@ -0,0 +1,177 @@
+/*
+    Likelihood
+    The negative log likelihood of a sequence is the sum of log(c_norm) over its time steps.
+    Instead of one log per time step (or a log per block of products, which still over- or
+    underflows for extreme c_norm), the product of the c_norm is kept as mantissa * 2^exponent:
+    after every multiplication the binary exponent is moved from the mantissa into an integer
+    (frexp-style, with bit operations), so one log per sequence suffices for any normal c_norm
+    below 2^1023 (about 9e307): the mantissa is below 2, thus mantissa * c_norm stays finite.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_LIKELIHOOD_H)
+#define __BW_LIKELIHOOD_H
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+#include "common.h"
+#include "scoring.h"
+
+#define BW_LIKELIHOOD_MANTISSA 0x000FFFFFFFFFFFFFULL
+#define BW_LIKELIHOOD_ONE      0x3FF0000000000000ULL
+
+/**
+ * Product of positive normal doubles below 2^1023 as mantissa * 2^exponent with 1 <= mantissa < 2.
+ *
+ *     BWlikelihood likelihood;
+ *     for (size_t t = 0; t < T; t++) likelihood.multiply(c_norm[t]); // or likelihood_multiply(likelihood, c_norm, T)
+ *     neg_log_likelihood += likelihood.log();
+ */
+struct BWlikelihood {
+    double mantissa = 1.0;
+    int64_t exponent = 0;
+
+    inline void multiply(const double c){
+        uint64_t bits;
+        const double product = mantissa * c;
+        memcpy(&bits, &product, sizeof(bits));
+        exponent += (int64_t)(bits >> 52) - 1023;
+        bits = (bits & BW_LIKELIHOOD_MANTISSA) | BW_LIKELIHOOD_ONE;
+        memcpy(&mantissa, &bits, sizeof(bits));
+    }
+
+    inline void multiply(const BWlikelihood& other){
+        multiply(other.mantissa);
+        exponent += other.exponent;
+    }
+
+    /**
+     * log of the product (the only log)
+     */
+    inline double log() const{
+        return std::log(mantissa) + (double)exponent * M_LN2;
+    }
+};
+
+/**
+ * Multiplies c[0], ..., c[n-1] into likelihood: 2x8 (AVX-512) or 2x4 (AVX2) partial products with
+ * their own exponents, the exponents are extracted after every multiplication.
+ * static such that every ISA variant of a kernel keeps its own copy (see CMakeLists.txt).
+ */
+static inline void likelihood_multiply(BWlikelihood& likelihood, const double* c, const size_t n){
+    size_t i = 0;
+#if BW_ISA >= BW_ISA_AVX512
+    // the biased exponents are summed up, the bias is subtracted once at the end
+    // (maskz shifts: the unmasked ones trip -Wmaybe-uninitialized with GCC 12)
+    const __m512i mantissa_mask = _mm512_set1_epi64(BW_LIKELIHOOD_MANTISSA);
+    const __m512i one = _mm512_set1_epi64(BW_LIKELIHOOD_ONE);
+    __m512d mantissa0 = _mm512_set1_pd(1.0);
+    __m512d mantissa1 = _mm512_set1_pd(1.0);
+    __m512i exponent0 = _mm512_setzero_si512();
+    __m512i exponent1 = _mm512_setzero_si512();
+    for (; i + 16 <= n; i += 16) {
+        const __m512i bits0 = _mm512_castpd_si512(_mm512_mul_pd(mantissa0, _mm512_loadu_pd(c + i)));
+        const __m512i bits1 = _mm512_castpd_si512(_mm512_mul_pd(mantissa1, _mm512_loadu_pd(c + i + 8)));
+        exponent0 = _mm512_add_epi64(exponent0, _mm512_maskz_srli_epi64(0xFF, bits0, 52));
+        exponent1 = _mm512_add_epi64(exponent1, _mm512_maskz_srli_epi64(0xFF, bits1, 52));
+        mantissa0 = _mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(bits0, mantissa_mask), one));
+        mantissa1 = _mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(bits1, mantissa_mask), one));
+    }
+    alignas(64) double mantissas[16];
+    alignas(64) int64_t exponents[8];
+    _mm512_store_pd(mantissas, mantissa0);
+    _mm512_store_pd(mantissas + 8, mantissa1);
+    _mm512_store_si512((__m512i *)exponents, _mm512_add_epi64(exponent0, exponent1));
+    for (size_t l = 0; l < 16; l++) likelihood.multiply(mantissas[l]);
+    for (size_t l = 0; l < 8; l++) likelihood.exponent += exponents[l];
+    likelihood.exponent -= (int64_t)i * 1023;
+#elif BW_ISA >= BW_ISA_AVX2
+    // the biased exponents are summed up, the bias is subtracted once at the end
+    const __m256i mantissa_mask = _mm256_set1_epi64x(BW_LIKELIHOOD_MANTISSA);
+    const __m256i one = _mm256_set1_epi64x(BW_LIKELIHOOD_ONE);
+    __m256d mantissa0 = _mm256_set1_pd(1.0);
+    __m256d mantissa1 = _mm256_set1_pd(1.0);
+    __m256i exponent0 = _mm256_setzero_si256();
+    __m256i exponent1 = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+        const __m256i bits0 = _mm256_castpd_si256(_mm256_mul_pd(mantissa0, _mm256_loadu_pd(c + i)));
+        const __m256i bits1 = _mm256_castpd_si256(_mm256_mul_pd(mantissa1, _mm256_loadu_pd(c + i + 4)));
+        exponent0 = _mm256_add_epi64(exponent0, _mm256_srli_epi64(bits0, 52));
+        exponent1 = _mm256_add_epi64(exponent1, _mm256_srli_epi64(bits1, 52));
+        mantissa0 = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits0, mantissa_mask), one));
+        mantissa1 = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits1, mantissa_mask), one));
+    }
+    alignas(32) double mantissas[8];
+    alignas(32) int64_t exponents[4];
+    _mm256_store_pd(mantissas, mantissa0);
+    _mm256_store_pd(mantissas + 4, mantissa1);
+    _mm256_store_si256((__m256i *)exponents, _mm256_add_epi64(exponent0, exponent1));
+    for (size_t l = 0; l < 8; l++) likelihood.multiply(mantissas[l]);
+    for (size_t l = 0; l < 4; l++) likelihood.exponent += exponents[l];
+    likelihood.exponent -= (int64_t)i * 1023;
+#endif
+    for (; i < n; i++) likelihood.multiply(c[i]);
+}
+
+#if BW_ISA >= BW_ISA_AVX2
+/**
+ * Four independent products, one per lane (e.g. four interleaved sequences):
+ * mantissa *= c, the binary exponent moves into exponent (unbiased, like BWlikelihood)
+ */
+static inline void likelihood_multiply_lanes(__m256d& mantissa, __m256i& exponent, const __m256d c){
+    const __m256i bits = _mm256_castpd_si256(_mm256_mul_pd(mantissa, c));
+    exponent = _mm256_add_epi64(exponent, _mm256_sub_epi64(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(1023)));
+    mantissa = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(BW_LIKELIHOOD_MANTISSA)), _mm256_set1_epi64x(BW_LIKELIHOOD_ONE)));
+}
+
+/**
+ * Lane l of four products as BWlikelihood
+ */
+static inline BWlikelihood likelihood_lane(const __m256d mantissa, const __m256i exponent, const size_t l){
+    alignas(32) double mantissas[4];
+    alignas(32) int64_t exponents[4];
+    _mm256_store_pd(mantissas, mantissa);
+    _mm256_store_si256((__m256i *)exponents, exponent);
+    BWlikelihood likelihood;
+    likelihood.mantissa = mantissas[l];
+    likelihood.exponent = exponents[l];
+    return likelihood;
+}
+#endif
+
+/**
+ * sum of log(c[0]), ..., log(c[n-1]) with one log
+ */
+static inline double likelihood_log(const double* c, const size_t n){
+    BWlikelihood likelihood;
+    likelihood_multiply(likelihood, c, n);
+    return likelihood.log();
+}
+
+/**
+ * Function interface of a likelihood accumulation (for the microbenchmark, see likelihood_optimized.cpp):
+ * neg_log_likelihoods[k] = sum of log(c_norm[offsets[k]]), ..., log(c_norm[offsets[k+1]-1])
+ */
+typedef void(*likelihood_func)(const double* c_norm, const size_t K, const size_t* offsets, double* neg_log_likelihoods);
+
+typedef RegisteredModelFunction<likelihood_func> RegisteredLikelihoodFunction;
+typedef ModelRegister<likelihood_func> LikelihoodRegister;
+
+// Macro to register a likelihood accumulation
+#define REGISTER_LIKELIHOOD_FUNCTION(f, name, description) REGISTER_MODEL_FUNCTION(LikelihoodRegister, f, name, description)
+
+#endif /* __BW_LIKELIHOOD_H */
@@ -0,0 +1,37 @@
+#include <cassert>
+#include <cstring>
+
+#include "packed_observations.h"
+#include "workspace.h"
+
+static void* pack(const BWdata& bw, const size_t width){
+    assert(bw.M <= 65536 && "Observations do not fit into 16 bit");
+    const size_t L = bw.total_length();
+    void* data = bw_scratch_alloc(bw, "packed_observations", (L + BW_PACKED_PADDING) * width);
+    if (width == 1) {
+        uint8_t* u8 = (uint8_t *)data;
+        for (size_t i = 0; i < L; i++) {
+            u8[i] = (uint8_t)bw.observations[i];
+        }
+    } else {
+        uint16_t* u16 = (uint16_t *)data;
+        for (size_t i = 0; i < L; i++) {
+            u16[i] = (uint16_t)bw.observations[i];
+        }
+    }
+    memset((char *)data + L*width, 0, BW_PACKED_PADDING * width);
+    return data;
+}
+
+BWpackedObservations::BWpackedObservations(const BWdata& bw): offsets(bw.offsets), u8(NULL), u16(NULL), width(width_for(bw.M)), bw(bw){
+    void* data = pack(bw, width);
+    if (width == 1) {
+        u8 = (const uint8_t *)data;
+    } else {
+        u16 = (const uint16_t *)data;
+    }
+}
+
+BWpackedObservations::~BWpackedObservations(){
+    bw_scratch_free(bw, (width == 1) ? (void *)u8 : (void *)u16);
+}
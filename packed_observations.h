@@ -0,0 +1,104 @@
+/*
+    Packed observations
+    A copy of the observations of a BWdata in the narrowest integer type that holds all M symbols:
+    uint8 for M <= 256, uint16 for M <= 65536, i.e. 1/8 or 1/4 of the size_t array.
+    "combined" and "vector_optimized" decode them on the fly, with SIMD 32 (16) symbols per
+    compare; the BWdata keeps its size_t observations for all other implementations.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_PACKED_OBSERVATIONS_H)
+#define __BW_PACKED_OBSERVATIONS_H
+
+#include <cstdlib>
+#include <cstdint>
+
+#include "common.h"
+
+// Symbols read past the end by the SIMD helpers below (the buffer is padded by as many)
+#define BW_PACKED_PADDING 32
+
+/**
+ * Same CSR layout as BWdata.observations (the offsets are shared with the BWdata):
+ * observation i is u8[i] if width == 1 and u16[i] otherwise.
+ * The buffer is a scratch buffer of the BWdata (see workspace.h), packed on construction.
+ *
+ *     const BWpackedObservations observations(bw);
+ *     const size_t y = observations.at(bw.offsets[k] + t);
+ */
+struct BWpackedObservations {
+    const size_t* offsets; // [K+1] (shared with the BWdata)
+    const uint8_t* u8;     // [K][T] if width == 1, NULL otherwise
+    const uint16_t* u16;   // [K][T] if width == 2, NULL otherwise
+    const size_t width;    // bytes per observation
+
+    /**
+     * Packs the observations of bw, M has to be at most 65536
+     */
+    BWpackedObservations(const BWdata& bw);
+
+    ~BWpackedObservations();
+
+    inline size_t at(const size_t i) const{
+        return (width == 1) ? u8[i] : u16[i];
+    }
+
+    /**
+     * Size of the packed observations in bytes (without the padding)
+     */
+    inline size_t bytes() const{
+        return offsets[bw.K] * width;
+    }
+
+    /**
+     * Bytes per observation for M distinct observations
+     */
+    static inline size_t width_for(const size_t M){
+        return (M <= 256) ? 1 : 2;
+    }
+
+private:
+    const BWdata& bw;
+};
+
+#if BW_ISA >= BW_ISA_AVX2
+/**
+ * Bit j is set iff observation i+j equals m (0 <= j < 32), observations past the end
+ * of the sequence have to be masked out by the caller
+ */
+static inline uint32_t packed_match(const BWpackedObservations& observations, const size_t i, const size_t m){
+    if (observations.width == 1) {
+        const __m256i symbols = _mm256_loadu_si256((const __m256i *)(observations.u8 + i));
+        return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(symbols, _mm256_set1_epi8((char)m)));
+    }
+    const __m256i m_v = _mm256_set1_epi16((short)m);
+    const __m256i match0 = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(observations.u16 + i)), m_v);
+    const __m256i match1 = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(observations.u16 + i + 16)), m_v);
+    // packs works per 128 bit lane, the permute restores the order of the time steps
+    const __m256i match = _mm256_permute4x64_epi64(_mm256_packs_epi16(match0, match1), 0xD8);
+    return (uint32_t)_mm256_movemask_epi8(match);
+}
+
+/**
+ * Observations i to i+3 converted to double
+ */
+static inline __m256d packed_load4_pd(const BWpackedObservations& observations, const size_t i){
+    const __m128i symbols = (observations.width == 1)
+        ? _mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int32_t *)(observations.u8 + i)))
+        : _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(observations.u16 + i)));
+    return _mm256_cvtepi32_pd(symbols);
+}
+#endif
+
+#endif /* __BW_PACKED_OBSERVATIONS_H */
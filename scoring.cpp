@@ -0,0 +1,58 @@
+#include <cmath>
+#include <cassert>
+
+#include "scoring.h"
+
+REGISTER_SCORE_FUNCTION(score_scalar, "score-scalar", "Scalar forward recursion (reference)");
+
+void bw_score(const BWmodel& model, const BWsequences& sequences, double* log_likelihoods){
+    ScoreRegister::best().func(model, sequences, log_likelihoods);
+}
+
+void score_scalar(const BWmodel& model, const BWsequences& sequences, double* log_likelihoods){
+    const size_t N = model.N;
+    const size_t M = model.M;
+    double* alpha = (double *)malloc(2*N * sizeof(double));
+    assert(alpha != NULL && "Failed to allocate memory");
+
+    for (size_t k = 0; k < sequences.K; k++) {
+        const size_t* observations = sequences.observations + sequences.offsets[k];
+        double* alpha_old = alpha;
+        double* alpha_new = alpha + N;
+
+        // t = 0, base case
+        double c_sum = 0.0;
+        for (size_t n = 0; n < N; n++) {
+            alpha_old[n] = model.init_prob[n]*model.emit_prob[n*M + observations[0]];
+            c_sum += alpha_old[n];
+        }
+        double log_likelihood = log(c_sum);
+        for (size_t n = 0; n < N; n++) {
+            alpha_old[n] /= c_sum;
+        }
+
+        // recursion step
+        for (size_t t = 1; t < sequences.length(k); t++) {
+            c_sum = 0.0;
+            for (size_t n0 = 0; n0 < N; n0++) {
+                double alpha_temp = 0.0;
+                for (size_t n1 = 0; n1 < N; n1++) {
+                    alpha_temp += alpha_old[n1]*model.trans_prob[n1*N + n0];
+                }
+                alpha_new[n0] = model.emit_prob[n0*M + observations[t]] * alpha_temp;
+                c_sum += alpha_new[n0];
+            }
+            log_likelihood += log(c_sum);
+            for (size_t n0 = 0; n0 < N; n0++) {
+                alpha_new[n0] /= c_sum;
+            }
+            double* swap = alpha_old;
+            alpha_old = alpha_new;
+            alpha_new = swap;
+        }
+
+        log_likelihoods[k] = log_likelihood;
+    }
+
+    free(alpha);
+}
@@ -0,0 +1,171 @@
+/*
+    Scoring
+    Log likelihood log P(sequence | model) of many sequences under a trained model.
+    Only the scaled forward recursion is needed: no beta, gamma or sigma and only two
+    alpha rows per sequence.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_SCORING_H)
+#define __BW_SCORING_H
+
+#include <cstdlib>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+/**
+ * Parameters of a (trained) model. Does not own the arrays.
+ */
+struct BWmodel {
+    size_t N;
+    size_t M;
+    const double* init_prob;  // [N]
+    const double* trans_prob; // [N][N]
+    const double* emit_prob;  // [N][M] (row major, also after training with an implementation that transposes it)
+
+    BWmodel(const size_t N, const size_t M, const double* init_prob, const double* trans_prob, const double* emit_prob):
+        N(N), M(M), init_prob(init_prob), trans_prob(trans_prob), emit_prob(emit_prob){}
+
+    /**
+     * Model of a BWdata (e.g. after training)
+     */
+    BWmodel(const BWdata& bw): N(bw.N), M(bw.M), init_prob(bw.init_prob), trans_prob(bw.trans_prob), emit_prob(bw.emit_prob){}
+};
+
+/**
+ * Sequences to score in the CSR layout of BWdata: sequence k is observations[offsets[k]],
+ * ..., observations[offsets[k+1]-1] (at least one time step each). Does not own the arrays.
+ */
+struct BWsequences {
+    size_t K;
+    const size_t* offsets;      // [K+1]
+    const size_t* observations; // [offsets[K]]
+
+    BWsequences(const size_t K, const size_t* offsets, const size_t* observations):
+        K(K), offsets(offsets), observations(observations){}
+
+    /**
+     * Observation sequences of a BWdata
+     */
+    BWsequences(const BWdata& bw): K(bw.K), offsets(bw.offsets), observations(bw.observations){}
+
+    inline size_t length(const size_t k) const{
+        return offsets[k+1] - offsets[k];
+    }
+};
+
+/**
+ * Function interface of a scoring implementation: log_likelihoods[k] = log P(sequence k | model)
+ * Has to support any N, M and sequence lengths.
+ */
+typedef void(*score_func)(const BWmodel& model, const BWsequences& sequences, double* log_likelihoods);
+
+template<typename F>
+struct RegisteredModelFunction{
+    F func;
+    std::string name;
+    std::string description;
+    int isa; // BW_ISA_* level of the selected variant
+};
+
+/**
+ * Static class that handles the registration of the implementations of a function
+ * interface F on a trained model (scoring, decoding), see FuncRegister
+ */
+template<typename F>
+class ModelRegister
+{
+public:
+
+    /**
+     * Registers a function. If a function with the same name is registered for several
+     * ISA levels, only the highest level supported by the CPU is kept
+     */
+    static void add_function(F f, const std::string& name, const std::string& description, const int isa = BW_ISA_GENERIC)
+    {
+        if(!funcs)
+            funcs = new std::vector<RegisteredModelFunction<F>>();
+
+        // Variant for an instruction set this CPU cannot execute
+        if(isa > FuncRegister::cpu_isa())
+            return;
+
+        for(size_t i = 0; i < funcs->size(); i++){
+            if(funcs->at(i).name == name){
+                if(isa > funcs->at(i).isa)
+                    funcs->at(i) = {f, name, description, isa};
+                return;
+            }
+        }
+
+        funcs->push_back({f, name, description, isa});
+    }
+
+    /**
+     * The registered function with the highest ISA level (the fastest one)
+     */
+    static const RegisteredModelFunction<F>& best()
+    {
+        assert(size() > 0 && "No function registered");
+        size_t best = 0;
+        for(size_t i = 1; i < size(); i++){
+            if(funcs->at(i).isa > funcs->at(best).isa) best = i;
+        }
+        return funcs->at(best);
+    }
+
+    static size_t size()
+    {
+        return funcs ? (*funcs).size() : 0;
+    }
+
+    static std::vector<RegisteredModelFunction<F>> *funcs;
+};
+
+template<typename F>
+std::vector<RegisteredModelFunction<F>> *ModelRegister<F>::funcs = NULL;
+
+typedef RegisteredModelFunction<score_func> RegisteredScoreFunction;
+typedef ModelRegister<score_func> ScoreRegister;
+
+/**
+ * Scores the sequences against the model with the best registered implementation
+ */
+void bw_score(const BWmodel& model, const BWsequences& sequences, double* log_likelihoods);
+
+/**
+ * Reference implementation (scalar, one log per time step), also registered as "score-scalar"
+ */
+void score_scalar(const BWmodel& model, const BWsequences& sequences, double* log_likelihoods);
+
+// Macro to register a function in a ModelRegister (see REGISTER_FUNCTION)
+#define REGISTER_MODEL_FUNCTION(Register, f, name, description)   \
+    namespace {                                                   \
+    struct f##_                                                   \
+    {                                                             \
+        f##_()                                                    \
+        {                                                         \
+            Register::add_function(f, name, description, BW_ISA); \
+        }                                                         \
+    };                                                            \
+    }                                                             \
+    static f##_ f##__BW_
+
+// Macro to register a scoring function
+#define REGISTER_SCORE_FUNCTION(f, name, description) REGISTER_MODEL_FUNCTION(ScoreRegister, f, name, description)
+
+#endif /* __BW_SCORING_H */
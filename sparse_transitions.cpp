@@ -0,0 +1,55 @@
+#include <cassert>
+#include <cstring>
+
+#include "sparse_transitions.h"
+#include "workspace.h"
+
+static double sparse_max_density = BW_SPARSE_MAX_DENSITY;
+
+BWsparseTransitions::BWsparseTransitions(const BWdata& bw): nnz(0), bw(bw){
+    const size_t N = bw.N;
+    row_offsets = (size_t *)bw_scratch_alloc(bw, "sparse_transitions/row_offsets", (N+1) * sizeof(size_t));
+    columns = (size_t *)bw_scratch_alloc(bw, "sparse_transitions/columns", N*N * sizeof(size_t));
+    values = (double *)bw_scratch_alloc(bw, "sparse_transitions/values", N*N * sizeof(double));
+    assert(row_offsets != NULL && columns != NULL && values != NULL && "Failed to allocate the sparse transitions");
+    memset(row_offsets, 0, (N+1) * sizeof(size_t));
+}
+
+BWsparseTransitions::~BWsparseTransitions(){
+    bw_scratch_free(bw, row_offsets);
+    bw_scratch_free(bw, columns);
+    bw_scratch_free(bw, values);
+}
+
+void BWsparseTransitions::compress(){
+    const size_t N = bw.N;
+    nnz = 0;
+    for (size_t n0 = 0; n0 < N; n0++) {
+        row_offsets[n0] = nnz;
+        for (size_t n1 = 0; n1 < N; n1++) {
+            const double p = bw.trans_prob[n0*N + n1];
+            if (p != 0.0) {
+                columns[nnz] = n1;
+                values[nnz] = p;
+                nnz++;
+            }
+        }
+    }
+    row_offsets[N] = nnz;
+}
+
+double BWsparseTransitions::density(const double* trans_prob, const size_t N){
+    size_t nonzeros = 0;
+    for (size_t nn = 0; nn < N*N; nn++) {
+        if (trans_prob[nn] != 0.0) nonzeros++;
+    }
+    return (double)nonzeros / (N*N);
+}
+
+void BWsparseTransitions::set_max_density(const double max_density){
+    sparse_max_density = max_density;
+}
+
+double BWsparseTransitions::max_density(){
+    return sparse_max_density;
+}
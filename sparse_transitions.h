@@ -0,0 +1,73 @@
+/*
+    Sparse transitions
+    trans_prob of a BWdata in compressed sparse row (CSR) form, for left-to-right and
+    pruned topologies with few nonzeros per row. Baum-Welch never turns a zero transition
+    probability into a nonzero one, so the pattern of a sparse model stays sparse.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_SPARSE_TRANSITIONS_H)
+#define __BW_SPARSE_TRANSITIONS_H
+
+#include <cstdlib>
+
+#include "common.h"
+
+// Default of BWsparseTransitions::max_density()
+#define BW_SPARSE_MAX_DENSITY 0.25
+
+/**
+ * The nonzeros of row n0 are columns[j], values[j] for row_offsets[n0] <= j < row_offsets[n0+1].
+ * The buffers are scratch buffers of the BWdata (see workspace.h) with room for all N*N entries,
+ * they are filled by compress().
+ *
+ *     BWsparseTransitions trans(bw);
+ *     trans.compress();
+ *     for (size_t j = trans.row_offsets[n0]; j < trans.row_offsets[n0+1]; j++) {
+ *         ... trans.columns[j], trans.values[j]
+ *     }
+ */
+struct BWsparseTransitions {
+    size_t* row_offsets; // [N+1]
+    size_t* columns;     // [nnz]
+    double* values;      // [nnz]
+    size_t nnz;          // number of nonzeros
+
+    BWsparseTransitions(const BWdata& bw);
+
+    ~BWsparseTransitions();
+
+    /**
+     * (Re)builds the CSR form from bw.trans_prob
+     */
+    void compress();
+
+    /**
+     * Fraction of nonzero entries of the (dense) N x N trans_prob
+     */
+    static double density(const double* trans_prob, const size_t N);
+
+    /**
+     * Implementations switch to the sparse kernels once density(trans_prob) is at most this value
+     * (BW_SPARSE_MAX_DENSITY by default, 0 := never). Must not be called while a model is trained.
+     */
+    static void set_max_density(const double max_density);
+
+    static double max_density();
+
+private:
+    const BWdata& bw;
+};
+
+#endif /* __BW_SPARSE_TRANSITIONS_H */
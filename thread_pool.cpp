@@ -0,0 +1,106 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "thread_pool.h"
+
+static size_t requested_threads = 0; // 0 := hardware concurrency
+
+static std::vector<std::thread> workers;
+static std::mutex run_mutex; // one run() at a time, concurrent callers queue up
+static std::mutex pool_mutex;
+static std::condition_variable start_cv;
+static std::condition_variable done_cv;
+static const pool_job* current_job = nullptr;
+static size_t generation = 0;
+static size_t pending = 0;
+static bool shutdown = false;
+
+static void worker_loop(const size_t thread_id, const size_t num_threads){
+    size_t seen_generation = 0;
+    while(true){
+        const pool_job* job;
+        {
+            std::unique_lock<std::mutex> lock(pool_mutex);
+            start_cv.wait(lock, [&]{ return shutdown || generation != seen_generation; });
+            if(shutdown) return;
+            seen_generation = generation;
+            job = current_job;
+        }
+
+        (*job)(thread_id, num_threads);
+
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            pending--;
+        }
+        done_cv.notify_one();
+    }
+}
+
+static void stop_workers(){
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        shutdown = true;
+    }
+    start_cv.notify_all();
+    for(size_t i = 0; i < workers.size(); i++){
+        workers.at(i).join();
+    }
+    workers.clear();
+    shutdown = false;
+    generation = 0;
+}
+
+// Joins the workers when the process exits
+static struct ThreadPoolCleanup
+{
+    ~ThreadPoolCleanup()
+    {
+        stop_workers();
+    }
+} thread_pool_cleanup;
+
+void ThreadPool::set_num_threads(size_t num_threads){
+    requested_threads = num_threads;
+}
+
+size_t ThreadPool::get_num_threads(){
+    if(requested_threads > 0) return requested_threads;
+    const size_t hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+void ThreadPool::run(const pool_job& job){
+    const size_t num_threads = get_num_threads();
+
+    if(num_threads == 1){
+        job(0, 1);
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(run_mutex);
+
+    // (Re)spawn the workers if the thread count changed since the last run
+    if(workers.size() != num_threads - 1){
+        stop_workers();
+        for(size_t i = 1; i < num_threads; i++){
+            workers.emplace_back(worker_loop, i, num_threads);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        current_job = &job;
+        pending = num_threads - 1;
+        generation++;
+    }
+    start_cv.notify_all();
+
+    job(0, num_threads);
+
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    done_cv.wait(lock, []{ return pending == 0; });
+    current_job = nullptr;
+}
@@ -0,0 +1,64 @@
+/*
+    Thread Pool
+    Persistent worker threads for implementations that shard the K observation sequences
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_THREAD_POOL_H)
+#define __BW_THREAD_POOL_H
+
+#include <cstdlib>
+#include <functional>
+
+/**
+ * Job executed by every thread of the pool: job(thread_id, num_threads)
+ */
+typedef std::function<void(const size_t, const size_t)> pool_job;
+
+/**
+ * Static class that owns the worker threads.
+ * The threads are created on the first call to run() and are kept alive (sleeping)
+ * between calls, such that the start-up cost is only paid once per process.
+ */
+class ThreadPool
+{
+public:
+
+    /**
+     * Sets the number of threads (including the calling thread) that are used by run().
+     * A value of 0 resets to the number of hardware threads.
+     * Must not be called while another thread is inside run().
+     */
+    static void set_num_threads(size_t num_threads);
+
+    static size_t get_num_threads();
+
+    /**
+     * Executes job on all threads of the pool and blocks until every thread is done.
+     * The calling thread participates as thread 0.
+     * Calls from different threads are executed one after the other; models that are
+     * trained concurrently by the caller should use set_num_threads(1) instead.
+     */
+    static void run(const pool_job& job);
+
+    /**
+     * Returns the half-open range [begin, end) of the 0 <= i < count items assigned to thread_id
+     */
+    static inline void shard(const size_t count, const size_t thread_id, const size_t num_threads, size_t& begin, size_t& end){
+        begin = (count * thread_id) / num_threads;
+        end = (count * (thread_id + 1)) / num_threads;
+    }
+};
+
+#endif /* __BW_THREAD_POOL_H */
@@ -18,26 +18,65 @@
 #include <cstdlib>
 #include <cstdio>
 #include <tuple>
+#include <vector>
+#include <algorithm>
+#include <thread>
 #include <random>
 #include <ctime>
+#include <cfloat>
 #include <unistd.h>
 // custom files for the project
 #include "helper_utilities.h"
 #include "common.h"
+#include "workspace.h"
+#include "thread_pool.h"
+#include "scoring.h"
+#include "decoding.h"
+#include "likelihood.h"
+#include "autotuner.h"
+#include "interleaved_layout.h"
 
 void check_baseline(void);
 void check_user_functions(const size_t& nb_random_tests);
+void check_feature_functions(const size_t& nb_random_tests, const unsigned int feature, const char* label);
+void check_concurrent_functions(const size_t& nb_random_tests);
+void check_interleaved_layout(const size_t& nb_random_tests);
+void check_scoring_functions(const size_t& nb_random_tests);
+void check_likelihood_functions(const size_t& nb_random_tests);
+void check_autotuner(const size_t& nb_random_tests);
+void check_viterbi_functions(const size_t& nb_random_tests);
+void check_posterior_functions(const size_t& nb_random_tests);
+void check_float_functions(const size_t& nb_random_tests);
 bool test_case_ghmm_0(compute_bw_func func);
 bool test_case_ghmm_1(compute_bw_func func);
 bool test_case_ghmm_2(compute_bw_func func);
 bool test_case_ghmm_3(compute_bw_func func);
 bool test_case_randomized(compute_bw_func func);
+size_t run_user_function(const struct RegisteredFunction& f, const BWdata& bw);
 
 int main() {
     // maybe add commandline arguments, dunno
     if (true) check_baseline();
     const size_t nb_random_tests = 5;
     if (true) check_user_functions(nb_random_tests);
+    if (true) check_feature_functions(nb_random_tests, BW_FEATURE_RAGGED, "Ragged");
+    if (true) check_feature_functions(nb_random_tests, BW_FEATURE_ANY_NM, "Any N,M");
+    if (true) check_feature_functions(nb_random_tests, BW_FEATURE_CHECKPOINT, "Checkpoint");
+    if (true) check_feature_functions(nb_random_tests, BW_FEATURE_PARALLEL_T, "Parallel T");
+    if (true) check_feature_functions(nb_random_tests, BW_FEATURE_SPARSE, "Sparse");
+    if (true) check_feature_functions(nb_random_tests, BW_FEATURE_BANDED, "Banded");
+    if (true) check_feature_functions(nb_random_tests, BW_FEATURE_LOG_SPACE, "Log space");
+    if (true) check_feature_functions(nb_random_tests, BW_FEATURE_SPECIALIZED, "Specialized");
+    if (true) check_feature_functions(nb_random_tests, BW_FEATURE_BATCHED, "Batched");
+    if (true) check_interleaved_layout(nb_random_tests);
+    if (true) check_feature_functions(nb_random_tests, BW_FEATURE_INTERLEAVED, "Interleaved");
+    if (true) check_concurrent_functions(nb_random_tests);
+    if (true) check_scoring_functions(nb_random_tests);
+    if (true) check_likelihood_functions(nb_random_tests);
+    if (true) check_autotuner(nb_random_tests);
+    if (true) check_viterbi_functions(nb_random_tests);
+    if (true) check_posterior_functions(nb_random_tests);
+    if (true) check_float_functions(nb_random_tests);
 }
 
 /**
@@ -101,6 +140,10 @@ inline void check_user_functions(const size_t& nb_random_tests) {
     const size_t nb_user_functions = FuncRegister::size();
     bool test_results[nb_user_functions][nb_random_tests];
 
+    // one workspace per user function, kept over all test cases: buffers left dirty by
+    // the previous case (of the same shape) must not change the result
+    std::vector<BWworkspace> workspaces(nb_user_functions);
+
     // check optimizations w.r.t. the baseline using randomized tests
     for (size_t i = 0; i < nb_random_tests; i++) {
 
@@ -140,29 +183,37 @@ inline void check_user_functions(const size_t& nb_random_tests) {
         const bool baseline_success = check_and_verify(bw_baseline);
         printf("-------------------------------------------------------------------------------\n");
 
+        // the baseline has to produce the same results without the sigma buffer
+        printf("Running \x1b[1m'Baseline'\x1b[0m with stream_sigma\n");
+        printf("-------------------------------------------------------------------------------\n");
+        const BWdata& bw_baseline_stream = bw_baseline_initialized.deep_copy(true);
+        FuncRegister::baseline_func(bw_baseline_stream);
+        const bool baseline_stream_success = is_BWdata_equal(bw_baseline, bw_baseline_stream);
+        printf("-------------------------------------------------------------------------------\n");
+        delete &bw_baseline_stream;
+
+        // the baseline again with early stopping, the user functions have to stop at (about) the same iteration
+        BWstopping stopping;
+        stopping.early_stop = true;
+        stopping.patience = 2;
+        stopping.min_iterations = 4;
+        printf("Running \x1b[1m'Baseline'\x1b[0m with early stopping\n");
+        printf("-------------------------------------------------------------------------------\n");
+        const BWdata& bw_baseline_converge = bw_baseline_initialized.deep_copy();
+        bw_baseline_converge.stopping = stopping;
+        FuncRegister::baseline_func(bw_baseline_converge);
+        printf("It stopped after \x1b[1m[%zu] iterations\x1b[0m\n", bw_baseline_converge.iterations);
+        printf("-------------------------------------------------------------------------------\n");
+
         // run all user functions and compare against the data
         for(size_t f = 0; f < nb_user_functions; f++) {
+            // only approximately equal, see check_float_functions
+            if (FuncRegister::funcs->at(f).features & BW_FEATURE_FLOAT32) continue;
+
             printf("Running User Function \x1b[1m'%s'\x1b[0m\n", FuncRegister::funcs->at(f).name.c_str());
             printf("-------------------------------------------------------------------------------\n");
             const BWdata& bw_user_function = bw_baseline_initialized.deep_copy();
-
-            // Hacky but it works: Transpose emit_prob
-            if(FuncRegister::funcs->at(f).transpose_emit_prob){
-                double *new_emit_prob = (double *)malloc(bw_user_function.N*bw_user_function.M * sizeof(double));
-                transpose_matrix(new_emit_prob, bw_user_function.emit_prob, bw_user_function.N, bw_user_function.M);
-                memcpy(bw_user_function.emit_prob, new_emit_prob, bw_user_function.N*bw_user_function.M * sizeof(double));
-                free(new_emit_prob);
-            }
-
-            const size_t user_function_convergence = FuncRegister::funcs->at(f).func(bw_user_function);
-
-            // Transpose back to do verification
-            if(FuncRegister::funcs->at(f).transpose_emit_prob){
-                double *new_emit_prob = (double *)malloc(bw_user_function.N*bw_user_function.M * sizeof(double));
-                transpose_matrix(new_emit_prob, bw_user_function.emit_prob, bw_user_function.M, bw_user_function.N);
-                memcpy(bw_user_function.emit_prob, new_emit_prob, bw_user_function.N*bw_user_function.M * sizeof(double));
-                free(new_emit_prob);
-            }
+            const size_t user_function_convergence = run_user_function(FuncRegister::funcs->at(f), bw_user_function);
 
             printf("It took \x1b[1m[%zu] iterations\x1b[0m to converge\n", user_function_convergence);
             printf("-------------------------------------------------------------------------------\n");
@@ -173,6 +224,44 @@ inline void check_user_functions(const size_t& nb_random_tests) {
             printf("-------------------------------------------------------------------------------\n");
             //const bool is_bw_baseline_equal_bw_user_function = is_BWdata_equal_only_probabilities(bw_baseline, bw_user_function);
 
+            // Same again without the sigma buffer if the implementation supports it
+            bool is_bw_baseline_equal_bw_user_function_stream = true;
+            if(FuncRegister::funcs->at(f).features & BW_FEATURE_STREAM_SIGMA){
+                printf("Running User Function \x1b[1m'%s'\x1b[0m with stream_sigma\n", FuncRegister::funcs->at(f).name.c_str());
+                printf("-------------------------------------------------------------------------------\n");
+                const BWdata& bw_user_function_stream = bw_baseline_initialized.deep_copy(true);
+                run_user_function(FuncRegister::funcs->at(f), bw_user_function_stream);
+                is_bw_baseline_equal_bw_user_function_stream = is_BWdata_equal(bw_baseline, bw_user_function_stream);
+                printf("-------------------------------------------------------------------------------\n");
+                delete &bw_user_function_stream;
+            }
+
+            // Same again with early stopping: probabilities after (about) the same number of iterations
+            printf("Running User Function \x1b[1m'%s'\x1b[0m with early stopping\n", FuncRegister::funcs->at(f).name.c_str());
+            printf("-------------------------------------------------------------------------------\n");
+            const BWdata& bw_user_function_converge = bw_baseline_initialized.deep_copy();
+            bw_user_function_converge.stopping = stopping;
+            run_user_function(FuncRegister::funcs->at(f), bw_user_function_converge);
+            printf("It stopped after \x1b[1m[%zu] iterations\x1b[0m\n", bw_user_function_converge.iterations);
+            const size_t iterations_difference = (bw_user_function_converge.iterations > bw_baseline_converge.iterations)
+                ? bw_user_function_converge.iterations - bw_baseline_converge.iterations
+                : bw_baseline_converge.iterations - bw_user_function_converge.iterations;
+            const bool is_bw_baseline_equal_bw_user_function_converge = iterations_difference <= 1
+                && bw_user_function_converge.iterations >= stopping.min_iterations
+                && is_BWdata_equal_only_probabilities(bw_baseline_converge, bw_user_function_converge);
+            printf("-------------------------------------------------------------------------------\n");
+            delete &bw_user_function_converge;
+
+            // Same again with a workspace reused from the previous test cases
+            printf("Running User Function \x1b[1m'%s'\x1b[0m with workspace\n", FuncRegister::funcs->at(f).name.c_str());
+            printf("-------------------------------------------------------------------------------\n");
+            const BWdata& bw_user_function_workspace = bw_baseline_initialized.deep_copy();
+            workspaces.at(f).prepare(bw_user_function_workspace);
+            run_user_function(FuncRegister::funcs->at(f), bw_user_function_workspace);
+            const bool is_bw_baseline_equal_bw_user_function_workspace = is_BWdata_equal(bw_baseline, bw_user_function_workspace);
+            printf("-------------------------------------------------------------------------------\n");
+            delete &bw_user_function_workspace;
+
             // Okay, hear me out!
             // If baseline is correct, then that's dope and we wanna have user function also correct, right?
             // Though, if baseline is wrong, then user function being true might be some potential bug-problem!
@@ -185,6 +274,10 @@ inline void check_user_functions(const size_t& nb_random_tests) {
             // U may change (false -> true), but no big h8sies pls uwu
             test_results[f][i] = (
                    ( false || is_bw_baseline_equal_bw_user_function )
+                && ( false || is_bw_baseline_equal_bw_user_function_stream )
+                && ( false || is_bw_baseline_equal_bw_user_function_workspace )
+                && ( false || is_bw_baseline_equal_bw_user_function_converge )
+                && ( false || baseline_stream_success )
                 && ( false || user_function_success )
                 && ( true  || (user_function_convergence == baseline_convergence) )
                 && ( false || (user_function_success == baseline_success) )
@@ -193,6 +286,7 @@ inline void check_user_functions(const size_t& nb_random_tests) {
             delete &bw_user_function;
         }
 
+        delete &bw_baseline_converge;
         delete &bw_baseline;
         delete &bw_baseline_initialized;
     }
@@ -201,6 +295,7 @@ inline void check_user_functions(const size_t& nb_random_tests) {
     printf("Results:\n");
     printf("-------------------------------------------------------------------------------\n");
     for (size_t f = 0; f < nb_user_functions; f++) {
+        if (FuncRegister::funcs->at(f).features & BW_FEATURE_FLOAT32) continue;
 
         size_t nb_fails = 0;
         for (size_t i = 0; i < nb_random_tests; i++) {
@@ -225,6 +320,1073 @@ inline void check_user_functions(const size_t& nb_random_tests) {
     printf("-------------------------------------------------------------------------------\n");
 }
 
+/**
+ * Verifies the implementations that declare the given feature w.r.t. the baseline using
+ * randomized corpora that only these implementations support:
+ * - BW_FEATURE_RAGGED: arbitrary sequence lengths (>= 2), K not necessarily divisible by 4,
+ *   sufficiently high (>= 16) values and divisibility of (16) for N and M (M > 256 in the last case)
+ * - BW_FEATURE_ANY_NM: arbitrary (small) K, N, M and T >= 2
+ * - BW_FEATURE_CHECKPOINT: as BW_FEATURE_RAGGED with long sequences (up to 2000 time steps),
+ *   run on a BWdata with checkpoint (and stream_sigma) set, i.e. alpha, beta and ggamma are not compared
+ * - BW_FEATURE_PARALLEL_T: one or two long sequences (up to 3000 time steps), arbitrary (small) N and M,
+ *   on 2 to nb_random_tests+1 threads, such that the sequences are split into several chunks
+ * - BW_FEATURE_SPARSE: arbitrary (small) N and M, ragged sequences and a left-to-right trans_prob with
+ *   1 to 3 nonzeros per row (sigma is compared as well, i.e. its zeros have to be written)
+ * - BW_FEATURE_BANDED: as BW_FEATURE_RAGGED with a banded trans_prob (1 to 3 diagonals below and
+ *   1 to 3 above the main diagonal; without one below the early states die out and the baseline divides 0/0),
+ *   8 to 23 sequences with at least 16*max(N, M) observations in the first one
+ * - BW_FEATURE_LOG_SPACE: as BW_FEATURE_BANDED with a dense trans_prob and peaked emissions (all but one
+ *   observation of a state down to 1e-150, such that the scaled baseline just does not underflow)
+ * - BW_FEATURE_SPECIALIZED: as BW_FEATURE_BANDED (dense) with N = 16, 32, 48, 64 and 128 in turn,
+ *   i.e. every specialized N and one that takes the generic path
+ * - BW_FEATURE_BATCHED: as BW_FEATURE_RAGGED with more sequences (33 to 96, i.e. several blocks with a
+ *   partial last one) and N a multiple of 4 (16 to 60)
+ * - BW_FEATURE_INTERLEAVED: as BW_FEATURE_BATCHED with K not divisible by 4 (empty lanes in the last
+ *   group) and some sequences of only 2 time steps (lanes of very different lengths in a group)
+ * Single precision implementations (BW_FEATURE_FLOAT32) are checked by check_float_functions instead.
+ */
+inline void check_feature_functions(const size_t& nb_random_tests, const unsigned int feature, const char* label) {
+
+    std::vector<size_t> feature_functions;
+    for (size_t f = 0; f < FuncRegister::size(); f++) {
+        const unsigned int features = FuncRegister::funcs->at(f).features;
+        if ((features & feature) && !(features & BW_FEATURE_FLOAT32)) feature_functions.push_back(f);
+    }
+    const size_t nb_feature_functions = feature_functions.size();
+    std::vector<std::vector<bool>> test_results(nb_feature_functions, std::vector<bool>(nb_random_tests));
+
+    for (size_t i = 0; i < nb_random_tests; i++) {
+
+        // randomize seed (new for each random test case)
+        const size_t baseline_random_seed = time(NULL)*i + 1;
+        srand(baseline_random_seed);
+        size_t baseline_random_number = rand();
+
+        const size_t max_iterations = (feature == BW_FEATURE_CHECKPOINT || feature == BW_FEATURE_PARALLEL_T || feature == BW_FEATURE_SPECIALIZED || feature == BW_FEATURE_BATCHED || feature == BW_FEATURE_INTERLEAVED) ? 50 : 500;
+        const BWdata* bw_new;
+        if (feature == BW_FEATURE_SPARSE) {
+            const size_t K = (rand() % 16) + 1;
+            const size_t N = (rand() % 40) + 2;
+            const size_t M = (rand() % 40) + 2;
+            std::vector<size_t> lengths = random_sequence_lengths(K, 2, 200);
+            // with fewer observations than parameters the baseline itself degenerates (0/0 = nan)
+            lengths.at(0) = std::max(lengths.at(0), 4*std::max(N, M));
+            bw_new = new BWdata(K, N, M, lengths, max_iterations);
+        } else if (feature == BW_FEATURE_PARALLEL_T) {
+            const size_t K = (rand() % 2) + 1;
+            const size_t N = (rand() % 24) + 2;
+            const size_t M = (rand() % 24) + 2;
+            std::vector<size_t> lengths = random_sequence_lengths(K, 2, 3000);
+            lengths.at(0) = 1000 + (rand() % 2000);
+            bw_new = new BWdata(K, N, M, lengths, max_iterations);
+            ThreadPool::set_num_threads(i + 2);
+        } else if (feature == BW_FEATURE_CHECKPOINT) {
+            // long sequences (many segments) and the shortest ones (segments of 2 time steps)
+            const size_t K = (rand() % 7) + 2;
+            const size_t N = (rand() % 2)*16 + 16; // don't touch
+            const size_t M = (rand() % 2)*16 + 16; // don't touch
+            std::vector<size_t> lengths = random_sequence_lengths(K, 2, 2000);
+            lengths.at(0) = 2 + i;
+            // with fewer observations than parameters the baseline itself degenerates (0/0 = nan)
+            lengths.at(1) = std::max(lengths.at(1), (size_t)1000);
+            bw_new = new BWdata(K, N, M, lengths, max_iterations);
+        } else if (feature == BW_FEATURE_BANDED || feature == BW_FEATURE_LOG_SPACE) {
+            // a band lets states die out faster: with few sequences init_prob collapses onto one state
+            // and the baseline divides 0/0 (nan) for the unreachable ones, hence more data if banded
+            const size_t K = (feature == BW_FEATURE_BANDED) ? (rand() % 16) + 8 : (rand() % 16) + 1;
+            const size_t N = (rand() % 2)*16 + 16; // don't touch
+            const size_t M = (rand() % 2)*16 + 16; // don't touch
+            std::vector<size_t> lengths = random_sequence_lengths(K, 2, 200);
+            // with fewer observations than parameters the baseline itself degenerates (0/0 = nan)
+            lengths.at(0) = std::max(lengths.at(0), ((feature == BW_FEATURE_BANDED) ? 16 : 4)*std::max(N, M));
+            bw_new = new BWdata(K, N, M, lengths, max_iterations);
+        } else if (feature == BW_FEATURE_SPECIALIZED) {
+            const size_t specialized_N[5] = {16, 32, 48, 64, 128};
+            const size_t K = (rand() % 4) + 1;
+            const size_t N = specialized_N[i % 5];
+            const size_t M = (rand() % 2)*16 + 16; // don't touch
+            std::vector<size_t> lengths = random_sequence_lengths(K, 2, 200);
+            // with fewer observations than parameters the baseline itself degenerates (0/0 = nan)
+            lengths.at(0) = std::max(lengths.at(0), 4*std::max(N, M));
+            bw_new = new BWdata(K, N, M, lengths, max_iterations);
+        } else if (feature == BW_FEATURE_BATCHED) {
+            const size_t K = (rand() % 64) + 33;
+            const size_t N = ((rand() % 12) + 4)*4;
+            const size_t M = (rand() % 2)*16 + 16; // don't touch
+            std::vector<size_t> lengths = random_sequence_lengths(K, 2, 100);
+            // with fewer observations than parameters the baseline itself degenerates (0/0 = nan)
+            lengths.at(0) = std::max(lengths.at(0), 4*std::max(N, M));
+            bw_new = new BWdata(K, N, M, lengths, max_iterations);
+        } else if (feature == BW_FEATURE_INTERLEAVED) {
+            const size_t K = ((rand() % 12) + 4)*4 + (i % 3) + 1;
+            const size_t N = ((rand() % 12) + 4)*4;
+            const size_t M = (rand() % 2)*16 + 16; // don't touch
+            std::vector<size_t> lengths = random_sequence_lengths(K, 2, 100);
+            for (size_t k = 1; k < K; k += 7) {
+                lengths.at(k) = 2;
+            }
+            // with fewer observations than parameters the baseline itself degenerates (0/0 = nan)
+            lengths.at(0) = std::max(lengths.at(0), 4*std::max(N, M));
+            bw_new = new BWdata(K, N, M, lengths, max_iterations);
+        } else if (feature == BW_FEATURE_RAGGED) {
+            const size_t K = (rand() % 16) + 16;
+            const size_t N = (rand() % 2)*16 + 16; // don't touch
+            // the last case with more than 256 observations (16 bit packed observations)
+            const size_t M = (i + 1 == nb_random_tests) ? 272 : (rand() % 2)*16 + 16; // don't touch
+            bw_new = new BWdata(K, N, M, random_sequence_lengths(K, 2, 64), max_iterations);
+        } else {
+            const size_t K = (rand() % 8) + 1;
+            const size_t N = (rand() % 40) + 2;
+            const size_t M = (rand() % 40) + 2;
+            // with fewer observations than parameters the baseline itself degenerates (0/0 = nan)
+            const size_t T = std::max((size_t)(rand() % 40) + 2, (4*std::max(N, M) + K - 1)/K);
+            bw_new = new BWdata(K, N, M, T, max_iterations);
+        }
+        const BWdata& bw_baseline_initialized = *bw_new;
+        const size_t K = bw_baseline_initialized.K;
+        const size_t N = bw_baseline_initialized.N;
+        const size_t M = bw_baseline_initialized.M;
+        initialize_random(bw_baseline_initialized);
+        if (feature == BW_FEATURE_SPARSE) sparsify_trans_prob(bw_baseline_initialized, (i % 3) + 1);
+        if (feature == BW_FEATURE_BANDED) bandify_trans_prob(bw_baseline_initialized, (rand() % 3) + 1, (rand() % 3) + 1);
+        if (feature == BW_FEATURE_LOG_SPACE) peak_emit_prob(bw_baseline_initialized, 1e-150);
+        const BWdata& bw_baseline = bw_baseline_initialized.deep_copy();
+
+        printf("\x1b[1m\n-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("\x1b[1mTest Case %s [%zu] with Baseline Random Number [%zu]\x1b[0m\n", label, i, baseline_random_number);
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("Initialized: K = %zu, N = %zu, M = %zu, T <= %zu (total %zu) and max_iterations = %zu\n", K, N, M, bw_baseline.T, bw_baseline.total_length(), max_iterations);
+        printf("-------------------------------------------------------------------------------\n");
+        printf("Running \x1b[1m'Baseline'\x1b[0m\n");
+        printf("-------------------------------------------------------------------------------\n");
+        FuncRegister::baseline_func(bw_baseline);
+        const bool baseline_success = check_and_verify(bw_baseline);
+        printf("-------------------------------------------------------------------------------\n");
+
+        for (size_t r = 0; r < nb_feature_functions; r++) {
+            const struct RegisteredFunction& f = FuncRegister::funcs->at(feature_functions.at(r));
+            printf("Running User Function \x1b[1m'%s'\x1b[0m\n", f.name.c_str());
+            printf("-------------------------------------------------------------------------------\n");
+            // without alpha, beta and ggamma buffers if checkpointing
+            const BWdata& bw_user_function = (feature == BW_FEATURE_CHECKPOINT) ? bw_baseline_initialized.deep_copy(true, true) : bw_baseline_initialized.deep_copy();
+            run_user_function(f, bw_user_function);
+            const bool user_function_success = check_and_verify(bw_user_function);
+            printf("-------------------------------------------------------------------------------\n");
+            const bool is_bw_baseline_equal_bw_user_function = is_BWdata_equal(bw_baseline, bw_user_function);
+            printf("-------------------------------------------------------------------------------\n");
+
+            test_results.at(r).at(i) = is_bw_baseline_equal_bw_user_function && user_function_success && baseline_success;
+
+            delete &bw_user_function;
+        }
+
+        delete &bw_baseline;
+        delete &bw_baseline_initialized;
+    }
+    // back to the number of hardware threads (changed for BW_FEATURE_PARALLEL_T)
+    ThreadPool::set_num_threads(0);
+
+    printf("\nAll %s Tests Done!\n\n", label);
+    printf("Results:\n");
+    printf("-------------------------------------------------------------------------------\n");
+    for (size_t r = 0; r < nb_feature_functions; r++) {
+        const struct RegisteredFunction& f = FuncRegister::funcs->at(feature_functions.at(r));
+
+        size_t nb_fails = 0;
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if (!test_results.at(r).at(i)) nb_fails++;
+        }
+
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        if(nb_fails == 0){
+            printf("\x1b[1;32mALL %s CASES PASSED:\x1b[0m '%s': %s\n", label, f.name.c_str(), f.description.c_str());
+        } else {
+            printf("\x1b[1;31m[%zu/%zu] %s CASES FAILED:\x1b[0m '%s': %s \n", nb_fails, nb_random_tests, label, f.name.c_str(), f.description.c_str());
+        }
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if(test_results.at(r).at(i)){
+                printf("\x1b[1;32mPASSED\x1b[0m Test Case %s [%zu]\n", label, i);
+            } else {
+                printf("\x1b[1;31mFAILED:\x1b[0m Test Case %s [%zu]\n", label, i);
+            }
+        }
+    }
+    printf("-------------------------------------------------------------------------------\n");
+}
+
+/**
+ * Runs a registered user function on the given BWdata.
+ * Transposes emit_prob before and after the run if the implementation requires it.
+ *
+ * Returns: the result of the user function (iterations until convergence)
+ */
+size_t run_user_function(const struct RegisteredFunction& f, const BWdata& bw) {
+    // Hacky but it works: Transpose emit_prob
+    if(f.transpose_emit_prob){
+        double *new_emit_prob = (double *)malloc(bw.N*bw.M * sizeof(double));
+        transpose_matrix(new_emit_prob, bw.emit_prob, bw.N, bw.M);
+        memcpy(bw.emit_prob, new_emit_prob, bw.N*bw.M * sizeof(double));
+        free(new_emit_prob);
+    }
+
+    const size_t convergence = f.func(bw);
+
+    // Transpose back to do verification
+    if(f.transpose_emit_prob){
+        double *new_emit_prob = (double *)malloc(bw.N*bw.M * sizeof(double));
+        transpose_matrix(new_emit_prob, bw.emit_prob, bw.M, bw.N);
+        memcpy(bw.emit_prob, new_emit_prob, bw.N*bw.M * sizeof(double));
+        free(new_emit_prob);
+    }
+
+    return convergence;
+}
+
+/**
+ * Verifies the lane assignment of BWinterleavedLayout (interleaved_layout.h) on ragged sequences:
+ * every sequence is in exactly one lane, the lanes are sorted by decreasing length, empty lanes
+ * only occur at the end of the last group, and the observations of a lane are those of its
+ * sequence, padded with the last one (an empty lane repeats lane 0).
+ * interleaved_store_group (AVX2) is checked by the "Interleaved" cases, which compare alpha, beta,
+ * ggamma and c_norm with the baseline.
+ */
+inline void check_interleaved_layout(const size_t& nb_random_tests) {
+
+    std::vector<bool> test_results(nb_random_tests);
+
+    for (size_t i = 0; i < nb_random_tests; i++) {
+
+        // randomize seed (new for each random test case)
+        const size_t baseline_random_seed = time(NULL)*i + 7;
+        srand(baseline_random_seed);
+        size_t baseline_random_number = rand();
+
+        const size_t K = (rand() % 40) + 1;
+        const size_t N = ((rand() % 8) + 1)*4;
+        std::vector<size_t> lengths = random_sequence_lengths(K, 2, 100);
+        for (size_t k = 0; k < K; k += 5) {
+            lengths.at(k) = 2;
+        }
+        const BWdata& bw = *new BWdata(K, N, 16, lengths, 1, true);
+        initialize_random(bw);
+
+        printf("\x1b[1m\n-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("\x1b[1mTest Case Interleaved layout [%zu] with Baseline Random Number [%zu]\x1b[0m\n", i, baseline_random_number);
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("Initialized: K = %zu, N = %zu, T <= %zu (total %zu)\n", K, N, bw.T, bw.total_length());
+        printf("-------------------------------------------------------------------------------\n");
+
+        bool success = true;
+        {
+            const BWinterleavedLayout layout(bw);
+            success &= (layout.nb_groups == (K + BW_LANES - 1) / BW_LANES);
+
+            std::vector<size_t> seen(K, 0);
+            size_t previous_length = bw.T;
+            for (size_t g = 0; g < layout.nb_groups; g++) {
+                success &= (layout.length(g) == layout.lengths[g*BW_LANES]);
+                for (size_t l = 0; l < BW_LANES; l++) {
+                    const size_t k = layout.sequence(g, l);
+                    const size_t lane = g*BW_LANES + l;
+                    if (k == K) {
+                        // empty lanes only at the end
+                        success &= (lane >= K) && (layout.lengths[lane] == 0);
+                        continue;
+                    }
+                    success &= (k < K) && (lane < K) && (layout.lengths[lane] == bw.length(k)) && (bw.length(k) <= previous_length);
+                    if (k < K) seen.at(k)++;
+                    previous_length = bw.length(k);
+                }
+
+                for (size_t t = 0; t < layout.length(g); t++) {
+                    for (size_t l = 0; l < BW_LANES; l++) {
+                        const size_t k = (layout.lengths[g*BW_LANES + l] > 0) ? layout.sequence(g, l) : layout.sequence(g, 0);
+                        const size_t expected = bw.observations[bw.offsets[k] + std::min(t, bw.length(k) - 1)];
+                        success &= (layout.observations[(layout.offsets[g] + t)*BW_LANES + l] == expected);
+                    }
+                }
+            }
+            for (size_t k = 0; k < K; k++) {
+                success &= (seen.at(k) == 1);
+            }
+        }
+        printf("%s\n", success ? "Layout as expected" : "Layout differs");
+        printf("-------------------------------------------------------------------------------\n");
+
+        test_results.at(i) = success;
+        delete &bw;
+    }
+
+    printf("\nAll Interleaved layout Tests Done!\n\n");
+    printf("Results:\n");
+    printf("-------------------------------------------------------------------------------\n");
+
+    size_t nb_fails = 0;
+    for (size_t i = 0; i < nb_random_tests; i++) {
+        if (!test_results.at(i)) nb_fails++;
+    }
+    printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+    if(nb_fails == 0){
+        printf("\x1b[1;32mALL Interleaved layout CASES PASSED:\x1b[0m lanes, lengths and padded observations\n");
+    } else {
+        printf("\x1b[1;31m[%zu/%zu] Interleaved layout CASES FAILED:\x1b[0m lanes, lengths and padded observations\n", nb_fails, nb_random_tests);
+    }
+    printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+    for (size_t i = 0; i < nb_random_tests; i++) {
+        if(test_results.at(i)){
+            printf("\x1b[1;32mPASSED\x1b[0m Test Case Interleaved layout [%zu]\n", i);
+        } else {
+            printf("\x1b[1;31mFAILED:\x1b[0m Test Case Interleaved layout [%zu]\n", i);
+        }
+    }
+    printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+}
+
+/**
+ * Verifies that the implementations are reentrant: every user function is run concurrently
+ * on several BWdata of different shapes (half of them with a workspace) and has to produce
+ * the same results as the serial runs on the same data (within EPSILON, see is_BWdata_equal).
+ */
+inline void check_concurrent_functions(const size_t& nb_random_tests) {
+
+    const size_t nb_user_functions = FuncRegister::size();
+    const size_t nb_instances = 4;
+    std::vector<std::vector<bool>> test_results(nb_user_functions, std::vector<bool>(nb_random_tests));
+
+    for (size_t i = 0; i < nb_random_tests; i++) {
+
+        // randomize seed (new for each random test case)
+        const size_t baseline_random_seed = time(NULL)*i + 2;
+        srand(baseline_random_seed);
+        size_t baseline_random_number = rand();
+
+        printf("\x1b[1m\n-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("\x1b[1mTest Case Concurrent [%zu] with Baseline Random Number [%zu]\x1b[0m\n", i, baseline_random_number);
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+
+        // same assumptions as check_user_functions
+        std::vector<const BWdata*> bw_initialized(nb_instances);
+        for (size_t c = 0; c < nb_instances; c++) {
+            const size_t K = (rand() % 2)*16 + 16; // don't touch
+            const size_t N = (rand() % 2)*16 + 16; // don't touch
+            const size_t M = (rand() % 2)*16 + 16; // don't touch
+            const size_t T = (rand() % 2)*16 + 32; // don't touch
+            const size_t max_iterations = 100;
+            bw_initialized.at(c) = new BWdata(K, N, M, T, max_iterations);
+            initialize_random(*bw_initialized.at(c));
+            printf("Instance [%zu]: K = %zu, N = %zu, M = %zu, T = %zu and max_iterations = %zu\n", c, K, N, M, T, max_iterations);
+        }
+        printf("-------------------------------------------------------------------------------\n");
+
+        for (size_t f = 0; f < nb_user_functions; f++) {
+            const struct RegisteredFunction& func = FuncRegister::funcs->at(f);
+            printf("Running User Function \x1b[1m'%s'\x1b[0m serially and on %zu threads\n", func.name.c_str(), nb_instances);
+            printf("-------------------------------------------------------------------------------\n");
+
+            std::vector<const BWdata*> bw_serial(nb_instances);
+            std::vector<const BWdata*> bw_concurrent(nb_instances);
+            for (size_t c = 0; c < nb_instances; c++) {
+                bw_serial.at(c) = &bw_initialized.at(c)->deep_copy();
+                bw_concurrent.at(c) = &bw_initialized.at(c)->deep_copy();
+                run_user_function(func, *bw_serial.at(c));
+            }
+
+            std::vector<BWworkspace> workspaces(nb_instances);
+            std::vector<std::thread> threads;
+            for (size_t c = 0; c < nb_instances; c++) {
+                if (c % 2 == 1) workspaces.at(c).prepare(*bw_concurrent.at(c));
+                threads.emplace_back([&func, &bw_concurrent, c]{ run_user_function(func, *bw_concurrent.at(c)); });
+            }
+            for (size_t c = 0; c < nb_instances; c++) {
+                threads.at(c).join();
+            }
+
+            bool all_equal = true;
+            for (size_t c = 0; c < nb_instances; c++) {
+                all_equal = is_BWdata_equal(*bw_serial.at(c), *bw_concurrent.at(c)) && all_equal;
+                delete bw_serial.at(c);
+                delete bw_concurrent.at(c);
+            }
+            printf("-------------------------------------------------------------------------------\n");
+
+            test_results.at(f).at(i) = all_equal;
+        }
+
+        for (size_t c = 0; c < nb_instances; c++) {
+            delete bw_initialized.at(c);
+        }
+    }
+
+    printf("\nAll Concurrent Tests Done!\n\n");
+    printf("Results:\n");
+    printf("-------------------------------------------------------------------------------\n");
+    for (size_t f = 0; f < nb_user_functions; f++) {
+
+        size_t nb_fails = 0;
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if (!test_results.at(f).at(i)) nb_fails++;
+        }
+
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        if(nb_fails == 0){
+            printf("\x1b[1;32mALL Concurrent CASES PASSED:\x1b[0m '%s': %s\n", FuncRegister::funcs->at(f).name.c_str(), FuncRegister::funcs->at(f).description.c_str());
+        } else {
+            printf("\x1b[1;31m[%zu/%zu] Concurrent CASES FAILED:\x1b[0m '%s': %s \n", nb_fails, nb_random_tests, FuncRegister::funcs->at(f).name.c_str(), FuncRegister::funcs->at(f).description.c_str());
+        }
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if(test_results.at(f).at(i)){
+                printf("\x1b[1;32mPASSED\x1b[0m Test Case Concurrent [%zu]\n", i);
+            } else {
+                printf("\x1b[1;31mFAILED:\x1b[0m Test Case Concurrent [%zu]\n", i);
+            }
+        }
+    }
+    printf("-------------------------------------------------------------------------------\n");
+}
+
+/**
+ * Verifies the scoring implementations (scoring.h) on ragged sequences with any N and M.
+ * The reference score_scalar is checked against the negative log likelihood of the first
+ * baseline iteration (computed with the same, untrained, model), the registered scoring
+ * functions against score_scalar.
+ */
+inline void check_scoring_functions(const size_t& nb_random_tests) {
+
+    const size_t nb_score_functions = ScoreRegister::size();
+    std::vector<std::vector<bool>> test_results(nb_score_functions, std::vector<bool>(nb_random_tests));
+
+    for (size_t i = 0; i < nb_random_tests; i++) {
+
+        // randomize seed (new for each random test case)
+        const size_t baseline_random_seed = time(NULL)*i + 3;
+        srand(baseline_random_seed);
+        size_t baseline_random_number = rand();
+
+        // one iteration is enough, only the likelihood of the initial model is compared
+        const size_t K = (rand() % 37) + 1;
+        const size_t N = (rand() % 40) + 2;
+        const size_t M = (rand() % 40) + 2;
+        const BWdata& bw_initialized = *new BWdata(K, N, M, random_sequence_lengths(K, 2, 64), 1);
+        initialize_random(bw_initialized);
+        const BWdata& bw_baseline = bw_initialized.deep_copy();
+
+        printf("\x1b[1m\n-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("\x1b[1mTest Case Scoring [%zu] with Baseline Random Number [%zu]\x1b[0m\n", i, baseline_random_number);
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("Initialized: K = %zu, N = %zu, M = %zu, T <= %zu (total %zu)\n", K, N, M, bw_initialized.T, bw_initialized.total_length());
+        printf("-------------------------------------------------------------------------------\n");
+
+        const BWmodel model(bw_initialized);
+        const BWsequences sequences(bw_initialized);
+        std::vector<double> reference(K);
+        score_scalar(model, sequences, reference.data());
+
+        FuncRegister::baseline_func(bw_baseline);
+        double reference_sum = 0.0;
+        for (size_t k = 0; k < K; k++) {
+            reference_sum += reference.at(k);
+        }
+        const double baseline_nll = bw_baseline.neg_log_likelihoods[0];
+        const bool reference_success = fabs(reference_sum + baseline_nll) <= EPSILON*std::max(1.0, fabs(baseline_nll));
+        printf("Reference: sum of log likelihoods = %f, baseline negative log likelihood = %f\n", reference_sum, baseline_nll);
+        printf("-------------------------------------------------------------------------------\n");
+
+        for (size_t f = 0; f < nb_score_functions; f++) {
+            const RegisteredScoreFunction& func = ScoreRegister::funcs->at(f);
+            std::vector<double> log_likelihoods(K);
+            func.func(model, sequences, log_likelihoods.data());
+
+            bool success = reference_success;
+            for (size_t k = 0; k < K; k++) {
+                if (!(fabs(log_likelihoods.at(k) - reference.at(k)) <= EPSILON*std::max(1.0, fabs(reference.at(k))))) {
+                    printf("Sequence %zu: '%s' = %f, reference = %f\n", k, func.name.c_str(), log_likelihoods.at(k), reference.at(k));
+                    success = false;
+                }
+            }
+            test_results.at(f).at(i) = success;
+        }
+
+        delete &bw_baseline;
+        delete &bw_initialized;
+    }
+
+    printf("\nAll Scoring Tests Done!\n\n");
+    printf("Results:\n");
+    printf("-------------------------------------------------------------------------------\n");
+    for (size_t f = 0; f < nb_score_functions; f++) {
+        const RegisteredScoreFunction& func = ScoreRegister::funcs->at(f);
+
+        size_t nb_fails = 0;
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if (!test_results.at(f).at(i)) nb_fails++;
+        }
+
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        if(nb_fails == 0){
+            printf("\x1b[1;32mALL Scoring CASES PASSED:\x1b[0m '%s': %s\n", func.name.c_str(), func.description.c_str());
+        } else {
+            printf("\x1b[1;31m[%zu/%zu] Scoring CASES FAILED:\x1b[0m '%s': %s \n", nb_fails, nb_random_tests, func.name.c_str(), func.description.c_str());
+        }
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if(test_results.at(f).at(i)){
+                printf("\x1b[1;32mPASSED\x1b[0m Test Case Scoring [%zu]\n", i);
+            } else {
+                printf("\x1b[1;31mFAILED:\x1b[0m Test Case Scoring [%zu]\n", i);
+            }
+        }
+    }
+    printf("-------------------------------------------------------------------------------\n");
+}
+
+/**
+ * Verifies the likelihood accumulations (likelihood.h) w.r.t. the sum of log(c_norm) in long double
+ * on ragged sequences of up to 4000 time steps with c_norm between exp(-9) and exp(9), and
+ * BWlikelihood alone on c_norm around 1e-300 and 1e300 (any product of two overflows) and at the
+ * ends of its range: between DBL_MIN and 2*DBL_MIN and between 2^1022 and just below 2^1023.
+ */
+inline void check_likelihood_functions(const size_t& nb_random_tests) {
+
+    const size_t nb_likelihood_functions = LikelihoodRegister::size();
+    std::vector<std::vector<bool>> test_results(nb_likelihood_functions, std::vector<bool>(nb_random_tests));
+    bool extreme_success = true;
+
+    for (size_t i = 0; i < nb_random_tests; i++) {
+
+        // randomize seed (new for each random test case)
+        const size_t baseline_random_seed = time(NULL)*i + 6;
+        srand(baseline_random_seed);
+        size_t baseline_random_number = rand();
+
+        const size_t K = (rand() % 37) + 1;
+        std::vector<size_t> offsets(K + 1, 0);
+        for (size_t k = 0; k < K; k++) {
+            offsets.at(k+1) = offsets.at(k) + (rand() % 4000) + 1;
+        }
+        std::vector<double> c_norm(offsets.at(K));
+        std::vector<double> c_extreme(offsets.at(K));
+        for (size_t l = 0; l < offsets.at(K); l++) {
+            c_norm.at(l) = exp(18.0*rand()/RAND_MAX - 9.0);
+            switch (rand() % 4) {
+                case 0: c_extreme.at(l) = 1e300*rand()/RAND_MAX + 1e299; break;
+                case 1: c_extreme.at(l) = 1e-300*rand()/RAND_MAX + 1e-301; break;
+                case 2: c_extreme.at(l) = DBL_MIN*(1.0 + (double)rand()/RAND_MAX); break;
+                default: c_extreme.at(l) = ldexp(1.0 + 0.999*rand()/RAND_MAX, 1022); break;
+            }
+        }
+
+        printf("\x1b[1m\n-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("\x1b[1mTest Case Likelihood [%zu] with Baseline Random Number [%zu]\x1b[0m\n", i, baseline_random_number);
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("Initialized: K = %zu, total %zu time steps\n", K, offsets.at(K));
+        printf("-------------------------------------------------------------------------------\n");
+
+        std::vector<long double> reference(K);
+        for (size_t k = 0; k < K; k++) {
+            long double log_sum = 0.0;
+            long double extreme_sum = 0.0;
+            for (size_t l = offsets.at(k); l < offsets.at(k+1); l++) {
+                log_sum += logl(c_norm.at(l));
+                extreme_sum += logl(c_extreme.at(l));
+            }
+            reference.at(k) = log_sum;
+
+            BWlikelihood likelihood;
+            for (size_t l = offsets.at(k); l < offsets.at(k+1); l++) {
+                likelihood.multiply(c_extreme.at(l));
+            }
+            if (!(fabsl(likelihood.log() - extreme_sum) <= 1e-12*std::max((long double)1.0, fabsl(extreme_sum)))) {
+                printf("Sequence %zu: BWlikelihood of the extreme c_norm = %f, reference = %f\n", k, likelihood.log(), (double)extreme_sum);
+                extreme_success = false;
+            }
+        }
+
+        for (size_t f = 0; f < nb_likelihood_functions; f++) {
+            const RegisteredLikelihoodFunction& func = LikelihoodRegister::funcs->at(f);
+            std::vector<double> neg_log_likelihoods(K);
+            func.func(c_norm.data(), K, offsets.data(), neg_log_likelihoods.data());
+
+            bool success = true;
+            for (size_t k = 0; k < K; k++) {
+                if (!(fabsl(neg_log_likelihoods.at(k) - reference.at(k)) <= 1e-12*std::max((long double)1.0, fabsl(reference.at(k))))) {
+                    printf("Sequence %zu: '%s' = %f, reference = %f\n", k, func.name.c_str(), neg_log_likelihoods.at(k), (double)reference.at(k));
+                    success = false;
+                }
+            }
+            test_results.at(f).at(i) = success;
+        }
+    }
+
+    printf("\nAll Likelihood Tests Done!\n\n");
+    printf("Results:\n");
+    printf("-------------------------------------------------------------------------------\n");
+    for (size_t f = 0; f < nb_likelihood_functions; f++) {
+        const RegisteredLikelihoodFunction& func = LikelihoodRegister::funcs->at(f);
+
+        size_t nb_fails = 0;
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if (!test_results.at(f).at(i)) nb_fails++;
+        }
+
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        if(nb_fails == 0){
+            printf("\x1b[1;32mALL Likelihood CASES PASSED:\x1b[0m '%s': %s\n", func.name.c_str(), func.description.c_str());
+        } else {
+            printf("\x1b[1;31m[%zu/%zu] Likelihood CASES FAILED:\x1b[0m '%s': %s \n", nb_fails, nb_random_tests, func.name.c_str(), func.description.c_str());
+        }
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if(test_results.at(f).at(i)){
+                printf("\x1b[1;32mPASSED\x1b[0m Test Case Likelihood [%zu]\n", i);
+            } else {
+                printf("\x1b[1;31mFAILED:\x1b[0m Test Case Likelihood [%zu]\n", i);
+            }
+        }
+    }
+    printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+    if(extreme_success){
+        printf("\x1b[1;32mALL Likelihood CASES PASSED:\x1b[0m BWlikelihood with extreme c_norm\n");
+    } else {
+        printf("\x1b[1;31mLikelihood CASES FAILED:\x1b[0m BWlikelihood with extreme c_norm\n");
+    }
+    printf("-------------------------------------------------------------------------------\n");
+}
+
+/**
+ * Verifies the autotuner (autotuner.h) on a temporary tuning cache: uniform and ragged shapes
+ * (the last one with any N and M), with and without sigma buffer. The first run of a shape has
+ * to tune it, the selected implementation has to be eligible and produce the results of the
+ * baseline; after forgetting the decisions in memory, the second run has to take the same
+ * implementation from the tuning cache without tuning again.
+ */
+inline void check_autotuner(const size_t& nb_random_tests) {
+
+    char cache_path[] = "/tmp/bw_tuning_XXXXXX";
+    const int cache_file = mkstemp(cache_path);
+    if (cache_file >= 0) close(cache_file);
+    Autotuner::set_cache_path(cache_path);
+    std::vector<bool> test_results(nb_random_tests);
+
+    for (size_t i = 0; i < nb_random_tests; i++) {
+
+        // randomize seed (new for each random test case)
+        const size_t baseline_random_seed = time(NULL)*i + 7;
+        srand(baseline_random_seed);
+        size_t baseline_random_number = rand();
+
+        const size_t max_iterations = 20;
+        const bool stream_sigma = (i % 4 >= 2);
+        const BWdata* bw_new;
+        if (i + 1 == nb_random_tests) {
+            const size_t K = (rand() % 8) + 1;
+            const size_t N = (rand() % 40) + 2;
+            const size_t M = (rand() % 40) + 2;
+            // with fewer observations than parameters the baseline itself degenerates (0/0 = nan)
+            const size_t T = std::max((size_t)(rand() % 40) + 2, (4*std::max(N, M) + K - 1)/K);
+            bw_new = new BWdata(K, N, M, T, max_iterations, stream_sigma);
+        } else if (i % 2 == 1) {
+            const size_t K = (rand() % 16) + 16;
+            const size_t N = (rand() % 2)*16 + 16; // don't touch
+            const size_t M = (rand() % 2)*16 + 16; // don't touch
+            bw_new = new BWdata(K, N, M, random_sequence_lengths(K, 2, 64), max_iterations, stream_sigma);
+        } else {
+            const size_t N = (rand() % 2)*16 + 16; // don't touch
+            bw_new = new BWdata(16, N, 16, 32, max_iterations, stream_sigma);
+        }
+        const BWdata& bw_baseline_initialized = *bw_new;
+        initialize_random(bw_baseline_initialized);
+        const BWdata& bw_baseline = bw_baseline_initialized.deep_copy(false);
+
+        printf("\x1b[1m\n-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("\x1b[1mTest Case Autotuner [%zu] with Baseline Random Number [%zu]\x1b[0m\n", i, baseline_random_number);
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("Initialized: K = %zu, N = %zu, M = %zu, T <= %zu (total %zu), max_iterations = %zu%s\n", bw_baseline.K, bw_baseline.N, bw_baseline.M, bw_baseline.T, bw_baseline.total_length(), max_iterations, stream_sigma ? " and stream_sigma" : "");
+        printf("-------------------------------------------------------------------------------\n");
+        FuncRegister::baseline_func(bw_baseline);
+        bool success = check_and_verify(bw_baseline);
+
+        // first run: tuned and written to the tuning cache
+        const size_t tunings = Autotuner::tunings();
+        const BWdata& bw_tuned = bw_baseline_initialized.deep_copy();
+        Autotuner::run(bw_tuned);
+        const struct RegisteredFunction* selected = Autotuner::select(bw_tuned);
+        printf("Selected '%s' (tuned %zu shapes)\n", selected ? selected->name.c_str() : "baseline", Autotuner::tunings() - tunings);
+        success &= (Autotuner::tunings() == tunings + 1);
+        success &= (selected == NULL || Autotuner::eligible(*selected, bw_tuned));
+        success &= check_and_verify(bw_tuned) && is_BWdata_equal(bw_baseline, bw_tuned);
+
+        // second run: from the tuning cache
+        Autotuner::clear();
+        const BWdata& bw_cached = bw_baseline_initialized.deep_copy();
+        Autotuner::run(bw_cached);
+        const struct RegisteredFunction* cached = Autotuner::select(bw_cached);
+        printf("From the tuning cache: '%s'\n", cached ? cached->name.c_str() : "baseline");
+        success &= (Autotuner::tunings() == tunings + 1) && (cached == selected);
+        success &= check_and_verify(bw_cached) && is_BWdata_equal(bw_baseline, bw_cached);
+        printf("-------------------------------------------------------------------------------\n");
+
+        test_results.at(i) = success;
+        delete &bw_cached;
+        delete &bw_tuned;
+        delete &bw_baseline;
+        delete &bw_baseline_initialized;
+    }
+    unlink(cache_path);
+    Autotuner::set_cache_path("");
+
+    printf("\nAll Autotuner Tests Done!\n\n");
+    printf("Results:\n");
+    printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+    size_t nb_fails = 0;
+    for (size_t i = 0; i < nb_random_tests; i++) {
+        if (!test_results.at(i)) nb_fails++;
+    }
+    if(nb_fails == 0){
+        printf("\x1b[1;32mALL Autotuner CASES PASSED:\x1b[0m selection, results and tuning cache\n");
+    } else {
+        printf("\x1b[1;31m[%zu/%zu] Autotuner CASES FAILED:\x1b[0m selection, results and tuning cache\n", nb_fails, nb_random_tests);
+    }
+    printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+    for (size_t i = 0; i < nb_random_tests; i++) {
+        if(test_results.at(i)){
+            printf("\x1b[1;32mPASSED\x1b[0m Test Case Autotuner [%zu]\n", i);
+        } else {
+            printf("\x1b[1;31mFAILED:\x1b[0m Test Case Autotuner [%zu]\n", i);
+        }
+    }
+    printf("-------------------------------------------------------------------------------\n");
+}
+
+/**
+ * Verifies the Viterbi implementations (decoding.h) on ragged sequences with any N and M.
+ * The reference viterbi_scalar is checked for consistency: the log probability of its path is
+ * the returned one and not above the log likelihood of the sequence (score_scalar).
+ * The registered Viterbi functions have to return the same log probabilities and paths with
+ * these log probabilities (paths may only differ where several paths are equally likely).
+ */
+inline void check_viterbi_functions(const size_t& nb_random_tests) {
+
+    const size_t nb_viterbi_functions = ViterbiRegister::size();
+    std::vector<std::vector<bool>> test_results(nb_viterbi_functions, std::vector<bool>(nb_random_tests));
+
+    for (size_t i = 0; i < nb_random_tests; i++) {
+
+        // randomize seed (new for each random test case)
+        const size_t baseline_random_seed = time(NULL)*i + 4;
+        srand(baseline_random_seed);
+        size_t baseline_random_number = rand();
+
+        const size_t K = (rand() % 37) + 1;
+        const size_t N = (rand() % 40) + 2;
+        const size_t M = (rand() % 40) + 2;
+        const BWdata& bw = *new BWdata(K, N, M, random_sequence_lengths(K, 2, 64), 1, true);
+        initialize_random(bw);
+        const size_t total_length = bw.total_length();
+
+        printf("\x1b[1m\n-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("\x1b[1mTest Case Viterbi [%zu] with Baseline Random Number [%zu]\x1b[0m\n", i, baseline_random_number);
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("Initialized: K = %zu, N = %zu, M = %zu, T <= %zu (total %zu)\n", K, N, M, bw.T, total_length);
+        printf("-------------------------------------------------------------------------------\n");
+
+        const BWmodel model(bw);
+        const BWsequences sequences(bw);
+        std::vector<size_t> reference_paths(total_length);
+        std::vector<double> reference(K);
+        std::vector<double> log_likelihoods(K);
+        viterbi_scalar(model, sequences, reference_paths.data(), reference.data());
+        score_scalar(model, sequences, log_likelihoods.data());
+
+        bool reference_success = true;
+        for (size_t k = 0; k < K; k++) {
+            const double path_log_prob = path_log_probability(model, sequences, k, reference_paths.data() + sequences.offsets[k]);
+            if (!(fabs(path_log_prob - reference.at(k)) <= EPSILON*std::max(1.0, fabs(reference.at(k)))
+                  && reference.at(k) <= log_likelihoods.at(k) + EPSILON*std::max(1.0, fabs(log_likelihoods.at(k))))) {
+                printf("Sequence %zu: reference = %f, log probability of its path = %f, log likelihood = %f\n", k, reference.at(k), path_log_prob, log_likelihoods.at(k));
+                reference_success = false;
+            }
+        }
+
+        for (size_t f = 0; f < nb_viterbi_functions; f++) {
+            const RegisteredViterbiFunction& func = ViterbiRegister::funcs->at(f);
+            std::vector<size_t> paths(total_length, N);
+            std::vector<double> log_probabilities(K);
+            func.func(model, sequences, paths.data(), log_probabilities.data());
+
+            bool success = reference_success;
+            size_t nb_different_paths = 0;
+            for (size_t k = 0; k < K; k++) {
+                const size_t* path = paths.data() + sequences.offsets[k];
+                bool valid = true;
+                for (size_t t = 0; t < sequences.length(k); t++) {
+                    valid = valid && path[t] < N;
+                    if (path[t] != reference_paths.at(sequences.offsets[k] + t)) {
+                        nb_different_paths++;
+                        break;
+                    }
+                }
+                const double tolerance = EPSILON*std::max(1.0, fabs(reference.at(k)));
+                if (!valid || !(fabs(log_probabilities.at(k) - reference.at(k)) <= tolerance)
+                    || !(fabs(path_log_probability(model, sequences, k, path) - reference.at(k)) <= tolerance)) {
+                    printf("Sequence %zu: '%s' = %f, reference = %f\n", k, func.name.c_str(), log_probabilities.at(k), reference.at(k));
+                    success = false;
+                }
+            }
+            if (nb_different_paths > 0) {
+                printf("'%s': %zu of %zu paths differ from the reference (equally likely)\n", func.name.c_str(), nb_different_paths, K);
+            }
+            test_results.at(f).at(i) = success;
+        }
+
+        delete &bw;
+    }
+
+    printf("\nAll Viterbi Tests Done!\n\n");
+    printf("Results:\n");
+    printf("-------------------------------------------------------------------------------\n");
+    for (size_t f = 0; f < nb_viterbi_functions; f++) {
+        const RegisteredViterbiFunction& func = ViterbiRegister::funcs->at(f);
+
+        size_t nb_fails = 0;
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if (!test_results.at(f).at(i)) nb_fails++;
+        }
+
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        if(nb_fails == 0){
+            printf("\x1b[1;32mALL Viterbi CASES PASSED:\x1b[0m '%s': %s\n", func.name.c_str(), func.description.c_str());
+        } else {
+            printf("\x1b[1;31m[%zu/%zu] Viterbi CASES FAILED:\x1b[0m '%s': %s \n", nb_fails, nb_random_tests, func.name.c_str(), func.description.c_str());
+        }
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if(test_results.at(f).at(i)){
+                printf("\x1b[1;32mPASSED\x1b[0m Test Case Viterbi [%zu]\n", i);
+            } else {
+                printf("\x1b[1;31mFAILED:\x1b[0m Test Case Viterbi [%zu]\n", i);
+            }
+        }
+    }
+    printf("-------------------------------------------------------------------------------\n");
+}
+
+/**
+ * Verifies the posterior decoding implementations (decoding.h) on ragged sequences with any N and M.
+ * The reference posterior_scalar is checked against ggamma of the first baseline iteration (computed
+ * with the same, untrained, model), the registered functions against posterior_scalar: gamma and,
+ * in a second run without gamma, the states (which may only differ where two states are equally likely).
+ */
+inline void check_posterior_functions(const size_t& nb_random_tests) {
+
+    const size_t nb_posterior_functions = PosteriorRegister::size();
+    std::vector<std::vector<bool>> test_results(nb_posterior_functions, std::vector<bool>(nb_random_tests));
+
+    for (size_t i = 0; i < nb_random_tests; i++) {
+
+        // randomize seed (new for each random test case)
+        const size_t baseline_random_seed = time(NULL)*i + 5;
+        srand(baseline_random_seed);
+        size_t baseline_random_number = rand();
+
+        // one iteration is enough, only ggamma of the initial model is compared
+        const size_t K = (rand() % 37) + 1;
+        const size_t N = (rand() % 40) + 2;
+        const size_t M = (rand() % 40) + 2;
+        const BWdata& bw_initialized = *new BWdata(K, N, M, random_sequence_lengths(K, 2, 64), 1);
+        initialize_random(bw_initialized);
+        const BWdata& bw_baseline = bw_initialized.deep_copy();
+        const size_t total_length = bw_initialized.total_length();
+
+        printf("\x1b[1m\n-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("\x1b[1mTest Case Posterior [%zu] with Baseline Random Number [%zu]\x1b[0m\n", i, baseline_random_number);
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("Initialized: K = %zu, N = %zu, M = %zu, T <= %zu (total %zu)\n", K, N, M, bw_initialized.T, total_length);
+        printf("-------------------------------------------------------------------------------\n");
+
+        const BWmodel model(bw_initialized);
+        const BWsequences sequences(bw_initialized);
+        std::vector<double> reference(total_length*N);
+        std::vector<size_t> reference_states(total_length);
+        posterior_scalar(model, sequences, reference.data(), reference_states.data());
+
+        FuncRegister::baseline_func(bw_baseline);
+        bool reference_success = true;
+        for (size_t j = 0; j < total_length; j++) {
+            double g_sum = 0.0;
+            for (size_t n = 0; n < N; n++) {
+                g_sum += reference.at(j*N + n);
+                reference_success = reference_success && fabs(reference.at(j*N + n) - bw_baseline.ggamma[j*N + n]) <= EPSILON;
+            }
+            reference_success = reference_success && fabs(g_sum - 1.0) <= EPSILON;
+        }
+        printf("Reference: %s\n", reference_success ? "gamma equal to the baseline" : "gamma differs from the baseline");
+        printf("-------------------------------------------------------------------------------\n");
+
+        for (size_t f = 0; f < nb_posterior_functions; f++) {
+            const RegisteredPosteriorFunction& func = PosteriorRegister::funcs->at(f);
+            std::vector<double> gamma(total_length*N);
+            std::vector<size_t> states(total_length, N);
+            func.func(model, sequences, gamma.data(), NULL);
+            func.func(model, sequences, NULL, states.data());
+
+            bool success = reference_success;
+            size_t nb_different_states = 0;
+            for (size_t j = 0; j < total_length; j++) {
+                for (size_t n = 0; n < N; n++) {
+                    success = success && fabs(gamma.at(j*N + n) - reference.at(j*N + n)) <= EPSILON;
+                }
+                const size_t state = states.at(j);
+                const size_t reference_state = reference_states.at(j);
+                if (state != reference_state) {
+                    nb_different_states++;
+                    success = success && state < N && fabs(reference.at(j*N + state) - reference.at(j*N + reference_state)) <= EPSILON;
+                }
+            }
+            if (nb_different_states > 0) {
+                printf("'%s': %zu of %zu states differ from the reference (equally likely)\n", func.name.c_str(), nb_different_states, total_length);
+            }
+            if (!success) {
+                printf("'%s': gamma or states differ from the reference\n", func.name.c_str());
+            }
+            test_results.at(f).at(i) = success;
+        }
+
+        delete &bw_baseline;
+        delete &bw_initialized;
+    }
+
+    printf("\nAll Posterior Tests Done!\n\n");
+    printf("Results:\n");
+    printf("-------------------------------------------------------------------------------\n");
+    for (size_t f = 0; f < nb_posterior_functions; f++) {
+        const RegisteredPosteriorFunction& func = PosteriorRegister::funcs->at(f);
+
+        size_t nb_fails = 0;
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if (!test_results.at(f).at(i)) nb_fails++;
+        }
+
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        if(nb_fails == 0){
+            printf("\x1b[1;32mALL Posterior CASES PASSED:\x1b[0m '%s': %s\n", func.name.c_str(), func.description.c_str());
+        } else {
+            printf("\x1b[1;31m[%zu/%zu] Posterior CASES FAILED:\x1b[0m '%s': %s \n", nb_fails, nb_random_tests, func.name.c_str(), func.description.c_str());
+        }
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if(test_results.at(f).at(i)){
+                printf("\x1b[1;32mPASSED\x1b[0m Test Case Posterior [%zu]\n", i);
+            } else {
+                printf("\x1b[1;31mFAILED:\x1b[0m Test Case Posterior [%zu]\n", i);
+            }
+        }
+    }
+    printf("-------------------------------------------------------------------------------\n");
+}
+
+/**
+ * Verifies the single precision implementations (BW_FEATURE_FLOAT32) w.r.t. the baseline.
+ * They cannot match up to EPSILON, hence reports their divergence after the training:
+ * the relative difference of the final negative log likelihood and the maximal absolute
+ * difference of the trained probabilities, both have to stay within FLOAT_*_TOLERANCE.
+ * Few iterations only, over many iterations the rounding errors may lead to another local optimum.
+ */
+#define FLOAT_NLL_TOLERANCE 1e-6
+#define FLOAT_PROB_TOLERANCE 1e-4
+inline void check_float_functions(const size_t& nb_random_tests) {
+
+    std::vector<size_t> float_functions;
+    for (size_t f = 0; f < FuncRegister::size(); f++) {
+        if (FuncRegister::funcs->at(f).features & BW_FEATURE_FLOAT32) float_functions.push_back(f);
+    }
+    const size_t nb_float_functions = float_functions.size();
+    std::vector<std::vector<bool>> test_results(nb_float_functions, std::vector<bool>(nb_random_tests));
+
+    for (size_t i = 0; i < nb_random_tests; i++) {
+
+        // randomize seed (new for each random test case)
+        const size_t baseline_random_seed = time(NULL)*i + 6;
+        srand(baseline_random_seed);
+        size_t baseline_random_number = rand();
+
+        // same assumptions as check_user_functions, every other case with ragged sequences
+        const size_t K = (rand() % 2)*16 + 16; // don't touch
+        const size_t N = (rand() % 2)*16 + 16; // don't touch
+        const size_t M = (rand() % 2)*16 + 16; // don't touch
+        const size_t T = (rand() % 2)*16 + 32; // don't touch
+        const size_t max_iterations = 20;
+        const BWdata& bw_initialized = (i % 2 == 0)
+            ? *new BWdata(K, N, M, T, max_iterations)
+            : *new BWdata(K, N, M, random_sequence_lengths(K, 2, T), max_iterations);
+        initialize_random(bw_initialized);
+        const BWdata& bw_baseline = bw_initialized.deep_copy();
+
+        printf("\x1b[1m\n-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("\x1b[1mTest Case Float [%zu] with Baseline Random Number [%zu]\x1b[0m\n", i, baseline_random_number);
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        printf("Initialized: K = %zu, N = %zu, M = %zu, T <= %zu (total %zu) and max_iterations = %zu\n", K, N, M, T, bw_initialized.total_length(), max_iterations);
+        printf("-------------------------------------------------------------------------------\n");
+        FuncRegister::baseline_func(bw_baseline);
+        const double baseline_nll = bw_baseline.neg_log_likelihoods[max_iterations-1];
+
+        for (size_t r = 0; r < nb_float_functions; r++) {
+            const struct RegisteredFunction& f = FuncRegister::funcs->at(float_functions.at(r));
+            const BWdata& bw_user_function = bw_initialized.deep_copy();
+            run_user_function(f, bw_user_function);
+
+            const double nll_difference = fabs(bw_user_function.neg_log_likelihoods[max_iterations-1] - baseline_nll) / fabs(baseline_nll);
+            double prob_difference = 0.0;
+            for (size_t n0 = 0; n0 < N; n0++) {
+                prob_difference = std::max(prob_difference, fabs(bw_user_function.init_prob[n0] - bw_baseline.init_prob[n0]));
+                for (size_t n1 = 0; n1 < N; n1++) {
+                    prob_difference = std::max(prob_difference, fabs(bw_user_function.trans_prob[n0*N + n1] - bw_baseline.trans_prob[n0*N + n1]));
+                }
+                for (size_t m = 0; m < M; m++) {
+                    prob_difference = std::max(prob_difference, fabs(bw_user_function.emit_prob[n0*M + m] - bw_baseline.emit_prob[n0*M + m]));
+                }
+            }
+            printf("'%s': relative difference of the negative log likelihood %.3e, of the probabilities at most %.3e\n", f.name.c_str(), nll_difference, prob_difference);
+
+            test_results.at(r).at(i) = nll_difference <= FLOAT_NLL_TOLERANCE && prob_difference <= FLOAT_PROB_TOLERANCE;
+
+            delete &bw_user_function;
+        }
+
+        delete &bw_baseline;
+        delete &bw_initialized;
+    }
+
+    printf("\nAll Float Tests Done!\n\n");
+    printf("Results:\n");
+    printf("-------------------------------------------------------------------------------\n");
+    for (size_t r = 0; r < nb_float_functions; r++) {
+        const struct RegisteredFunction& f = FuncRegister::funcs->at(float_functions.at(r));
+
+        size_t nb_fails = 0;
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if (!test_results.at(r).at(i)) nb_fails++;
+        }
+
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        if(nb_fails == 0){
+            printf("\x1b[1;32mALL Float CASES PASSED:\x1b[0m '%s': %s\n", f.name.c_str(), f.description.c_str());
+        } else {
+            printf("\x1b[1;31m[%zu/%zu] Float CASES FAILED:\x1b[0m '%s': %s \n", nb_fails, nb_random_tests, f.name.c_str(), f.description.c_str());
+        }
+        printf("\x1b[1m-------------------------------------------------------------------------------\x1b[0m\n");
+        for (size_t i = 0; i < nb_random_tests; i++) {
+            if(test_results.at(r).at(i)){
+                printf("\x1b[1;32mPASSED\x1b[0m Test Case Float [%zu]\n", i);
+            } else {
+                printf("\x1b[1;31mFAILED:\x1b[0m Test Case Float [%zu]\n", i);
+            }
+        }
+    }
+    printf("-------------------------------------------------------------------------------\n");
+}
+
 /**
  * The following test cases check against examples created in ghmm
  * For reproducibility purposes, the code can be found in misc/ghmm_experiments.ipynb
@@ -0,0 +1,68 @@
+#include <cstring>
+#include <cassert>
+
+#include "workspace.h"
+
+// round up to whole cache lines (aligned_alloc requires a multiple of the alignment)
+static inline size_t round_up(const size_t bytes){
+    return ((bytes + 63) / 64) * 64;
+}
+
+void BWworkspace::prepare(const BWdata& bw){
+    if(bw.K != K || bw.N != N || bw.M != M || bw.T != T || bw.total_length() != L){
+        release();
+        K = bw.K;
+        N = bw.N;
+        M = bw.M;
+        T = bw.T;
+        L = bw.total_length();
+    }
+    bw.workspace = this;
+}
+
+void BWworkspace::release(){
+    for(size_t i = 0; i < buffers.size(); i++){
+        free(buffers.at(i).data);
+    }
+    buffers.clear();
+}
+
+void* BWworkspace::acquire(const char* key, const size_t bytes){
+    for(size_t i = 0; i < buffers.size(); i++){
+        Buffer& buffer = buffers.at(i);
+        if(strcmp(buffer.key, key) != 0) continue;
+        if(buffer.bytes < bytes){
+            free(buffer.data);
+            buffer.bytes = round_up(bytes);
+            buffer.data = aligned_alloc(64, buffer.bytes);
+            assert(buffer.data != NULL && "Failed to allocate workspace buffer");
+            memset(buffer.data, 0, buffer.bytes);
+        }
+        return buffer.data;
+    }
+
+    Buffer buffer = {key, aligned_alloc(64, round_up(bytes)), round_up(bytes)};
+    assert(buffer.data != NULL && "Failed to allocate workspace buffer");
+    memset(buffer.data, 0, buffer.bytes);
+    buffers.push_back(buffer);
+    return buffer.data;
+}
+
+size_t BWworkspace::size() const{
+    size_t bytes = 0;
+    for(size_t i = 0; i < buffers.size(); i++){
+        bytes += buffers.at(i).bytes;
+    }
+    return bytes;
+}
+
+void* bw_scratch_alloc(const BWdata& bw, const char* key, const size_t bytes){
+    if(bw.workspace) return bw.workspace->acquire(key, bytes);
+    void* data = aligned_alloc(64, round_up(bytes));
+    assert(data != NULL && "Failed to allocate memory");
+    return data;
+}
+
+void bw_scratch_free(const BWdata& bw, void* data){
+    if(!bw.workspace) free(data);
+}
@@ -0,0 +1,97 @@
+/*
+    Workspace
+    Scratch memory of the implementations that is kept between runs, such that training
+    many (small) models of the same shape does not pay for allocations and page faults
+    on every call.
+
+    -----------------------------------------------------------------------------------
+
+    Spring 2020
+    Advanced Systems Lab (How to Write Fast Numerical Code)
+    Semester Project: Baum-Welch algorithm
+
+    Authors
+    Josua Cantieni, Franz Knobel, Cheuk Yu Chan, Ramon Witschi
+    ETH Computer Science MSc, Computer Science Department ETH Zurich
+
+    -----------------------------------------------------------------------------------
+*/
+
+#if !defined(__BW_WORKSPACE_H)
+#define __BW_WORKSPACE_H
+
+#include <cstdlib>
+#include <vector>
+
+#include "common.h"
+
+/**
+ * Plan for one shape: prepare it for a BWdata, run any registered implementation on
+ * that BWdata as often as needed and release the memory when done.
+ *
+ *     BWworkspace workspace;
+ *     workspace.prepare(bw);
+ *     for (...) func(bw); // scratch buffers are allocated on the first run only
+ *     workspace.release();
+ *
+ * A workspace serves one run at a time; concurrent runs need one workspace each.
+ */
+class BWworkspace
+{
+public:
+
+    BWworkspace() = default;
+    BWworkspace(const BWworkspace&) = delete;
+    BWworkspace& operator=(const BWworkspace&) = delete;
+
+    ~BWworkspace(){
+        release();
+    }
+
+    /**
+     * Attaches the workspace to bw. The buffers are dropped if the shape changed.
+     */
+    void prepare(const BWdata& bw);
+
+    /**
+     * Frees all buffers (they are allocated again by the next run)
+     */
+    void release();
+
+    /**
+     * Returns the (64 byte aligned) buffer with the given key of at least the given size,
+     * allocating or growing it if necessary. New memory is touched, such that the
+     * page faults happen here and not in the first run.
+     */
+    void* acquire(const char* key, const size_t bytes);
+
+    /**
+     * Total size of all buffers in bytes
+     */
+    size_t size() const;
+
+private:
+
+    struct Buffer {
+        const char* key;
+        void* data;
+        size_t bytes;
+    };
+
+    std::vector<Buffer> buffers;
+    size_t K = 0, N = 0, M = 0, T = 0, L = 0;
+};
+
+/**
+ * Scratch buffer for an implementation: taken from the workspace attached to bw
+ * (key has to be unique among the buffers of all implementations, e.g. "combined/numerator_sum"),
+ * or allocated for this run only if there is none. Has to be passed to bw_scratch_free.
+ */
+void* bw_scratch_alloc(const BWdata& bw, const char* key, const size_t bytes);
+
+/**
+ * Frees a buffer of bw_scratch_alloc, unless it belongs to the attached workspace
+ */
+void bw_scratch_free(const BWdata& bw, void* data);
+
+#endif /* __BW_WORKSPACE_H */